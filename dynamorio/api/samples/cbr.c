@@ -1,4 +1,5 @@
 /* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
  * Copyright (c) 2008 VMware, Inc.  All rights reserved.
  * **********************************************************/
 
@@ -33,28 +34,30 @@
 /* Code Manipulation API Sample:
  * cbr.c
  *
- * This sample shows how to update or replace instrumented code after
- * it executes.  We focus on cbr instructions, inserting
- * instrumentation to record the fallthrough and taken addresses when
- * they first execute.  After a particular branch first executes, we
- * re-instrument the basic block to remove the instrumentation for the
- * direction taken.  If and when we see the other direction, we remove
- * all instrumentation for that branch.  We design this sample to
- * avoid the instrumentation overhead for a particular direction until
- * it is taken.  Furthermore, we remove all overhead for that
- * direction after it triggers.
+ * This sample shows how to remove instrumented code after it
+ * executes.  We focus on cbr instructions, inserting instrumentation
+ * to record the fallthrough and taken addresses when they first
+ * execute.  Each direction's instrumentation is a one-shot call that
+ * disables itself in the code cache after it first triggers, so we
+ * remove all overhead for that direction without flushing or
+ * rebuilding the block.
  *
  * This sample might form part of a dynamic CFG builder, where we want
  * to record each control-flow edge, but we don't want to pay the
  * execution overhead of the instrumentation after we've noted the
  * edge.
  *
- * We use the following replacement scheme:
- * 1) In the BB event, insert instrumentation for both the taken and
- *    fallthrough edges.
- * 2) When the BB executes, note the direction taken and flush the
- *    fragment from the code cache.
- * 3) When the BB event triggers again, insert new instrumentation.
+ * We use the following scheme:
+ * 1) In the BB event, insert a one-shot call via dr_insert_oneshot_call()
+ *    for each of the taken and fallthrough edges not yet seen.
+ * 2) When an edge first executes, its call notes the direction taken
+ *    and DR patches the call out of the code cache.
+ * 3) If the BB event triggers again (e.g., for a trace or after some
+ *    unrelated flush), we only insert calls for edges not yet seen.
+ *
+ * An older version of this sample flushed the block with
+ * dr_flush_region() and redirected execution from each call, paying
+ * for a flush and a rebuild per edge.
  */
 
 #include "dr_api.h"
@@ -228,54 +231,26 @@ void insert(hash_table_t table, app_pc addr, cbr_state_t state)
  * End hash table implementation 
  */
 
-/* Clean call for the 'taken' case */
-static void at_taken(app_pc src, app_pc targ)
+/* One-shot call for the 'taken' case */
+static void at_taken(void *user_data)
 {
-    dr_mcontext_t mcontext = {sizeof(mcontext),DR_MC_ALL,};
-    void *drcontext = dr_get_current_drcontext();
-
     /* 
-     * Record the fact that we've seen the taken case.
+     * Record the fact that we've seen the taken case.  DR has already
+     * patched this call out of the code cache, so there is nothing
+     * more to do.
      */
-    elem_t *elem = lookup(table, src);
-    ASSERT(elem != NULL);
+    elem_t *elem = (elem_t *)user_data;
     elem->state |= CBR_TAKEN;
-
-    /* Remove the bb from the cache so it will be re-built the next
-     * time it executes.
-     */
-    /* Since the flush will remove the fragment we're already in,
-     * redirect execution to the target address.
-     */
-    dr_flush_region(src, 1);
-    dr_get_mcontext(drcontext, &mcontext);
-    mcontext.pc = targ;
-    dr_redirect_execution(&mcontext);
 }
 
-/* Clean call for the 'not taken' case */
-static void at_not_taken(app_pc src, app_pc fall)
+/* One-shot call for the 'not taken' case */
+static void at_not_taken(void *user_data)
 {
-    dr_mcontext_t mcontext = {sizeof(mcontext),DR_MC_ALL,};
-    void *drcontext = dr_get_current_drcontext();
-
     /* 
      * Record the fact that we've seen the not_taken case.
      */
-    elem_t *elem = lookup(table, src);
-    ASSERT(elem != NULL);
+    elem_t *elem = (elem_t *)user_data;
     elem->state |= CBR_NOT_TAKEN;
-
-    /* Remove the bb from the cache so it will be re-built the next
-     * time it executes.
-     */
-    /* Since the flush will remove the fragment we're already in,
-     * redirect execution to the fallthrough address.
-     */
-    dr_flush_region(src, 1);
-    dr_get_mcontext(drcontext, &mcontext);
-    mcontext.pc = fall;
-    dr_redirect_execution(&mcontext);
 }
 
 
@@ -308,6 +283,7 @@ bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool trans
             if (elem == NULL) {
                 state = CBR_NEITHER;
                 insert(table, src, CBR_NEITHER);
+                elem = lookup(table, src);
             }
             else {
                 state = elem->state;
@@ -340,25 +316,18 @@ bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool trans
                     /* Callout for the not-taken case.  Insert after
                      * the cbr (i.e., 3rd argument is NULL). 
                      */
-                    dr_insert_clean_call(drcontext, bb, NULL, 
-                                         (void*)at_not_taken,
-                                         false /* don't save fp state */, 
-                                         2 /* 2 args for at_not_taken */,
-                                         OPND_CREATE_INTPTR(src),
-                                         OPND_CREATE_INTPTR(fall));
+                    if (!dr_insert_oneshot_call(drcontext, bb, NULL,
+                                                (void*)at_not_taken,
+                                                false /* don't save fp state */,
+                                                elem))
+                        ASSERT(false);
                 }
                 
                 /* After the callout, jump to the original fallthrough
                  * address.  Note that this is an exit cti, and should
                  * not be a meta-instruction.  Therefore, we use
                  * preinsert instead of meta_preinsert, and we must
-                 * set the translation field.  On Windows, this jump
-                 * and the final jump below never execute since the
-                 * at_taken and at_not_taken callouts redirect
-                 * execution and never return.  However, since the API
-                 * expects clients to produced well-formed code, we
-                 * insert explicit exits from the block for Windows as
-                 * well as Linux.
+                 * set the translation field.
                  */
                 instrlist_preinsert(bb, NULL,
                                     INSTR_XL8(INSTR_CREATE_jmp
@@ -369,12 +338,11 @@ bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool trans
                 
                 if (insert_taken) {
                     /* Callout for the taken case */
-                    dr_insert_clean_call(drcontext, bb, NULL,
-                                         (void*)at_taken,
-                                         false /* don't save fp state */,
-                                         2 /* 2 args for at_taken */,
-                                         OPND_CREATE_INTPTR(src),
-                                         OPND_CREATE_INTPTR(targ));
+                    if (!dr_insert_oneshot_call(drcontext, bb, NULL,
+                                                (void*)at_taken,
+                                                false /* don't save fp state */,
+                                                elem))
+                        ASSERT(false);
                 }
                 
                 /* After the callout, jump to the original target
@@ -386,8 +354,8 @@ bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool trans
             }
         }
     }
-    /* since our added instrumentation is not constant, we ask to store
-     * translations now
+    /* since our added instrumentation depends on which edges have
+     * fired, we ask to store translations now
      */
     return DR_EMIT_STORE_TRANSLATIONS;
 }
@@ -0,0 +1,311 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Code Manipulation API Sample:
+ * loopregion.c
+ *
+ * Uses the trace region API to build each hot loop, together with the
+ * small functions it calls directly, into a single trace.
+ *
+ * Loops are found from backward direct branches: a block ending in a
+ * branch to an earlier address T at most LOOP_SIZE_LIMIT bytes before
+ * the branch is taken as the back edge of a loop occupying [T, end of
+ * the block).  The loop's region is every block seen so far that starts
+ * in that range plus, for each direct call from those blocks, the blocks
+ * of the callee: the blocks starting from the call target up to and
+ * including the first one ending in a return, at most CALLEE_SIZE_LIMIT
+ * bytes on.  Since loop bodies and callees are discovered one block at a
+ * time, a loop's region is registered again whenever it gains a block.
+ * Only one level of calls is followed.
+ */
+
+#include "dr_api.h"
+#include <string.h> /* memmove */
+
+#ifdef WINDOWS
+# define DISPLAY_STRING(msg) dr_messagebox(msg)
+#else
+# define DISPLAY_STRING(msg) dr_printf("%s\n", msg);
+#endif
+
+/* bytes from a loop head to the end of its back-edge block */
+#define LOOP_SIZE_LIMIT 1024
+/* bytes from a callee's entry to the start of its return block */
+#define CALLEE_SIZE_LIMIT 512
+/* a region holds at most this many blocks */
+#define MAX_REGION_TAGS 256
+#define MAX_LOOPS 1024
+
+/* a block we have seen, kept sorted by start */
+typedef struct _block_t {
+    app_pc start;
+    app_pc end;
+    app_pc call_target; /* target of a final direct call, else NULL */
+    bool has_ret;
+} block_t;
+
+typedef struct _loop_t {
+    app_pc head;
+    app_pc end;
+    uint num_tags; /* size of the region last registered */
+} loop_t;
+
+static void *table_mutex; /* protects everything below */
+static block_t *blocks;
+static uint num_blocks;
+static uint max_blocks;
+static loop_t loops[MAX_LOOPS];
+static uint num_loops;
+static uint num_registrations;
+
+static void event_exit(void);
+static dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
+                                         bool for_trace, bool translating);
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    table_mutex = dr_mutex_create();
+    dr_register_exit_event(event_exit);
+    dr_register_bb_event(event_basic_block);
+
+    /* make it easy to tell, by looking at log file, which client executed */
+    dr_log(NULL, LOG_ALL, 1, "Client 'loopregion' initializing\n");
+#ifdef SHOW_RESULTS
+    /* also give notification to stderr */
+    if (dr_is_notify_on()) {
+# ifdef WINDOWS
+        /* ask for best-effort printing to cmd window.  must be called in dr_init(). */
+        dr_enable_console_printing();
+# endif
+        dr_fprintf(STDERR, "Client loopregion is running\n");
+    }
+#endif
+}
+
+static void
+event_exit(void)
+{
+#ifdef SHOW_RESULTS
+    char msg[512];
+    int len = dr_snprintf(msg, sizeof(msg)/sizeof(msg[0]),
+                          "Loop region results:\n"
+                          "  Loops found: %d\n"
+                          "  Region registrations: %d\n",
+                          num_loops, num_registrations);
+    DR_ASSERT(len > 0);
+    msg[sizeof(msg)/sizeof(msg[0])-1] = '\0';
+    DISPLAY_STRING(msg);
+#endif
+    if (blocks != NULL)
+        dr_global_free(blocks, max_blocks * sizeof(*blocks));
+    dr_mutex_destroy(table_mutex);
+}
+
+/* Returns the index of the first block starting at or after pc.
+ * Caller must hold table_mutex.
+ */
+static uint
+block_lower_bound(app_pc pc)
+{
+    uint lo = 0, hi = num_blocks;
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+        if (blocks[mid].start < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Records a new block.  Returns false if we already knew it.
+ * Caller must hold table_mutex.
+ */
+static bool
+block_add(block_t *block)
+{
+    uint i = block_lower_bound(block->start);
+    if (i < num_blocks && blocks[i].start == block->start)
+        return false;
+    if (num_blocks == max_blocks) {
+        uint new_max = (max_blocks == 0) ? 1024 : max_blocks * 2;
+        block_t *grown = (block_t *) dr_global_alloc(new_max * sizeof(*blocks));
+        if (blocks != NULL) {
+            memcpy(grown, blocks, num_blocks * sizeof(*blocks));
+            dr_global_free(blocks, max_blocks * sizeof(*blocks));
+        }
+        blocks = grown;
+        max_blocks = new_max;
+    }
+    memmove(&blocks[i + 1], &blocks[i], (num_blocks - i) * sizeof(*blocks));
+    blocks[i] = *block;
+    num_blocks++;
+    return true;
+}
+
+/* Adds tag to tags unless it is already there or tags is full.
+ * Regions are small, so a linear scan is fine.
+ */
+static void
+region_add(void **tags, uint *num, app_pc tag)
+{
+    uint i;
+    for (i = 0; i < *num; i++) {
+        if (tags[i] == (void *) tag)
+            return;
+    }
+    if (*num < MAX_REGION_TAGS)
+        tags[(*num)++] = (void *) tag;
+}
+
+/* Fills tags with the region of loop and returns its size.
+ * Caller must hold table_mutex.
+ */
+static uint
+loop_region(loop_t *loop, void **tags)
+{
+    uint i, j, num = 0;
+    for (i = block_lower_bound(loop->head);
+         i < num_blocks && blocks[i].start < loop->end; i++) {
+        app_pc callee = blocks[i].call_target;
+        region_add(tags, &num, blocks[i].start);
+        if (callee == NULL || (callee >= loop->head && callee < loop->end))
+            continue;
+        for (j = block_lower_bound(callee);
+             j < num_blocks && blocks[j].start < callee + CALLEE_SIZE_LIMIT; j++) {
+            region_add(tags, &num, blocks[j].start);
+            if (blocks[j].has_ret)
+                break;
+        }
+    }
+    return num;
+}
+
+/* Returns whether adding block to the region of loop could change it.
+ * Caller must hold table_mutex.
+ */
+static bool
+loop_affected_by(loop_t *loop, block_t *block)
+{
+    uint i;
+    if (block->start >= loop->head && block->start < loop->end)
+        return true;
+    /* a callee block: check the loop's direct call targets */
+    for (i = block_lower_bound(loop->head);
+         i < num_blocks && blocks[i].start < loop->end; i++) {
+        app_pc callee = blocks[i].call_target;
+        if (callee != NULL && block->start >= callee &&
+            block->start < callee + CALLEE_SIZE_LIMIT)
+            return true;
+    }
+    return false;
+}
+
+static dr_emit_flags_t
+event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating)
+{
+    instr_t *last = instrlist_last(bb);
+    block_t block;
+    app_pc refresh[MAX_LOOPS];
+    uint i, num_refresh = 0;
+    void **tags;
+
+    /* trace blocks were all seen as blocks first */
+    if (for_trace || translating || last == NULL || instr_get_app_pc(last) == NULL)
+        return DR_EMIT_DEFAULT;
+    block.start = (app_pc) tag;
+    block.end = instr_get_app_pc(last) + instr_length(drcontext, last);
+    block.call_target = instr_is_call_direct(last) ?
+        instr_get_branch_target_pc(last) : NULL;
+    block.has_ret = instr_is_return(last);
+
+    dr_mutex_lock(table_mutex);
+    if (!block_add(&block)) {
+        dr_mutex_unlock(table_mutex);
+        return DR_EMIT_DEFAULT;
+    }
+    if ((instr_is_cbr(last) || instr_is_ubr(last)) &&
+        instr_get_branch_target_pc(last) <= block.start &&
+        block.end - instr_get_branch_target_pc(last) <= LOOP_SIZE_LIMIT &&
+        num_loops < MAX_LOOPS) {
+        app_pc head = instr_get_branch_target_pc(last);
+        for (i = 0; i < num_loops && loops[i].head != head; i++)
+            ; /* nothing */
+        if (i == num_loops) {
+            loops[i].head = head;
+            loops[i].end = block.end;
+            loops[i].num_tags = 0;
+            num_loops++;
+        } else if (block.end > loops[i].end) {
+            /* another back edge to the same head, e.g. a continue */
+            loops[i].end = block.end;
+        }
+    }
+    for (i = 0; i < num_loops; i++) {
+        if (loop_affected_by(&loops[i], &block))
+            refresh[num_refresh++] = loops[i].head;
+    }
+    dr_mutex_unlock(table_mutex);
+    if (num_refresh == 0)
+        return DR_EMIT_DEFAULT;
+
+    /* dr_register_trace_region() acquires DR locks that rank below client
+     * mutexes, so we build each region under our lock but register it
+     * after dropping the lock.
+     */
+    tags = (void **) dr_thread_alloc(drcontext, MAX_REGION_TAGS * sizeof(*tags));
+    for (i = 0; i < num_refresh; i++) {
+        uint j, num = 0;
+        dr_mutex_lock(table_mutex);
+        for (j = 0; j < num_loops && loops[j].head != refresh[i]; j++)
+            ; /* nothing */
+        num = loop_region(&loops[j], tags);
+        if (num == loops[j].num_tags)
+            num = 0; /* unchanged */
+        else
+            loops[j].num_tags = num;
+        dr_mutex_unlock(table_mutex);
+        if (num == 0)
+            continue;
+        if (dr_register_trace_region(drcontext, refresh[i], tags, num, 0)) {
+            dr_log(drcontext, LOG_ALL, 3,
+                   "loopregion: loop "PFX" region has %d blocks\n", refresh[i], num);
+            dr_mutex_lock(table_mutex);
+            num_registrations++;
+            dr_mutex_unlock(table_mutex);
+        }
+    }
+    dr_thread_free(drcontext, tags, MAX_REGION_TAGS * sizeof(*tags));
+    return DR_EMIT_DEFAULT;
+}
@@ -42,13 +42,19 @@
  * (2) It inlines the buffer filling code to avoid full context switch.
  * (3) It uses lean procedure calling clean call to reduce code cache size.
  *
- * Illustrates the use of drutil_expand_rep_string() to expand string
- * loops to obtain every memory reference and of
- * drutil_opnd_mem_size_in_bytes() to obtain the size of OP_enter
- * memory references.
+ * Illustrates the use of drutil_insert_rep_string_range() to record
+ * each execution of a string loop as a single range rather than as
+ * one reference per iteration, which is much cheaper for memcpy-heavy
+ * code, and of drutil_opnd_mem_size_in_bytes() to obtain the size of
+ * OP_enter memory references.  Passing "-rep_expand" as the client
+ * option instead uses drutil_expand_rep_string() to expand string loops
+ * and obtain every individual memory reference.
+ *
+ * The trace is large: see the drmemtrace tool for a compact format
+ * suitable for tracing real workloads.
  */
 
-#include <string.h> /* for memset */
+#include <string.h> /* for memset, strstr */
 #include <stddef.h> /* for offsetof */
 #include "dr_api.h"
 #include "drmgr.h"
@@ -63,14 +69,27 @@
 #define NULL_TERMINATE(buf) buf[(sizeof(buf)/sizeof(buf[0])) - 1] = '\0'
 
 
-/* Each mem_ref_t includes the type of reference (read or write), 
- * the address referenced, and the size of the reference.
+enum {
+    REF_TYPE_READ  = 0,
+    REF_TYPE_WRITE = 1,
+    /* all the references of one execution of a string loop */
+    REF_TYPE_RANGE = 2,
+};
+
+/* Each mem_ref_t includes the type of reference (read, write, or range)
+ * and either the address referenced and the size of the reference, or
+ * for a range, the record filled in by drutil_insert_rep_string_range().
  */
 typedef struct _mem_ref_t {
-    bool  write;
-    void *addr;
-    size_t size;
-    app_pc pc;
+    uint type;
+    union {
+        struct {
+            void *addr;
+            size_t size;
+            app_pc pc;
+        } ref;
+        drutil_rep_string_range_t range;
+    } u;
 } mem_ref_t;
 
 /* Control the format of memory trace: readable or hexl */
@@ -98,6 +117,7 @@ static app_pc code_cache;
 static void  *mutex;    /* for multithread support */
 static uint64 num_refs; /* keep a global memory reference count */
 static int tls_index;
+static bool rep_expand; /* expand string loops rather than recording ranges */
 
 static void event_exit(void);
 static void event_thread_init(void *drcontext);
@@ -122,6 +142,16 @@ static void instrument_mem(void        *drcontext,
                            instr_t     *where, 
                            int          pos, 
                            bool         write);
+static void insert_advance_buf_ptr(void        *drcontext,
+                                   instrlist_t *ilist,
+                                   instr_t     *where,
+                                   reg_id_t     reg1,
+                                   reg_id_t     reg2);
+static void instrument_range(void        *drcontext,
+                             instrlist_t *ilist,
+                             instr_t     *where,
+                             int          pos,
+                             bool         write);
 
 DR_EXPORT void 
 dr_init(client_id_t id)
@@ -133,9 +163,11 @@ dr_init(client_id_t id)
         NULL,             /* optional name of operation we should precede */
         NULL,             /* optional name of operation we should follow */
         0};               /* numeric priority */
+    const char *opstr = dr_get_options(id);
     drmgr_init();
     drutil_init();
     client_id = id;
+    rep_expand = (opstr != NULL && strstr(opstr, "-rep_expand") != NULL);
     mutex = dr_mutex_create();
     dr_register_exit_event(event_exit);
     if (!drmgr_register_thread_init_event(event_thread_init) ||
@@ -257,14 +289,14 @@ event_thread_exit(void *drcontext)
 }
 
 
-/* we transform string loops into regular loops so we can more easily
- * monitor every memory reference they make
+/* with -rep_expand we transform string loops into regular loops so we can
+ * more easily monitor every memory reference they make
  */
 static dr_emit_flags_t
 event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
                  bool for_trace, bool translating)
 {
-    if (!drutil_expand_rep_string(drcontext, bb)) {
+    if (rep_expand && !drutil_expand_rep_string(drcontext, bb)) {
         DR_ASSERT(false);
         /* in release build, carry on: we'll just miss per-iter refs */
     }
@@ -283,7 +315,8 @@ event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
 }
 
 /* event_bb_insert calls instrument_mem to instrument every
- * application memory reference.
+ * application memory reference, or instrument_range for each memory
+ * operand of a string loop.
  */
 static dr_emit_flags_t
 event_bb_insert(void *drcontext, void *tag, instrlist_t *bb,
@@ -291,19 +324,22 @@ event_bb_insert(void *drcontext, void *tag, instrlist_t *bb,
                 void *user_data)
 {
     int i;
+    void (*instrument)(void *, instrlist_t *, instr_t *, int, bool) = instrument_mem;
     if (instr_get_app_pc(instr) == NULL)
         return DR_EMIT_DEFAULT;
+    if (drutil_instr_is_stringop_loop(instr))
+        instrument = instrument_range;
     if (instr_reads_memory(instr)) {
         for (i = 0; i < instr_num_srcs(instr); i++) {
             if (opnd_is_memory_reference(instr_get_src(instr, i))) {
-                instrument_mem(drcontext, bb, instr, i, false);
+                instrument(drcontext, bb, instr, i, false);
             }
         }
     }
     if (instr_writes_memory(instr)) {
         for (i = 0; i < instr_num_dsts(instr); i++) {
             if (opnd_is_memory_reference(instr_get_dst(instr, i))) {
-                instrument_mem(drcontext, bb, instr, i, true);
+                instrument(drcontext, bb, instr, i, true);
             }
         }
     }
@@ -326,10 +362,19 @@ memtrace(void *drcontext)
 
 #ifdef READABLE_TRACE
     dr_fprintf(data->log,
-               "Format: <instr address>,<(r)ead/(w)rite>,<data size>,<data address>\n");
+               "Format: <instr address>,<(r)ead/(w)rite>,<data size>,<data address>\n"
+               "String loop ranges use (R)ead/(W)rite and the lowest address\n");
     for (i = 0; i < num_refs; i++) {
-        dr_fprintf(data->log, PFX",%c,%d,"PFX"\n",
-                   mem_ref->pc, mem_ref->write ? 'w' : 'r', mem_ref->size, mem_ref->addr);
+        if (mem_ref->type == REF_TYPE_RANGE) {
+            app_pc start, end;
+            drutil_rep_string_range_bounds(&mem_ref->u.range, &start, &end);
+            dr_fprintf(data->log, PFX",%c,%d,"PFX"\n", mem_ref->u.range.pc,
+                       mem_ref->u.range.write ? 'W' : 'R', (int)(end - start), start);
+        } else {
+            dr_fprintf(data->log, PFX",%c,%d,"PFX"\n", mem_ref->u.ref.pc,
+                       mem_ref->type == REF_TYPE_WRITE ? 'w' : 'r',
+                       mem_ref->u.ref.size, mem_ref->u.ref.addr);
+        }
         ++mem_ref;
     }
 #else
@@ -395,7 +440,7 @@ static void
 instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where, 
                int pos, bool write)
 {
-    instr_t *instr, *call, *restore, *first, *second;
+    instr_t *instr, *first, *second;
     opnd_t   ref, opnd1, opnd2;
     reg_id_t reg1 = DR_REG_XBX; /* We can optimize it by picking dead reg */
     reg_id_t reg2 = DR_REG_XCX; /* reg2 must be ECX or RCX for jecxz */
@@ -420,7 +465,7 @@ instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where,
     drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg1, reg2);
     
     /* The following assembly performs the following instructions
-     * buf_ptr->write = write;
+     * buf_ptr->type  = write;
      * buf_ptr->addr  = addr;
      * buf_ptr->size  = size;
      * buf_ptr->pc    = pc;
@@ -435,20 +480,20 @@ instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where,
     instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
     instrlist_meta_preinsert(ilist, where, instr);
 
-    /* Move write/read to write field */
-    opnd1 = OPND_CREATE_MEM32(reg2, offsetof(mem_ref_t, write));
-    opnd2 = OPND_CREATE_INT32(write);
+    /* Move write/read to type field */
+    opnd1 = OPND_CREATE_MEM32(reg2, offsetof(mem_ref_t, type));
+    opnd2 = OPND_CREATE_INT32(write ? REF_TYPE_WRITE : REF_TYPE_READ);
     instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
     instrlist_meta_preinsert(ilist, where, instr);
 
     /* Store address in memory ref */
-    opnd1 = OPND_CREATE_MEMPTR(reg2, offsetof(mem_ref_t, addr));
+    opnd1 = OPND_CREATE_MEMPTR(reg2, offsetof(mem_ref_t, u.ref.addr));
     opnd2 = opnd_create_reg(reg1);
     instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
     instrlist_meta_preinsert(ilist, where, instr);
 
     /* Store size in memory ref */
-    opnd1 = OPND_CREATE_MEMPTR(reg2, offsetof(mem_ref_t, size));
+    opnd1 = OPND_CREATE_MEMPTR(reg2, offsetof(mem_ref_t, u.ref.size));
     /* drutil_opnd_mem_size_in_bytes handles OP_enter */
     opnd2 = OPND_CREATE_INT32(drutil_opnd_mem_size_in_bytes(ref, where));
     instr = INSTR_CREATE_mov_st(drcontext, opnd1, opnd2);
@@ -460,13 +505,29 @@ instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where,
      * We could alternatively load it into reg1 and then store reg1.
      * We use a convenience routine that does the two-step store for us.
      */
-    opnd1 = OPND_CREATE_MEMPTR(reg2, offsetof(mem_ref_t, pc));
+    opnd1 = OPND_CREATE_MEMPTR(reg2, offsetof(mem_ref_t, u.ref.pc));
     instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t) pc, opnd1,
                                      ilist, where, &first, &second);
     instr_set_ok_to_mangle(first, false/*meta*/);
     if (second != NULL)
         instr_set_ok_to_mangle(second, false/*meta*/);
 
+    insert_advance_buf_ptr(drcontext, ilist, where, reg1, reg2);
+}
+
+/*
+ * insert_advance_buf_ptr is called by instrument_mem and instrument_range
+ * once they have filled in the mem_ref_t pointed at by reg2.  It inserts
+ * code to advance the buffer pointer, to jump to our own code cache to
+ * call the clean_call when the buffer is full, and to restore reg1 and reg2.
+ */
+static void
+insert_advance_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       reg_id_t reg1, reg_id_t reg2)
+{
+    instr_t *instr, *call, *restore;
+    opnd_t   opnd1, opnd2;
+
     /* Increment reg value by pointer size using lea instr */
     opnd1 = opnd_create_reg(reg2);
     opnd2 = opnd_create_base_disp(reg2, DR_REG_NULL, 0, 
@@ -533,3 +594,51 @@ instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where,
     dr_restore_reg(drcontext, ilist, where, reg2, SPILL_SLOT_3);
 }
 
+/*
+ * instrument_range is called for each memory operand of a string loop.
+ * Rather than one mem_ref_t per iteration, it inserts code before the
+ * loop to fill in a single REF_TYPE_RANGE entry via drutil.
+ */
+static void
+instrument_range(void *drcontext, instrlist_t *ilist, instr_t *where,
+                 int pos, bool write)
+{
+    instr_t *instr;
+    opnd_t   ref, opnd1, opnd2;
+    reg_id_t reg1 = DR_REG_XBX;
+    reg_id_t reg2 = DR_REG_XCX; /* reg2 must be ECX or RCX for jecxz */
+
+    dr_save_reg(drcontext, ilist, where, reg1, SPILL_SLOT_2);
+    dr_save_reg(drcontext, ilist, where, reg2, SPILL_SLOT_3);
+
+    if (write)
+       ref = instr_get_dst(where, pos);
+    else
+       ref = instr_get_src(where, pos);
+
+    /* drutil needs the app's xcx so we load data->buf_ptr into reg1 */
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg1);
+    opnd1 = opnd_create_reg(reg1);
+    opnd2 = OPND_CREATE_MEMPTR(reg1, offsetof(per_thread_t, buf_ptr));
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    opnd1 = OPND_CREATE_MEM32(reg1, offsetof(mem_ref_t, type));
+    opnd2 = OPND_CREATE_INT32(REF_TYPE_RANGE);
+    instr = INSTR_CREATE_mov_imm(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    /* The range record clobbers reg2, after reading the count from it */
+    if (!drutil_insert_rep_string_range(drcontext, ilist, where, ref, write, reg1,
+                                        offsetof(mem_ref_t, u.range), reg2))
+        DR_ASSERT(false);
+
+    /* Move buf_ptr into reg2 as insert_advance_buf_ptr expects */
+    opnd1 = opnd_create_reg(reg2);
+    opnd2 = opnd_create_reg(reg1);
+    instr = INSTR_CREATE_mov_ld(drcontext, opnd1, opnd2);
+    instrlist_meta_preinsert(ilist, where, instr);
+
+    insert_advance_buf_ptr(drcontext, ilist, where, reg1, reg2);
+}
+
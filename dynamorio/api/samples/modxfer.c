@@ -48,6 +48,12 @@
  * - It is possible a direct branch with DGC or self-mod jumps between modules,
  *   they are ignored for now. They can be handled differently from indirect
  *   branch since the src and target are known at instrumentation time.
+ * - The source module of an indirect branch is known at instrumentation time,
+ *   and the target's module is found inline via drx's page-indexed module
+ *   table, so each branch updates the transfer matrix without a clean call.
+ *   Defining CLEAN_CALL_XFER instead uses dr_insert_mbr_instrumentation()
+ *   and a clean call per branch, for comparison: "make benchmarks" in a
+ *   build with tests times both on an indirect-call-heavy workload.
  */
 
 #include "utils.h"
@@ -55,7 +61,8 @@
 #include <string.h>
 
 #define MAX_NUM_MODULES    0x1000
-#define UNKNOW_MODULE_IDX  (MAX_NUM_MODULES-1)
+/* the module table's id for non-module addresses */
+#define UNKNOW_MODULE_IDX  DRX_MODULE_ID_NONE
 
 typedef struct _module_array_t {
     app_pc base;
@@ -63,12 +70,14 @@ typedef struct _module_array_t {
     bool   loaded;
     module_data_t *info;
 } module_array_t;
-/* the last slot is where all non-module address go */
+/* The first slot is where all non-module address go.  An index in this
+ * array is also the module's id in the drx module table.
+ */
 static module_array_t mod_array[MAX_NUM_MODULES];
 
 static uint64 ins_count;   /* number of instructions executed in total */
 static void  *mod_lock;
-static int    num_mods;
+static int    num_mods = UNKNOW_MODULE_IDX + 1;
 static uint   xfer_cnt[MAX_NUM_MODULES][MAX_NUM_MODULES];
 static uint64 mod_cnt[MAX_NUM_MODULES];
 static file_t logfile;
@@ -92,44 +101,57 @@ module_data_same(const module_data_t *d1, const module_data_t *d2)
     return false;
 }
 
+#ifdef CLEAN_CALL_XFER
 /* Simple clean calls with two arguments will not be inlined, but the context
  * switch can be optimized for better performance.
  */
 static void
 mbr_update(app_pc instr_addr, app_pc target_addr)
 {
-    int i, j;
-    /* XXX: this can be optimized by walking a tree instead */
-    /* find the source module */
-    for (i = 0; i < num_mods; i++) {
-        if (mod_array[i].loaded &&
-            mod_array[i].base <= instr_addr &&
-            mod_array[i].end  >  instr_addr)
-            break;
-    }
-    /* if cannot find a module, put it to the last */
-    if (i == num_mods)
-        i = UNKNOW_MODULE_IDX;
-    /* find the target module */
-    /* quick check if it is the same module */
-    if (i < UNKNOW_MODULE_IDX &&
-        mod_array[i].base <= target_addr &&
-        mod_array[i].end  >  target_addr) {
-        j = i;
-    } else {
-        for (j = 0; j < num_mods; j++) {
-            if (mod_array[j].loaded &&
-                mod_array[j].base <= target_addr &&
-                mod_array[j].end  >  target_addr)
-                break;
-        }
-        /* if cannot find a module, put it to the last */
-        if (j == num_mods)
-            j = UNKNOW_MODULE_IDX;
-    }
     /* this is a racy update, but should be ok to be a few number off */
-    xfer_cnt[i][j]++;
+    xfer_cnt[drx_module_table_lookup(instr_addr)]
+        [drx_module_table_lookup(target_addr)]++;
+}
+#else
+/* Inserts an inline update of xfer_cnt[src][module of mbr's target].
+ * Returns false if the target cannot be loaded with a simple mov.
+ */
+static bool
+insert_xfer_update(void *drcontext, instrlist_t *bb, instr_t *mbr, int src)
+{
+    /* a return's target operand is xsp itself, so we read the address off
+     * the stack, where it still is for ret imm16 too
+     */
+    opnd_t target = instr_is_return(mbr) ? OPND_CREATE_MEMPTR(DR_REG_XSP, 0) :
+        instr_get_target(mbr);
+    bool save_aflags = !drx_aflags_are_dead(mbr);
+    if (opnd_get_size(target) != OPSZ_PTR)
+        return false;
+    dr_save_reg(drcontext, bb, mbr, DR_REG_XCX, SPILL_SLOT_2);
+    dr_save_reg(drcontext, bb, mbr, DR_REG_XDX, SPILL_SLOT_3);
+    /* load the target before the flags save clobbers xax */
+    instrlist_meta_preinsert(bb, mbr, INSTR_CREATE_mov_ld
+                             (drcontext, opnd_create_reg(DR_REG_XCX), target));
+    if (save_aflags)
+        dr_save_arith_flags(drcontext, bb, mbr, SPILL_SLOT_1);
+    drx_insert_module_table_lookup(drcontext, bb, mbr, DR_REG_XCX, DR_REG_XDX);
+    /* this is a racy update, but should be ok to be a few number off */
+    instrlist_meta_preinsert(bb, mbr, INSTR_CREATE_mov_imm
+                             (drcontext, opnd_create_reg(DR_REG_XDX),
+                              OPND_CREATE_INTPTR(&xfer_cnt[src][0])));
+    instrlist_meta_preinsert(bb, mbr, INSTR_CREATE_add
+                             (drcontext,
+                              opnd_create_base_disp(DR_REG_XDX, DR_REG_XCX,
+                                                    sizeof(xfer_cnt[0][0]), 0,
+                                                    OPSZ_4),
+                              OPND_CREATE_INT8(1)));
+    if (save_aflags)
+        dr_restore_arith_flags(drcontext, bb, mbr, SPILL_SLOT_1);
+    dr_restore_reg(drcontext, bb, mbr, DR_REG_XDX, SPILL_SLOT_3);
+    dr_restore_reg(drcontext, bb, mbr, DR_REG_XCX, SPILL_SLOT_2);
+    return true;
 }
+#endif
 
 static void
 event_exit(void);
@@ -189,7 +211,7 @@ event_exit(void)
     int j;
     uint64 xmod_xfer = 0;
     uint64 self_xfer = 0;
-    for (i = 0; i < num_mods; i++) {
+    for (i = UNKNOW_MODULE_IDX + 1; i < num_mods; i++) {
         dr_fprintf(logfile, "module %3d: %s\n", i,
                    dr_module_preferred_name(mod_array[i].info) == NULL ?
                    "<unknown>" : dr_module_preferred_name(mod_array[i].info));
@@ -199,7 +221,7 @@ event_exit(void)
         dr_fprintf(logfile, "unknown modules:\n%20llu instruction executed\n",
                    mod_cnt[UNKNOW_MODULE_IDX]);
     }
-    for (i = 0; i < MAX_NUM_MODULES; i++) {
+    for (i = 0; i < num_mods; i++) {
         for (j = 0; j < num_mods; j++) {
             if (xfer_cnt[i][j] != 0) {
                 dr_fprintf(logfile, "mod %3d => mod %3d: %8u\n",
@@ -226,7 +248,7 @@ event_exit(void)
 #endif /* SHOW_RESULTS */
     dr_fprintf(logfile, "%s\n", msg);
     dr_mutex_lock(mod_lock);
-    for (i = 0; i < num_mods; i++) {
+    for (i = UNKNOW_MODULE_IDX + 1; i < num_mods; i++) {
         DR_ASSERT(mod_array[i].info != NULL);
         dr_free_module_data(mod_array[i].info);
     }
@@ -270,22 +292,22 @@ event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
             mbr = instr;
     }
 
-    for (i = 0; i < num_mods; i++) {
-        if (mod_array[i].loaded &&
-            mod_array[i].base <= bb_addr &&
-            mod_array[i].end  >  bb_addr)
-            break;
-    }
-    if (i == num_mods)
-        i = UNKNOW_MODULE_IDX;
+    i = drx_module_table_lookup(bb_addr);
     first = instrlist_first(bb);
     drx_insert_counter_update(drcontext, bb, first, SPILL_SLOT_1,
                               (void *)&mod_cnt[i], num_instrs, DRX_COUNTER_64BIT);
     drx_insert_counter_update(drcontext, bb, first, SPILL_SLOT_1,
                               (void *)&ins_count, num_instrs, DRX_COUNTER_64BIT);
     if (mbr != NULL) {
+#ifdef CLEAN_CALL_XFER
         dr_insert_mbr_instrumentation(drcontext, bb, mbr,
                                       (void *)mbr_update, SPILL_SLOT_1);
+#else
+        /* The module of the branch itself is known now.  A branch whose
+         * target is not pointer-sized is rare enough to not count.
+         */
+        insert_xfer_update(drcontext, bb, mbr, i);
+#endif
     }
 
 #if defined(VERBOSE) && defined(VERBOSE_VERBOSE)
@@ -300,7 +322,7 @@ event_module_load(void *drcontext, const module_data_t *info, bool loaded)
 {
     int i;
     dr_mutex_lock(mod_lock);
-    for (i = 0; i < num_mods; i++) {
+    for (i = UNKNOW_MODULE_IDX + 1; i < num_mods; i++) {
         /* check if it is the same as any unloaded module */
         if (!mod_array[i].loaded && module_data_same(mod_array[i].info, info)) {
             mod_array[i].loaded = true;
@@ -315,7 +337,8 @@ event_module_load(void *drcontext, const module_data_t *info, bool loaded)
         mod_array[i].info   = dr_copy_module_data(info);
         num_mods++;
     }
-    DR_ASSERT(num_mods < UNKNOW_MODULE_IDX);
+    DR_ASSERT(num_mods < MAX_NUM_MODULES);
+    drx_module_table_add(info->start, info->end, (ushort)i);
     dr_mutex_unlock(mod_lock);
 }
 
@@ -324,13 +347,14 @@ event_module_unload(void *drcontext, const module_data_t *info)
 {
     int i;
     dr_mutex_lock(mod_lock);
-    for (i = 0; i < num_mods; i++) {
+    for (i = UNKNOW_MODULE_IDX + 1; i < num_mods; i++) {
         if (mod_array[i].loaded && module_data_same(mod_array[i].info, info)) {
             /* Some module might be repeatedly loaded and unloaded, so instead
              * of clearing out the array entry, we keep the data for possible
              * reuse.
              */
             mod_array[i].loaded = false;
+            drx_module_table_remove(info->start, info->end);
             break;
         }
     }
@@ -37,6 +37,11 @@
  * It simply stores the information of basic blocks seen in bb callback event
  * into a table without any instrumentation, and dumps the buffer into log files
  * on thread/process exit.
+ * On Linux, a nudge with argument 2 (e.g., "nudgeunix -pid <pid> -client 0 2")
+ * writes a snapshot of the coverage so far to a bbcov.*.snap.log file from a
+ * forked copy of the process, without pausing the application for the I/O.
+ * A nudge with argument 3 moves every module that -native_after has moved to
+ * native execution back under DR, restarting its quiet interval.
  * To collect per-thread basic block execution information, run DR with
  * a thread private code cache (i.e., -thread_private).
  * The information can be used in cases like code coverage.
@@ -49,6 +54,23 @@
  *                    so that the exit event will be called.
  * -logdir <dir>      Sets log directory, which by default is at the same
  *                    directory as the client library.
+ * -shared_map        Linux only.  Records coverage into a per-module bitmap
+ *                    in a single bbcov.*.shm.log file that is shared with
+ *                    all forked children, instead of writing one log file
+ *                    per process or thread.
+ * -shared_map_size <MB>  Linux only.  The size of the -shared_map file,
+ *                    64MB by default.
+ * -native_after <ms> Runs a module natively once no new basic block has been
+ *                    seen in it for <ms> milliseconds, so that code whose
+ *                    coverage has saturated runs at native speed.  Coverage
+ *                    of other and newly loaded modules is still collected.
+ *                    Requires the -native_exec_retakeover DR option.
+ * -duty_cycle <window_ms> <period_ms>  Linux only.  Collects coverage for
+ *                    only <window_ms> out of every <period_ms> milliseconds,
+ *                    running all threads natively in between.  The code
+ *                    cache is kept across windows, so each window after the
+ *                    first starts warm.  Best combined with -shared_map, as
+ *                    an exit outside of a window skips the exit event.
  *
  * The two options below can only be used when the client is compiled with
  * CBR_COVERAGE being defined.
@@ -67,6 +89,7 @@
 #include "../common/utils.h"
 #include "hashtable.h"
 #include "drtable.h"
+#include "drx.h"
 #include "limits.h"
 #include <string.h>
 
@@ -101,6 +124,18 @@ typedef struct _bbcov_option_t {
 #endif
     char logdir[MAXIMUM_PATH];
     int native_until_thread;
+    /* Quiet interval in ms after which a module is run natively, 0 if off */
+    uint native_after;
+#ifndef WINDOWS
+    /* Record coverage into a single file-backed bitmap shared with
+     * forked children instead of per-process or per-thread logs.
+     */
+    bool shared_map;
+    uint shared_map_size; /* in MB */
+    /* Instrumented window and period in ms for -duty_cycle, 0 if off */
+    uint duty_window;
+    uint duty_period;
+#endif
 #ifdef CBR_COVERAGE
     bool check;
     bool summary;
@@ -129,6 +164,20 @@ static client_id_t client_id;
 static int sysnum_execve = IF_X64_ELSE(59, 11);
 #endif
 static volatile bool go_native;
+#ifndef WINDOWS
+/* the most recent snapshot process, until it is reaped */
+static process_id_t snapshot_pid;
+/* the -shared_map file mapping, inherited across fork */
+static shared_map_header_t *shared_map;
+/* process-local map from module_entry_t to its bitmap in shared_map */
+static hashtable_t shared_map_table;
+#endif
+
+enum {
+    NUDGE_TERMINATE_PROCESS = 1, /* Windows only */
+    NUDGE_SNAPSHOT          = 2, /* Linux only */
+    NUDGE_REINSTRUMENT      = 3,
+};
 
 static void
 event_exit(void);
@@ -164,10 +213,12 @@ log_file_create_helper(void *drcontext, char *prefix, const char *suffix)
     return INVALID_FILE;
 }
 
+/* Writes the log file name prefix, which is made up of the log directory,
+ * the application name, and the process or thread id, into logname.
+ */
 static void
-log_file_create(void *drcontext, per_thread_t *data)
+log_file_name(void *drcontext, char *logname, size_t logname_size)
 {
-    char logname[MAXIMUM_PATH];
     const char *app_name;
     char *dirsep;
     size_t len;
@@ -175,16 +226,16 @@ log_file_create(void *drcontext, per_thread_t *data)
     /* We will dump data to a log file at the same directory as our library.
      * We could also pass in a path and retrieve with dr_get_options().
      */
-    len = dr_snprintf(logname, BUFFER_SIZE_ELEMENTS(logname), "%s",
+    len = dr_snprintf(logname, logname_size, "%s",
                       options.logdir[0] != '\0' ?
                       options.logdir : dr_get_client_path(client_id));
     ASSERT(len > 0, "dr_snprintf failed");
-    NULL_TERMINATE_BUFFER(logname);
+    logname[logname_size - 1] = '\0';
     dirsep = logname + len - 1;
     if (options.logdir[0] == '\0' /* removing client lib */ ||
         /* path does not have a trailing / and is too large to add it */
         (*dirsep != '/' IF_WINDOWS(&& *dirsep != '\\') &&
-         len == BUFFER_SIZE_ELEMENTS(logname) - 1)) {
+         len == logname_size - 1)) {
         for (dirsep = logname + len;
              *dirsep != '/' IF_WINDOWS(&& *dirsep != '\\');
              dirsep--)
@@ -199,23 +250,32 @@ log_file_create(void *drcontext, per_thread_t *data)
     app_name = dr_get_application_name();
     if (app_name == NULL)
         app_name = "unknown";
-    len = dr_snprintf(dirsep + 1,
-                      (sizeof(logname)-(dirsep+1-logname))/sizeof(logname[0]),
+    len = dr_snprintf(dirsep + 1, logname_size - (dirsep + 1 - logname),
                       "bbcov.%s.%05d", app_name,
                       drcontext == NULL ?
                       dr_get_process_id() :
                       dr_get_thread_id(drcontext));
     ASSERT(len > 0, "dr_snprintf failed");
-    NULL_TERMINATE_BUFFER(logname);
+    logname[logname_size - 1] = '\0';
+}
+
+/* For a snapshot, drcontext must be NULL */
+static void
+log_file_create(void *drcontext, per_thread_t *data, bool snapshot)
+{
+    char logname[MAXIMUM_PATH];
+
+    log_file_name(drcontext, logname, BUFFER_SIZE_ELEMENTS(logname));
     if (options.dump_text || options.dump_binary) {
         data->log = log_file_create_helper(drcontext, logname,
-                                           drcontext == NULL ?
-                                           "proc.log" : "thd.log");
+                                           snapshot ? "snap.log" :
+                                           (drcontext == NULL ?
+                                            "proc.log" : "thd.log"));
     } else {
         data->log = INVALID_FILE;
     }
 #ifdef CBR_COVERAGE
-    if (options.check) {
+    if (options.check && !snapshot) {
         data->res = log_file_create_helper(drcontext, logname,
                                            drcontext == NULL ?
                                            "proc.res" : "thd.res");
@@ -497,6 +557,320 @@ bb_table_destroy(void *table, void *data)
     drtable_destroy(table, data);
 }
 
+#ifndef WINDOWS
+/****************************************************************************
+ * Shared Coverage Map
+ */
+
+#define DEFAULT_SHARED_MAP_SIZE 64 /* MB */
+#define MAX_SHARED_MAP_SIZE     1024 /* MB, keeps offsets within an int */
+
+static bool
+shared_map_create(void)
+{
+    char logname[MAXIMUM_PATH];
+    size_t size = (size_t)options.shared_map_size << 20;
+    file_t f;
+
+    log_file_name(NULL, logname, BUFFER_SIZE_ELEMENTS(logname));
+    f = log_file_create_helper(NULL, logname, "shm.log");
+    if (f == INVALID_FILE)
+        return false;
+    /* Extend the file by writing its last byte.  The file is sparse, so only
+     * the pages for modules that are actually executed take up disk space.
+     */
+    if (!dr_file_seek(f, size - 1, DR_SEEK_SET) ||
+        dr_write_file(f, "", 1) != 1) {
+        dr_close_file(f);
+        return false;
+    }
+    /* not DR_MAP_PRIVATE: all forked children write to the same pages */
+    shared_map = (shared_map_header_t *)
+        dr_map_file(f, &size, 0, NULL, DR_MEMPROT_READ | DR_MEMPROT_WRITE, 0);
+    /* the mapping keeps the file alive */
+    dr_close_file(f);
+    if (shared_map == NULL)
+        return false;
+    ASSERT(size >= sizeof(*shared_map), "shared map is too small");
+    /* the new file is zeroed, so no module slot is ready */
+    dr_snprintf(shared_map->text, BUFFER_SIZE_ELEMENTS(shared_map->text),
+                "BBCOV VERSION: %d\n%s\n", BBCOV_VERSION, BBCOV_SHARED_MAP_TAG);
+    shared_map->capacity = (uint)size;
+    shared_map->used     = sizeof(*shared_map);
+    shared_map->max_mods = BBCOV_SHARED_MAP_MAX_MODS;
+    hashtable_init_ex(&shared_map_table, 6, HASH_INTPTR, false/*!strdup*/,
+                      true/*sync*/, NULL, NULL, NULL);
+    return true;
+}
+
+static void
+shared_map_destroy(void)
+{
+    hashtable_delete(&shared_map_table);
+    dr_unmap_file((byte *)shared_map, shared_map->capacity);
+    shared_map = NULL;
+}
+
+/* Returns the bitmap of the module, claiming a slot in the shared map for it
+ * if no process has done so yet, or NULL if the module is not tracked.
+ */
+static byte *
+shared_map_module_bitmap(module_entry_t *entry)
+{
+    module_data_t *mod = entry->data;
+    shared_map_module_t *slot;
+    byte *bitmap;
+    uint size, bytes;
+    int i, num_mods, used;
+
+    bitmap = hashtable_lookup(&shared_map_table, entry);
+    if (bitmap != NULL)
+        return bitmap;
+    /* bbcov2lcov ignores modules with no path */
+    if (mod->full_path == NULL || mod->full_path[0] == '\0')
+        return NULL;
+    /* bbcov2lcov wants a byte-aligned bitmap, and we keep each bitmap
+     * pointer-aligned
+     */
+    bytes = (uint)(((mod->end - mod->start) + 63) / 64 * 8);
+    size  = bytes * 8;
+    /* look for a slot added by another process or before a fork */
+    num_mods = shared_map->num_mods;
+    if (num_mods > BBCOV_SHARED_MAP_MAX_MODS)
+        num_mods = BBCOV_SHARED_MAP_MAX_MODS;
+    for (i = 0; i < num_mods && bitmap == NULL; i++) {
+        slot = &shared_map->mods[i];
+        if (__atomic_load_n(&slot->ready, __ATOMIC_ACQUIRE) &&
+            slot->size == size && strcmp(slot->path, mod->full_path) == 0)
+            bitmap = (byte *)shared_map + slot->offs;
+    }
+    if (bitmap == NULL) {
+        i = dr_atomic_add32_return_sum(&shared_map->num_mods, 1) - 1;
+        if (i >= BBCOV_SHARED_MAP_MAX_MODS) {
+            NOTIFY(0, "bbcov: too many modules for the shared map, "
+                   "dropping coverage for %s\n", mod->full_path);
+            return NULL;
+        }
+        slot = &shared_map->mods[i];
+        used = dr_atomic_add32_return_sum(&shared_map->used, (int)bytes);
+        if ((uint)used > shared_map->capacity) {
+            NOTIFY(0, "bbcov: the shared map is full, dropping coverage for "
+                   "%s: use a larger -shared_map_size\n", mod->full_path);
+            /* a zero size tells bbcov2lcov to skip the slot */
+            __atomic_store_n(&slot->ready, 1, __ATOMIC_RELEASE);
+            return NULL;
+        }
+        slot->size = size;
+        slot->offs = (uint)used - bytes;
+        dr_snprintf(slot->path, BUFFER_SIZE_ELEMENTS(slot->path), "%s",
+                    mod->full_path);
+        NULL_TERMINATE_BUFFER(slot->path);
+        __atomic_store_n(&slot->ready, 1, __ATOMIC_RELEASE);
+        bitmap = (byte *)shared_map + slot->offs;
+    }
+    /* If another thread won the race we use its bitmap and leave ours as a
+     * duplicate slot, which bbcov2lcov merges.
+     */
+    if (!hashtable_add(&shared_map_table, entry, bitmap))
+        bitmap = hashtable_lookup(&shared_map_table, entry);
+    return bitmap;
+}
+
+/* Sets the bits for [start, start + size) in the module's bitmap.  The bits
+ * are only ever set, so relaxed atomic ORs are enough for concurrent writers
+ * in this process and in other processes, and we skip the atomic operation
+ * if the bits are already set, which is the common case for a bb that is
+ * rebuilt.
+ */
+static void
+shared_map_add(per_thread_t *data, app_pc start, uint size)
+{
+    module_entry_t **mod_entry_cache = data != NULL ? data->cache : NULL;
+    module_entry_t *mod_entry = module_table_lookup(mod_entry_cache,
+                                                    NUM_THREAD_MODULE_CACHE,
+                                                    module_table, start);
+    byte *bitmap;
+    uint offs, end, idx;
+
+    if (mod_entry == NULL || mod_entry->data == NULL || size == 0)
+        return;
+    bitmap = shared_map_module_bitmap(mod_entry);
+    if (bitmap == NULL)
+        return;
+    offs = (uint)(start - mod_entry->data->start);
+    end  = offs + size - 1; /* inclusive */
+    if (end >= (uint)(mod_entry->data->end - mod_entry->data->start))
+        end = (uint)(mod_entry->data->end - mod_entry->data->start) - 1;
+    for (idx = offs / 8; idx <= end / 8; idx++) {
+        byte mask = 0xff;
+        if (idx == offs / 8)
+            mask &= (byte)(0xff << (offs % 8));
+        if (idx == end / 8)
+            mask &= (byte)(0xff >> (7 - end % 8));
+        if ((bitmap[idx] & mask) != mask)
+            __atomic_fetch_or(&bitmap[idx], mask, __ATOMIC_RELAXED);
+    }
+}
+#endif /* !WINDOWS */
+
+/****************************************************************************
+ * Adaptive Native Execution
+ *
+ * For -native_after, we record when each module last produced a new basic
+ * block, and a client thread moves modules that have been quiet for the
+ * interval to native execution via dr_module_set_native().
+ */
+
+/* the most modules moved in one pass of the native thread */
+#define MAX_NATIVE_BATCH 32
+
+typedef struct _native_mod_t {
+    module_handle_t handle;
+    /* ms since native_base_time: a uint so that updates are never torn */
+    volatile uint last_new;
+    bool native;
+    /* start pcs of the blocks seen so far */
+    hashtable_t blocks;
+} native_mod_t;
+
+/* maps module base to native_mod_t */
+static hashtable_t native_table;
+static uint64 native_base_time;
+
+static uint
+native_time_now(void)
+{
+    return (uint)(dr_get_milliseconds() - native_base_time);
+}
+
+static void
+native_mod_free(void *payload)
+{
+    native_mod_t *mod = (native_mod_t *)payload;
+    hashtable_delete(&mod->blocks);
+    dr_global_free(mod, sizeof(*mod));
+}
+
+static void
+native_module_load(const module_data_t *info)
+{
+    native_mod_t *mod = dr_global_alloc(sizeof(*mod));
+    mod->handle   = info->handle;
+    mod->last_new = native_time_now();
+    mod->native   = false;
+    hashtable_init_ex(&mod->blocks, 10, HASH_INTPTR, false/*!strdup*/,
+                      true/*sync*/, NULL, NULL, NULL);
+    hashtable_add_replace(&native_table, (void *)info->start, mod);
+}
+
+static void
+native_module_unload(const module_data_t *info)
+{
+    hashtable_remove(&native_table, (void *)info->start);
+}
+
+/* Restarts the quiet interval of the module containing pc if the block at pc
+ * is new to the module.  A block is rebuilt after the module comes back from
+ * native execution or after other flushes, and with thread-private caches each
+ * thread builds its own copy: none of those adds coverage, so none of them
+ * may keep the module from going native.
+ */
+static void
+native_note_new_block(per_thread_t *data, app_pc pc)
+{
+    module_entry_t **mod_entry_cache = data != NULL ? data->cache : NULL;
+    module_entry_t *mod_entry = module_table_lookup(mod_entry_cache,
+                                                    NUM_THREAD_MODULE_CACHE,
+                                                    module_table, pc);
+    native_mod_t *mod;
+    uint now;
+    if (mod_entry == NULL || mod_entry->data == NULL)
+        return;
+    mod = hashtable_lookup(&native_table, (void *)mod_entry->data->start);
+    if (mod == NULL || !hashtable_add(&mod->blocks, (void *)pc, (void *)pc))
+        return;
+    /* avoid dirtying the shared cache line when nothing changed */
+    now = native_time_now();
+    if (mod->last_new != now)
+        mod->last_new = now;
+}
+
+/* Moves all modules that have been quiet for -native_after into (native is
+ * true) native execution, or moves all native modules back under DR.
+ * Returns the number of modules moved.
+ */
+static uint
+native_update_modules(bool native)
+{
+    module_handle_t batch[MAX_NATIVE_BATCH];
+    uint i, count = 0, now = native_time_now();
+    /* We cannot call dr_module_set_native() while holding our lock, as it
+     * acquires DR's module lock, which can be held in our module events.
+     * A module unloaded in between makes dr_module_set_native() fail.
+     */
+    hashtable_lock(&native_table);
+    for (i = 0; i < HASHTABLE_SIZE(native_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = native_table.table[i]; he != NULL; he = he->next) {
+            native_mod_t *mod = (native_mod_t *)he->payload;
+            if (count == MAX_NATIVE_BATCH)
+                break;
+            if (native && !mod->native &&
+                now - mod->last_new >= options.native_after) {
+                mod->native = true;
+                batch[count++] = mod->handle;
+            } else if (!native && mod->native) {
+                mod->native   = false;
+                mod->last_new = now;
+                batch[count++] = mod->handle;
+            }
+        }
+    }
+    hashtable_unlock(&native_table);
+    for (i = 0; i < count; i++) {
+        if (!dr_module_set_native(batch[i], native)) {
+            NOTIFY(0, "bbcov: failed to move module "PFX" %s native execution\n",
+                   batch[i], native ? "to" : "out of");
+        } else {
+            NOTIFY(1, "bbcov: moved module "PFX" %s native execution\n",
+                   batch[i], native ? "to" : "out of");
+        }
+    }
+    return count;
+}
+
+static void
+native_thread_main(void *arg)
+{
+    /* check a few times per interval so a module goes native soon after
+     * its quiet interval ends
+     */
+    int period = options.native_after / 4 + 1;
+    while (true) {
+        dr_sleep(period);
+        native_update_modules(true);
+    }
+}
+
+static void
+native_init(void)
+{
+    hashtable_init_ex(&native_table, 6, HASH_INTPTR, false/*!strdup*/,
+                      true/*sync*/, native_mod_free, NULL, NULL);
+    native_base_time = dr_get_milliseconds();
+    if (!dr_create_client_thread(native_thread_main, NULL)) {
+        NOTIFY(0, "%s\n", "bbcov: failed to create the -native_after thread");
+        hashtable_delete(&native_table);
+        options.native_after = 0;
+    }
+}
+
+static void
+native_exit(void)
+{
+    hashtable_delete(&native_table);
+}
+
 /****************************************************************************
  * Thread/Global Data Creation/Destroy
  */
@@ -528,7 +902,7 @@ thread_data_create(void *drcontext)
      */
     data->bb_table = bb_table_create(drcontext == NULL ? true : false);
     memset(data->cache, 0, sizeof(data->cache));
-    log_file_create(drcontext, data);
+    log_file_create(drcontext, data, false);
     return data;
 }
 
@@ -537,7 +911,8 @@ thread_data_destroy(void *drcontext, per_thread_t *data)
 {
     /* destroy the bb table */
     bb_table_destroy(data->bb_table, data);
-    dr_close_file(data->log);
+    if (data->log != INVALID_FILE)
+        dr_close_file(data->log);
     /* free thread data */
     if (drcontext == NULL) {
         ASSERT(!bbcov_per_thread, "bbcov_per_thread should not be set");
@@ -566,10 +941,6 @@ global_data_destroy(per_thread_t *data)
 
 #ifdef WINDOWS
 
-enum {
-    NUDGE_TERMINATE_PROCESS = 1,
-};
-
 static int sysnum_TerminateProcess = 0;
 
 /* copy from nudge_ex.dll.c */
@@ -586,17 +957,94 @@ get_sysnum(const char *wrapper)
     return drmgr_decode_sysnum_from_wrapper(entry);
 }
 
+#endif
+
+/****************************************************************************
+ * Snapshots and Nudges
+ */
+
+static void
+version_print(file_t log)
+{
+    if (log == INVALID_FILE) {
+        /* It is possible that failure on log file creation is caused by the
+         * running process not having enough privilege, so this is not a
+         * release-build fatal error
+         */
+        ASSERT(false, "invalid log file");
+        return;
+    }
+    dr_fprintf(log, "BBCOV VERSION: %d\n", BBCOV_VERSION);
+}
+
+#ifndef WINDOWS
+/* Runs in the snapshot process, where global_data is a frozen copy */
+static void
+snapshot_dump(void *drcontext, void *arg)
+{
+    per_thread_t data = *global_data;
+    log_file_create(NULL, &data, true);
+    if (data.log == INVALID_FILE)
+        return;
+    version_print(data.log);
+    module_table_print(module_table, data.log, IF_CBR_COVERAGE_ELSE(true, false));
+    bb_table_print(NULL, &data);
+    dr_close_file(data.log);
+}
+
+static void
+snapshot_create(void)
+{
+    if (options.shared_map) {
+        NOTIFY(1, "%s\n", "bbcov: the shared map file is always up to date");
+        return;
+    }
+    if (bbcov_per_thread) {
+        /* the other threads' tables are not reachable from here */
+        NOTIFY(0, "%s\n", "bbcov: snapshots are not supported with thread-private caches");
+        return;
+    }
+    if (snapshot_pid != 0) {
+        if (!dr_snapshot_wait(snapshot_pid, false/*don't block*/, NULL)) {
+            NOTIFY(1, "%s\n", "bbcov: previous snapshot still running, skipping");
+            return;
+        }
+        snapshot_pid = 0;
+    }
+    snapshot_pid = dr_create_snapshot(snapshot_dump, NULL);
+    if (snapshot_pid == (process_id_t) INVALID_PROCESS_ID) {
+        ASSERT(false, "failed to create snapshot");
+        snapshot_pid = 0;
+    }
+}
+#endif
+
 static void
 event_nudge(void *drcontext, uint64 argument)
 {
     int nudge_arg = (int)argument;
+#ifdef WINDOWS
     int exit_arg  = (int)(argument >> 32);
-    if (nudge_arg == NUDGE_TERMINATE_PROCESS)
+    if (nudge_arg == NUDGE_TERMINATE_PROCESS) {
         dr_exit_process(exit_arg);
-    ASSERT(nudge_arg == NUDGE_TERMINATE_PROCESS, "unsupported nudge");
-    ASSERT(false, "should not reach"); /* should not reach */
-}
+        ASSERT(false, "should not reach"); /* should not reach */
+    }
+#else
+    if (nudge_arg == NUDGE_SNAPSHOT) {
+        snapshot_create();
+        return;
+    }
 #endif
+    if (nudge_arg == NUDGE_REINSTRUMENT) {
+        if (options.native_after > 0) {
+            /* each pass moves at most MAX_NATIVE_BATCH modules */
+            while (native_update_modules(false) == MAX_NATIVE_BATCH)
+                ; /* keep going */
+        }
+        return;
+    }
+    ASSERT(false, "unsupported nudge");
+}
 
 static bool
 event_filter_syscall(void *drcontext, int sysnum)
@@ -709,11 +1157,19 @@ event_basic_block(void *drcontext, void *tag,
      * 4. The duplication can be easily handled in a post-processing step,
      *    which is required anyway.
      */
-    bb_table_entry_add(drcontext, data, start_pc,
+#ifndef WINDOWS
+    if (options.shared_map)
+        shared_map_add(data, start_pc, (uint)(end_pc - start_pc));
+    else
+#endif
+        bb_table_entry_add(drcontext, data, start_pc,
 #ifdef CBR_COVERAGE
-                       cbr_tgt, num_instrs, for_trace,
+                           cbr_tgt, num_instrs, for_trace,
 #endif
-                       (uint)(end_pc - start_pc));
+                           (uint)(end_pc - start_pc));
+    /* a trace rebuilds blocks we have already seen */
+    if (options.native_after > 0 && !for_trace)
+        native_note_new_block(data, start_pc);
 
     if (go_native)
         return DR_EMIT_GO_NATIVE;
@@ -726,26 +1182,16 @@ event_module_unload(void *drcontext, const module_data_t *info)
 {
     /* we do not delete the module entry but clean the cache only. */
     module_table_unload(module_table, info);
+    if (options.native_after > 0)
+        native_module_unload(info);
 }
 
 static void
 event_module_load(void *drcontext, const module_data_t *info, bool loaded)
 {
     module_table_load(module_table, info);
-}
-
-static void
-version_print(file_t log)
-{
-    if (log == INVALID_FILE) {
-        /* It is possible that failure on log file creation is caused by the
-         * running process not having enough privilege, so this is not a
-         * release-build fatal error
-         */
-        ASSERT(false, "invalid log file");
-        return;
-    }
-    dr_fprintf(log, "BBCOV VERSION: %d\n", BBCOV_VERSION);
+    if (options.native_after > 0)
+        native_module_load(info);
 }
 
 static void
@@ -825,7 +1271,7 @@ static void
 event_fork(void *drcontext)
 {
     if (!bbcov_per_thread) {
-        log_file_create(NULL, global_data);
+        log_file_create(NULL, global_data, false);
     } else {
         per_thread_t *data = dr_get_tls_field(drcontext);
         if (data != NULL) {
@@ -852,6 +1298,18 @@ event_exit(void)
 #endif
         global_data_destroy(global_data);
     }
+#ifndef WINDOWS
+    if (shared_map != NULL)
+        shared_map_destroy();
+#endif
+    if (options.native_after > 0)
+        native_exit();
+#ifndef WINDOWS
+    if (options.duty_window > 0) {
+        drx_duty_cycle_stop();
+        drx_exit();
+    }
+#endif
     /* destroy module table */
     module_table_destroy(module_table);
 }
@@ -870,6 +1328,37 @@ event_init(void)
 #endif
     /* create module table */
     module_table = module_table_create();
+#ifndef WINDOWS
+    if (options.shared_map && !shared_map_create()) {
+        NOTIFY(0, "%s\n", "bbcov: failed to create the shared map, "
+               "falling back to log files");
+        options.shared_map  = false;
+        options.dump_binary = true;
+    }
+#endif
+    if (options.native_after > 0) {
+        uint64 retakeover = 0;
+        /* Without -native_exec_retakeover, a native module's calls out to
+         * other modules stay native, so control would never come back to us.
+         */
+        if (!dr_get_integer_option("native_exec_retakeover", &retakeover) ||
+            !retakeover) {
+            NOTIFY(0, "%s\n", "bbcov: -native_after requires the "
+                   "-native_exec_retakeover DynamoRIO option, ignoring it");
+            options.native_after = 0;
+        } else
+            native_init();
+    }
+#ifndef WINDOWS
+    if (options.duty_window > 0) {
+        if (!drx_init() ||
+            !drx_duty_cycle_start(options.duty_window, options.duty_period,
+                                  NULL, NULL)) {
+            NOTIFY(0, "%s\n", "bbcov: failed to start -duty_cycle, "
+                   "collecting coverage continuously");
+        }
+    }
+#endif
     /* create process data if whole process bb coverage. */
     if (!bbcov_per_thread)
         global_data = global_data_create();
@@ -885,6 +1374,8 @@ options_init(client_id_t id)
 #ifdef WINDOWS
     /* enable nudge_kills by default */
     options.nudge_kills = true;
+#else
+    options.shared_map_size = DEFAULT_SHARED_MAP_SIZE;
 #endif
     for (s = dr_get_token(opstr, token, BUFFER_SIZE_ELEMENTS(token));
          s != NULL;
@@ -898,6 +1389,34 @@ options_init(client_id_t id)
             options.nudge_kills = false;
         else if (strcmp(token, "-nudge_kills") == 0)
             options.nudge_kills = true;
+#endif
+#ifndef WINDOWS
+        else if (strcmp(token, "-shared_map") == 0)
+            options.shared_map = true;
+        else if (strcmp(token, "-shared_map_size") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -shared_map_size number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &options.shared_map_size);
+                USAGE_CHECK(res == 1 && options.shared_map_size > 0 &&
+                            options.shared_map_size <= MAX_SHARED_MAP_SIZE,
+                            "invalid -shared_map_size number");
+            }
+        }
+        else if (strcmp(token, "-duty_cycle") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -duty_cycle window");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &options.duty_window);
+                s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+                USAGE_CHECK(s != NULL, "missing -duty_cycle period");
+                if (s != NULL)
+                    res += dr_sscanf(token, "%u", &options.duty_period);
+                USAGE_CHECK(res == 2 && options.duty_window > 0 &&
+                            options.duty_window < options.duty_period,
+                            "invalid -duty_cycle window and period");
+            }
+        }
 #endif
         else if (strcmp(token, "-logdir") == 0) {
             s = dr_get_token(s, options.logdir,
@@ -917,6 +1436,15 @@ options_init(client_id_t id)
                 }
             }
         }
+        else if (strcmp(token, "-native_after") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -native_after number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &options.native_after);
+                USAGE_CHECK(res == 1 && options.native_after > 0,
+                            "invalid -native_after number");
+            }
+        }
         else if (strcmp(token, "-verbose") == 0) {
             s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
             USAGE_CHECK(s != NULL, "missing -verbose number");
@@ -945,6 +1473,13 @@ options_init(client_id_t id)
         options.dump_text   = false;
         options.dump_binary = true;
     }
+#ifndef WINDOWS
+    /* the shared map replaces the log files */
+    if (options.shared_map) {
+        options.dump_text   = false;
+        options.dump_binary = false;
+    }
+#endif
 }
 
 DR_EXPORT void 
@@ -960,10 +1495,10 @@ dr_init(client_id_t id)
     dr_register_pre_syscall_event(event_pre_syscall);
 #ifdef WINDOWS
     sysnum_TerminateProcess = get_sysnum("NtTerminateProcess");
-    dr_register_nudge_event(event_nudge, id);
 #else
     dr_register_fork_init_event(event_fork);
 #endif
+    dr_register_nudge_event(event_nudge, id);
     client_id = id;
     if (dr_using_all_private_caches())
         bbcov_per_thread = true;
@@ -77,4 +77,34 @@ typedef struct _bb_entry_t {
 #endif
 } bb_entry_t;
 
+/* Layout of the -shared_map file (Linux only).  A single file is mapped
+ * MAP_SHARED by a process and inherited by all of its forked children, which
+ * set bits in per-module bitmaps: bit i of a module's bitmap is set if the
+ * byte at offset i from the module base is part of an executed basic block.
+ * Module slots are claimed with an atomic increment of num_mods and only
+ * valid once ready is set.  Two processes may race to add the same module,
+ * resulting in duplicate slots that bbcov2lcov merges by path.
+ */
+#define BBCOV_SHARED_MAP_TAG      "BBCOV SHARED MAP"
+#define BBCOV_SHARED_MAP_TEXT_LEN 64
+#define BBCOV_SHARED_MAP_MAX_MODS 1024
+
+typedef struct _shared_map_module_t {
+    volatile uint ready;
+    uint   size;       /* module size: number of bits in the bitmap */
+    uint   offs;       /* offset of the bitmap from the start of the file */
+    uint   pad;
+    char   path[MAXIMUM_PATH];
+} shared_map_module_t;
+
+typedef struct _shared_map_header_t {
+    /* "BBCOV VERSION: %d\nBBCOV SHARED MAP\n" followed by zeroes */
+    char   text[BBCOV_SHARED_MAP_TEXT_LEN];
+    uint   capacity;             /* size of the file */
+    volatile int used;           /* bytes allocated, including the header */
+    volatile int num_mods;       /* slots claimed, may exceed the maximum */
+    uint   max_mods;
+    shared_map_module_t mods[BBCOV_SHARED_MAP_MAX_MODS];
+} shared_map_header_t;
+
 #endif /* _BBCOV_H_ */
@@ -501,6 +501,28 @@ bb_table_add(bb_table_t *table, bb_entry_t *entry)
     return true;
 }
 
+/* Returns the bb table for the module, creating it on the first lookup */
+static void *
+module_bb_table(const char *path, uint64 mod_size)
+{
+    void *bb_table = hashtable_lookup(&module_htable, (void *)path);
+    if (bb_table == NULL) {
+        if (mod_size >= UINT_MAX)
+            ASSERT(false, "module size is too large");
+        if (strstr(path, "<unknown>") != NULL ||
+            (mod_filter != NULL && strstr(path, mod_filter) == NULL))
+            bb_table = BB_TABLE_IGNORE;
+         else
+            bb_table = bb_table_create((uint)mod_size);
+        PRINT(4, "Create bb table "PFX" for module %s\n",
+              (ptr_uint_t)bb_table, path);
+        num_module_htable_entries++;
+        if (!hashtable_add(&module_htable, (void *)path, bb_table))
+            ASSERT(false, "Failed to add new module");
+    }
+    return bb_table;
+}
+
 static char *
 read_module_list(char *buf, void ***tables, uint *num_mods)
 {
@@ -540,21 +562,7 @@ read_module_list(char *buf, void ***tables, uint *num_mods)
             ASSERT(false, "Failed to read module table");
         buf = move_to_next_line(buf);
         PRINT(5, "Module: %u, "PFX", %s\n", mod_id, (ptr_uint_t)mod_size, path);
-        bb_table = hashtable_lookup(&module_htable, path);
-        if (bb_table == NULL) {
-            if (mod_size >= UINT_MAX)
-                ASSERT(false, "module size is too large");
-            if (strstr(path, "<unknown>") != NULL ||
-                (mod_filter != NULL && strstr(path, mod_filter) == NULL))
-                bb_table = BB_TABLE_IGNORE;
-             else
-                bb_table = bb_table_create((uint)mod_size);
-            PRINT(4, "Create bb table "PFX" for module %s\n",
-                  (ptr_uint_t)bb_table, path);
-            num_module_htable_entries++;
-            if (!hashtable_add(&module_htable, path, bb_table))
-                ASSERT(false, "Failed to add new module");
-        }
+        bb_table = module_bb_table(path, mod_size);
         (*tables)[i] = bb_table;
     }
     return buf;
@@ -623,6 +631,79 @@ close_input_file(file_t f, char *map, size_t map_size)
     dr_close_file(f);
 }
 
+static bool
+is_shared_map(char *map, size_t map_size)
+{
+    char tag[BBCOV_SHARED_MAP_TEXT_LEN];
+    char *ptr;
+    uint version;
+    if (map_size < sizeof(shared_map_header_t))
+        return false;
+    if (dr_sscanf(map, "BBCOV VERSION: %u\n", &version) != 1)
+        return false;
+    ptr = move_to_next_line(map);
+    dr_snprintf(tag, BUFFER_SIZE_ELEMENTS(tag), "%s\n", BBCOV_SHARED_MAP_TAG);
+    NULL_TERMINATE_BUFFER(tag);
+    if (strncmp(ptr, tag, strlen(tag)) != 0)
+        return false;
+    if (version != BBCOV_VERSION) {
+        WARN(1, "Shared map version %u does not match %u\n",
+             version, BBCOV_VERSION);
+        return false;
+    }
+    return true;
+}
+
+/* Merges the module bitmaps of a -shared_map file, which already have the
+ * same layout as our bb tables.
+ */
+static bool
+read_shared_map(char *map, size_t map_size)
+{
+    shared_map_header_t *header = (shared_map_header_t *)map;
+    char path[MAXIMUM_PATH];
+    uint i, j, num_mods;
+    bool add_new_bb = false;
+
+    num_mods = header->num_mods;
+    if (num_mods > header->max_mods)
+        num_mods = header->max_mods;
+    if (num_mods > BBCOV_SHARED_MAP_MAX_MODS)
+        num_mods = BBCOV_SHARED_MAP_MAX_MODS;
+    PRINT(4, "Reading %u shared map modules\n", num_mods);
+    for (i = 0; i < num_mods; i++) {
+        shared_map_module_t *slot = &header->mods[i];
+        bb_table_t *table;
+        byte *bm;
+        uint bytes;
+        /* a slot that is not ready was never completed */
+        if (!slot->ready || slot->size == 0)
+            continue;
+        bytes = slot->size / BITS_PER_BYTE;
+        if ((size_t)slot->offs + bytes > map_size) {
+            WARN(1, "Corrupt shared map module %u\n", i);
+            continue;
+        }
+        /* the map is read-only, so we copy the path to terminate it */
+        memcpy(path, slot->path, sizeof(path));
+        NULL_TERMINATE_BUFFER(path);
+        PRINT(5, "Module: %u, "PFX", %s\n", i, (ptr_uint_t)slot->size, path);
+        table = module_bb_table(path, slot->size);
+        if (table == BB_TABLE_IGNORE)
+            continue;
+        if (table->size < slot->size)
+            bytes = table->size / BITS_PER_BYTE;
+        bm = (byte *)map + slot->offs;
+        for (j = 0; j < bytes; j++) {
+            if ((bm[j] & ~table->bm[j]) != 0) {
+                table->bm[j] |= bm[j];
+                add_new_bb = true;
+            }
+        }
+    }
+    return add_new_bb;
+}
+
 static bool
 read_bbcov_file(char *input)
 {
@@ -639,6 +720,13 @@ read_bbcov_file(char *input)
         WARN(1, "Failed to read bbcov log file %s\n", input);
         return false;
     }
+    if (is_shared_map(map, map_size)) {
+        res = read_shared_map(map, map_size);
+        if (res && set_log != INVALID_FILE)
+            dr_fprintf(set_log, "%s\n", input);
+        close_input_file(log, map, map_size);
+        return true;
+    }
     ptr = read_module_list(map, &tables, &num_mods);
     if (ptr == NULL)
         return false;
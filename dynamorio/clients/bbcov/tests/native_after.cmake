@@ -0,0 +1,82 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Check script for tool.bbcov.native_after, included by runcheck.cmake after
+# bbcov -native_after -shared_map ran the common.saturate test.  The app's
+# library is quiet for most of the run, so bbcov should have moved it to
+# native execution before the app first calls its late function.  The caller
+# passes the paths of bbcov2lcov and of the library's source, src.  The lcov
+# output must show the library's hot function as executed and its late
+# function as not executed.
+
+file(GLOB logs "${tmpdir}/bbcov.*.shm.log")
+list(LENGTH logs num_logs)
+if (NOT num_logs EQUAL 1)
+  message(FATAL_ERROR "expected one shared map under ${tmpdir}, found ${num_logs}")
+endif ()
+
+set(info "${tmpdir}/coverage.info")
+execute_process(COMMAND ${bbcov2lcov} --dir ${tmpdir} --output ${info}
+  RESULT_VARIABLE lcov_result
+  OUTPUT_VARIABLE lcov_output ERROR_VARIABLE lcov_output)
+if (lcov_result)
+  message(FATAL_ERROR "bbcov2lcov failed: ${lcov_output}")
+endif ()
+file(READ "${info}" lcov)
+get_filename_component(src_name "${src}" NAME)
+string(REPLACE "." "\\." src_regex "${src_name}")
+if (NOT "${lcov}" MATCHES "SF:[^\n]*/${src_regex}\n([^e]*)end_of_record")
+  message(FATAL_ERROR "no coverage of ${src_name} in ${info}")
+endif ()
+set(records "${CMAKE_MATCH_1}")
+
+# Sets var to the number of the first line of src containing text.
+file(READ "${src}" src_contents)
+function (find_line var text)
+  string(FIND "${src_contents}" "${text}" pos)
+  if (pos LESS 0)
+    message(FATAL_ERROR "\"${text}\" is not in ${src}")
+  endif ()
+  string(SUBSTRING "${src_contents}" 0 ${pos} before)
+  string(REGEX MATCHALL "\n" newlines "${before}")
+  list(LENGTH newlines num)
+  math(EXPR num "${num} + 1")
+  set(${var} ${num} PARENT_SCOPE)
+endfunction ()
+
+find_line(hot_line "(x & 7) + 1")
+find_line(late_line "x * x - 2")
+if (NOT "${records}" MATCHES "(^|\n)DA:${hot_line},1\n")
+  message(FATAL_ERROR "expected DA:${hot_line},1 for ${src_name} in ${info}")
+endif ()
+if (NOT "${records}" MATCHES "(^|\n)DA:${late_line},0\n")
+  message(FATAL_ERROR "the library did not go native: expected "
+    "DA:${late_line},0 for ${src_name} in ${info}")
+endif ()
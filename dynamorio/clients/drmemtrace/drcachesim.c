@@ -0,0 +1,615 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drcachesim.c
+ *
+ * Decodes the per-thread trace files written by drmemtrace (see
+ * drmemtrace_format.h) and runs each thread's references through a
+ * configurable hierarchy of data caches and TLBs.  Each application thread
+ * is simulated against its own private hierarchy, so the threads are
+ * independent and are simulated in parallel by a pool of workers; sharing
+ * between application threads is not modeled.
+ *
+ * Each level is set-associative with LRU replacement and allocates on
+ * every miss, whether a read or a write.  A reference that spans several
+ * lines or pages accesses each of them.
+ */
+
+#include "drmemtrace_format.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int verbose = 1;
+
+#define PRINT(lvl, ...) do {                                \
+    if (verbose >= lvl) {                                   \
+        fprintf(stdout, __VA_ARGS__);                       \
+    }                                                       \
+} while (0)
+
+#define ASSERT(val, ...) do {                               \
+    if (!(val)) {                                           \
+        fprintf(stderr, "[DRCACHESIM] ERROR:    ");         \
+        fprintf(stderr, __VA_ARGS__);                       \
+        exit(1);                                            \
+    }                                                       \
+} while (0)
+
+const char *usage_str =
+    "drcachesim: simulate caches and TLBs over a drmemtrace trace\n"
+    "usage: drcachesim [options] <trace file>...\n"
+    "      --help                          Print this message.\n"
+    "      --verbose <int>                 Verbose level: 2 prints per-thread results.\n"
+    "      --threads <int>                 Worker threads, 0 for one per CPU (default).\n"
+    "      --cache <name>:<size>:<assoc>:<line>\n"
+    "                                      Adds a cache level, e.g. L1:32K:8:64.\n"
+    "      --tlb <name>:<entries>:<assoc>:<page>\n"
+    "                                      Adds a TLB level, e.g. L1:64:4:4K.\n"
+    "Levels are listed from closest to the core.  By default the caches are\n"
+    "L1:32K:8:64, L2:256K:8:64, and L3:8M:16:64, and the TLBs are L1:64:4:4K\n"
+    "and L2:1536:12:4K (12-way with 128 sets).\n"
+    "Each trace file is one application thread.\n";
+
+#define MAX_LEVELS 8
+#define MAX_THREADS 256
+
+typedef struct _level_config_t {
+    char name[32];
+    uint32_t num_sets;
+    uint32_t assoc;
+    uint32_t block_bits;  /* log2 of the line or page size */
+} level_config_t;
+
+typedef struct _level_t {
+    const level_config_t *config;
+    uint64_t *tags;   /* num_sets * assoc, ~0 if empty */
+    uint64_t *stamps; /* the last use of each way, for LRU */
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+} level_t;
+
+static level_config_t cache_configs[MAX_LEVELS];
+static int num_caches;
+static level_config_t tlb_configs[MAX_LEVELS];
+static int num_tlbs;
+
+/* Simulation of one trace file */
+typedef struct _sim_t {
+    const char *path;
+    bool ok;
+    uint64_t refs;
+    uint64_t bytes;
+    level_t caches[MAX_LEVELS];
+    level_t tlbs[MAX_LEVELS];
+} sim_t;
+
+/* Decoded blocks of one trace file, in a two-level table indexed by id */
+#define BLOCK_PAGE_BITS    12
+#define BLOCK_PAGE_ENTRIES (1U << BLOCK_PAGE_BITS)
+
+typedef struct _block_t {
+    uint32_t num_refs;
+    uint32_t *size_write; /* size << 1 | is_write; the pcs are not needed */
+    uint64_t *last;       /* the previous address of each reference */
+} block_t;
+
+typedef struct _block_table_t {
+    block_t **pages;
+    size_t num_pages;
+} block_table_t;
+
+/****************************************************************************
+ * Cache and TLB model
+ */
+
+static bool
+is_power_of_2(uint64_t x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static uint32_t
+log2_of(uint64_t x)
+{
+    uint32_t res = 0;
+    while (x > 1) {
+        x >>= 1;
+        res++;
+    }
+    return res;
+}
+
+/* Parses a count with an optional K, M, or G suffix */
+static bool
+parse_size(const char *s, uint64_t *res)
+{
+    char *end;
+    *res = strtoull(s, &end, 10);
+    if (end == s)
+        return false;
+    if (*end == 'K' || *end == 'k')
+        *res <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        *res <<= 20;
+    else if (*end == 'G' || *end == 'g')
+        *res <<= 30;
+    else if (*end != '\0')
+        return false;
+    return true;
+}
+
+/* Parses <name>:<size>:<assoc>:<block>, where size is in bytes for a cache
+ * and in entries for a TLB.
+ */
+static void
+parse_level(const char *spec, bool tlb, level_config_t *config)
+{
+    char buf[128];
+    char *fields[4];
+    uint64_t size, assoc, block;
+    int i;
+    ASSERT(strlen(spec) < sizeof(buf), "level spec too long: %s\n", spec);
+    strcpy(buf, spec);
+    fields[0] = buf;
+    for (i = 1; i < 4; i++) {
+        fields[i] = strchr(fields[i - 1], ':');
+        ASSERT(fields[i] != NULL, "expected 4 fields in %s\n", spec);
+        *fields[i]++ = '\0';
+    }
+    ASSERT(parse_size(fields[1], &size) && parse_size(fields[2], &assoc) &&
+           parse_size(fields[3], &block), "invalid number in %s\n", spec);
+    ASSERT(is_power_of_2(block), "%s: block size must be a power of 2\n", spec);
+    ASSERT(assoc > 0 && size > 0, "%s: size and associativity must be > 0\n", spec);
+    if (!tlb)
+        size /= block;
+    ASSERT(size % assoc == 0 && is_power_of_2(size / assoc),
+           "%s: the number of sets must be a power of 2\n", spec);
+    snprintf(config->name, sizeof(config->name), "%s%s", fields[0],
+             tlb ? " TLB" : "");
+    config->num_sets = (uint32_t)(size / assoc);
+    config->assoc = (uint32_t)assoc;
+    config->block_bits = log2_of(block);
+}
+
+static void
+level_init(level_t *level, const level_config_t *config)
+{
+    size_t ways = (size_t)config->num_sets * config->assoc;
+    memset(level, 0, sizeof(*level));
+    level->config = config;
+    level->tags = malloc(ways * sizeof(*level->tags));
+    level->stamps = calloc(ways, sizeof(*level->stamps));
+    ASSERT(level->tags != NULL && level->stamps != NULL, "out of memory\n");
+    memset(level->tags, 0xff, ways * sizeof(*level->tags));
+}
+
+static void
+level_free(level_t *level)
+{
+    free(level->tags);
+    free(level->stamps);
+    level->tags = NULL;
+    level->stamps = NULL;
+}
+
+/* Returns whether the block holding addr was present, inserting it if not */
+static bool
+level_access(level_t *level, uint64_t addr)
+{
+    const level_config_t *config = level->config;
+    uint64_t block = addr >> config->block_bits;
+    size_t base = (size_t)(block & (config->num_sets - 1)) * config->assoc;
+    size_t way, victim = base;
+    level->clock++;
+    for (way = base; way < base + config->assoc; way++) {
+        if (level->tags[way] == block) {
+            level->stamps[way] = level->clock;
+            level->hits++;
+            return true;
+        }
+        if (level->stamps[way] < level->stamps[victim])
+            victim = way;
+    }
+    level->tags[victim] = block;
+    level->stamps[victim] = level->clock;
+    level->misses++;
+    return false;
+}
+
+/* Accesses each block of levels[0] touched by [addr, addr + size), going
+ * down the hierarchy until a level hits.
+ */
+static void
+hierarchy_access(level_t *levels, int num, uint64_t addr, uint32_t size)
+{
+    uint32_t bits;
+    uint64_t block, last;
+    int i;
+    if (num == 0)
+        return;
+    bits = levels[0].config->block_bits;
+    last = (addr + (size == 0 ? 0 : size - 1)) >> bits;
+    for (block = addr >> bits; block <= last; block++) {
+        for (i = 0; i < num; i++) {
+            if (level_access(&levels[i], block << bits))
+                break;
+        }
+    }
+}
+
+/****************************************************************************
+ * Trace decoding
+ */
+
+static block_t *
+block_lookup(block_table_t *table, uint64_t id)
+{
+    uint64_t page = id >> BLOCK_PAGE_BITS;
+    if (page >= table->num_pages || table->pages[page] == NULL)
+        return NULL;
+    return &table->pages[page][id & (BLOCK_PAGE_ENTRIES - 1)];
+}
+
+/* Returns NULL if id is out of range */
+static block_t *
+block_add(block_table_t *table, uint64_t id)
+{
+    uint64_t page = id >> BLOCK_PAGE_BITS;
+    if (id >= TRACE_MAX_BLOCKS)
+        return NULL;
+    if (page >= table->num_pages) {
+        size_t num = table->num_pages == 0 ? 16 : table->num_pages;
+        block_t **pages;
+        while (num <= page)
+            num *= 2;
+        pages = realloc(table->pages, num * sizeof(*pages));
+        ASSERT(pages != NULL, "out of memory\n");
+        memset(pages + table->num_pages, 0,
+               (num - table->num_pages) * sizeof(*pages));
+        table->pages = pages;
+        table->num_pages = num;
+    }
+    if (table->pages[page] == NULL) {
+        table->pages[page] = calloc(BLOCK_PAGE_ENTRIES, sizeof(block_t));
+        ASSERT(table->pages[page] != NULL, "out of memory\n");
+    }
+    return &table->pages[page][id & (BLOCK_PAGE_ENTRIES - 1)];
+}
+
+static void
+block_table_free(block_table_t *table)
+{
+    size_t i, j;
+    for (i = 0; i < table->num_pages; i++) {
+        if (table->pages[i] == NULL)
+            continue;
+        for (j = 0; j < BLOCK_PAGE_ENTRIES; j++) {
+            free(table->pages[i][j].size_write);
+            free(table->pages[i][j].last);
+        }
+        free(table->pages[i]);
+    }
+    free(table->pages);
+}
+
+/* Decodes and simulates the records of one chunk.  Returns the number of
+ * references, or -1 if the chunk is corrupt.
+ */
+static int64_t
+simulate_chunk(sim_t *sim, block_table_t *table, const uint8_t *p,
+               const uint8_t *end)
+{
+    int64_t refs = 0;
+    while (p < end) {
+        uint64_t val, id, count, i;
+        int64_t delta;
+        block_t *block;
+        p = trace_get_uvar(p, end, &val);
+        if (p == NULL)
+            return -1;
+        id = val >> TRACE_RECORD_TYPE_BITS;
+        switch (val & TRACE_RECORD_TYPE_MASK) {
+        case TRACE_RECORD_BLOCK_DEF:
+            block = block_add(table, id);
+            if (block == NULL || block->size_write != NULL)
+                return -1; /* bad id, or already defined */
+            p = trace_get_uvar(p, end, &count);
+            if (p == NULL || count == 0 || count > (uint64_t)(end - p))
+                return -1;
+            block->num_refs = (uint32_t)count;
+            block->size_write = malloc(count * sizeof(*block->size_write));
+            block->last = calloc(count, sizeof(*block->last));
+            ASSERT(block->size_write != NULL && block->last != NULL,
+                   "out of memory\n");
+            for (i = 0; i < count; i++) {
+                p = trace_get_svar(p, end, &delta); /* pc */
+                if (p == NULL)
+                    return -1;
+                p = trace_get_uvar(p, end, &val);
+                if (p == NULL)
+                    return -1;
+                block->size_write[i] = (uint32_t)val;
+            }
+            break;
+        case TRACE_RECORD_BLOCK:
+        case TRACE_RECORD_BLOCK_PARTIAL:
+            block = block_lookup(table, id);
+            if (block == NULL || block->size_write == NULL)
+                return -1;
+            count = block->num_refs;
+            if ((val & TRACE_RECORD_TYPE_MASK) == TRACE_RECORD_BLOCK_PARTIAL) {
+                p = trace_get_uvar(p, end, &count);
+                if (p == NULL || count > block->num_refs)
+                    return -1;
+            }
+            for (i = 0; i < count; i++) {
+                uint64_t addr;
+                p = trace_get_svar(p, end, &delta);
+                if (p == NULL)
+                    return -1;
+                addr = block->last[i] + (uint64_t)delta;
+                block->last[i] = addr;
+                hierarchy_access(sim->caches, num_caches, addr,
+                                 block->size_write[i] >> 1);
+                hierarchy_access(sim->tlbs, num_tlbs, addr,
+                                 block->size_write[i] >> 1);
+            }
+            refs += count;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return refs;
+}
+
+static bool
+simulate_file(sim_t *sim)
+{
+    FILE *f = fopen(sim->path, "rb");
+    trace_header_t header;
+    trace_chunk_t chunk;
+    block_table_t table = {NULL, 0};
+    uint8_t *buf = NULL;
+    size_t buf_size = 0;
+    bool ok = false;
+
+    if (f == NULL) {
+        fprintf(stderr, "%s: unable to open\n", sim->path);
+        return false;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d drmemtrace trace\n", sim->path,
+                TRACE_VERSION);
+        goto done;
+    }
+    sim->bytes = sizeof(header);
+    while (fread(&chunk, sizeof(chunk), 1, f) == 1) {
+        int64_t refs;
+        if (chunk.payload_size > buf_size) {
+            free(buf);
+            buf_size = chunk.payload_size;
+            buf = malloc(buf_size);
+            ASSERT(buf != NULL, "out of memory\n");
+        }
+        if (fread(buf, 1, chunk.payload_size, f) != chunk.payload_size) {
+            fprintf(stderr, "%s: truncated chunk at offset %llu\n", sim->path,
+                    (unsigned long long)sim->bytes);
+            goto done;
+        }
+        refs = simulate_chunk(sim, &table, buf, buf + chunk.payload_size);
+        if (refs != (int64_t)chunk.num_refs) {
+            fprintf(stderr, "%s: corrupt chunk at offset %llu\n", sim->path,
+                    (unsigned long long)sim->bytes);
+            goto done;
+        }
+        sim->refs += refs;
+        sim->bytes += sizeof(chunk) + chunk.payload_size;
+    }
+    ok = true;
+ done:
+    free(buf);
+    block_table_free(&table);
+    fclose(f);
+    return ok;
+}
+
+/****************************************************************************
+ * Workers and results
+ */
+
+static sim_t *sims;
+static int num_sims;
+static int next_sim;
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *
+worker_main(void *arg)
+{
+    while (true) {
+        sim_t *sim;
+        int i;
+        pthread_mutex_lock(&next_lock);
+        sim = next_sim < num_sims ? &sims[next_sim++] : NULL;
+        pthread_mutex_unlock(&next_lock);
+        if (sim == NULL)
+            break;
+        for (i = 0; i < num_caches; i++)
+            level_init(&sim->caches[i], &cache_configs[i]);
+        for (i = 0; i < num_tlbs; i++)
+            level_init(&sim->tlbs[i], &tlb_configs[i]);
+        sim->ok = simulate_file(sim);
+        for (i = 0; i < num_caches; i++)
+            level_free(&sim->caches[i]);
+        for (i = 0; i < num_tlbs; i++)
+            level_free(&sim->tlbs[i]);
+    }
+    return NULL;
+}
+
+static void
+print_levels(const level_t *levels, int num)
+{
+    int i;
+    for (i = 0; i < num; i++) {
+        uint64_t accesses = levels[i].hits + levels[i].misses;
+        printf("  %-12s %14llu accesses %14llu misses %7.3f%% miss rate\n",
+               levels[i].config->name, (unsigned long long)accesses,
+               (unsigned long long)levels[i].misses,
+               accesses == 0 ? 0. : 100. * levels[i].misses / accesses);
+    }
+}
+
+static void
+add_levels(level_t *total, const level_t *levels, int num)
+{
+    int i;
+    for (i = 0; i < num; i++) {
+        total[i].config = levels[i].config;
+        total[i].hits += levels[i].hits;
+        total[i].misses += levels[i].misses;
+    }
+}
+
+static double
+seconds_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    int num_threads = 0;
+    pthread_t threads[MAX_THREADS];
+    sim_t total;
+    double start, secs;
+    int i, failed = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            printf("%s", usage_str);
+            return 0;
+        } else if (strcmp(argv[i], "--verbose") == 0 && i + 1 < argc) {
+            verbose = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            ASSERT(num_caches < MAX_LEVELS, "too many cache levels\n");
+            parse_level(argv[++i], false, &cache_configs[num_caches++]);
+        } else if (strcmp(argv[i], "--tlb") == 0 && i + 1 < argc) {
+            ASSERT(num_tlbs < MAX_LEVELS, "too many TLB levels\n");
+            parse_level(argv[++i], true, &tlb_configs[num_tlbs++]);
+        } else {
+            fprintf(stderr, "%s", usage_str);
+            return 1;
+        }
+    }
+    if (i == argc) {
+        fprintf(stderr, "%s", usage_str);
+        return 1;
+    }
+    if (num_caches == 0) {
+        parse_level("L1:32K:8:64", false, &cache_configs[num_caches++]);
+        parse_level("L2:256K:8:64", false, &cache_configs[num_caches++]);
+        parse_level("L3:8M:16:64", false, &cache_configs[num_caches++]);
+    }
+    if (num_tlbs == 0) {
+        parse_level("L1:64:4:4K", true, &tlb_configs[num_tlbs++]);
+        parse_level("L2:1536:12:4K", true, &tlb_configs[num_tlbs++]);
+    }
+
+    num_sims = argc - i;
+    sims = calloc(num_sims, sizeof(*sims));
+    ASSERT(sims != NULL, "out of memory\n");
+    for (; i < argc; i++)
+        sims[num_sims - (argc - i)].path = argv[i];
+    if (num_threads <= 0)
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > num_sims)
+        num_threads = num_sims;
+    if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    start = seconds_now();
+    for (i = 0; i < num_threads; i++) {
+        ASSERT(pthread_create(&threads[i], NULL, worker_main, NULL) == 0,
+               "failed to create worker thread\n");
+    }
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    secs = seconds_now() - start;
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < num_sims; i++) {
+        if (!sims[i].ok) {
+            failed++;
+            continue;
+        }
+        PRINT(2, "%s: %llu references\n", sims[i].path,
+              (unsigned long long)sims[i].refs);
+        if (verbose >= 2) {
+            print_levels(sims[i].caches, num_caches);
+            print_levels(sims[i].tlbs, num_tlbs);
+        }
+        total.refs += sims[i].refs;
+        total.bytes += sims[i].bytes;
+        add_levels(total.caches, sims[i].caches, num_caches);
+        add_levels(total.tlbs, sims[i].tlbs, num_tlbs);
+    }
+    PRINT(1, "Total over %d threads: %llu references\n", num_sims - failed,
+          (unsigned long long)total.refs);
+    if (verbose >= 1 && total.refs > 0) {
+        print_levels(total.caches, num_caches);
+        print_levels(total.tlbs, num_tlbs);
+    }
+    PRINT(1, "Simulated %llu references from %llu bytes (%.2f bytes per "
+          "reference) in %.3f s with %d workers: %.2f M references/s\n",
+          (unsigned long long)total.refs, (unsigned long long)total.bytes,
+          total.refs == 0 ? 0. : (double)total.bytes / total.refs, secs,
+          num_threads, secs == 0 ? 0. : total.refs / secs / 1e6);
+    free(sims);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,808 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drmemtrace: compact memory address tracer.
+ *
+ * Records the address of every application data reference to per-thread
+ * files in the format described in drmemtrace_format.h, for offline
+ * analysis by drcachesim.  Unlike the memtrace sample, which writes a
+ * pc, size, type, and address per reference, the static information about
+ * each reference is written once per block, and the inlined
+ * instrumentation only stores an 8-byte entry per block execution and per
+ * reference into a per-thread buffer:
+ *
+ *   RAW_HEADER_MARK << 32 | block id     at the start of each block
+ *   address                              for each reference
+ *
+ * When the buffer fills, a lean procedure calls flush_buffer(), which
+ * delta-encodes the addresses of each complete block execution and writes
+ * them out in chunks.  The entries of a block execution that has not yet
+ * completed are carried over to the start of the buffer.
+ *
+ * String loops are expanded via drutil_expand_rep_string() so that every
+ * iteration is recorded.  Only the first MAX_BLOCK_REFS references of a
+ * block are recorded.
+ *
+ * The runtime options for this client include:
+ * -logdir <dir>      Sets the output directory, which by default is the
+ *                    directory containing the client library.
+ * -verbose <N>       Prints per-thread and total reference counts and
+ *                    trace sizes for N >= 1.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drutil.h"
+#include "../common/utils.h"
+#include "drmemtrace_format.h"
+#include <string.h>
+#include <stddef.h> /* offsetof */
+
+#define NOTIFY(level, fmt, ...) do {          \
+    if (verbose >= (level))                   \
+        dr_fprintf(STDERR, fmt, __VA_ARGS__); \
+} while (0)
+
+/* XXX: should be moved to DR API headers */
+#define BUFFER_SIZE_BYTES(buf)      sizeof(buf)
+#define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
+#define NULL_TERMINATE_BUFFER(buf)  ((buf)[BUFFER_SIZE_ELEMENTS(buf)-1] = 0)
+
+#define OPTION_MAX_LENGTH MAXIMUM_PATH
+
+/* The raw buffer filled by the inlined instrumentation.  The top half of
+ * a block header entry is non-canonical on x64, and addresses have a zero
+ * top half on x86, so headers can never be mistaken for addresses.
+ */
+#define RAW_BUF_ENTRIES 8192
+#define RAW_BUF_SIZE    (RAW_BUF_ENTRIES * sizeof(uint64))
+#define RAW_HEADER_MARK 0x80000000
+#define RAW_IS_HEADER(entry) ((uint)((entry) >> 32) == RAW_HEADER_MARK)
+
+/* At most this many references of a block are recorded, so that a
+ * carried-over block execution always fits in the raw buffer.
+ */
+#define MAX_BLOCK_REFS 1024
+
+/* The encoded chunk, including its trace_chunk_t */
+#define CHUNK_BUF_SIZE (64*1024)
+
+/* Block information is kept in a two-level table indexed by block id */
+#define BLOCK_PAGE_BITS    12
+#define BLOCK_PAGE_ENTRIES (1U << BLOCK_PAGE_BITS)
+#define BLOCK_TOP_ENTRIES  (TRACE_MAX_BLOCKS / BLOCK_PAGE_ENTRIES)
+#define MAX_BLOCKS         TRACE_MAX_BLOCKS
+
+typedef struct _ref_info_t {
+    app_pc pc;
+    uint size;
+    bool write;
+} ref_info_t;
+
+/* Immutable once the block's id is published */
+typedef struct _block_info_t {
+    uint id;
+    uint num_refs;
+    ref_info_t refs[1]; /* num_refs entries */
+} block_info_t;
+
+#define BLOCK_INFO_SIZE(num_refs) \
+    (offsetof(block_info_t, refs) + (num_refs) * sizeof(ref_info_t))
+
+/* Passed from the analysis to the insertion event */
+typedef struct _instru_t {
+    block_info_t *info;
+    instr_t *first;    /* the first instr with a recorded reference */
+    instr_t *last;     /* the last instr with a recorded reference */
+    uint next_ref;
+} instru_t;
+
+typedef struct _per_thread_t {
+    /* Written by the inlined instrumentation */
+    byte *buf_ptr;
+    byte *buf_base;
+    /* buf_end holds the negative value of real address of buffer end. */
+    ptr_int_t buf_end;
+    file_t file;
+    byte *chunk;
+    size_t chunk_used;
+    uint chunk_refs;
+    /* The last address of each reference of each block, indexed by block
+     * id: a NULL entry means the block is not yet defined in this thread's
+     * file.
+     */
+    uint64 **last_addr[BLOCK_TOP_ENTRIES];
+    /* Block building is not re-entrant, so one instru_t per thread suffices */
+    instru_t instru;
+    /* Used when translating, as the block id is then irrelevant */
+    block_info_t *scratch_info;
+    uint64 num_refs;
+    uint64 bytes_written;
+} per_thread_t;
+
+typedef struct _drmemtrace_option_t {
+    char logdir[MAXIMUM_PATH];
+} drmemtrace_option_t;
+static drmemtrace_option_t options;
+
+static uint verbose;
+static client_id_t client_id;
+static int tls_index;
+static app_pc code_cache;
+
+/* block_table pages and entries are only added, under block_lock, before
+ * any code that refers to them runs, so they can be read without the lock.
+ */
+static void *block_lock;
+static block_info_t **block_table[BLOCK_TOP_ENTRIES];
+static uint num_blocks;
+
+/* Totals, protected by stats_lock */
+static void *stats_lock;
+static uint64 total_refs;
+static uint64 total_bytes;
+static uint64 refs_not_recorded;
+
+static block_info_t *
+block_lookup(uint id)
+{
+    block_info_t **page = block_table[id >> BLOCK_PAGE_BITS];
+    if (page == NULL)
+        return NULL;
+    return page[id & (BLOCK_PAGE_ENTRIES - 1)];
+}
+
+/* Assigns info an id and publishes it.  Returns false if out of ids. */
+static bool
+block_register(block_info_t *info)
+{
+    block_info_t **page;
+    bool res = false;
+    dr_mutex_lock(block_lock);
+    if (num_blocks < MAX_BLOCKS) {
+        info->id = num_blocks;
+        page = block_table[info->id >> BLOCK_PAGE_BITS];
+        if (page == NULL) {
+            page = dr_global_alloc(BLOCK_PAGE_ENTRIES * sizeof(*page));
+            memset(page, 0, BLOCK_PAGE_ENTRIES * sizeof(*page));
+            block_table[info->id >> BLOCK_PAGE_BITS] = page;
+        }
+        page[info->id & (BLOCK_PAGE_ENTRIES - 1)] = info;
+        num_blocks++;
+        res = true;
+    }
+    dr_mutex_unlock(block_lock);
+    return res;
+}
+
+static void
+block_table_free(void)
+{
+    uint i, j;
+    for (i = 0; i < BLOCK_TOP_ENTRIES; i++) {
+        if (block_table[i] == NULL)
+            continue;
+        for (j = 0; j < BLOCK_PAGE_ENTRIES; j++) {
+            block_info_t *info = block_table[i][j];
+            if (info != NULL)
+                dr_global_free(info, BLOCK_INFO_SIZE(info->num_refs));
+        }
+        dr_global_free(block_table[i], BLOCK_PAGE_ENTRIES * sizeof(block_info_t *));
+        block_table[i] = NULL;
+    }
+}
+
+/***************************************************************************
+ * Encoding
+ */
+
+static void
+chunk_write(per_thread_t *data)
+{
+    trace_chunk_t *header = (trace_chunk_t *) data->chunk;
+    if (data->chunk_used == sizeof(*header))
+        return;
+    if (data->file == INVALID_FILE) {
+        data->chunk_used = sizeof(*header);
+        data->chunk_refs = 0;
+        return;
+    }
+    header->payload_size = (uint32_t)(data->chunk_used - sizeof(*header));
+    header->num_refs = data->chunk_refs;
+    if (dr_write_file(data->file, data->chunk, data->chunk_used) !=
+        (ssize_t)data->chunk_used)
+        NOTIFY(0, "%s\n", "drmemtrace: failed to write trace");
+    data->bytes_written += data->chunk_used;
+    data->num_refs += data->chunk_refs;
+    data->chunk_used = sizeof(*header);
+    data->chunk_refs = 0;
+}
+
+/* Returns where to encode a record of at most size bytes */
+static byte *
+chunk_reserve(per_thread_t *data, size_t size)
+{
+    ASSERT(size <= CHUNK_BUF_SIZE - sizeof(trace_chunk_t), "record too large");
+    if (data->chunk_used + size > CHUNK_BUF_SIZE)
+        chunk_write(data);
+    return data->chunk + data->chunk_used;
+}
+
+/* Returns the thread's last addresses for the block, defining the block
+ * in the thread's file if this is its first execution there.
+ */
+static uint64 *
+block_last_addr(void *drcontext, per_thread_t *data, block_info_t *info)
+{
+    uint64 **page = data->last_addr[info->id >> BLOCK_PAGE_BITS];
+    uint64 *last;
+    byte *start, *p;
+    app_pc prev_pc = NULL;
+    uint i;
+    if (page == NULL) {
+        page = dr_thread_alloc(drcontext, BLOCK_PAGE_ENTRIES * sizeof(*page));
+        memset(page, 0, BLOCK_PAGE_ENTRIES * sizeof(*page));
+        data->last_addr[info->id >> BLOCK_PAGE_BITS] = page;
+    }
+    last = page[info->id & (BLOCK_PAGE_ENTRIES - 1)];
+    if (last != NULL)
+        return last;
+    last = dr_thread_alloc(drcontext, info->num_refs * sizeof(*last));
+    memset(last, 0, info->num_refs * sizeof(*last));
+    page[info->id & (BLOCK_PAGE_ENTRIES - 1)] = last;
+
+    start = chunk_reserve(data, TRACE_VAR_MAX_BYTES * (2 + 2 * info->num_refs));
+    p = trace_put_uvar(start, (uint64)info->id << TRACE_RECORD_TYPE_BITS |
+                       TRACE_RECORD_BLOCK_DEF);
+    p = trace_put_uvar(p, info->num_refs);
+    for (i = 0; i < info->num_refs; i++) {
+        p = trace_put_svar(p, (int64)(info->refs[i].pc - prev_pc));
+        p = trace_put_uvar(p, info->refs[i].size << 1 | (info->refs[i].write ? 1 : 0));
+        prev_pc = info->refs[i].pc;
+    }
+    data->chunk_used += p - start;
+    return last;
+}
+
+/* Encodes an execution of the block that recorded count addresses */
+static void
+encode_block(void *drcontext, per_thread_t *data, block_info_t *info,
+             uint64 *addrs, uint count)
+{
+    uint64 *last = block_last_addr(drcontext, data, info);
+    byte *start = chunk_reserve(data, TRACE_VAR_MAX_BYTES * (2 + count));
+    byte *p;
+    uint i;
+    if (count == info->num_refs) {
+        p = trace_put_uvar(start, (uint64)info->id << TRACE_RECORD_TYPE_BITS |
+                           TRACE_RECORD_BLOCK);
+    } else {
+        p = trace_put_uvar(start, (uint64)info->id << TRACE_RECORD_TYPE_BITS |
+                           TRACE_RECORD_BLOCK_PARTIAL);
+        p = trace_put_uvar(p, count);
+    }
+    for (i = 0; i < count; i++) {
+        p = trace_put_svar(p, (int64)(addrs[i] - last[i]));
+        last[i] = addrs[i];
+    }
+    data->chunk_used += p - start;
+    data->chunk_refs += count;
+}
+
+/* Encodes the complete block executions in the raw buffer, or all of them
+ * at thread exit, and carries over the rest.
+ */
+static void
+flush_buffer(void *drcontext, per_thread_t *data, bool thread_exit)
+{
+    uint64 *entries = (uint64 *) data->buf_base;
+    uint num = (uint)((uint64 *)data->buf_ptr - entries);
+    uint i = 0, j, count, carry;
+    block_info_t *info;
+
+    while (i < num) {
+        ASSERT(RAW_IS_HEADER(entries[i]), "raw buffer out of sync");
+        info = block_lookup((uint)entries[i]);
+        ASSERT(info != NULL, "unknown block id");
+        for (j = i + 1; j < num && j - (i + 1) < info->num_refs &&
+                 !RAW_IS_HEADER(entries[j]); j++)
+            ; /* nothing */
+        count = j - (i + 1);
+        if (count < info->num_refs && j == num && !thread_exit)
+            break; /* the block may still be executing */
+        encode_block(drcontext, data, info, &entries[i + 1], count);
+        i = j;
+    }
+    carry = num - i;
+    memmove(entries, &entries[i], carry * sizeof(uint64));
+#ifndef X64
+    /* the instrumentation only writes the bottom half of addresses */
+    memset(&entries[carry], 0, (num - carry) * sizeof(uint64));
+#endif
+    data->buf_ptr = (byte *)&entries[carry];
+}
+
+/* clean_call flushes the raw buffer when it is full */
+static void
+clean_call(void)
+{
+    void *drcontext = dr_get_current_drcontext();
+    flush_buffer(drcontext, drmgr_get_tls_field(drcontext, tls_index), false);
+}
+
+/***************************************************************************
+ * Instrumentation
+ */
+
+static void
+code_cache_init(void)
+{
+    void         *drcontext;
+    instrlist_t  *ilist;
+    instr_t      *where;
+    byte         *end;
+
+    drcontext  = dr_get_current_drcontext();
+    code_cache = dr_nonheap_alloc(PAGE_SIZE,
+                                  DR_MEMPROT_READ  |
+                                  DR_MEMPROT_WRITE |
+                                  DR_MEMPROT_EXEC);
+    ilist = instrlist_create(drcontext);
+    /* The lean procedure simply performs a clean call, and then jumps back
+     * to the return address in xcx.
+     */
+    where = INSTR_CREATE_jmp_ind(drcontext, opnd_create_reg(DR_REG_XCX));
+    instrlist_meta_append(ilist, where);
+    dr_insert_clean_call(drcontext, ilist, where, (void *)clean_call, false, 0);
+    end = instrlist_encode(drcontext, ilist, code_cache, false);
+    DR_ASSERT((end - code_cache) < PAGE_SIZE);
+    instrlist_clear_and_destroy(drcontext, ilist);
+    dr_memory_protect(code_cache, PAGE_SIZE, DR_MEMPROT_READ | DR_MEMPROT_EXEC);
+}
+
+static void
+code_cache_exit(void)
+{
+    dr_nonheap_free(code_cache, PAGE_SIZE);
+}
+
+/* Loads data->buf_ptr into reg2 */
+static void
+insert_load_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
+                    reg_id_t reg2)
+{
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg2);
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_ld
+                             (drcontext, opnd_create_reg(reg2),
+                              OPND_CREATE_MEMPTR(reg2, offsetof(per_thread_t,
+                                                                buf_ptr))));
+}
+
+/* Once the entry at reg2 is written, advances data->buf_ptr past it,
+ * jumps to the lean procedure if the buffer is full, and restores reg1
+ * and reg2.  As in the memtrace sample, lea and jecxz are used to avoid
+ * touching the arithmetic flags.
+ */
+static void
+insert_advance_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       reg_id_t reg1, reg_id_t reg2)
+{
+    instr_t *call = INSTR_CREATE_label(drcontext);
+    instr_t *restore = INSTR_CREATE_label(drcontext);
+
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_lea
+                             (drcontext, opnd_create_reg(reg2),
+                              opnd_create_base_disp(reg2, DR_REG_NULL, 0,
+                                                    sizeof(uint64), OPSZ_lea)));
+    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, reg1);
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_st
+                             (drcontext,
+                              OPND_CREATE_MEMPTR(reg1, offsetof(per_thread_t,
+                                                                buf_ptr)),
+                              opnd_create_reg(reg2)));
+    /* lea [reg2 - buf_end] => reg2 */
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_ld
+                             (drcontext, opnd_create_reg(reg1),
+                              OPND_CREATE_MEMPTR(reg1, offsetof(per_thread_t,
+                                                                buf_end))));
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_lea
+                             (drcontext, opnd_create_reg(reg2),
+                              opnd_create_base_disp(reg1, reg2, 1, 0, OPSZ_lea)));
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_jecxz
+                             (drcontext, opnd_create_instr(call)));
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_jmp
+                             (drcontext, opnd_create_instr(restore)));
+    instrlist_meta_preinsert(ilist, where, call);
+    /* the return address for the lean procedure */
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_imm
+                             (drcontext, opnd_create_reg(reg2),
+                              opnd_create_instr(restore)));
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_jmp
+                             (drcontext, opnd_create_pc(code_cache)));
+    instrlist_meta_preinsert(ilist, where, restore);
+    dr_restore_reg(drcontext, ilist, where, reg1, SPILL_SLOT_2);
+    dr_restore_reg(drcontext, ilist, where, reg2, SPILL_SLOT_3);
+}
+
+static void
+insert_block_header(void *drcontext, instrlist_t *ilist, instr_t *where, uint id)
+{
+    reg_id_t reg1 = DR_REG_XBX;
+    reg_id_t reg2 = DR_REG_XCX; /* reg2 must be ECX or RCX for jecxz */
+    dr_save_reg(drcontext, ilist, where, reg1, SPILL_SLOT_2);
+    dr_save_reg(drcontext, ilist, where, reg2, SPILL_SLOT_3);
+    insert_load_buf_ptr(drcontext, ilist, where, reg2);
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_imm
+                             (drcontext, OPND_CREATE_MEM32(reg2, 0),
+                              OPND_CREATE_INT32(id)));
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_imm
+                             (drcontext, OPND_CREATE_MEM32(reg2, 4),
+                              OPND_CREATE_INT32((int)RAW_HEADER_MARK)));
+    insert_advance_buf_ptr(drcontext, ilist, where, reg1, reg2);
+}
+
+static void
+insert_ref(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t ref)
+{
+    reg_id_t reg1 = DR_REG_XBX;
+    reg_id_t reg2 = DR_REG_XCX; /* reg2 must be ECX or RCX for jecxz */
+    dr_save_reg(drcontext, ilist, where, reg1, SPILL_SLOT_2);
+    dr_save_reg(drcontext, ilist, where, reg2, SPILL_SLOT_3);
+    drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg1, reg2);
+    insert_load_buf_ptr(drcontext, ilist, where, reg2);
+    /* on x86 the top half is left zero */
+    instrlist_meta_preinsert(ilist, where, INSTR_CREATE_mov_st
+                             (drcontext, OPND_CREATE_MEMPTR(reg2, 0),
+                              opnd_create_reg(reg1)));
+    insert_advance_buf_ptr(drcontext, ilist, where, reg1, reg2);
+}
+
+/* Calls func(instr, ref, write, user) for each reference instr makes that
+ * we record, in the order we record them, stopping when it returns false.
+ */
+static bool
+instr_for_each_ref(instr_t *instr, bool (*func)(instr_t *, opnd_t, bool, void *),
+                   void *user)
+{
+    int i;
+    if (instr_get_app_pc(instr) == NULL)
+        return true;
+    if (instr_reads_memory(instr)) {
+        for (i = 0; i < instr_num_srcs(instr); i++) {
+            if (opnd_is_memory_reference(instr_get_src(instr, i)) &&
+                !func(instr, instr_get_src(instr, i), false, user))
+                return false;
+        }
+    }
+    if (instr_writes_memory(instr)) {
+        for (i = 0; i < instr_num_dsts(instr); i++) {
+            if (opnd_is_memory_reference(instr_get_dst(instr, i)) &&
+                !func(instr, instr_get_dst(instr, i), true, user))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool
+count_ref(instr_t *instr, opnd_t ref, bool write, void *user)
+{
+    instru_t *instru = (instru_t *) user;
+    if (instru->next_ref == MAX_BLOCK_REFS)
+        return false;
+    if (instru->first == NULL)
+        instru->first = instr;
+    instru->last = instr;
+    instru->next_ref++;
+    return true;
+}
+
+static bool
+describe_ref(instr_t *instr, opnd_t ref, bool write, void *user)
+{
+    block_info_t *info = (block_info_t *) user;
+    if (info->num_refs == MAX_BLOCK_REFS)
+        return false;
+    info->refs[info->num_refs].pc = instr_get_app_pc(instr);
+    /* drutil_opnd_mem_size_in_bytes handles OP_enter */
+    info->refs[info->num_refs].size = drutil_opnd_mem_size_in_bytes(ref, instr);
+    info->refs[info->num_refs].write = write;
+    info->num_refs++;
+    return true;
+}
+
+/* Transform string loops into regular loops so we can monitor every
+ * memory reference they make.  Each iteration is a separate execution of
+ * the block.
+ */
+static dr_emit_flags_t
+event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating)
+{
+    if (!drutil_expand_rep_string(drcontext, bb)) {
+        DR_ASSERT(false);
+        /* in release build, carry on: we'll just miss per-iter refs */
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating, OUT void **user_data)
+{
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_index);
+    instru_t *instru = &data->instru;
+    block_info_t *info;
+    instr_t *instr;
+    uint num_refs;
+
+    *user_data = NULL;
+    memset(instru, 0, sizeof(*instru));
+    for (instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr)) {
+        if (!instr_for_each_ref(instr, count_ref, instru))
+            break;
+    }
+    if (instru->next_ref == 0)
+        return DR_EMIT_DEFAULT;
+    num_refs = instru->next_ref;
+    instru->next_ref = 0;
+
+    if (translating)
+        info = data->scratch_info;
+    else
+        info = dr_global_alloc(BLOCK_INFO_SIZE(num_refs));
+    info->num_refs = 0;
+    for (instr = instru->first; instr != instr_get_next(instru->last);
+         instr = instr_get_next(instr))
+        instr_for_each_ref(instr, describe_ref, info);
+    ASSERT(info->num_refs == num_refs, "inconsistent reference count");
+    if (translating)
+        info->id = 0;
+    else if (!block_register(info)) {
+        dr_global_free(info, BLOCK_INFO_SIZE(num_refs));
+        dr_mutex_lock(stats_lock);
+        refs_not_recorded += num_refs;
+        dr_mutex_unlock(stats_lock);
+        return DR_EMIT_DEFAULT;
+    }
+    instru->info = info;
+    *user_data = instru;
+    return DR_EMIT_DEFAULT;
+}
+
+static bool
+insert_ref_cb(instr_t *instr, opnd_t ref, bool write, void *user)
+{
+    void **args = (void **) user;
+    instru_t *instru = (instru_t *) args[1];
+    if (instru->next_ref == instru->info->num_refs)
+        return false;
+    insert_ref(args[0], (instrlist_t *) args[2], instr, ref);
+    instru->next_ref++;
+    return true;
+}
+
+static dr_emit_flags_t
+event_bb_insert(void *drcontext, void *tag, instrlist_t *bb,
+                instr_t *instr, bool for_trace, bool translating,
+                void *user_data)
+{
+    instru_t *instru = (instru_t *) user_data;
+    void *args[3];
+    if (instru == NULL || instru->next_ref == instru->info->num_refs)
+        return DR_EMIT_DEFAULT;
+    if (instr == instru->first)
+        insert_block_header(drcontext, bb, instr, instru->info->id);
+    args[0] = drcontext;
+    args[1] = instru;
+    args[2] = bb;
+    instr_for_each_ref(instr, insert_ref_cb, args);
+    ASSERT(instr != instru->last || instru->next_ref == instru->info->num_refs,
+           "missed a reference");
+    return DR_EMIT_DEFAULT;
+}
+
+/***************************************************************************
+ * Threads and initialization
+ */
+
+static file_t
+trace_file_create(void *drcontext)
+{
+    char path[MAXIMUM_PATH];
+    char *dirsep;
+    const char *app_name = dr_get_application_name();
+    size_t len;
+    file_t f;
+    trace_header_t header;
+
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s",
+                options.logdir[0] != '\0' ?
+                options.logdir : dr_get_client_path(client_id));
+    NULL_TERMINATE_BUFFER(path);
+    len = strlen(path);
+    if (options.logdir[0] == '\0') {
+        /* remove the client library name */
+        dirsep = strrchr(path, '/');
+        if (dirsep != NULL)
+            *dirsep = '\0';
+        len = strlen(path);
+    }
+    dr_snprintf(path + len, BUFFER_SIZE_ELEMENTS(path) - len,
+                "/drmemtrace.%s.%05d.%05d.trace",
+                app_name == NULL ? "unknown" : app_name, dr_get_process_id(),
+                dr_get_thread_id(drcontext));
+    NULL_TERMINATE_BUFFER(path);
+    NOTIFY(1, "<writing trace to %s>\n", path);
+    f = dr_open_file(path, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+    if (f == INVALID_FILE) {
+        NOTIFY(0, "drmemtrace: unable to create %s\n", path);
+        return f;
+    }
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.pointer_size = sizeof(void *);
+    dr_write_file(f, &header, sizeof(header));
+    return f;
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    drmgr_set_tls_field(drcontext, tls_index, data);
+    data->buf_base = dr_thread_alloc(drcontext, RAW_BUF_SIZE);
+    memset(data->buf_base, 0, RAW_BUF_SIZE);
+    data->buf_ptr  = data->buf_base;
+    /* set buf_end to be negative of address of buffer end for the lea later */
+    data->buf_end  = -(ptr_int_t)(data->buf_base + RAW_BUF_SIZE);
+    data->chunk = dr_thread_alloc(drcontext, CHUNK_BUF_SIZE);
+    data->scratch_info = dr_thread_alloc(drcontext, BLOCK_INFO_SIZE(MAX_BLOCK_REFS));
+    data->chunk_used = sizeof(trace_chunk_t);
+    data->file = trace_file_create(drcontext);
+    data->bytes_written = sizeof(trace_header_t);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_index);
+    uint i, j;
+    flush_buffer(drcontext, data, true);
+    chunk_write(data);
+    NOTIFY(1, "drmemtrace: thread %d recorded "UINT64_FORMAT_STRING
+           " references in "UINT64_FORMAT_STRING" bytes\n",
+           dr_get_thread_id(drcontext), data->num_refs, data->bytes_written);
+    dr_mutex_lock(stats_lock);
+    total_refs += data->num_refs;
+    total_bytes += data->bytes_written;
+    dr_mutex_unlock(stats_lock);
+    if (data->file != INVALID_FILE)
+        dr_close_file(data->file);
+
+    for (i = 0; i < BLOCK_TOP_ENTRIES; i++) {
+        if (data->last_addr[i] == NULL)
+            continue;
+        for (j = 0; j < BLOCK_PAGE_ENTRIES; j++) {
+            if (data->last_addr[i][j] != NULL) {
+                block_info_t *info = block_lookup(i << BLOCK_PAGE_BITS | j);
+                dr_thread_free(drcontext, data->last_addr[i][j],
+                               info->num_refs * sizeof(uint64));
+            }
+        }
+        dr_thread_free(drcontext, data->last_addr[i],
+                       BLOCK_PAGE_ENTRIES * sizeof(uint64 *));
+    }
+    dr_thread_free(drcontext, data->scratch_info, BLOCK_INFO_SIZE(MAX_BLOCK_REFS));
+    dr_thread_free(drcontext, data->chunk, CHUNK_BUF_SIZE);
+    dr_thread_free(drcontext, data->buf_base, RAW_BUF_SIZE);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+static void
+event_exit(void)
+{
+    if (total_refs > 0) {
+        NOTIFY(1, "drmemtrace: recorded "UINT64_FORMAT_STRING" references in "
+               UINT64_FORMAT_STRING" bytes (%u.%02u bytes per reference)\n",
+               total_refs, total_bytes, (uint)(total_bytes / total_refs),
+               (uint)((total_bytes * 100 / total_refs) % 100));
+    }
+    if (refs_not_recorded > 0) {
+        NOTIFY(1, "drmemtrace: out of block ids: "UINT64_FORMAT_STRING
+               " static references not recorded\n", refs_not_recorded);
+    }
+    code_cache_exit();
+    block_table_free();
+    drmgr_unregister_tls_field(tls_index);
+    dr_mutex_destroy(block_lock);
+    dr_mutex_destroy(stats_lock);
+    drutil_exit();
+    drmgr_exit();
+}
+
+static void
+options_init(client_id_t id)
+{
+    const char *opstr = dr_get_options(id);
+    const char *s;
+    char token[OPTION_MAX_LENGTH];
+
+    for (s = dr_get_token(opstr, token, BUFFER_SIZE_ELEMENTS(token));
+         s != NULL;
+         s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token))) {
+        if (strcmp(token, "-logdir") == 0) {
+            s = dr_get_token(s, options.logdir,
+                             BUFFER_SIZE_ELEMENTS(options.logdir));
+            USAGE_CHECK(s != NULL, "missing logdir path");
+        }
+        else if (strcmp(token, "-verbose") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -verbose number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &verbose);
+                USAGE_CHECK(res == 1, "invalid -verbose number");
+            }
+        }
+        else {
+            NOTIFY(0, "UNRECOGNIZED OPTION: \"%s\"\n", token);
+            USAGE_CHECK(false, "invalid option");
+        }
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    drmgr_priority_t priority = {sizeof(priority), "drmemtrace", NULL, NULL, 0};
+    client_id = id;
+    options_init(id);
+    drmgr_init();
+    drutil_init();
+    block_lock = dr_mutex_create();
+    stats_lock = dr_mutex_create();
+    dr_register_exit_event(event_exit);
+    if (!drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit) ||
+        !drmgr_register_bb_app2app_event(event_bb_app2app, &priority) ||
+        !drmgr_register_bb_instrumentation_event(event_bb_analysis,
+                                                 event_bb_insert,
+                                                 &priority)) {
+        /* something is wrong: can't continue */
+        DR_ASSERT(false);
+        return;
+    }
+    tls_index = drmgr_register_tls_field();
+    DR_ASSERT(tls_index != -1);
+    code_cache_init();
+}
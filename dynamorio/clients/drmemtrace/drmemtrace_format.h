@@ -0,0 +1,156 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Compact memory trace format written by drmemtrace and read by drcachesim.
+ *
+ * Each application thread writes its own file, so the threads of a trace
+ * can be decoded independently.  A file is a trace_header_t followed by a
+ * sequence of chunks, each a trace_chunk_t followed by payload_size bytes
+ * of records.  Records never span chunks.
+ *
+ * Every record starts with an unsigned varint holding (block_id << 2 |
+ * record type).  Block ids identify one instrumented copy of an
+ * application basic block.  The first time a thread executes a block, a
+ * TRACE_RECORD_BLOCK_DEF gives the block's memory references once:
+ *   num_refs                          uvar
+ *   per reference:
+ *     pc - previous reference's pc    svar (the first is relative to 0)
+ *     size << 1 | is_write            uvar
+ * Each execution of the block is then a TRACE_RECORD_BLOCK holding one
+ * address per reference, or, if the block was exited before all of its
+ * references executed (e.g., by a fault), a TRACE_RECORD_BLOCK_PARTIAL
+ * holding an extra uvar count of the addresses that follow.  Each address
+ * is an svar delta from the address accessed by the same reference the
+ * previous time its block executed in this thread (or from 0), so loops
+ * over arrays and repeated stack accesses take a byte per reference.
+ *
+ * A uvar is a little-endian base-128 varint.  An svar is a zigzag-encoded
+ * signed value stored as a uvar.  All other integers are in host byte
+ * order.
+ */
+
+#ifndef _DRMEMTRACE_FORMAT_H_
+#define _DRMEMTRACE_FORMAT_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _MSC_VER
+# define TRACE_INLINE __inline
+#else
+# define TRACE_INLINE inline
+#endif
+
+#define TRACE_MAGIC   "DRMEMTRC"
+#define TRACE_VERSION 1
+
+typedef struct _trace_header_t {
+    char magic[8];          /* TRACE_MAGIC, not null-terminated */
+    uint32_t version;       /* TRACE_VERSION */
+    uint32_t pointer_size;  /* of the traced application */
+} trace_header_t;
+
+typedef struct _trace_chunk_t {
+    uint32_t payload_size;  /* bytes of records following this header */
+    uint32_t num_refs;      /* memory references encoded in the payload */
+} trace_chunk_t;
+
+typedef enum {
+    TRACE_RECORD_BLOCK_DEF,
+    TRACE_RECORD_BLOCK,
+    TRACE_RECORD_BLOCK_PARTIAL,
+} trace_record_type_t;
+
+#define TRACE_RECORD_TYPE_BITS 2
+#define TRACE_RECORD_TYPE_MASK ((1U << TRACE_RECORD_TYPE_BITS) - 1)
+
+/* Block ids are below this */
+#define TRACE_MAX_BLOCKS (1U << 24)
+
+/* The most bytes a uvar or svar can take */
+#define TRACE_VAR_MAX_BYTES 10
+
+static TRACE_INLINE uint8_t *
+trace_put_uvar(uint8_t *p, uint64_t val)
+{
+    while (val >= 0x80) {
+        *p++ = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    *p++ = (uint8_t)val;
+    return p;
+}
+
+static TRACE_INLINE uint8_t *
+trace_put_svar(uint8_t *p, int64_t val)
+{
+    return trace_put_uvar(p, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+/* Returns the position after the varint, or NULL if it does not end
+ * before end.
+ */
+static TRACE_INLINE const uint8_t *
+trace_get_uvar(const uint8_t *p, const uint8_t *end, uint64_t *val)
+{
+    uint64_t res = 0;
+    unsigned int shift;
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        res |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *val = res;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static TRACE_INLINE const uint8_t *
+trace_get_svar(const uint8_t *p, const uint8_t *end, int64_t *val)
+{
+    uint64_t uval;
+    p = trace_get_uvar(p, end, &uval);
+    if (p != NULL)
+        *val = (int64_t)(uval >> 1) ^ -(int64_t)(uval & 1);
+    return p;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRMEMTRACE_FORMAT_H_ */
@@ -0,0 +1,57 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Check script for tool.drmemtrace, included by runcheck.cmake after a run
+# that traced common.rep-string.  Every thread's trace must then parse in
+# drcachesim, whose path is passed in as drcachesim.
+
+file(GLOB traces "${tmpdir}/drmemtrace.*.trace")
+list(LENGTH traces num_traces)
+if (num_traces EQUAL 0)
+  message(FATAL_ERROR "no traces written under ${tmpdir}")
+endif ()
+
+execute_process(COMMAND ${drcachesim} --verbose 2 ${traces}
+  RESULT_VARIABLE sim_result
+  OUTPUT_VARIABLE sim_output ERROR_VARIABLE sim_output)
+if (sim_result)
+  message(FATAL_ERROR "drcachesim failed to parse the traces: ${sim_output}")
+endif ()
+if (NOT "${sim_output}" MATCHES "Total over ([0-9]+) threads: ([0-9]+) references")
+  message(FATAL_ERROR "no totals from drcachesim: ${sim_output}")
+endif ()
+if (NOT CMAKE_MATCH_1 EQUAL num_traces)
+  message(FATAL_ERROR "drcachesim read ${CMAKE_MATCH_1} of ${num_traces} traces")
+endif ()
+# The app copies 98304 bytes, so even with 64-byte vector loads it must read
+# at least 1536 times.
+if (CMAKE_MATCH_2 LESS 1536)
+  message(FATAL_ERROR "only ${CMAKE_MATCH_2} references traced")
+endif ()
@@ -0,0 +1,450 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drpersist: ahead-of-time persisted cache generator.
+ *
+ * Persisted caches normally only exist after an application has run long
+ * enough to build its coarse-grain units, so every fresh machine or
+ * container starts cold.  This client fills the units of the modules it
+ * sees from statically discovered block starts instead, so that a run with
+ * -persist writes out a cache that later runs load as is.
+ *
+ * Block starts are discovered from each module's entry point and the
+ * symbols (via drsyms) that lie in its executable sections, by recursive
+ * descent over direct branches:
+ * conditional branch targets and fallthroughs, jump targets, and call
+ * targets and return points.  Descent stops at returns and indirect
+ * branches.  The blocks are then built by DR's regular bb builder through
+ * dr_prepopulate_cache() just before the process exits, at which point
+ * all module segments are mapped, and -coarse_freeze_at_exit persists them.
+ *
+ * It is meant to be run on the drpersist_gen launcher, which just loads
+ * the modules named on its command line:
+ *
+ *   drrun -persist -persist_dir <dir> -c libdrpersist.so [options] --
+ *     drpersist_gen <module> ...
+ *
+ * The runtime options for this client include:
+ * -only <substring>  Only generate for modules whose path contains the
+ *                    substring.  May be repeated.  By default all modules
+ *                    in the process are covered.
+ * -no_symbols        Do not use symbols as descent roots.
+ * -verbose <N>       Prints per-module statistics for N >= 1.
+ */
+
+#include "dr_api.h"
+#include "drsyms.h"
+#include "hashtable.h"
+#include "drvector.h"
+#include "../common/utils.h"
+#include <string.h>
+#include <elf.h>
+#include <sys/syscall.h>
+
+#define NOTIFY(level, fmt, ...) do {          \
+    if (verbose >= (level))                   \
+        dr_fprintf(STDERR, fmt, __VA_ARGS__); \
+} while (0)
+
+/* XXX: should be moved to DR API headers */
+#define BUFFER_SIZE_BYTES(buf)      sizeof(buf)
+#define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
+
+#define OPTION_MAX_LENGTH MAXIMUM_PATH
+#define MAX_ONLY_FILTERS 16
+/* an upper bound on the length of one x86 instruction */
+#define MAX_INSTR_BYTES 16
+#define MAX_CODE_SECTIONS 32
+
+#ifdef X64
+# define Elf_Ehdr Elf64_Ehdr
+# define Elf_Phdr Elf64_Phdr
+# define Elf_Shdr Elf64_Shdr
+#else
+# define Elf_Ehdr Elf32_Ehdr
+# define Elf_Phdr Elf32_Phdr
+# define Elf_Shdr Elf32_Shdr
+#endif
+
+typedef struct _drpersist_option_t {
+    char only[MAX_ONLY_FILTERS][OPTION_MAX_LENGTH];
+    uint num_only;
+    bool no_symbols;
+} drpersist_option_t;
+static drpersist_option_t options;
+
+static uint verbose;
+
+/* module_data_t copies of the modules to generate for */
+static drvector_t modules;
+
+/* An executable section, as offsets from the module base */
+typedef struct _code_section_t {
+    size_t start;
+    size_t end;
+} code_section_t;
+
+/* Per-module discovery state */
+typedef struct _discover_t {
+    module_data_t *mod;
+    code_section_t sections[MAX_CODE_SECTIONS];
+    uint num_sections;
+    hashtable_t visited;
+    drvector_t worklist;
+    drvector_t *tags;
+    /* the executable region containing the last queried pc */
+    app_pc region_start;
+    app_pc region_end;
+} discover_t;
+
+/****************************************************************************
+ * Block discovery
+ */
+
+/* Returns whether pc lies in readable and executable memory within the
+ * module, caching the containing region in the discovery state.
+ */
+static bool
+is_code(discover_t *disc, app_pc pc)
+{
+    byte *base;
+    size_t size;
+    uint prot;
+    if (pc < disc->mod->start || pc >= disc->mod->end)
+        return false;
+    if (pc >= disc->region_start && pc < disc->region_end)
+        return true;
+    if (!dr_query_memory(pc, &base, &size, &prot) ||
+        (prot & (DR_MEMPROT_READ | DR_MEMPROT_EXEC)) !=
+        (DR_MEMPROT_READ | DR_MEMPROT_EXEC))
+        return false;
+    disc->region_start = base;
+    disc->region_end = base + size;
+    return true;
+}
+
+static void
+add_root(discover_t *disc, app_pc pc)
+{
+    if (!is_code(disc, pc) || hashtable_lookup(&disc->visited, pc) != NULL)
+        return;
+    hashtable_add(&disc->visited, pc, (void *)pc);
+    drvector_append(&disc->worklist, pc);
+}
+
+/* Decodes one block starting at tag, queueing its direct successors. */
+static void
+walk_block(void *drcontext, discover_t *disc, app_pc tag)
+{
+    instr_t instr;
+    app_pc pc = tag, next_pc;
+    instr_init(drcontext, &instr);
+    while (true) {
+        /* avoid decoding off the end of the mapped region */
+        if (!is_code(disc, pc) || pc + MAX_INSTR_BYTES > disc->region_end)
+            break;
+        instr_reset(drcontext, &instr);
+        next_pc = decode(drcontext, pc, &instr);
+        if (next_pc == NULL || !instr_valid(&instr))
+            break;
+        if (instr_is_cti(&instr)) {
+            if (instr_is_cbr(&instr)) {
+                add_root(disc, opnd_get_pc(instr_get_target(&instr)));
+                add_root(disc, next_pc);
+            } else if (instr_is_ubr(&instr)) {
+                add_root(disc, opnd_get_pc(instr_get_target(&instr)));
+            } else if (instr_is_call_direct(&instr)) {
+                add_root(disc, opnd_get_pc(instr_get_target(&instr)));
+                add_root(disc, next_pc);
+            }
+            /* returns and indirect branches end the descent */
+            break;
+        }
+        pc = next_pc;
+    }
+    instr_free(drcontext, &instr);
+}
+
+/* Records the module's executable sections from the section headers of its
+ * file.  Data often shares an executable segment with code (e.g., .rodata
+ * right after .text), so the page protections alone cannot tell us which
+ * symbols are safe to decode from.  Returns false if the section headers
+ * cannot be read.
+ */
+static bool
+find_code_sections(discover_t *disc)
+{
+    file_t f;
+    uint64 file_size;
+    size_t map_size;
+    byte *map = NULL;
+    Elf_Ehdr *ehdr;
+    Elf_Phdr *phdr;
+    Elf_Shdr *shdr;
+    ptr_uint_t load_base = 0;
+    bool found_load = false;
+    uint i;
+
+    f = dr_open_file(disc->mod->full_path, DR_FILE_READ);
+    if (f == INVALID_FILE)
+        return false;
+    if (dr_file_size(f, &file_size) && file_size >= sizeof(*ehdr)) {
+        map_size = (size_t) file_size;
+        map = dr_map_file(f, &map_size, 0, NULL, DR_MEMPROT_READ, DR_MAP_PRIVATE);
+    }
+    dr_close_file(f);
+    if (map == NULL)
+        return false;
+
+    ehdr = (Elf_Ehdr *) map;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_phentsize != sizeof(*phdr) || ehdr->e_shentsize != sizeof(*shdr) ||
+        ehdr->e_phoff + ehdr->e_phnum * sizeof(*phdr) > map_size ||
+        ehdr->e_shoff + ehdr->e_shnum * sizeof(*shdr) > map_size) {
+        dr_unmap_file(map, map_size);
+        return false;
+    }
+    /* symbol offsets from drsyms are relative to the lowest segment address */
+    phdr = (Elf_Phdr *) (map + ehdr->e_phoff);
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD &&
+            (!found_load || phdr[i].p_vaddr < load_base)) {
+            load_base = phdr[i].p_vaddr;
+            found_load = true;
+        }
+    }
+    shdr = (Elf_Shdr *) (map + ehdr->e_shoff);
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        if (shdr[i].sh_type == SHT_NOBITS ||
+            (shdr[i].sh_flags & (SHF_ALLOC | SHF_EXECINSTR)) !=
+            (SHF_ALLOC | SHF_EXECINSTR))
+            continue;
+        if (disc->num_sections >= MAX_CODE_SECTIONS) {
+            NOTIFY(1, "drpersist: too many code sections in %s\n",
+                   disc->mod->full_path);
+            break;
+        }
+        disc->sections[disc->num_sections].start = shdr[i].sh_addr - load_base;
+        disc->sections[disc->num_sections].end =
+            shdr[i].sh_addr - load_base + shdr[i].sh_size;
+        disc->num_sections++;
+    }
+    dr_unmap_file(map, map_size);
+    return true;
+}
+
+static bool
+in_code_section(discover_t *disc, size_t modoffs)
+{
+    uint i;
+    for (i = 0; i < disc->num_sections; i++) {
+        if (modoffs >= disc->sections[i].start && modoffs < disc->sections[i].end)
+            return true;
+    }
+    return false;
+}
+
+static bool
+enumerate_symbol_cb(const char *name, size_t modoffs, void *data)
+{
+    discover_t *disc = (discover_t *) data;
+    /* skip data objects and other non-code symbols */
+    if (in_code_section(disc, modoffs))
+        add_root(disc, disc->mod->start + modoffs);
+    return true; /* keep iterating */
+}
+
+static void
+discover_module(void *drcontext, module_data_t *mod, drvector_t *tags)
+{
+    discover_t disc;
+    uint start_count = tags->entries;
+    memset(&disc, 0, sizeof(disc));
+    disc.mod = mod;
+    disc.tags = tags;
+    hashtable_init(&disc.visited, 16, HASH_INTPTR, false/*!strdup*/);
+    drvector_init(&disc.worklist, 1024, false/*!synch*/, NULL);
+
+    add_root(&disc, mod->entry_point);
+    if (!options.no_symbols && mod->full_path != NULL) {
+        if (!find_code_sections(&disc))
+            NOTIFY(1, "drpersist: no section headers for %s\n", mod->full_path);
+        else if (drsym_enumerate_symbols(mod->full_path, enumerate_symbol_cb, &disc,
+                                    DRSYM_DEFAULT_FLAGS) != DRSYM_SUCCESS)
+            NOTIFY(1, "drpersist: no symbols for %s\n", mod->full_path);
+    }
+    while (disc.worklist.entries > 0) {
+        app_pc tag = (app_pc)
+            drvector_get_entry(&disc.worklist, disc.worklist.entries - 1);
+        disc.worklist.entries--;
+        drvector_append(tags, tag);
+        walk_block(drcontext, &disc, tag);
+    }
+    NOTIFY(1, "drpersist: %u blocks in %s\n", tags->entries - start_count,
+           mod->full_path == NULL ? "<unknown>" : mod->full_path);
+
+    drvector_delete(&disc.worklist);
+    hashtable_delete(&disc.visited);
+}
+
+static void
+generate_all(void *drcontext)
+{
+    drvector_t tags;
+    size_t built;
+    uint i;
+    drvector_init(&tags, 4096, false/*!synch*/, NULL);
+    for (i = 0; i < modules.entries; i++) {
+        module_data_t *mod = (module_data_t *) drvector_get_entry(&modules, i);
+        /* re-look-up to skip modules that have since been unloaded */
+        module_data_t *cur = dr_lookup_module(mod->start);
+        if (cur == NULL)
+            continue;
+        if (cur->start == mod->start)
+            discover_module(drcontext, cur, &tags);
+        dr_free_module_data(cur);
+    }
+    if (!dr_prepopulate_cache((app_pc *)tags.array, tags.entries, &built))
+        NOTIFY(0, "%s\n", "drpersist: failed to build blocks");
+    else {
+        NOTIFY(1, "drpersist: built %u of %u blocks\n", (uint) built,
+               tags.entries);
+    }
+    drvector_delete(&tags);
+}
+
+/****************************************************************************
+ * Event Callbacks
+ */
+
+static bool
+module_is_wanted(const module_data_t *info)
+{
+    uint i;
+    if (options.num_only == 0)
+        return true;
+    if (info->full_path == NULL)
+        return false;
+    for (i = 0; i < options.num_only; i++) {
+        if (strstr(info->full_path, options.only[i]) != NULL)
+            return true;
+    }
+    return false;
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    /* The segments may not all be mapped yet, so we just record the module
+     * here and wait for process exit to decode it.
+     */
+    if (module_is_wanted(info))
+        drvector_append(&modules, dr_copy_module_data(info));
+}
+
+static bool
+event_filter_syscall(void *drcontext, int sysnum)
+{
+    return sysnum == SYS_exit_group;
+}
+
+static bool
+event_pre_syscall(void *drcontext, int sysnum)
+{
+    if (sysnum == SYS_exit_group)
+        generate_all(drcontext);
+    return true;
+}
+
+static void
+free_module_data(void *data)
+{
+    dr_free_module_data((module_data_t *) data);
+}
+
+static void
+event_exit(void)
+{
+    drvector_delete(&modules);
+    drsym_exit();
+}
+
+static void
+options_init(client_id_t id)
+{
+    const char *opstr = dr_get_options(id);
+    const char *s;
+    char token[OPTION_MAX_LENGTH];
+
+    for (s = dr_get_token(opstr, token, BUFFER_SIZE_ELEMENTS(token));
+         s != NULL;
+         s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token))) {
+        if (strcmp(token, "-only") == 0) {
+            USAGE_CHECK(options.num_only < MAX_ONLY_FILTERS, "too many -only");
+            s = dr_get_token(s, options.only[options.num_only],
+                             BUFFER_SIZE_ELEMENTS(options.only[0]));
+            USAGE_CHECK(s != NULL, "missing -only substring");
+            options.num_only++;
+        }
+        else if (strcmp(token, "-no_symbols") == 0)
+            options.no_symbols = true;
+        else if (strcmp(token, "-verbose") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -verbose number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &verbose);
+                USAGE_CHECK(res == 1, "invalid -verbose number");
+            }
+        }
+        else {
+            NOTIFY(0, "UNRECOGNIZED OPTION: \"%s\"\n", token);
+            USAGE_CHECK(false, "invalid option");
+        }
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    options_init(id);
+    if (dr_using_all_private_caches()) {
+        /* coarse-grain units only hold shared blocks */
+        NOTIFY(0, "%s\n", "drpersist: nothing to persist with private caches");
+    }
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        NOTIFY(0, "%s\n", "drpersist: unable to initialize symbol access");
+    drvector_init(&modules, 64, true/*synch*/, free_module_data);
+    dr_register_exit_event(event_exit);
+    dr_register_module_load_event(event_module_load);
+    dr_register_filter_syscall_event(event_filter_syscall);
+    dr_register_pre_syscall_event(event_pre_syscall);
+}
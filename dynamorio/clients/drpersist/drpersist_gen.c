@@ -0,0 +1,60 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drpersist_gen: launcher for the drpersist persisted cache generator.
+ * Loads each module named on the command line and exits, giving
+ * libdrpersist a process in which those modules are mapped.  Run as:
+ *
+ *   drrun -persist -persist_dir <dir> -c libdrpersist.so --
+ *     drpersist_gen <module> ...
+ */
+
+#include <stdio.h>
+#include <dlfcn.h>
+
+int
+main(int argc, char *argv[])
+{
+    int i, failed = 0;
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <module> ...\n", argv[0]);
+        return 1;
+    }
+    for (i = 1; i < argc; i++) {
+        if (dlopen(argv[i], RTLD_NOW | RTLD_LOCAL) == NULL) {
+            fprintf(stderr, "failed to load %s: %s\n", argv[i], dlerror());
+            failed++;
+        }
+    }
+    /* we leave the modules loaded: their blocks are built at exit */
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Check script for tool.drpersist, included by runcheck.cmake after a run
+# that generated persisted caches for a library.  Running the same command
+# again must load those caches, leaving fewer of the same blocks to build.
+
+if (NOT "${output}" MATCHES "drpersist: built ([0-9]+) of ([0-9]+) blocks")
+  message(FATAL_ERROR "no block counts from the generating run")
+endif ()
+set(gen_built ${CMAKE_MATCH_1})
+set(gen_total ${CMAKE_MATCH_2})
+
+file(GLOB_RECURSE pcaches "${tmpdir}/*.dpc")
+if (NOT pcaches)
+  message(FATAL_ERROR "no persisted caches written under ${tmpdir}")
+endif ()
+
+execute_process(COMMAND ${cmd}
+  RESULT_VARIABLE use_result
+  OUTPUT_VARIABLE use_output ERROR_VARIABLE use_output)
+if (use_result OR
+    NOT "${use_output}" MATCHES "drpersist: built ([0-9]+) of ([0-9]+) blocks")
+  message(FATAL_ERROR "run using the persisted caches failed: ${use_output}")
+endif ()
+if (NOT CMAKE_MATCH_2 EQUAL gen_total)
+  message(FATAL_ERROR "discovered ${CMAKE_MATCH_2} blocks, not ${gen_total}")
+endif ()
+if (NOT CMAKE_MATCH_1 LESS gen_built)
+  message(FATAL_ERROR
+    "built ${CMAKE_MATCH_1} blocks with persisted caches vs ${gen_built} without")
+endif ()
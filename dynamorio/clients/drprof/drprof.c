@@ -0,0 +1,528 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drprof: timer-sampling profiler.
+ *
+ * Each thread is sampled on an ITIMER_PROF itimer (see dr_set_itimer()),
+ * so only threads that use CPU time are sampled.  A sample is attributed to
+ * the application block (or trace head) whose fragment was executing, as
+ * found by dr_where_am_i() without any translation, plus the return
+ * addresses found by walking the application's frame pointer chain.  Time
+ * spent in DR itself is attributed to a "[dynamorio:<where>]" frame.  The
+ * stacks are aggregated in per-thread tables that are only written from
+ * the thread's own timer callback and so need no locks.  At thread exit
+ * they are symbolized via drsyms and merged, and at process exit the
+ * result is written in the "folded" format of flamegraph.pl to
+ * drprof.<app>.<pid>.folded:
+ *
+ *   main;run;hash_block 152
+ *
+ * Stacks are only complete for code compiled with frame pointers.
+ *
+ * The runtime options for this client include:
+ * -rate <ms>         Sampling period in milliseconds of CPU time, 10 by
+ *                    default.
+ * -depth <N>         The maximum number of frames recorded per sample,
+ *                    including the sampled block, 32 by default.
+ * -logdir <dir>      Sets the output directory, which by default is the
+ *                    directory containing the client library.
+ * -verbose <N>       Prints per-thread sample counts for N >= 1.
+ */
+
+#include "dr_api.h"
+#include "drsyms.h"
+#include "hashtable.h"
+#include "../common/utils.h"
+#include <string.h>
+#include <sys/time.h> /* ITIMER_PROF */
+
+#define NOTIFY(level, fmt, ...) do {          \
+    if (verbose >= (level))                   \
+        dr_fprintf(STDERR, fmt, __VA_ARGS__); \
+} while (0)
+
+/* XXX: should be moved to DR API headers */
+#define BUFFER_SIZE_BYTES(buf)      sizeof(buf)
+#define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
+#define NULL_TERMINATE_BUFFER(buf)  ((buf)[BUFFER_SIZE_ELEMENTS(buf)-1] = 0)
+
+#define OPTION_MAX_LENGTH MAXIMUM_PATH
+#define DEFAULT_RATE  10 /* ms */
+#define DEFAULT_DEPTH 32
+#define MAX_DEPTH     128
+#define MAX_SYM_LEN   256
+/* a frame pointer further than this from the previous one ends the walk */
+#define MAX_FRAME_SIZE (1024*1024)
+
+/* Each thread keeps up to STACK_TABLE_SIZE unique stacks, whose frames
+ * are stored in an arena of STACK_ARENA_FRAMES pcs.  Samples that do not
+ * fit are counted as dropped.
+ */
+#define STACK_TABLE_BITS   12
+#define STACK_TABLE_SIZE   (1U << STACK_TABLE_BITS)
+#define STACK_ARENA_FRAMES (256*1024)
+#define MAX_PROBES         16
+
+typedef struct _drprof_option_t {
+    uint rate;
+    uint depth;
+    char logdir[MAXIMUM_PATH];
+} drprof_option_t;
+static drprof_option_t options;
+
+static uint verbose;
+static client_id_t client_id;
+
+/* An aggregated stack: frames[offs .. offs+depth) in the thread's arena,
+ * leaf first.  A zero hash marks an empty slot.
+ */
+typedef struct _stack_entry_t {
+    uint hash;
+    uint count;
+    uint offs;
+    uint depth;
+} stack_entry_t;
+
+/* Only written from the thread's own itimer callback, and read at thread
+ * exit once the callback is disabled, so it needs no synchronization.
+ */
+typedef struct _per_thread_t {
+    volatile bool active;
+    stack_entry_t *table;
+    app_pc *frames;
+    uint frames_used;
+    uint samples;
+    uint dropped;
+} per_thread_t;
+
+#define TABLE_ALLOC_SIZE (STACK_TABLE_SIZE * sizeof(stack_entry_t))
+#define ARENA_ALLOC_SIZE (STACK_ARENA_FRAMES * sizeof(app_pc))
+
+/* Folded stacks of exited threads, mapping the stack string to its count,
+ * and a cache of symbolized pcs.  Both are protected by merge_lock.
+ */
+static void *merge_lock;
+static hashtable_t folded_table;
+static hashtable_t sym_table;
+
+static const char * const where_names[] = {
+    "app", "interp", "dispatch", "monitor", "syscall", "signal",
+    "trampoline", "context_switch", "ibl", "fcache", "unknown",
+};
+
+/****************************************************************************
+ * Sampling
+ *
+ * Everything in this section runs in the itimer callback, which can
+ * interrupt a lock holder, so it must not acquire locks or allocate.
+ */
+
+static uint
+stack_hash(app_pc *stack, uint depth)
+{
+    uint i, hash = 2166136261U; /* FNV-1a */
+    for (i = 0; i < depth; i++) {
+        hash ^= (uint)(ptr_uint_t)stack[i];
+        hash *= 16777619U;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+static void
+stack_record(per_thread_t *data, app_pc *stack, uint depth)
+{
+    uint hash = stack_hash(stack, depth);
+    uint idx = hash & (STACK_TABLE_SIZE - 1);
+    uint probe;
+    for (probe = 0; probe < MAX_PROBES;
+         probe++, idx = (idx + 1) & (STACK_TABLE_SIZE - 1)) {
+        stack_entry_t *entry = &data->table[idx];
+        if (entry->hash == 0) {
+            if (data->frames_used + depth > STACK_ARENA_FRAMES)
+                break;
+            memcpy(&data->frames[data->frames_used], stack,
+                   depth * sizeof(app_pc));
+            entry->offs  = data->frames_used;
+            entry->depth = depth;
+            entry->count = 1;
+            entry->hash  = hash;
+            data->frames_used += depth;
+            return;
+        }
+        if (entry->hash == hash && entry->depth == depth &&
+            memcmp(&data->frames[entry->offs], stack,
+                   depth * sizeof(app_pc)) == 0) {
+            entry->count++;
+            return;
+        }
+    }
+    data->dropped++;
+}
+
+/* Walks the application's frame pointer chain starting at fp, storing
+ * return addresses into stack.  Each return address is stored minus one so
+ * that it symbolizes to the call site.  Returns the number stored.
+ */
+static uint
+stack_walk(reg_t fp, reg_t sp, app_pc *stack, uint max)
+{
+    uint depth = 0;
+    while (depth < max) {
+        reg_t frame[2]; /* saved fp, return address */
+        /* the chain must go up the stack from the sampled sp */
+        if (fp < sp || fp - sp > MAX_FRAME_SIZE ||
+            !dr_safe_read((void *)fp, sizeof(frame), frame, NULL))
+            break;
+        if (frame[1] == 0)
+            break;
+        stack[depth++] = (app_pc)(frame[1] - 1);
+        sp = fp + sizeof(frame);
+        fp = frame[0];
+    }
+    return depth;
+}
+
+static void
+event_timer(void *drcontext, dr_mcontext_t *mcontext)
+{
+    per_thread_t *data = (per_thread_t *) dr_get_tls_field(drcontext);
+    app_pc stack[MAX_DEPTH];
+    uint depth = 0;
+    void *tag;
+    dr_where_am_i_t where;
+
+    if (data == NULL || !data->active)
+        return;
+    data->samples++;
+    where = dr_where_am_i(drcontext, mcontext->pc, &tag);
+    if (where == DR_WHERE_FCACHE)
+        stack[depth++] = dr_fragment_app_pc(tag);
+    else if (where == DR_WHERE_APP)
+        stack[depth++] = mcontext->pc;
+    else {
+        /* No application pc is at hand, and xbp need not be the app's,
+         * so we record DR's location only.  No app pc is this small.
+         */
+        stack[depth++] = (app_pc)(ptr_uint_t)where;
+    }
+    if (where == DR_WHERE_FCACHE || where == DR_WHERE_APP) {
+        depth += stack_walk(mcontext->xbp, mcontext->xsp, stack + depth,
+                            options.depth - depth);
+    }
+    stack_record(data, stack, depth);
+}
+
+/****************************************************************************
+ * Symbolization and Output
+ */
+
+static void
+free_string(void *str)
+{
+    dr_global_free(str, strlen((char *)str) + 1);
+}
+
+static char *
+string_copy(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = dr_global_alloc(len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+/* Returns the name of the function containing pc as "module!function",
+ * falling back to "module+offset" or the raw pc.  Caller holds merge_lock.
+ */
+static const char *
+symbolize(app_pc pc)
+{
+    char buf[MAX_SYM_LEN];
+    char *name = hashtable_lookup(&sym_table, pc);
+    char *c;
+    module_data_t *mod;
+
+    if (name != NULL)
+        return name;
+    if ((ptr_uint_t)pc <= DR_WHERE_UNKNOWN) {
+        dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "[dynamorio:%s]",
+                    where_names[(ptr_uint_t)pc]);
+    } else if ((mod = dr_lookup_module(pc)) != NULL) {
+        const char *modname = dr_module_preferred_name(mod);
+        char fname[MAX_SYM_LEN];
+        drsym_info_t sym;
+        drsym_error_t res;
+        sym.struct_size = sizeof(sym);
+        sym.name = fname;
+        sym.name_size = BUFFER_SIZE_BYTES(fname);
+        sym.file = NULL;
+        sym.file_size = 0;
+        if (modname == NULL)
+            modname = "<noname>";
+        res = drsym_lookup_address(mod->full_path, pc - mod->start, &sym,
+                                   DRSYM_DEMANGLE);
+        if (res == DRSYM_SUCCESS || res == DRSYM_ERROR_LINE_NOT_AVAILABLE)
+            dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "%s!%s", modname, fname);
+        else {
+            dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "%s+0x%x",
+                        modname, (uint)(pc - mod->start));
+        }
+        dr_free_module_data(mod);
+    } else
+        dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), PFX, pc);
+    NULL_TERMINATE_BUFFER(buf);
+    /* ';' separates frames in the folded format */
+    for (c = buf; *c != '\0'; c++) {
+        if (*c == ';')
+            *c = ':';
+    }
+    name = string_copy(buf);
+    hashtable_add(&sym_table, pc, name);
+    return name;
+}
+
+/* Merges a thread's stacks into folded_table */
+static void
+thread_merge(per_thread_t *data)
+{
+    size_t line_size = MAX_DEPTH * MAX_SYM_LEN;
+    char *line = dr_global_alloc(line_size);
+    uint i;
+
+    dr_mutex_lock(merge_lock);
+    for (i = 0; i < STACK_TABLE_SIZE; i++) {
+        stack_entry_t *entry = &data->table[i];
+        size_t len = 0;
+        uint j;
+        ptr_uint_t count;
+        if (entry->hash == 0)
+            continue;
+        /* root first */
+        for (j = entry->depth; j > 0; j--) {
+            const char *sym = symbolize(data->frames[entry->offs + j - 1]);
+            int res = dr_snprintf(line + len, line_size - len, "%s%s",
+                                  len == 0 ? "" : ";", sym);
+            if (res < 0)
+                break;
+            len += res;
+        }
+        line[line_size - 1] = '\0';
+        count = (ptr_uint_t) hashtable_lookup(&folded_table, line);
+        count += entry->count;
+        hashtable_add_replace(&folded_table, line, (void *)count);
+    }
+    dr_mutex_unlock(merge_lock);
+    dr_global_free(line, line_size);
+}
+
+static file_t
+output_create(void)
+{
+    char path[MAXIMUM_PATH];
+    char *dirsep;
+    const char *app_name = dr_get_application_name();
+    size_t len;
+
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s",
+                options.logdir[0] != '\0' ?
+                options.logdir : dr_get_client_path(client_id));
+    NULL_TERMINATE_BUFFER(path);
+    len = strlen(path);
+    if (options.logdir[0] == '\0') {
+        /* remove the client library name */
+        dirsep = strrchr(path, '/');
+        if (dirsep != NULL)
+            *dirsep = '\0';
+        len = strlen(path);
+    }
+    dr_snprintf(path + len, BUFFER_SIZE_ELEMENTS(path) - len,
+                "/drprof.%s.%05d.folded",
+                app_name == NULL ? "unknown" : app_name, dr_get_process_id());
+    NULL_TERMINATE_BUFFER(path);
+    NOTIFY(1, "<writing profile to %s>\n", path);
+    return dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+}
+
+static void
+output_write(void)
+{
+    file_t f = output_create();
+    uint i;
+    if (f == INVALID_FILE) {
+        NOTIFY(0, "%s\n", "drprof: unable to create the output file");
+        return;
+    }
+    for (i = 0; i < HASHTABLE_SIZE(folded_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = folded_table.table[i]; he != NULL; he = he->next) {
+            dr_fprintf(f, "%s "SZFMT"\n", (char *)he->key,
+                       (ptr_uint_t)he->payload);
+        }
+    }
+    dr_close_file(f);
+}
+
+/****************************************************************************
+ * Event Callbacks
+ */
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    /* The raw allocations are zeroed and only touched as they fill up */
+    data->table = dr_raw_mem_alloc(TABLE_ALLOC_SIZE,
+                                   DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    data->frames = dr_raw_mem_alloc(ARENA_ALLOC_SIZE,
+                                    DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    ASSERT(data->table != NULL && data->frames != NULL, "out of memory");
+    dr_set_tls_field(drcontext, data);
+    data->active = true;
+    /* The itimer can be shared by all threads in the group, in which case
+     * the kernel delivers each signal to a thread that is using the CPU.
+     */
+    if (dr_get_itimer(ITIMER_PROF) == 0 &&
+        !dr_set_itimer(ITIMER_PROF, options.rate, event_timer))
+        NOTIFY(0, "%s\n", "drprof: unable to set the itimer");
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) dr_get_tls_field(drcontext);
+    /* the callback runs on this thread, so none is in progress past here */
+    data->active = false;
+    NOTIFY(1, "drprof: thread %d: %u samples, %u dropped\n",
+           dr_get_thread_id(drcontext), data->samples, data->dropped);
+    thread_merge(data);
+    dr_set_tls_field(drcontext, NULL);
+    dr_raw_mem_free(data->table, TABLE_ALLOC_SIZE);
+    dr_raw_mem_free(data->frames, ARENA_ALLOC_SIZE);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+static void
+event_fork(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) dr_get_tls_field(drcontext);
+    /* the samples so far belong to the parent */
+    data->active = false;
+    memset(data->table, 0, TABLE_ALLOC_SIZE);
+    data->frames_used = 0;
+    data->samples = 0;
+    data->dropped = 0;
+    dr_mutex_lock(merge_lock);
+    hashtable_clear(&folded_table);
+    dr_mutex_unlock(merge_lock);
+    data->active = true;
+    /* itimers are not inherited across fork */
+    if (!dr_set_itimer(ITIMER_PROF, options.rate, event_timer))
+        NOTIFY(0, "%s\n", "drprof: unable to set the itimer");
+}
+
+static void
+event_exit(void)
+{
+    output_write();
+    hashtable_delete(&folded_table);
+    hashtable_delete(&sym_table);
+    dr_mutex_destroy(merge_lock);
+    drsym_exit();
+}
+
+static void
+options_init(client_id_t id)
+{
+    const char *opstr = dr_get_options(id);
+    const char *s;
+    char token[OPTION_MAX_LENGTH];
+
+    options.rate  = DEFAULT_RATE;
+    options.depth = DEFAULT_DEPTH;
+    for (s = dr_get_token(opstr, token, BUFFER_SIZE_ELEMENTS(token));
+         s != NULL;
+         s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token))) {
+        if (strcmp(token, "-rate") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -rate number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &options.rate);
+                USAGE_CHECK(res == 1 && options.rate > 0, "invalid -rate number");
+            }
+        }
+        else if (strcmp(token, "-depth") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -depth number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &options.depth);
+                USAGE_CHECK(res == 1 && options.depth > 0 &&
+                            options.depth <= MAX_DEPTH, "invalid -depth number");
+            }
+        }
+        else if (strcmp(token, "-logdir") == 0) {
+            s = dr_get_token(s, options.logdir,
+                             BUFFER_SIZE_ELEMENTS(options.logdir));
+            USAGE_CHECK(s != NULL, "missing logdir path");
+        }
+        else if (strcmp(token, "-verbose") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -verbose number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &verbose);
+                USAGE_CHECK(res == 1, "invalid -verbose number");
+            }
+        }
+        else {
+            NOTIFY(0, "UNRECOGNIZED OPTION: \"%s\"\n", token);
+            USAGE_CHECK(false, "invalid option");
+        }
+    }
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    client_id = id;
+    options_init(id);
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        NOTIFY(0, "%s\n", "drprof: unable to initialize symbol access");
+    merge_lock = dr_mutex_create();
+    hashtable_init_ex(&folded_table, 10, HASH_STRING, true/*strdup*/,
+                      false/*!synch*/, NULL, NULL, NULL);
+    hashtable_init_ex(&sym_table, 10, HASH_INTPTR, false/*!strdup*/,
+                      false/*!synch*/, free_string, NULL, NULL);
+    dr_register_exit_event(event_exit);
+    dr_register_thread_init_event(event_thread_init);
+    dr_register_thread_exit_event(event_thread_exit);
+    dr_register_fork_init_event(event_fork);
+}
@@ -0,0 +1,60 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Check script for tool.drprof, included by runcheck.cmake after drprof
+# profiled linux.fp-profile, which spends its time in profile_inner() called
+# from profile_outer() called from main(), all built with frame pointers.
+# There must be one folded profile whose every line is a ';'-separated stack
+# and a sample count, and some stack must end in main, profile_outer and
+# profile_inner.
+
+file(GLOB profiles "${tmpdir}/drprof.*.folded")
+list(LENGTH profiles num_profiles)
+if (NOT num_profiles EQUAL 1)
+  message(FATAL_ERROR "expected one profile under ${tmpdir}, found ${num_profiles}")
+endif ()
+
+file(STRINGS "${profiles}" lines)
+list(LENGTH lines num_lines)
+if (num_lines EQUAL 0)
+  message(FATAL_ERROR "${profiles} is empty")
+endif ()
+set(found_stack OFF)
+foreach (line ${lines})
+  if (NOT "${line}" MATCHES "^([^ ].*) [1-9][0-9]*$")
+    message(FATAL_ERROR "not a \"stack count\" line in ${profiles}: ${line}")
+  endif ()
+  if ("${CMAKE_MATCH_1}" MATCHES "(^|;)[^;]*!main;[^;]*!profile_outer;[^;]*!profile_inner$")
+    set(found_stack ON)
+  endif ()
+endforeach ()
+if (NOT found_stack)
+  message(FATAL_ERROR "no main;profile_outer;profile_inner stack in ${profiles}")
+endif ()
@@ -0,0 +1,404 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_graph.cpp
+ *
+ * Provides the graph model, its grid index, and the dump loader
+ */
+
+#ifdef __CLASS__
+#  undef __CLASS__
+#endif
+#define __CLASS__ "drvis_loader_t::"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <math.h>
+
+#include "drvis_dump.h"
+#include "drvis_layout.h"
+#include "drvis_graph.h"
+
+/* Distance between neighboring blocks of a function */
+#define BLOCK_SPACING 1.f
+/* Grid cells are sized for this many items each */
+#define ITEMS_PER_CELL 8
+#define FUNCTION_LAYOUT_ITERS 50
+
+/****************************************************************************
+ * drvis_grid_t
+ */
+
+drvis_grid_t::drvis_grid_t(void)
+    : cols(1), rows(1), cell_width(1), cell_height(1)
+{
+    cells.resize(1);
+}
+
+void
+drvis_grid_t::reset(const QRectF &bounds_, int expected_items)
+{
+    int num_cells = qMax(1, expected_items / ITEMS_PER_CELL);
+    qreal aspect;
+    bounds = bounds_;
+    if (bounds.width() <= 0 || bounds.height() <= 0)
+        bounds.adjust(-1, -1, 1, 1);
+    aspect = bounds.width() / bounds.height();
+    cols = qMax(1, (int)ceil(sqrt(num_cells * aspect)));
+    rows = qMax(1, (num_cells + cols - 1) / cols);
+    cell_width = bounds.width() / cols;
+    cell_height = bounds.height() / rows;
+    cells.clear();
+    cells.resize(cols * rows);
+}
+
+int
+drvis_grid_t::cell_index(float x, float y) const
+{
+    int c = (int)((x - bounds.left()) / cell_width);
+    int r = (int)((y - bounds.top()) / cell_height);
+    c = qBound(0, c, cols - 1);
+    r = qBound(0, r, rows - 1);
+    return r * cols + c;
+}
+
+void
+drvis_grid_t::insert(uint32_t item, float x, float y)
+{
+    cells[cell_index(x, y)].append(item);
+}
+
+void
+drvis_grid_t::query(const QRectF &r, QVector<uint32_t> *out) const
+{
+    int c0 = qBound(0, (int)floor((r.left() - bounds.left()) / cell_width), cols - 1);
+    int c1 = qBound(0, (int)floor((r.right() - bounds.left()) / cell_width), cols - 1);
+    int r0 = qBound(0, (int)floor((r.top() - bounds.top()) / cell_height), rows - 1);
+    int r1 = qBound(0, (int)floor((r.bottom() - bounds.top()) / cell_height), rows - 1);
+    for (int row = r0; row <= r1; row++) {
+        for (int col = c0; col <= c1; col++) {
+            const QVector<uint32_t> &cell = cells.at(row * cols + col);
+            for (int i = 0; i < cell.size(); i++)
+                out->append(cell.at(i));
+        }
+    }
+}
+
+/****************************************************************************
+ * drvis_graph_t
+ */
+
+drvis_graph_t::drvis_graph_t(void)
+{
+    clear();
+}
+
+void
+drvis_graph_t::clear(void)
+{
+    bounds = QRectF();
+    functions.nodes.clear();
+    functions.first.clear();
+    functions.dst.clear();
+    functions.grid.reset(QRectF(), 0);
+    functions.max_radius = 0;
+    functions.max_executions = 0;
+    blocks.nodes.clear();
+    blocks.first.clear();
+    blocks.first.append(0);
+    blocks.dst.clear();
+    blocks.grid.reset(QRectF(), 0);
+    blocks.max_radius = 0;
+    blocks.max_executions = 0;
+    loaded_functions = 0;
+}
+
+void
+drvis_graph_t::set_functions(const drvis_chunk_t &chunk, const QRectF &bounds_,
+                             int total_blocks)
+{
+    clear();
+    bounds = bounds_;
+    functions.nodes = chunk.nodes;
+    functions.first = chunk.first;
+    functions.dst = chunk.dst;
+    functions.grid.reset(bounds, functions.nodes.size());
+    for (int i = 0; i < functions.nodes.size(); i++) {
+        const drvis_node_t &node = functions.nodes.at(i);
+        functions.grid.insert(i, node.x, node.y);
+        functions.max_radius = qMax(functions.max_radius, node.radius);
+        functions.max_executions = qMax(functions.max_executions, node.num_executions);
+    }
+    blocks.nodes.reserve(total_blocks);
+    blocks.grid.reset(bounds, total_blocks);
+}
+
+void
+drvis_graph_t::add_blocks(const drvis_chunk_t &chunk)
+{
+    uint32_t base = blocks.dst.size();
+    for (int i = 0; i < chunk.nodes.size(); i++) {
+        const drvis_node_t &node = chunk.nodes.at(i);
+        blocks.grid.insert(blocks.nodes.size(), node.x, node.y);
+        blocks.nodes.append(node);
+        blocks.first.append(base + chunk.first.at(i + 1));
+        blocks.max_radius = qMax(blocks.max_radius, node.radius);
+        blocks.max_executions = qMax(blocks.max_executions, node.num_executions);
+    }
+    blocks.dst += chunk.dst;
+    loaded_functions = chunk.end_function;
+}
+
+/****************************************************************************
+ * drvis_loader_t
+ */
+
+/* Public
+ * Constructor
+ */
+drvis_loader_t::drvis_loader_t(const QString &path_, int chunk_functions_,
+                               QObject *parent)
+    : QThread(parent), path(path_), chunk_functions(qMax(1, chunk_functions_)),
+      cancel_requested(false), have_functions(false), pending_total_blocks(0)
+{
+}
+
+/* Public
+ * Destructor, waits for the thread to stop
+ */
+drvis_loader_t::~drvis_loader_t(void)
+{
+    cancel();
+    wait();
+}
+
+/* Public
+ * Asks the thread to stop at its next check
+ */
+void
+drvis_loader_t::cancel(void)
+{
+    QMutexLocker locker(&lock);
+    cancel_requested = true;
+}
+
+bool
+drvis_loader_t::canceled(void)
+{
+    QMutexLocker locker(&lock);
+    return cancel_requested;
+}
+
+/* Public
+ * Hands over the function level, once
+ */
+bool
+drvis_loader_t::take_functions(drvis_chunk_t *functions, QRectF *bounds_,
+                               int *total_blocks)
+{
+    QMutexLocker locker(&lock);
+    if (!have_functions)
+        return false;
+    *functions = pending_functions;
+    *bounds_ = pending_bounds;
+    *total_blocks = pending_total_blocks;
+    pending_functions = drvis_chunk_t();
+    have_functions = false;
+    return true;
+}
+
+/* Public
+ * Hands over the oldest chunk of blocks not yet taken
+ */
+bool
+drvis_loader_t::take_blocks(drvis_chunk_t *chunk)
+{
+    QMutexLocker locker(&lock);
+    if (pending_blocks.isEmpty())
+        return false;
+    *chunk = pending_blocks.first();
+    pending_blocks.remove(0);
+    return true;
+}
+
+static float
+edge_weight(uint64_t count)
+{
+    return 1.f + (float)log(1.0 + (double)count);
+}
+
+/* Protected
+ * Reads the dump.  Functions are laid out as a graph of their inter-function
+ * edges; the blocks of each function are then placed on a sunflower spiral
+ * around it, so whole functions can be handed over as they are read.
+ */
+void
+drvis_loader_t::run(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    drvis_dump_t *dump;
+    if (drvis_dump_open(path.toLocal8Bit().constData(), &dump) != DRVIS_SUCCESS) {
+        emit load_failed(tr("Failed to open %1").arg(path));
+        return;
+    }
+    if (drvis_dump_validate(dump) != DRVIS_SUCCESS) {
+        drvis_dump_close(dump);
+        emit load_failed(tr("%1 is corrupt").arg(path));
+        return;
+    }
+    const drvis_blocks_t *blocks = drvis_dump_blocks(dump);
+    const drvis_functions_t *funcs = drvis_dump_functions(dump);
+    const drvis_edges_t *inter = drvis_dump_edges(dump, DRVIS_EDGE_INTER);
+    const drvis_edges_t *intra = drvis_dump_edges(dump, DRVIS_EDGE_INTRA);
+
+    /* Function level */
+    QVector<uint32_t> row_func(blocks->count);
+    for (size_t f = 0; f < funcs->count; f++) {
+        for (uint32_t row = funcs->first_row[f];
+             row < funcs->first_row[f] + funcs->num_rows[f]; row++)
+            row_func[row] = f;
+    }
+    drvis_layout_t *layout = drvis_layout_create(NULL);
+    if (layout == NULL ||
+        drvis_layout_add_nodes(layout, funcs->count) == (size_t)-1) {
+        if (layout != NULL)
+            drvis_layout_destroy(layout);
+        drvis_dump_close(dump);
+        emit load_failed(tr("Out of memory laying out %1").arg(path));
+        return;
+    }
+    QVector<quint64> pairs;
+    for (size_t row = 0; row < blocks->count; row++) {
+        for (uint32_t e = inter->first[row]; e < inter->first[row + 1]; e++) {
+            size_t dst;
+            if (drvis_dump_block_row(dump, inter->dst[e], &dst) != DRVIS_SUCCESS ||
+                row_func[row] == row_func[dst])
+                continue;
+            drvis_layout_add_edge(layout, row_func[row], row_func[dst],
+                                  edge_weight(blocks->num_executions[row]));
+            pairs.append(((quint64)row_func[row] << 32) | row_func[dst]);
+        }
+    }
+    if (!canceled())
+        drvis_layout_run(layout, FUNCTION_LAYOUT_ITERS);
+    if (canceled()) {
+        drvis_layout_destroy(layout);
+        drvis_dump_close(dump);
+        return;
+    }
+    const float *xs, *ys;
+    drvis_layout_positions(layout, &xs, &ys);
+
+    /* Space functions by the size of an average function */
+    float spacing = BLOCK_SPACING *
+        (sqrtf((float)blocks->count / qMax((size_t)1, funcs->count)) + 1.f);
+    drvis_chunk_t functions;
+    QRectF bounds;
+    functions.end_function = funcs->count;
+    functions.nodes.resize(funcs->count);
+    for (size_t f = 0; f < funcs->count; f++) {
+        drvis_node_t &node = functions.nodes[f];
+        node.x = xs[f] * spacing;
+        node.y = ys[f] * spacing;
+        node.radius = BLOCK_SPACING * 0.5f * (sqrtf((float)funcs->num_rows[f]) + 1.f);
+        node.parent = DRVIS_NO_NODE;
+        node.num_executions = 0;
+        for (uint32_t row = funcs->first_row[f];
+             row < funcs->first_row[f] + funcs->num_rows[f]; row++)
+            node.num_executions += blocks->num_executions[row];
+        node.id = funcs->function_id[f];
+        bounds |= QRectF(node.x - node.radius, node.y - node.radius,
+                         2 * node.radius, 2 * node.radius);
+    }
+    drvis_layout_destroy(layout);
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    functions.first.fill(0, funcs->count + 1);
+    for (int i = 0; i < pairs.size(); i++) {
+        functions.first[(pairs.at(i) >> 32) + 1]++;
+        functions.dst.append((uint32_t)pairs.at(i));
+    }
+    for (size_t f = 0; f < funcs->count; f++)
+        functions.first[f + 1] += functions.first[f];
+    {
+        QMutexLocker locker(&lock);
+        pending_functions = functions;
+        pending_bounds = bounds;
+        pending_total_blocks = blocks->count;
+        have_functions = true;
+    }
+    emit functions_ready();
+
+    /* Block level, in chunks of whole functions */
+    for (size_t f0 = 0; f0 < funcs->count && !canceled(); f0 += chunk_functions) {
+        size_t f1 = qMin(funcs->count, f0 + chunk_functions);
+        drvis_chunk_t chunk;
+        chunk.first.append(0);
+        for (size_t f = f0; f < f1; f++) {
+            const drvis_node_t &func = functions.nodes.at(f);
+            for (uint32_t i = 0; i < funcs->num_rows[f]; i++) {
+                uint32_t row = funcs->first_row[f] + i;
+                /* golden angle spiral: even density, entry blocks central */
+                float angle = 2.39996323f * i;
+                float dist = BLOCK_SPACING * 0.5f * sqrtf((float)i);
+                drvis_node_t node;
+                node.x = func.x + dist * cosf(angle);
+                node.y = func.y + dist * sinf(angle);
+                node.radius = BLOCK_SPACING * 0.35f;
+                node.parent = f;
+                node.num_executions = blocks->num_executions[row];
+                node.id = blocks->block_id[row];
+                chunk.nodes.append(node);
+                for (int kind = 0; kind < 2; kind++) {
+                    const drvis_edges_t *edges = kind == 0 ? intra : inter;
+                    for (uint32_t e = edges->first[row]; e < edges->first[row + 1]; e++) {
+                        size_t dst;
+                        if (drvis_dump_block_row(dump, edges->dst[e], &dst) ==
+                            DRVIS_SUCCESS)
+                            chunk.dst.append(dst);
+                    }
+                }
+                chunk.first.append(chunk.dst.size());
+            }
+        }
+        chunk.end_function = f1;
+        {
+            QMutexLocker locker(&lock);
+            pending_blocks.append(chunk);
+        }
+        emit blocks_ready();
+    }
+    drvis_dump_close(dump);
+}
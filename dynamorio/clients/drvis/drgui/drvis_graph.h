@@ -0,0 +1,185 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_graph.h
+ *
+ * The graph shown by the drvis tool: function and block nodes with their
+ * layout positions, a uniform grid index per level for finding the nodes
+ * in view, and a loader thread that reads a binary dump (see drvis_dump.h)
+ * and hands the graph over in chunks.
+ */
+
+#ifndef DRVIS_GRAPH_H
+#define DRVIS_GRAPH_H
+
+#include <QMutex>
+#include <QRectF>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+#include <stdint.h>
+
+#define DRVIS_NO_NODE 0xffffffffu
+
+struct drvis_node_t
+{
+    float x;
+    float y;
+    float radius;
+    /* the function of a block, or DRVIS_NO_NODE for a function */
+    uint32_t parent;
+    uint64_t num_executions;
+    uint32_t id;
+};
+
+/* Append-only uniform grid over fixed bounds.  Points outside the bounds are
+ * clamped into the border cells.
+ */
+class drvis_grid_t
+{
+public:
+    drvis_grid_t(void);
+
+    void reset(const QRectF &bounds_, int expected_items);
+
+    void insert(uint32_t item, float x, float y);
+
+    /* Appends the items in cells overlapping r to out */
+    void query(const QRectF &r, QVector<uint32_t> *out) const;
+
+private:
+    int cell_index(float x, float y) const;
+
+    QRectF bounds;
+    int cols;
+    int rows;
+    qreal cell_width;
+    qreal cell_height;
+    QVector<QVector<uint32_t> > cells;
+};
+
+/* The nodes of one level, with out-edges in compressed rows: the edges of
+ * node i are dst[first[i]] to dst[first[i + 1] - 1].
+ */
+struct drvis_level_t
+{
+    QVector<drvis_node_t> nodes;
+    QVector<uint32_t> first;
+    QVector<uint32_t> dst;
+    drvis_grid_t grid;
+    float max_radius;
+    uint64_t max_executions;
+};
+
+/* Nodes handed over by the loader: either all functions, with edges between
+ * function indices, or the blocks of consecutive dump rows, with edges to
+ * dump rows that may be in chunks that have not arrived yet.
+ */
+struct drvis_chunk_t
+{
+    QVector<drvis_node_t> nodes;
+    QVector<uint32_t> first;
+    QVector<uint32_t> dst;
+    /* for blocks, the functions up to here are complete */
+    uint32_t end_function;
+};
+
+class drvis_graph_t
+{
+public:
+    drvis_graph_t(void);
+
+    void clear(void);
+
+    /* Takes over the function level and sizes the block index for
+     * total_blocks blocks within the same bounds.
+     */
+    void set_functions(const drvis_chunk_t &functions, const QRectF &bounds_,
+                       int total_blocks);
+
+    void add_blocks(const drvis_chunk_t &chunk);
+
+    QRectF bounds;
+    drvis_level_t functions;
+    drvis_level_t blocks;
+    /* functions whose blocks have all been added */
+    uint32_t loaded_functions;
+};
+
+/* Reads a dump in a background thread.  The function level is laid out
+ * first and announced with functions_ready(); blocks then arrive in chunks
+ * of whole functions announced with blocks_ready().  The receiver collects
+ * the data with take_functions() and take_blocks().
+ */
+class drvis_loader_t : public QThread
+{
+    Q_OBJECT
+
+public:
+    drvis_loader_t(const QString &path_, int chunk_functions_, QObject *parent = 0);
+
+    ~drvis_loader_t(void);
+
+    void cancel(void);
+
+    bool take_functions(drvis_chunk_t *functions, QRectF *bounds_, int *total_blocks);
+
+    bool take_blocks(drvis_chunk_t *chunk);
+
+signals:
+    void functions_ready(void);
+
+    void blocks_ready(void);
+
+    void load_failed(const QString &msg);
+
+protected:
+    void run(void);
+
+private:
+    bool canceled(void);
+
+    QString path;
+    int chunk_functions;
+
+    QMutex lock;
+    bool cancel_requested;
+    bool have_functions;
+    drvis_chunk_t pending_functions;
+    QRectF pending_bounds;
+    int pending_total_blocks;
+    QVector<drvis_chunk_t> pending_blocks;
+};
+
+#endif
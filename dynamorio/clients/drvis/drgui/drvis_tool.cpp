@@ -0,0 +1,238 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_tool.cpp
+ *
+ * Provides the drgui tool for viewing block and function graphs
+ */
+
+#ifdef __CLASS__
+#  undef __CLASS__
+#endif
+#define __CLASS__ "drvis_tool_t::"
+
+#include <QDebug>
+#include <QFileDialog>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QSettings>
+#include <QSpinBox>
+#include <QVBoxLayout>
+
+#include "drvis_tool.h"
+
+#define DEFAULT_OPEN_RADIUS 24
+#define DEFAULT_MAX_EDGES 20000
+#define DEFAULT_CHUNK_FUNCTIONS 1024
+
+drvis_view_options_t
+drvis_read_view_options(void)
+{
+    drvis_view_options_t ops;
+    QSettings settings("DynamoRIO", "DrGUI");
+    settings.beginGroup("Drvis");
+    ops.open_radius = settings.value("Open_radius", DEFAULT_OPEN_RADIUS).toInt();
+    ops.max_edges = settings.value("Max_edges", DEFAULT_MAX_EDGES).toInt();
+    ops.chunk_functions =
+        settings.value("Chunk_functions", DEFAULT_CHUNK_FUNCTIONS).toInt();
+    settings.endGroup();
+    return ops;
+}
+
+/****************************************************************************
+ * drvis_tool_t
+ */
+
+/* Public
+ * Returns the tool names provided by this plugin
+ */
+QStringList
+drvis_tool_t::tool_names(void) const
+{
+    return QStringList() << "Drvis Graph";
+}
+
+/* Public
+ * Returns a new tab for the tool
+ */
+QWidget *
+drvis_tool_t::create_instance(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    return new drvis_tool_widget_t;
+}
+
+/* Public
+ * Returns the options page for the tool
+ */
+drgui_options_interface_t *
+drvis_tool_t::create_options_page(void)
+{
+    return new drvis_options_page_t;
+}
+
+/* Public
+ * There are no source files to open
+ */
+void
+drvis_tool_t::open_file(const QString &path, int line_num)
+{
+    Q_UNUSED(path);
+    Q_UNUSED(line_num);
+}
+
+/****************************************************************************
+ * drvis_tool_widget_t
+ */
+
+#undef __CLASS__
+#define __CLASS__ "drvis_tool_widget_t::"
+
+/* Public
+ * Constructor
+ */
+drvis_tool_widget_t::drvis_tool_widget_t(QWidget *parent)
+    : QWidget(parent)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    view_ = new drvis_view_t(drvis_read_view_options(), this);
+
+    open_button = new QPushButton(tr("Open dump..."), this);
+    connect(open_button, SIGNAL(clicked()),
+            this, SLOT(choose_file()));
+    fit_button = new QPushButton(tr("Fit"), this);
+    connect(fit_button, SIGNAL(clicked()),
+            view_, SLOT(fit()));
+    status_label = new QLabel(tr("No dump loaded"), this);
+    connect(view_, SIGNAL(status_changed(const QString &)),
+            status_label, SLOT(setText(const QString &)));
+
+    QHBoxLayout *controls_layout = new QHBoxLayout;
+    controls_layout->addWidget(open_button);
+    controls_layout->addWidget(fit_button);
+    controls_layout->addWidget(status_label, 1);
+
+    QVBoxLayout *main_layout = new QVBoxLayout;
+    main_layout->addLayout(controls_layout);
+    main_layout->addWidget(view_, 1);
+    setLayout(main_layout);
+}
+
+drvis_view_t *
+drvis_tool_widget_t::view(void)
+{
+    return view_;
+}
+
+/* Private Slot
+ * Asks for a dump to open
+ */
+void
+drvis_tool_widget_t::choose_file(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    QString path = QFileDialog::getOpenFileName(this, tr("Open dump"), "",
+                                                tr("Binary dumps (*.drvis);;"
+                                                   "All files (*)"));
+    if (!path.isEmpty())
+        view_->load(path);
+}
+
+/****************************************************************************
+ * drvis_options_page_t
+ */
+
+#undef __CLASS__
+#define __CLASS__ "drvis_options_page_t::"
+
+/* Public
+ * Constructor
+ */
+drvis_options_page_t::drvis_options_page_t(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    open_radius_spin = new QSpinBox(this);
+    open_radius_spin->setRange(2, 1000);
+    open_radius_spin->setSuffix(tr(" px"));
+    max_edges_spin = new QSpinBox(this);
+    max_edges_spin->setRange(0, 10000000);
+    chunk_functions_spin = new QSpinBox(this);
+    chunk_functions_spin->setRange(1, 1000000);
+
+    QFormLayout *main_layout = new QFormLayout;
+    main_layout->addRow(tr("Show blocks of functions wider than"), open_radius_spin);
+    main_layout->addRow(tr("Edges drawn per frame at most"), max_edges_spin);
+    main_layout->addRow(tr("Functions loaded per chunk"), chunk_functions_spin);
+    setLayout(main_layout);
+
+    read_settings();
+}
+
+/* Public
+ * Returns the tool names supported by this page
+ */
+QStringList
+drvis_options_page_t::tool_names(void) const
+{
+    return QStringList() << "Drvis Graph";
+}
+
+/* Public
+ * Writes settings, which apply to tabs opened afterward
+ */
+void
+drvis_options_page_t::write_settings(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    QSettings settings("DynamoRIO", "DrGUI");
+    settings.beginGroup("Drvis");
+    settings.setValue("Open_radius", open_radius_spin->value());
+    settings.setValue("Max_edges", max_edges_spin->value());
+    settings.setValue("Chunk_functions", chunk_functions_spin->value());
+    settings.endGroup();
+}
+
+/* Public
+ * Reads settings
+ */
+void
+drvis_options_page_t::read_settings(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    drvis_view_options_t ops = drvis_read_view_options();
+    open_radius_spin->setValue(ops.open_radius);
+    max_edges_spin->setValue(ops.max_edges);
+    chunk_functions_spin->setValue(ops.chunk_functions);
+}
@@ -0,0 +1,111 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_tool.h
+ *
+ * Defines the drgui tool that displays block and function graphs from
+ * binary dumps, its tab widget, and its options page.
+ */
+
+#ifndef DRVIS_TOOL_H
+#define DRVIS_TOOL_H
+
+#include <QWidget>
+
+#include "drgui_tool_interface.h"
+#include "drgui_options_interface.h"
+#include "drvis_view.h"
+
+class QLabel;
+class QPushButton;
+class QSpinBox;
+
+/* Reads the options saved by drvis_options_page_t */
+drvis_view_options_t
+drvis_read_view_options(void);
+
+class drvis_tool_t : public drgui_tool_interface_t
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID "DynamoRIO.DrGUI.ToolInterface")
+    Q_INTERFACES(drgui_tool_interface_t)
+
+public:
+    QStringList tool_names(void) const;
+
+    QWidget *create_instance(void);
+
+    drgui_options_interface_t *create_options_page(void);
+
+    void open_file(const QString &path, int line_num);
+};
+
+class drvis_tool_widget_t : public QWidget
+{
+    Q_OBJECT
+
+public:
+    drvis_tool_widget_t(QWidget *parent = 0);
+
+    drvis_view_t *view(void);
+
+private slots:
+    void choose_file(void);
+
+private:
+    drvis_view_t *view_;
+    QPushButton *open_button;
+    QPushButton *fit_button;
+    QLabel *status_label;
+};
+
+class drvis_options_page_t : public drgui_options_interface_t
+{
+    Q_OBJECT
+
+public:
+    drvis_options_page_t(void);
+
+    QStringList tool_names(void) const;
+
+    void write_settings(void);
+
+    void read_settings(void);
+
+private:
+    QSpinBox *open_radius_spin;
+    QSpinBox *max_edges_spin;
+    QSpinBox *chunk_functions_spin;
+};
+
+#endif
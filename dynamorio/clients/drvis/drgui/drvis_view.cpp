@@ -0,0 +1,497 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_view.cpp
+ *
+ * Draws a drvis_graph_t with level of detail.  Each frame only visits the
+ * grid cells in view, and nodes that would land on an already drawn pixel
+ * are skipped, so the cost of a frame is bounded by the size of the widget
+ * rather than by the size of the graph.
+ */
+
+#ifdef __CLASS__
+#  undef __CLASS__
+#endif
+#define __CLASS__ "drvis_view_t::"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QLineF>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include <math.h>
+
+#include "drvis_view.h"
+
+#define HEAT_BUCKETS 8
+/* Nodes smaller than this screen radius are drawn as points */
+#define POINT_RADIUS 1.5f
+/* Side in pixels of the bins used to skip overdrawn points */
+#define PIXEL_BIN 2
+#define ZOOM_PER_DEGREE 1.0015
+
+/* Public
+ * Constructor
+ */
+drvis_view_t::drvis_view_t(const drvis_view_options_t &ops_, QWidget *parent)
+    : QWidget(parent), ops(ops_), loader(NULL), fitted(false), scale_(1),
+      frame(0), frame_ms(0), frame_nodes(0), frame_blocks(false)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    setMinimumSize(200, 200);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+/* Public
+ * Destructor
+ */
+drvis_view_t::~drvis_view_t(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    delete loader;
+}
+
+/* Public
+ * Starts loading path in the background
+ */
+void
+drvis_view_t::load(const QString &path)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    delete loader;
+    graph_.clear();
+    func_frame.clear();
+    block_frame.clear();
+    fitted = false;
+    load_error.clear();
+    loader = new drvis_loader_t(path, ops.chunk_functions, this);
+    connect(loader, SIGNAL(functions_ready()),
+            this, SLOT(take_functions()));
+    connect(loader, SIGNAL(blocks_ready()),
+            this, SLOT(take_blocks()));
+    connect(loader, SIGNAL(load_failed(const QString &)),
+            this, SLOT(loader_failed(const QString &)));
+    connect(loader, SIGNAL(finished()),
+            this, SLOT(loader_finished()));
+    loader->start(QThread::LowPriority);
+    update_status();
+    update();
+}
+
+bool
+drvis_view_t::loading(void) const
+{
+    return loader != NULL && loader->isRunning();
+}
+
+void
+drvis_view_t::set_view(const QPointF &center, qreal scale)
+{
+    center_ = center;
+    scale_ = qMax(scale, (qreal)1e-6);
+    fitted = true;
+    update();
+}
+
+void
+drvis_view_t::fit(void)
+{
+    if (!graph_.bounds.isValid())
+        return;
+    set_view(graph_.bounds.center(),
+             0.95 * qMin(width() / graph_.bounds.width(),
+                         height() / graph_.bounds.height()));
+}
+
+const drvis_graph_t &
+drvis_view_t::graph(void) const
+{
+    return graph_;
+}
+
+qreal
+drvis_view_t::scale(void) const
+{
+    return scale_;
+}
+
+QPointF
+drvis_view_t::center(void) const
+{
+    return center_;
+}
+
+double
+drvis_view_t::last_frame_ms(void) const
+{
+    return frame_ms;
+}
+
+int
+drvis_view_t::last_frame_nodes(void) const
+{
+    return frame_nodes;
+}
+
+bool
+drvis_view_t::last_frame_blocks(void) const
+{
+    return frame_blocks;
+}
+
+/* Private Slot
+ * Receives the laid out functions from the loader
+ */
+void
+drvis_view_t::take_functions(void)
+{
+    drvis_chunk_t functions;
+    QRectF bounds;
+    int total_blocks;
+    if (sender() != loader ||
+        !loader->take_functions(&functions, &bounds, &total_blocks))
+        return;
+    graph_.set_functions(functions, bounds, total_blocks);
+    func_frame.fill(0, graph_.functions.nodes.size());
+    if (!fitted)
+        fit();
+    update_status();
+    update();
+}
+
+/* Private Slot
+ * Receives the chunks of blocks the loader has read so far
+ */
+void
+drvis_view_t::take_blocks(void)
+{
+    drvis_chunk_t chunk;
+    bool added = false;
+    if (sender() != loader)
+        return;
+    while (loader->take_blocks(&chunk)) {
+        graph_.add_blocks(chunk);
+        added = true;
+    }
+    if (!added)
+        return;
+    block_frame.resize(graph_.blocks.nodes.size());
+    update_status();
+    update();
+}
+
+/* Private Slot */
+void
+drvis_view_t::loader_failed(const QString &msg)
+{
+    if (sender() != loader)
+        return;
+    qDebug() << "WARNING:" << msg;
+    load_error = msg;
+    update_status();
+    update();
+}
+
+/* Private Slot
+ * Collects anything left over and reports the outcome
+ */
+void
+drvis_view_t::loader_finished(void)
+{
+    if (sender() != loader)
+        return;
+    take_blocks();
+    update_status();
+    emit load_finished(load_error.isEmpty());
+}
+
+void
+drvis_view_t::update_status(void)
+{
+    QString status;
+    if (!load_error.isEmpty()) {
+        status = load_error;
+    } else if (graph_.functions.nodes.isEmpty()) {
+        status = loader == NULL ? tr("No dump loaded") : tr("Laying out functions...");
+    } else {
+        status = tr("%1 functions, %2 blocks%3 | %4 level | %5 nodes in %6 ms")
+            .arg(graph_.functions.nodes.size())
+            .arg(graph_.blocks.nodes.size())
+            .arg(loading() ? tr(" (loading)") : QString())
+            .arg(frame_blocks ? tr("block") : tr("function"))
+            .arg(frame_nodes)
+            .arg(frame_ms, 0, 'f', 1);
+    }
+    emit status_changed(status);
+}
+
+QPointF
+drvis_view_t::to_screen(const drvis_node_t &node) const
+{
+    return QPointF((node.x - center_.x()) * scale_ + width() / 2.0,
+                   (node.y - center_.y()) * scale_ + height() / 2.0);
+}
+
+/* Marks the pixel bin under a small node as drawn.  Returns false if the bin
+ * was already drawn, in which case the node would not be visible anyway.
+ */
+bool
+drvis_view_t::claim_pixel(const QPointF &p, float screen_radius)
+{
+    int bins_x = (width() + PIXEL_BIN - 1) / PIXEL_BIN;
+    int bx = (int)p.x() / PIXEL_BIN;
+    int by = (int)p.y() / PIXEL_BIN;
+    if (screen_radius >= POINT_RADIUS)
+        return true;
+    if (p.x() < 0 || p.y() < 0 || bx >= bins_x || by * bins_x + bx >= pixels.size())
+        return false;
+    if (pixels[by * bins_x + bx] != 0)
+        return false;
+    pixels[by * bins_x + bx] = 1;
+    return true;
+}
+
+static int
+heat_bucket(uint64_t num_executions, uint64_t max_executions)
+{
+    if (num_executions == 0 || max_executions == 0)
+        return 0;
+    return qBound(0, (int)(HEAT_BUCKETS * log((double)num_executions + 1) /
+                           log((double)max_executions + 1)),
+                  HEAT_BUCKETS - 1);
+}
+
+static QColor
+bucket_color(int bucket)
+{
+    /* blue for cold through red for hot */
+    return QColor::fromHsvF(0.66 * (1.0 - (qreal)bucket / (HEAT_BUCKETS - 1)),
+                            0.8, 0.9);
+}
+
+/* Protected */
+void
+drvis_view_t::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    draw(&painter);
+}
+
+/* Private
+ * Draws one frame: open functions show their blocks, the rest are single
+ * nodes, and edges are drawn between whatever is on screen until the edge
+ * budget runs out.
+ */
+void
+drvis_view_t::draw(QPainter *painter)
+{
+    QElapsedTimer timer;
+    timer.start();
+    painter->fillRect(rect(), palette().base());
+    if (graph_.functions.nodes.isEmpty()) {
+        painter->drawText(rect(), Qt::AlignCenter,
+                          load_error.isEmpty() ? tr("Loading...") : load_error);
+        return;
+    }
+    frame++;
+    const uint32_t closed_stamp = frame << 1;
+    const uint32_t open_stamp = closed_stamp | 1;
+    const qreal half_w = width() / (2 * scale_);
+    const qreal half_h = height() / (2 * scale_);
+    const QRectF view(center_.x() - half_w, center_.y() - half_h, 2 * half_w, 2 * half_h);
+    pixels.fill(0, ((width() + PIXEL_BIN - 1) / PIXEL_BIN) *
+                ((height() + PIXEL_BIN - 1) / PIXEL_BIN));
+
+    QVector<QPointF> points[HEAT_BUCKETS];
+    QVector<QPair<QRectF, int> > discs;
+    QVector<QRectF> outlines;
+    QVector<uint32_t> drawn_funcs, drawn_blocks;
+    QRectF open_area;
+
+    /* Functions */
+    const drvis_level_t &funcs = graph_.functions;
+    qreal margin = funcs.max_radius;
+    visible.clear();
+    funcs.grid.query(view.adjusted(-margin, -margin, margin, margin), &visible);
+    for (int i = 0; i < visible.size(); i++) {
+        uint32_t f = visible.at(i);
+        const drvis_node_t &node = funcs.nodes.at(f);
+        float sr = node.radius * scale_;
+        if (node.x + node.radius < view.left() || node.x - node.radius > view.right() ||
+            node.y + node.radius < view.top() || node.y - node.radius > view.bottom())
+            continue;
+        QPointF p = to_screen(node);
+        if (sr >= ops.open_radius && f < graph_.loaded_functions) {
+            func_frame[f] = open_stamp;
+            outlines.append(QRectF(p.x() - sr, p.y() - sr, 2 * sr, 2 * sr));
+            open_area |= QRectF(node.x - node.radius, node.y - node.radius,
+                                2 * node.radius, 2 * node.radius);
+            continue;
+        }
+        if (!claim_pixel(p, sr))
+            continue;
+        func_frame[f] = closed_stamp;
+        drawn_funcs.append(f);
+        int bucket = heat_bucket(node.num_executions, funcs.max_executions);
+        if (sr < POINT_RADIUS)
+            points[bucket].append(p);
+        else
+            discs.append(qMakePair(QRectF(p.x() - sr, p.y() - sr, 2 * sr, 2 * sr),
+                                   bucket));
+    }
+
+    /* Blocks of open functions */
+    const drvis_level_t &blocks = graph_.blocks;
+    frame_blocks = !outlines.isEmpty();
+    if (frame_blocks) {
+        margin = blocks.max_radius;
+        visible.clear();
+        blocks.grid.query(open_area.intersected(view)
+                          .adjusted(-margin, -margin, margin, margin), &visible);
+        for (int i = 0; i < visible.size(); i++) {
+            uint32_t b = visible.at(i);
+            const drvis_node_t &node = blocks.nodes.at(b);
+            if (func_frame.at(node.parent) != open_stamp ||
+                !view.contains(node.x, node.y))
+                continue;
+            QPointF p = to_screen(node);
+            float sr = node.radius * scale_;
+            if (!claim_pixel(p, sr))
+                continue;
+            block_frame[b] = frame;
+            drawn_blocks.append(b);
+            int bucket = heat_bucket(node.num_executions, blocks.max_executions);
+            if (sr < POINT_RADIUS)
+                points[bucket].append(p);
+            else
+                discs.append(qMakePair(QRectF(p.x() - sr, p.y() - sr, 2 * sr, 2 * sr),
+                                       bucket));
+        }
+    }
+
+    /* Edges between drawn nodes, within the budget */
+    QVector<QLineF> lines;
+    for (int i = 0; i < drawn_funcs.size() && lines.size() < ops.max_edges; i++) {
+        uint32_t f = drawn_funcs.at(i);
+        for (uint32_t e = funcs.first.at(f); e < funcs.first.at(f + 1); e++) {
+            uint32_t d = funcs.dst.at(e);
+            if (func_frame.at(d) == closed_stamp)
+                lines.append(QLineF(to_screen(funcs.nodes.at(f)),
+                                    to_screen(funcs.nodes.at(d))));
+        }
+    }
+    for (int i = 0; i < drawn_blocks.size() && lines.size() < ops.max_edges; i++) {
+        uint32_t b = drawn_blocks.at(i);
+        QPointF p = to_screen(blocks.nodes.at(b));
+        for (uint32_t e = blocks.first.at(b); e < blocks.first.at(b + 1); e++) {
+            uint32_t d = blocks.dst.at(e);
+            if (d >= (uint32_t)blocks.nodes.size())
+                continue;
+            const drvis_node_t &dst = blocks.nodes.at(d);
+            if (block_frame.at(d) == frame)
+                lines.append(QLineF(p, to_screen(dst)));
+            else if (func_frame.at(dst.parent) == closed_stamp)
+                lines.append(QLineF(p, to_screen(funcs.nodes.at(dst.parent))));
+        }
+    }
+    painter->setPen(QPen(palette().color(QPalette::Mid), 0));
+    painter->drawLines(lines);
+
+    /* Nodes on top */
+    painter->setPen(QPen(palette().color(QPalette::Dark), 0));
+    painter->setBrush(Qt::NoBrush);
+    for (int i = 0; i < outlines.size(); i++)
+        painter->drawEllipse(outlines.at(i));
+    for (int i = 0; i < discs.size(); i++) {
+        painter->setBrush(bucket_color(discs.at(i).second));
+        painter->drawEllipse(discs.at(i).first);
+    }
+    for (int bucket = 0; bucket < HEAT_BUCKETS; bucket++) {
+        if (points[bucket].isEmpty())
+            continue;
+        painter->setPen(QPen(bucket_color(bucket), PIXEL_BIN));
+        painter->drawPoints(points[bucket].constData(), points[bucket].size());
+    }
+
+    frame_nodes = drawn_funcs.size() + drawn_blocks.size();
+    frame_ms = timer.nsecsElapsed() / 1e6;
+    update_status();
+}
+
+/* Protected
+ * Zooms around the cursor
+ */
+void
+drvis_view_t::wheelEvent(QWheelEvent *event)
+{
+    QPointF offset = QPointF(event->pos()) - QPointF(width() / 2.0, height() / 2.0);
+    QPointF world = center_ + offset / scale_;
+    qreal new_scale = scale_ * pow(ZOOM_PER_DEGREE, event->angleDelta().y());
+    set_view(world - offset / new_scale, new_scale);
+    event->accept();
+}
+
+/* Protected */
+void
+drvis_view_t::mousePressEvent(QMouseEvent *event)
+{
+    last_mouse = event->pos();
+    event->accept();
+}
+
+/* Protected
+ * Pans with the left button held
+ */
+void
+drvis_view_t::mouseMoveEvent(QMouseEvent *event)
+{
+    if ((event->buttons() & Qt::LeftButton) == 0)
+        return;
+    QPointF delta = QPointF(event->pos() - last_mouse) / scale_;
+    last_mouse = event->pos();
+    set_view(center_ - delta, scale_);
+    event->accept();
+}
+
+/* Protected
+ * Shows the whole graph again
+ */
+void
+drvis_view_t::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    fit();
+    event->accept();
+}
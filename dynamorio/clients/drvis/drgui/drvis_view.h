@@ -0,0 +1,153 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_view.h
+ *
+ * Defines the widget that draws a drvis_graph_t with level of detail:
+ * functions that are small on screen are drawn as single nodes and open up
+ * into their blocks as the user zooms in.
+ */
+
+#ifndef DRVIS_VIEW_H
+#define DRVIS_VIEW_H
+
+#include <QPointF>
+#include <QVector>
+#include <QWidget>
+
+#include "drvis_graph.h"
+
+class QPainter;
+
+struct drvis_view_options_t
+{
+    /* Screen radius in pixels at which a function opens into its blocks */
+    int open_radius;
+    /* Edges drawn per frame at most */
+    int max_edges;
+    /* Functions per chunk handed over by the loader */
+    int chunk_functions;
+};
+
+class drvis_view_t : public QWidget
+{
+    Q_OBJECT
+
+public:
+    drvis_view_t(const drvis_view_options_t &ops_, QWidget *parent = 0);
+
+    ~drvis_view_t(void);
+
+    /* Starts loading path in the background, replacing any current graph */
+    void load(const QString &path);
+
+    bool loading(void) const;
+
+    /* Centers on world point center at scale pixels per world unit */
+    void set_view(const QPointF &center, qreal scale);
+
+    const drvis_graph_t &graph(void) const;
+
+    qreal scale(void) const;
+
+    QPointF center(void) const;
+
+    /* Time taken and nodes drawn by the last frame, and whether any
+     * function was open
+     */
+    double last_frame_ms(void) const;
+
+    int last_frame_nodes(void) const;
+
+    bool last_frame_blocks(void) const;
+
+public slots:
+    /* Fits the whole graph in the widget */
+    void fit(void);
+
+signals:
+    void status_changed(const QString &status);
+
+    void load_finished(bool success);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+    void wheelEvent(QWheelEvent *event);
+
+    void mousePressEvent(QMouseEvent *event);
+
+    void mouseMoveEvent(QMouseEvent *event);
+
+    void mouseDoubleClickEvent(QMouseEvent *event);
+
+private slots:
+    void take_functions(void);
+
+    void take_blocks(void);
+
+    void loader_failed(const QString &msg);
+
+    void loader_finished(void);
+
+private:
+    void draw(QPainter *painter);
+
+    bool claim_pixel(const QPointF &p, float screen_radius);
+
+    QPointF to_screen(const drvis_node_t &node) const;
+
+    void update_status(void);
+
+    drvis_view_options_t ops;
+    drvis_graph_t graph_;
+    drvis_loader_t *loader;
+    bool fitted;
+    QString load_error;
+
+    QPointF center_;
+    qreal scale_;
+    QPoint last_mouse;
+
+    /* Per-frame scratch, kept to avoid reallocation */
+    QVector<uint32_t> visible;
+    QVector<uint32_t> func_frame;
+    QVector<uint32_t> block_frame;
+    QVector<uchar> pixels;
+    uint32_t frame;
+    double frame_ms;
+    int frame_nodes;
+    bool frame_blocks;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_view_bench.cpp
+ *
+ * Loads a binary dump into a drvis_view_t and times frames at zoom levels
+ * from the whole graph down to single blocks, as well as while the dump is
+ * still loading.  Runs on the offscreen platform unless QT_QPA_PLATFORM says
+ * otherwise, so it works headless.
+ */
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QThread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drvis_view.h"
+
+static const char *usage_str =
+    "drvis_view_bench: time frames of the drvis graph view\n"
+    "usage: drvis_view_bench [options] <binary dump>\n"
+    "      --help                          Print this message.\n"
+    "      --width <int>                   View width (default 1280).\n"
+    "      --height <int>                  View height (default 800).\n"
+    "      --frames <int>                  Frames per zoom level (default 20).\n"
+    "      --max_ms <float>                Fail if any frame takes longer.\n";
+
+#define NUM_ZOOMS 7
+
+int
+main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int width = 1280, height = 800, frames = 20;
+    double max_ms = 0, worst_ms = 0, loading_ms = 0;
+    int loading_frames = 0;
+
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            fprintf(stdout, "%s", usage_str);
+            return 0;
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max_ms") == 0 && i + 1 < argc) {
+            max_ms = atof(argv[++i]);
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "unknown option %s\n%s", argv[i], usage_str);
+            return 1;
+        }
+    }
+    if (path == NULL || width <= 0 || height <= 0 || frames <= 0) {
+        fprintf(stderr, "%s", usage_str);
+        return 1;
+    }
+
+    drvis_view_options_t ops;
+    ops.open_radius = 24;
+    ops.max_edges = 20000;
+    ops.chunk_functions = 1024;
+    drvis_view_t view(ops);
+    view.resize(width, height);
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+
+    /* Keep drawing while the loader runs, as an interactive user would */
+    QElapsedTimer load_timer;
+    load_timer.start();
+    view.load(QString::fromLocal8Bit(path));
+    while (view.loading()) {
+        QApplication::processEvents(QEventLoop::AllEvents, 10);
+        view.render(&image);
+        loading_ms = qMax(loading_ms, view.last_frame_ms());
+        loading_frames++;
+        QThread::msleep(15);
+    }
+    /* deliver the last chunks and the finished signal */
+    QApplication::processEvents();
+    const drvis_graph_t &graph = view.graph();
+    if (graph.functions.nodes.isEmpty()) {
+        fprintf(stderr, "failed to load %s\n", path);
+        return 1;
+    }
+    fprintf(stdout, "loaded %d functions and %d blocks in %.2fs; "
+            "%d frames while loading, slowest %.2f ms\n",
+            graph.functions.nodes.size(), graph.blocks.nodes.size(),
+            load_timer.elapsed() / 1000.0, loading_frames, loading_ms);
+    worst_ms = loading_ms;
+
+    /* Zoom in on the hottest function */
+    view.fit();
+    QPointF target = graph.bounds.center();
+    uint64_t hottest = 0;
+    for (int i = 0; i < graph.functions.nodes.size(); i++) {
+        const drvis_node_t &node = graph.functions.nodes.at(i);
+        if (node.num_executions >= hottest) {
+            hottest = node.num_executions;
+            target = QPointF(node.x, node.y);
+        }
+    }
+    qreal fit_scale = view.scale();
+    fprintf(stdout, "%6s %8s %8s %10s %10s\n",
+            "zoom", "level", "nodes", "avg ms", "max ms");
+    for (int z = 0; z < NUM_ZOOMS; z++) {
+        qreal zoom = qreal(1 << (2 * z));
+        double total = 0, slowest = 0;
+        view.set_view(z == 0 ? graph.bounds.center() : target, fit_scale * zoom);
+        for (int f = 0; f < frames; f++) {
+            view.render(&image);
+            total += view.last_frame_ms();
+            slowest = qMax(slowest, view.last_frame_ms());
+        }
+        fprintf(stdout, "%6g %8s %8d %10.2f %10.2f\n", zoom,
+                view.last_frame_blocks() ? "blocks" : "funcs", view.last_frame_nodes(),
+                total / frames, slowest);
+        worst_ms = qMax(worst_ms, slowest);
+    }
+    if (max_ms > 0 && worst_ms > max_ms) {
+        fprintf(stderr, "slowest frame took %.2f ms, over the %.2f ms limit\n",
+                worst_ms, max_ms);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,729 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_convert.c
+ *
+ * Converts a text block/edge dump (BB_FORMAT(...) header followed by BB(...),
+ * INTRA(...), and INTER(...) records) into the binary columnar format
+ * described in drvis_dump.h.
+ */
+
+#include "drvis_dump.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int verbose = 1;
+
+#define PRINT(lvl, ...) do {                                \
+    if (verbose >= lvl) {                                   \
+        fprintf(stdout, "[DRVIS_CONVERT] INFO(%d):  ", lvl); \
+        fprintf(stdout, __VA_ARGS__);                       \
+    }                                                       \
+} while (0)
+
+#define WARN(...) do {                                      \
+    fprintf(stderr, "[DRVIS_CONVERT] WARNING:  ");          \
+    fprintf(stderr, __VA_ARGS__);                           \
+} while (0)
+
+#define ASSERT(val, ...) do {                               \
+    if (!(val)) {                                           \
+        fprintf(stderr, "[DRVIS_CONVERT] ERROR:    ");      \
+        fprintf(stderr, __VA_ARGS__);                       \
+        exit(1);                                            \
+    }                                                       \
+} while (0)
+
+const char *usage_str =
+    "drvis_convert: convert a text block/edge dump to the binary dump format\n"
+    "usage: drvis_convert [options] <input text dump> <output binary dump>\n"
+    "      --help                          Print this message.\n"
+    "      --verbose <int>                 Verbose level.\n"
+    "      --verify                        Re-read the output and compare it with the input.\n";
+
+#define MAX_LINE 4096
+
+/****************************************************************************
+ * Input Parsing
+ */
+
+/* The BB_FORMAT fields we know about */
+enum {
+    FIELD_IS_ROOT,
+    FIELD_IS_FUNCTION_ENTRY,
+    FIELD_IS_FUNCTION_EXIT,
+    FIELD_IS_APP_CODE,
+    FIELD_IS_ALLOCATOR,
+    FIELD_IS_DEALLOCATOR,
+    FIELD_NUM_EXECUTIONS,
+    FIELD_FUNCTION_ID,
+    FIELD_BLOCK_ID,
+    FIELD_USED_REGS,
+    FIELD_ENTRY_REGS,
+    FIELD_NUM_OUTGOING_JUMPS,
+    FIELD_HAS_OUTGOING_INDIRECT_JMP,
+    FIELD_APP_NAME,
+    FIELD_APP_OFFSET_BEGIN,
+    FIELD_APP_OFFSET_END,
+    FIELD_NUM_INTERRUPTS,
+    NUM_FIELDS,
+    FIELD_UNKNOWN = NUM_FIELDS,
+};
+
+static const char * const field_names[NUM_FIELDS] = {
+    "is_root",
+    "is_function_entry",
+    "is_function_exit",
+    "is_app_code",
+    "is_allocator",
+    "is_deallocator",
+    "num_executions",
+    "function_id",
+    "block_id",
+    "used_regs",
+    "entry_regs",
+    "num_outgoing_jumps",
+    "has_outgoing_indirect_jmp",
+    "app_name",
+    "app_offset_begin",
+    "app_offset_end",
+    "num_interrupts",
+};
+
+static uint8_t
+field_flag(int field)
+{
+    switch (field) {
+    case FIELD_IS_ROOT:                   return DRVIS_BLOCK_ROOT;
+    case FIELD_IS_FUNCTION_ENTRY:         return DRVIS_BLOCK_FUNCTION_ENTRY;
+    case FIELD_IS_FUNCTION_EXIT:          return DRVIS_BLOCK_FUNCTION_EXIT;
+    case FIELD_IS_APP_CODE:               return DRVIS_BLOCK_APP_CODE;
+    case FIELD_IS_ALLOCATOR:              return DRVIS_BLOCK_ALLOCATOR;
+    case FIELD_IS_DEALLOCATOR:            return DRVIS_BLOCK_DEALLOCATOR;
+    case FIELD_HAS_OUTGOING_INDIRECT_JMP: return DRVIS_BLOCK_INDIRECT_JMP;
+    default:                              return 0;
+    }
+}
+
+/* BB(...) column number -> FIELD_*, from the BB_FORMAT header */
+#define MAX_COLUMNS 64
+static int columns[MAX_COLUMNS];
+static int num_columns;
+
+typedef struct _block_rec_t {
+    uint32_t block_id;
+    uint32_t function_id;
+    uint64_t num_executions;
+    uint32_t used_regs;
+    uint32_t entry_regs;
+    uint32_t num_out_jumps;
+    uint32_t num_interrupts;
+    uint32_t app_id;
+    uint64_t app_offs_begin;
+    uint64_t app_offs_end;
+    uint8_t  flags;
+    size_t   order; /* position in the input, for stable sorting */
+} block_rec_t;
+
+typedef struct _edge_rec_t {
+    uint32_t src;
+    uint32_t dst;
+    size_t   row;   /* row of src, or the number of blocks if unknown */
+    size_t   order;
+} edge_rec_t;
+
+/* growable arrays */
+#define ARRAY_APPEND(arr, num, cap) do {                                   \
+    if ((num) == (cap)) {                                                  \
+        (cap) = (cap) == 0 ? 1024 : (cap) * 2;                             \
+        (arr) = realloc((arr), (cap) * sizeof(*(arr)));                    \
+        ASSERT((arr) != NULL, "out of memory\n");                          \
+    }                                                                      \
+    (num)++;                                                               \
+} while (0)
+
+static block_rec_t *blocks;
+static size_t num_blocks, cap_blocks;
+static edge_rec_t *edges[DRVIS_EDGE_KINDS];
+static size_t num_edges[DRVIS_EDGE_KINDS], cap_edges[DRVIS_EDGE_KINDS];
+static char **apps;
+static size_t num_apps, cap_apps;
+
+static uint32_t
+app_lookup_or_add(const char *name)
+{
+    static size_t last;
+    size_t i;
+    /* there are only a handful of apps and consecutive blocks share one */
+    if (last < num_apps && strcmp(apps[last], name) == 0)
+        return (uint32_t)last;
+    for (i = 0; i < num_apps; i++) {
+        if (strcmp(apps[i], name) == 0) {
+            last = i;
+            return (uint32_t)i;
+        }
+    }
+    ARRAY_APPEND(apps, num_apps, cap_apps);
+    apps[num_apps - 1] = strdup(name);
+    ASSERT(apps[num_apps - 1] != NULL, "out of memory\n");
+    last = num_apps - 1;
+    return (uint32_t)last;
+}
+
+/* Splits the comma-separated list in buf, which must end in ')', in place */
+static int
+split_fields(char *buf, char **fields, int max_fields)
+{
+    int n = 0;
+    char *end = strrchr(buf, ')');
+    if (end == NULL)
+        return -1;
+    *end = '\0';
+    while (n < max_fields) {
+        fields[n++] = buf;
+        buf = strchr(buf, ',');
+        if (buf == NULL)
+            return n;
+        *buf++ = '\0';
+    }
+    return -1;
+}
+
+static void
+parse_format(char *list, size_t line_num)
+{
+    char *fields[MAX_COLUMNS];
+    int i, j, n = split_fields(list, fields, MAX_COLUMNS);
+    bool seen[NUM_FIELDS] = { 0 };
+    ASSERT(n > 0, "line %zu: malformed BB_FORMAT\n", line_num);
+    for (i = 0; i < n; i++) {
+        columns[i] = FIELD_UNKNOWN;
+        for (j = 0; j < NUM_FIELDS; j++) {
+            if (strcmp(fields[i], field_names[j]) == 0) {
+                columns[i] = j;
+                seen[j] = true;
+                break;
+            }
+        }
+        if (columns[i] == FIELD_UNKNOWN)
+            WARN("ignoring unknown BB_FORMAT field %s\n", fields[i]);
+    }
+    num_columns = n;
+    ASSERT(seen[FIELD_BLOCK_ID] && seen[FIELD_FUNCTION_ID],
+           "BB_FORMAT must have block_id and function_id\n");
+}
+
+static void
+parse_block(char *list, size_t line_num)
+{
+    char *fields[MAX_COLUMNS];
+    block_rec_t *rec;
+    int i, n;
+    ASSERT(num_columns > 0, "line %zu: BB before BB_FORMAT\n", line_num);
+    n = split_fields(list, fields, MAX_COLUMNS);
+    ASSERT(n == num_columns, "line %zu: expected %d fields, found %d\n",
+           line_num, num_columns, n);
+    ARRAY_APPEND(blocks, num_blocks, cap_blocks);
+    rec = &blocks[num_blocks - 1];
+    memset(rec, 0, sizeof(*rec));
+    rec->order = num_blocks - 1;
+    for (i = 0; i < n; i++) {
+        uint64_t val = 0;
+        int field = columns[i];
+        if (field == FIELD_UNKNOWN)
+            continue;
+        if (field == FIELD_APP_NAME) {
+            rec->app_id = app_lookup_or_add(fields[i]);
+            continue;
+        }
+        ASSERT(sscanf(fields[i], "%"SCNu64, &val) == 1,
+               "line %zu: invalid %s %s\n", line_num, field_names[field], fields[i]);
+        switch (field) {
+        case FIELD_NUM_EXECUTIONS:   rec->num_executions = val; break;
+        case FIELD_FUNCTION_ID:      rec->function_id    = (uint32_t)val; break;
+        case FIELD_BLOCK_ID:         rec->block_id       = (uint32_t)val; break;
+        case FIELD_USED_REGS:        rec->used_regs      = (uint32_t)val; break;
+        case FIELD_ENTRY_REGS:       rec->entry_regs     = (uint32_t)val; break;
+        case FIELD_NUM_OUTGOING_JUMPS: rec->num_out_jumps = (uint32_t)val; break;
+        case FIELD_NUM_INTERRUPTS:   rec->num_interrupts = (uint32_t)val; break;
+        case FIELD_APP_OFFSET_BEGIN: rec->app_offs_begin = val; break;
+        case FIELD_APP_OFFSET_END:   rec->app_offs_end   = val; break;
+        default:
+            if (val != 0)
+                rec->flags |= field_flag(field);
+            break;
+        }
+    }
+}
+
+static void
+parse_edge(drvis_edge_kind_t kind, char *list, size_t line_num)
+{
+    edge_rec_t *rec;
+    unsigned int src, dst;
+    ASSERT(sscanf(list, "%u,%u)", &src, &dst) == 2,
+           "line %zu: malformed edge\n", line_num);
+    ARRAY_APPEND(edges[kind], num_edges[kind], cap_edges[kind]);
+    rec = &edges[kind][num_edges[kind] - 1];
+    rec->src = src;
+    rec->dst = dst;
+    rec->order = num_edges[kind] - 1;
+}
+
+static void
+read_text_dump(const char *path)
+{
+    char line[MAX_LINE];
+    size_t line_num = 0;
+    FILE *f = fopen(path, "r");
+    ASSERT(f != NULL, "failed to open %s\n", path);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        size_t len = strlen(line);
+        line_num++;
+        ASSERT(len < sizeof(line) - 1 || line[len - 1] == '\n',
+               "line %zu is too long\n", line_num);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (strncmp(line, "BB(", 3) == 0)
+            parse_block(line + 3, line_num);
+        else if (strncmp(line, "INTRA(", 6) == 0)
+            parse_edge(DRVIS_EDGE_INTRA, line + 6, line_num);
+        else if (strncmp(line, "INTER(", 6) == 0)
+            parse_edge(DRVIS_EDGE_INTER, line + 6, line_num);
+        else if (strncmp(line, "BB_FORMAT(", 10) == 0)
+            parse_format(line + 10, line_num);
+        else
+            WARN("line %zu: ignoring unknown record\n", line_num);
+    }
+    fclose(f);
+    PRINT(1, "read %zu blocks, %zu intra edges, %zu inter edges from %s\n",
+          num_blocks, num_edges[DRVIS_EDGE_INTRA], num_edges[DRVIS_EDGE_INTER],
+          path);
+}
+
+/****************************************************************************
+ * Sorting and Indexing
+ */
+
+static int
+compare_block_id(const void *a_in, const void *b_in)
+{
+    const block_rec_t *a = a_in, *b = b_in;
+    if (a->block_id != b->block_id)
+        return a->block_id < b->block_id ? -1 : 1;
+    return a->order < b->order ? -1 : (a->order > b->order ? 1 : 0);
+}
+
+static int
+compare_function_block(const void *a_in, const void *b_in)
+{
+    const block_rec_t *a = a_in, *b = b_in;
+    if (a->function_id != b->function_id)
+        return a->function_id < b->function_id ? -1 : 1;
+    return a->block_id < b->block_id ? -1 : (a->block_id > b->block_id ? 1 : 0);
+}
+
+static int
+compare_edge_row(const void *a_in, const void *b_in)
+{
+    const edge_rec_t *a = a_in, *b = b_in;
+    if (a->row != b->row)
+        return a->row < b->row ? -1 : 1;
+    return a->order < b->order ? -1 : (a->order > b->order ? 1 : 0);
+}
+
+/* sorted by block id */
+static uint32_t *index_id;
+static uint32_t *index_row;
+static uint32_t *func_id, *func_first_row, *func_num_rows;
+static size_t num_funcs;
+static uint32_t *edge_first[DRVIS_EDGE_KINDS];
+
+static size_t
+block_row(uint32_t block_id)
+{
+    size_t lo = 0, hi = num_blocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index_id[mid] < block_id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < num_blocks && index_id[lo] == block_id)
+        return index_row[lo];
+    return num_blocks;
+}
+
+static void
+build_indexes(void)
+{
+    size_t i, j, kind;
+
+    /* With no blocks there is nothing to sort or index: every edge leaves an
+     * unknown block and each edge offset array is just its terminating 0.
+     */
+    if (num_blocks == 0) {
+        for (kind = 0; kind < DRVIS_EDGE_KINDS; kind++) {
+            if (num_edges[kind] > 0) {
+                WARN("%zu %s edges leave unknown blocks\n", num_edges[kind],
+                     kind == DRVIS_EDGE_INTRA ? "intra" : "inter");
+            }
+            edge_first[kind] = calloc(1, sizeof(uint32_t));
+            ASSERT(edge_first[kind] != NULL, "out of memory\n");
+        }
+        return;
+    }
+
+    /* drop duplicate block ids, keeping the first one seen */
+    qsort(blocks, num_blocks, sizeof(*blocks), compare_block_id);
+    for (i = 0, j = 0; i < num_blocks; i++) {
+        if (j > 0 && blocks[i].block_id == blocks[j - 1].block_id) {
+            WARN("dropping duplicate block %u\n", blocks[i].block_id);
+            continue;
+        }
+        blocks[j++] = blocks[i];
+    }
+    num_blocks = j;
+    ASSERT(num_blocks < UINT32_MAX, "too many blocks\n");
+
+    qsort(blocks, num_blocks, sizeof(*blocks), compare_function_block);
+    index_id  = malloc(num_blocks * sizeof(*index_id) + 1);
+    index_row = malloc(num_blocks * sizeof(*index_row) + 1);
+    ASSERT(index_id != NULL && index_row != NULL, "out of memory\n");
+    /* blocks are sorted by block id within each function, so a merge of
+     * the functions would do, but a sort of the ids is simpler
+     */
+    for (i = 0; i < num_blocks; i++)
+        blocks[i].order = i; /* reuse as the row */
+    {
+        block_rec_t *by_id = malloc(num_blocks * sizeof(*by_id) + 1);
+        ASSERT(by_id != NULL, "out of memory\n");
+        memcpy(by_id, blocks, num_blocks * sizeof(*by_id));
+        qsort(by_id, num_blocks, sizeof(*by_id), compare_block_id);
+        for (i = 0; i < num_blocks; i++) {
+            index_id[i]  = by_id[i].block_id;
+            index_row[i] = (uint32_t)by_id[i].order;
+        }
+        free(by_id);
+    }
+
+    /* function index */
+    func_id        = malloc(num_blocks * sizeof(*func_id) + 1);
+    func_first_row = malloc(num_blocks * sizeof(*func_first_row) + 1);
+    func_num_rows  = malloc(num_blocks * sizeof(*func_num_rows) + 1);
+    ASSERT(func_id != NULL && func_first_row != NULL && func_num_rows != NULL,
+           "out of memory\n");
+    for (i = 0; i < num_blocks; i++) {
+        if (i == 0 || blocks[i].function_id != blocks[i - 1].function_id) {
+            func_id[num_funcs] = blocks[i].function_id;
+            func_first_row[num_funcs] = (uint32_t)i;
+            func_num_rows[num_funcs] = 0;
+            num_funcs++;
+        }
+        func_num_rows[num_funcs - 1]++;
+    }
+
+    /* edges in compressed sparse row form */
+    for (kind = 0; kind < DRVIS_EDGE_KINDS; kind++) {
+        size_t unknown = 0;
+        ASSERT(num_edges[kind] < UINT32_MAX, "too many edges\n");
+        for (i = 0; i < num_edges[kind]; i++) {
+            edges[kind][i].row = block_row(edges[kind][i].src);
+            if (edges[kind][i].row == num_blocks)
+                unknown++;
+        }
+        if (unknown > 0) {
+            WARN("%zu %s edges leave unknown blocks\n", unknown,
+                 kind == DRVIS_EDGE_INTRA ? "intra" : "inter");
+        }
+        qsort(edges[kind], num_edges[kind], sizeof(*edges[kind]), compare_edge_row);
+        edge_first[kind] = calloc(num_blocks + 1, sizeof(uint32_t));
+        ASSERT(edge_first[kind] != NULL, "out of memory\n");
+        for (i = 0, j = 0; i <= num_blocks; i++) {
+            edge_first[kind][i] = (uint32_t)j;
+            while (j < num_edges[kind] && edges[kind][j].row == i)
+                j++;
+        }
+    }
+}
+
+/****************************************************************************
+ * Output
+ */
+
+#define ALIGN_FORWARD_8(x) (((x) + 7) & ~(uint64_t)7)
+
+typedef struct _writer_t {
+    FILE *f;
+    const char *path;
+    uint64_t pos;
+} writer_t;
+
+static void
+write_bytes(writer_t *w, const void *data, size_t size)
+{
+    ASSERT(size == 0 || fwrite(data, 1, size, w->f) == size,
+           "failed to write %s\n", w->path);
+    w->pos += size;
+}
+
+static void
+write_padding(writer_t *w, uint64_t to)
+{
+    static const char zeroes[8];
+    ASSERT(to >= w->pos && to - w->pos < sizeof(zeroes), "bad padding\n");
+    write_bytes(w, zeroes, (size_t)(to - w->pos));
+}
+
+/* Writes a section, recording it in the header */
+static void
+write_section(writer_t *w, drvis_dump_header_t *hdr, drvis_section_t sec,
+              const void *data, size_t size)
+{
+    write_padding(w, ALIGN_FORWARD_8(w->pos));
+    hdr->sections[sec].offs = w->pos;
+    hdr->sections[sec].size = size;
+    write_bytes(w, data, size);
+}
+
+/* Writes one block column, gathered from the records by field offset */
+static void
+write_block_column(writer_t *w, drvis_dump_header_t *hdr, drvis_section_t sec,
+                   size_t field_offs, size_t field_size)
+{
+    char *col = malloc(num_blocks * field_size + 1);
+    size_t i;
+    ASSERT(col != NULL, "out of memory\n");
+    for (i = 0; i < num_blocks; i++) {
+        memcpy(col + i * field_size, (char *)&blocks[i] + field_offs,
+               field_size);
+    }
+    write_section(w, hdr, sec, col, num_blocks * field_size);
+    free(col);
+}
+
+#define WRITE_BLOCK_COLUMN(w, hdr, sec, field) \
+    write_block_column(w, hdr, sec, offsetof(block_rec_t, field), \
+                       sizeof(((block_rec_t *)0)->field))
+
+static void
+write_edge_column(writer_t *w, drvis_dump_header_t *hdr, drvis_section_t sec,
+                  drvis_edge_kind_t kind, bool dst)
+{
+    uint32_t *col = malloc(num_edges[kind] * sizeof(*col) + 1);
+    size_t i;
+    ASSERT(col != NULL, "out of memory\n");
+    for (i = 0; i < num_edges[kind]; i++)
+        col[i] = dst ? edges[kind][i].dst : edges[kind][i].src;
+    write_section(w, hdr, sec, col, num_edges[kind] * sizeof(*col));
+    free(col);
+}
+
+static void
+write_binary_dump(const char *path)
+{
+    drvis_dump_header_t hdr;
+    writer_t w;
+    uint32_t *name_offs;
+    char *names;
+    size_t names_size = 0, i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DRVIS_DUMP_MAGIC, sizeof(hdr.magic));
+    hdr.version       = DRVIS_DUMP_VERSION;
+    hdr.header_size   = sizeof(hdr);
+    hdr.num_blocks    = num_blocks;
+    hdr.num_functions = num_funcs;
+    hdr.num_intra     = num_edges[DRVIS_EDGE_INTRA];
+    hdr.num_inter     = num_edges[DRVIS_EDGE_INTER];
+    hdr.num_apps      = num_apps;
+
+    w.f = fopen(path, "wb");
+    w.path = path;
+    w.pos = 0;
+    ASSERT(w.f != NULL, "failed to create %s\n", path);
+    /* the header is rewritten once the sections are laid out */
+    write_bytes(&w, &hdr, sizeof(hdr));
+
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_BLOCK_ID, block_id);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_FUNCTION_ID, function_id);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_NUM_EXECUTIONS, num_executions);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_USED_REGS, used_regs);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_ENTRY_REGS, entry_regs);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_NUM_OUT_JUMPS, num_out_jumps);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_NUM_INTERRUPTS, num_interrupts);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_APP_ID, app_id);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_APP_OFFS_BEGIN, app_offs_begin);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_APP_OFFS_END, app_offs_end);
+    WRITE_BLOCK_COLUMN(&w, &hdr, DRVIS_SEC_FLAGS, flags);
+
+    write_section(&w, &hdr, DRVIS_SEC_BLOCK_INDEX_ID, index_id,
+                  num_blocks * sizeof(*index_id));
+    write_section(&w, &hdr, DRVIS_SEC_BLOCK_INDEX_ROW, index_row,
+                  num_blocks * sizeof(*index_row));
+
+    write_section(&w, &hdr, DRVIS_SEC_FUNC_ID, func_id,
+                  num_funcs * sizeof(*func_id));
+    write_section(&w, &hdr, DRVIS_SEC_FUNC_FIRST_ROW, func_first_row,
+                  num_funcs * sizeof(*func_first_row));
+    write_section(&w, &hdr, DRVIS_SEC_FUNC_NUM_ROWS, func_num_rows,
+                  num_funcs * sizeof(*func_num_rows));
+
+    write_section(&w, &hdr, DRVIS_SEC_INTRA_FIRST, edge_first[DRVIS_EDGE_INTRA],
+                  (num_blocks + 1) * sizeof(uint32_t));
+    write_edge_column(&w, &hdr, DRVIS_SEC_INTRA_SRC, DRVIS_EDGE_INTRA, false);
+    write_edge_column(&w, &hdr, DRVIS_SEC_INTRA_DST, DRVIS_EDGE_INTRA, true);
+    write_section(&w, &hdr, DRVIS_SEC_INTER_FIRST, edge_first[DRVIS_EDGE_INTER],
+                  (num_blocks + 1) * sizeof(uint32_t));
+    write_edge_column(&w, &hdr, DRVIS_SEC_INTER_SRC, DRVIS_EDGE_INTER, false);
+    write_edge_column(&w, &hdr, DRVIS_SEC_INTER_DST, DRVIS_EDGE_INTER, true);
+
+    name_offs = malloc(num_apps * sizeof(*name_offs) + 1);
+    ASSERT(name_offs != NULL, "out of memory\n");
+    for (i = 0; i < num_apps; i++) {
+        name_offs[i] = (uint32_t)names_size;
+        names_size += strlen(apps[i]) + 1;
+    }
+    names = malloc(names_size + 1);
+    ASSERT(names != NULL, "out of memory\n");
+    for (i = 0; i < num_apps; i++)
+        strcpy(names + name_offs[i], apps[i]);
+    write_section(&w, &hdr, DRVIS_SEC_APP_NAME_OFFS, name_offs,
+                  num_apps * sizeof(*name_offs));
+    write_section(&w, &hdr, DRVIS_SEC_APP_NAMES, names, names_size);
+    free(name_offs);
+    free(names);
+
+    write_padding(&w, ALIGN_FORWARD_8(w.pos));
+    hdr.file_size = w.pos;
+    ASSERT(fseek(w.f, 0, SEEK_SET) == 0 &&
+           fwrite(&hdr, sizeof(hdr), 1, w.f) == 1 && fclose(w.f) == 0,
+           "failed to write %s\n", path);
+    PRINT(1, "wrote %zu blocks in %zu functions to %s, %"PRIu64" bytes\n",
+          num_blocks, num_funcs, path, hdr.file_size);
+}
+
+/****************************************************************************
+ * Verification
+ */
+
+static void
+verify_binary_dump(const char *path)
+{
+    drvis_dump_t *dump;
+    const drvis_blocks_t *b;
+    size_t i, row, first, count, kind;
+    drvis_error_t res = drvis_dump_open(path, &dump);
+    ASSERT(res == DRVIS_SUCCESS, "failed to open %s: %d\n", path, res);
+    res = drvis_dump_validate(dump);
+    ASSERT(res == DRVIS_SUCCESS, "%s is corrupt: %d\n", path, res);
+    b = drvis_dump_blocks(dump);
+    ASSERT(b->count == num_blocks, "block count mismatch\n");
+    for (i = 0; i < num_blocks; i++) {
+        const block_rec_t *rec = &blocks[i];
+        ASSERT(drvis_dump_block_row(dump, rec->block_id, &row) == DRVIS_SUCCESS &&
+               row == i, "block %u not found\n", rec->block_id);
+        ASSERT(b->function_id[row] == rec->function_id &&
+               b->num_executions[row] == rec->num_executions &&
+               b->used_regs[row] == rec->used_regs &&
+               b->entry_regs[row] == rec->entry_regs &&
+               b->num_out_jumps[row] == rec->num_out_jumps &&
+               b->num_interrupts[row] == rec->num_interrupts &&
+               b->app_offs_begin[row] == rec->app_offs_begin &&
+               b->app_offs_end[row] == rec->app_offs_end &&
+               b->flags[row] == rec->flags &&
+               strcmp(drvis_dump_app_name(dump, b->app_id[row]),
+                      apps[rec->app_id]) == 0,
+               "block %u mismatch\n", rec->block_id);
+        ASSERT(drvis_dump_function_rows(dump, rec->function_id, &first, &count) ==
+               DRVIS_SUCCESS && row >= first && row < first + count,
+               "function %u does not cover block %u\n", rec->function_id,
+               rec->block_id);
+        for (kind = 0; kind < DRVIS_EDGE_KINDS; kind++) {
+            const uint32_t *dst;
+            size_t j;
+            ASSERT(drvis_dump_out_edges(dump, kind, row, &dst, &count) ==
+                   DRVIS_SUCCESS, "failed to get edges of block %u\n",
+                   rec->block_id);
+            for (j = 0; j < count; j++) {
+                const edge_rec_t *e = &edges[kind][edge_first[kind][i] + j];
+                ASSERT(e->src == rec->block_id && e->dst == dst[j],
+                       "edge mismatch for block %u\n", rec->block_id);
+            }
+        }
+    }
+    drvis_dump_close(dump);
+    PRINT(1, "verified %s\n", path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *input = NULL, *output = NULL;
+    bool verify = false;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            fprintf(stdout, "%s", usage_str);
+            return 0;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            ASSERT(i + 1 < argc, "missing --verbose level\n%s", usage_str);
+            verbose = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (input == NULL) {
+            input = argv[i];
+        } else if (output == NULL) {
+            output = argv[i];
+        } else {
+            ASSERT(false, "unknown option %s\n%s", argv[i], usage_str);
+        }
+    }
+    ASSERT(input != NULL && output != NULL, "%s", usage_str);
+
+    read_text_dump(input);
+    build_indexes();
+    write_binary_dump(output);
+    if (verify)
+        verify_binary_dump(output);
+    return 0;
+}
@@ -0,0 +1,478 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Reader for the binary columnar dump format, see drvis_dump.h */
+
+#include "drvis_dump.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+struct _drvis_dump_t {
+    const char *map;
+    size_t map_size;
+    int is_mapped; /* whether we own the mapping */
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    const drvis_dump_header_t *header;
+    drvis_blocks_t blocks;
+    drvis_functions_t functions;
+    drvis_edges_t edges[DRVIS_EDGE_KINDS];
+    const uint32_t *block_index_id;
+    const uint32_t *block_index_row;
+    const uint32_t *app_name_offs;
+    const char *app_names;
+    size_t app_names_size;
+};
+
+/* Element size of each section */
+static size_t
+section_elem_size(drvis_section_t sec)
+{
+    switch (sec) {
+    case DRVIS_SEC_NUM_EXECUTIONS:
+    case DRVIS_SEC_APP_OFFS_BEGIN:
+    case DRVIS_SEC_APP_OFFS_END:
+        return sizeof(uint64_t);
+    case DRVIS_SEC_FLAGS:
+    case DRVIS_SEC_APP_NAMES:
+        return sizeof(uint8_t);
+    default:
+        return sizeof(uint32_t);
+    }
+}
+
+static uint64_t
+section_count(const drvis_dump_header_t *hdr, drvis_section_t sec)
+{
+    switch (sec) {
+    case DRVIS_SEC_FUNC_ID:
+    case DRVIS_SEC_FUNC_FIRST_ROW:
+    case DRVIS_SEC_FUNC_NUM_ROWS:
+        return hdr->num_functions;
+    case DRVIS_SEC_INTRA_FIRST:
+    case DRVIS_SEC_INTER_FIRST:
+        return hdr->num_blocks + 1;
+    case DRVIS_SEC_INTRA_SRC:
+    case DRVIS_SEC_INTRA_DST:
+        return hdr->num_intra;
+    case DRVIS_SEC_INTER_SRC:
+    case DRVIS_SEC_INTER_DST:
+        return hdr->num_inter;
+    case DRVIS_SEC_APP_NAME_OFFS:
+        return hdr->num_apps;
+    case DRVIS_SEC_APP_NAMES:
+        return hdr->sections[DRVIS_SEC_APP_NAMES].size; /* any length */
+    default:
+        return hdr->num_blocks;
+    }
+}
+
+#define SECTION(dump, sec) \
+    ((const void *)((dump)->map + (dump)->header->sections[sec].offs))
+
+/* Checks the header and the section table, which is all that is needed to
+ * safely hand out the arrays.
+ */
+static drvis_error_t
+dump_init(drvis_dump_t *dump)
+{
+    const drvis_dump_header_t *hdr = (const drvis_dump_header_t *)dump->map;
+    int i;
+
+    if (dump->map_size < sizeof(*hdr) ||
+        memcmp(hdr->magic, DRVIS_DUMP_MAGIC, sizeof(hdr->magic)) != 0)
+        return DRVIS_ERROR_BAD_FORMAT;
+    if (hdr->version != DRVIS_DUMP_VERSION ||
+        hdr->header_size != sizeof(*hdr))
+        return DRVIS_ERROR_BAD_FORMAT;
+    if (hdr->file_size != dump->map_size)
+        return DRVIS_ERROR_CORRUPT;
+    /* rows, edges, and name offsets are stored as uint32_t */
+    if (hdr->num_blocks >= UINT32_MAX || hdr->num_functions > hdr->num_blocks ||
+        hdr->num_intra >= UINT32_MAX || hdr->num_inter >= UINT32_MAX ||
+        hdr->num_apps >= UINT32_MAX)
+        return DRVIS_ERROR_CORRUPT;
+    for (i = 0; i < DRVIS_SEC_COUNT; i++) {
+        const drvis_section_entry_t *sec = &hdr->sections[i];
+        size_t elem_size = section_elem_size((drvis_section_t)i);
+        if (sec->offs % 8 != 0 || sec->offs < sizeof(*hdr) ||
+            sec->offs > dump->map_size ||
+            sec->size > dump->map_size - sec->offs ||
+            sec->size != section_count(hdr, (drvis_section_t)i) * elem_size)
+            return DRVIS_ERROR_CORRUPT;
+    }
+    dump->header = hdr;
+
+    dump->blocks.count          = (size_t)hdr->num_blocks;
+    dump->blocks.block_id       = SECTION(dump, DRVIS_SEC_BLOCK_ID);
+    dump->blocks.function_id    = SECTION(dump, DRVIS_SEC_FUNCTION_ID);
+    dump->blocks.num_executions = SECTION(dump, DRVIS_SEC_NUM_EXECUTIONS);
+    dump->blocks.used_regs      = SECTION(dump, DRVIS_SEC_USED_REGS);
+    dump->blocks.entry_regs     = SECTION(dump, DRVIS_SEC_ENTRY_REGS);
+    dump->blocks.num_out_jumps  = SECTION(dump, DRVIS_SEC_NUM_OUT_JUMPS);
+    dump->blocks.num_interrupts = SECTION(dump, DRVIS_SEC_NUM_INTERRUPTS);
+    dump->blocks.app_id         = SECTION(dump, DRVIS_SEC_APP_ID);
+    dump->blocks.app_offs_begin = SECTION(dump, DRVIS_SEC_APP_OFFS_BEGIN);
+    dump->blocks.app_offs_end   = SECTION(dump, DRVIS_SEC_APP_OFFS_END);
+    dump->blocks.flags          = SECTION(dump, DRVIS_SEC_FLAGS);
+
+    dump->block_index_id  = SECTION(dump, DRVIS_SEC_BLOCK_INDEX_ID);
+    dump->block_index_row = SECTION(dump, DRVIS_SEC_BLOCK_INDEX_ROW);
+
+    dump->functions.count       = (size_t)hdr->num_functions;
+    dump->functions.function_id = SECTION(dump, DRVIS_SEC_FUNC_ID);
+    dump->functions.first_row   = SECTION(dump, DRVIS_SEC_FUNC_FIRST_ROW);
+    dump->functions.num_rows    = SECTION(dump, DRVIS_SEC_FUNC_NUM_ROWS);
+
+    dump->edges[DRVIS_EDGE_INTRA].count = (size_t)hdr->num_intra;
+    dump->edges[DRVIS_EDGE_INTRA].first = SECTION(dump, DRVIS_SEC_INTRA_FIRST);
+    dump->edges[DRVIS_EDGE_INTRA].src   = SECTION(dump, DRVIS_SEC_INTRA_SRC);
+    dump->edges[DRVIS_EDGE_INTRA].dst   = SECTION(dump, DRVIS_SEC_INTRA_DST);
+    dump->edges[DRVIS_EDGE_INTER].count = (size_t)hdr->num_inter;
+    dump->edges[DRVIS_EDGE_INTER].first = SECTION(dump, DRVIS_SEC_INTER_FIRST);
+    dump->edges[DRVIS_EDGE_INTER].src   = SECTION(dump, DRVIS_SEC_INTER_SRC);
+    dump->edges[DRVIS_EDGE_INTER].dst   = SECTION(dump, DRVIS_SEC_INTER_DST);
+
+    dump->app_name_offs  = SECTION(dump, DRVIS_SEC_APP_NAME_OFFS);
+    dump->app_names      = SECTION(dump, DRVIS_SEC_APP_NAMES);
+    dump->app_names_size = (size_t)hdr->sections[DRVIS_SEC_APP_NAMES].size;
+    return DRVIS_SUCCESS;
+}
+
+drvis_error_t
+drvis_dump_open_memory(const void *data, size_t size, drvis_dump_t **dump_out)
+{
+    drvis_dump_t *dump;
+    drvis_error_t res;
+    if (data == NULL || dump_out == NULL)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    /* the sections rely on the header being 8-byte aligned */
+    if (((uintptr_t)data & 7) != 0)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    dump = calloc(1, sizeof(*dump));
+    if (dump == NULL)
+        return DRVIS_ERROR;
+    dump->map = data;
+    dump->map_size = size;
+    res = dump_init(dump);
+    if (res != DRVIS_SUCCESS) {
+        free(dump);
+        return res;
+    }
+    *dump_out = dump;
+    return DRVIS_SUCCESS;
+}
+
+drvis_error_t
+drvis_dump_open(const char *path, drvis_dump_t **dump_out)
+{
+    drvis_dump_t *dump;
+    drvis_error_t res;
+#ifdef _WIN32
+    HANDLE file;
+    LARGE_INTEGER file_size;
+#else
+    int fd;
+    struct stat st;
+#endif
+
+    if (path == NULL || dump_out == NULL)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    dump = calloc(1, sizeof(*dump));
+    if (dump == NULL)
+        return DRVIS_ERROR;
+#ifdef _WIN32
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 ||
+        (uint64_t)file_size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+    dump->map_size = (size_t)file_size.QuadPart;
+    dump->mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    /* the mapping keeps the file open */
+    CloseHandle(file);
+    if (dump->mapping == NULL) {
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+    dump->map = MapViewOfFile(dump->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (dump->map == NULL) {
+        CloseHandle(dump->mapping);
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+#else
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+        (uint64_t)st.st_size > (size_t)-1) {
+        close(fd);
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+    dump->map_size = (size_t)st.st_size;
+    dump->map = mmap(NULL, dump->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    /* the mapping keeps the file open */
+    close(fd);
+    if (dump->map == MAP_FAILED) {
+        free(dump);
+        return DRVIS_ERROR_OPEN_FAILED;
+    }
+#endif
+    dump->is_mapped = 1;
+    res = dump_init(dump);
+    if (res != DRVIS_SUCCESS) {
+        drvis_dump_close(dump);
+        return res;
+    }
+    *dump_out = dump;
+    return DRVIS_SUCCESS;
+}
+
+void
+drvis_dump_close(drvis_dump_t *dump)
+{
+    if (dump == NULL)
+        return;
+    if (dump->is_mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(dump->map);
+        CloseHandle(dump->mapping);
+#else
+        munmap((void *)dump->map, dump->map_size);
+#endif
+    }
+    free(dump);
+}
+
+static drvis_error_t
+validate_edges(drvis_dump_t *dump, drvis_edge_kind_t kind)
+{
+    const drvis_edges_t *edges = &dump->edges[kind];
+    size_t row;
+    if (edges->first[0] != 0 || edges->first[dump->blocks.count] > edges->count)
+        return DRVIS_ERROR_CORRUPT;
+    for (row = 0; row < dump->blocks.count; row++) {
+        uint32_t i;
+        if (edges->first[row] > edges->first[row + 1])
+            return DRVIS_ERROR_CORRUPT;
+        for (i = edges->first[row]; i < edges->first[row + 1]; i++) {
+            if (edges->src[i] != dump->blocks.block_id[row])
+                return DRVIS_ERROR_CORRUPT;
+        }
+    }
+    return DRVIS_SUCCESS;
+}
+
+drvis_error_t
+drvis_dump_validate(drvis_dump_t *dump)
+{
+    const drvis_blocks_t *blocks;
+    const drvis_functions_t *funcs;
+    size_t i, rows = 0;
+    drvis_error_t res;
+
+    if (dump == NULL)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    blocks = &dump->blocks;
+    funcs = &dump->functions;
+    for (i = 0; i < blocks->count; i++) {
+        if (i > 0 &&
+            (blocks->function_id[i] < blocks->function_id[i - 1] ||
+             (blocks->function_id[i] == blocks->function_id[i - 1] &&
+              blocks->block_id[i] <= blocks->block_id[i - 1])))
+            return DRVIS_ERROR_CORRUPT;
+        if (blocks->app_id[i] >= dump->header->num_apps)
+            return DRVIS_ERROR_CORRUPT;
+        /* the block index must be a sorted permutation of the rows */
+        if (dump->block_index_row[i] >= blocks->count ||
+            blocks->block_id[dump->block_index_row[i]] != dump->block_index_id[i] ||
+            (i > 0 && dump->block_index_id[i] <= dump->block_index_id[i - 1]))
+            return DRVIS_ERROR_CORRUPT;
+    }
+    for (i = 0; i < funcs->count; i++) {
+        if ((i > 0 && funcs->function_id[i] <= funcs->function_id[i - 1]) ||
+            funcs->first_row[i] != rows || funcs->num_rows[i] == 0 ||
+            funcs->num_rows[i] > blocks->count - rows ||
+            blocks->function_id[funcs->first_row[i]] != funcs->function_id[i] ||
+            blocks->function_id[funcs->first_row[i] + funcs->num_rows[i] - 1] !=
+            funcs->function_id[i])
+            return DRVIS_ERROR_CORRUPT;
+        rows += funcs->num_rows[i];
+    }
+    if (rows != blocks->count)
+        return DRVIS_ERROR_CORRUPT;
+    res = validate_edges(dump, DRVIS_EDGE_INTRA);
+    if (res != DRVIS_SUCCESS)
+        return res;
+    res = validate_edges(dump, DRVIS_EDGE_INTER);
+    if (res != DRVIS_SUCCESS)
+        return res;
+    for (i = 0; i < dump->header->num_apps; i++) {
+        if (dump->app_name_offs[i] >= dump->app_names_size)
+            return DRVIS_ERROR_CORRUPT;
+    }
+    if (dump->app_names_size > 0 &&
+        dump->app_names[dump->app_names_size - 1] != '\0')
+        return DRVIS_ERROR_CORRUPT;
+    return DRVIS_SUCCESS;
+}
+
+const drvis_dump_header_t *
+drvis_dump_header(drvis_dump_t *dump)
+{
+    return dump->header;
+}
+
+const drvis_blocks_t *
+drvis_dump_blocks(drvis_dump_t *dump)
+{
+    return &dump->blocks;
+}
+
+const drvis_functions_t *
+drvis_dump_functions(drvis_dump_t *dump)
+{
+    return &dump->functions;
+}
+
+const drvis_edges_t *
+drvis_dump_edges(drvis_dump_t *dump, drvis_edge_kind_t kind)
+{
+    if (kind >= DRVIS_EDGE_KINDS)
+        return NULL;
+    return &dump->edges[kind];
+}
+
+const char *
+drvis_dump_app_name(drvis_dump_t *dump, uint32_t app_id)
+{
+    uint32_t offs;
+    if (app_id >= dump->header->num_apps)
+        return NULL;
+    offs = dump->app_name_offs[app_id];
+    /* a name that runs off the end is only caught by drvis_dump_validate() */
+    if (offs >= dump->app_names_size ||
+        dump->app_names[dump->app_names_size - 1] != '\0')
+        return NULL;
+    return dump->app_names + offs;
+}
+
+/* Returns the first index in sorted[0, count) whose value is >= key */
+static size_t
+lower_bound(const uint32_t *sorted, size_t count, uint32_t key)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+drvis_error_t
+drvis_dump_block_row(drvis_dump_t *dump, uint32_t block_id, size_t *row)
+{
+    size_t i;
+    if (dump == NULL || row == NULL)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    i = lower_bound(dump->block_index_id, dump->blocks.count, block_id);
+    if (i == dump->blocks.count || dump->block_index_id[i] != block_id)
+        return DRVIS_ERROR_NOT_FOUND;
+    if (dump->block_index_row[i] >= dump->blocks.count)
+        return DRVIS_ERROR_CORRUPT;
+    *row = dump->block_index_row[i];
+    return DRVIS_SUCCESS;
+}
+
+drvis_error_t
+drvis_dump_function_rows(drvis_dump_t *dump, uint32_t function_id,
+                         size_t *first_row, size_t *num_rows)
+{
+    const drvis_functions_t *funcs;
+    size_t i;
+    if (dump == NULL || first_row == NULL || num_rows == NULL)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    funcs = &dump->functions;
+    i = lower_bound(funcs->function_id, funcs->count, function_id);
+    if (i == funcs->count || funcs->function_id[i] != function_id)
+        return DRVIS_ERROR_NOT_FOUND;
+    if (funcs->first_row[i] > dump->blocks.count ||
+        funcs->num_rows[i] > dump->blocks.count - funcs->first_row[i])
+        return DRVIS_ERROR_CORRUPT;
+    *first_row = funcs->first_row[i];
+    *num_rows = funcs->num_rows[i];
+    return DRVIS_SUCCESS;
+}
+
+drvis_error_t
+drvis_dump_out_edges(drvis_dump_t *dump, drvis_edge_kind_t kind, size_t row,
+                     const uint32_t **dst, size_t *count)
+{
+    const drvis_edges_t *edges;
+    if (dump == NULL || kind >= DRVIS_EDGE_KINDS || dst == NULL || count == NULL ||
+        row >= dump->blocks.count)
+        return DRVIS_ERROR_INVALID_PARAMETER;
+    edges = &dump->edges[kind];
+    if (edges->first[row] > edges->first[row + 1] ||
+        edges->first[row + 1] > edges->count)
+        return DRVIS_ERROR_CORRUPT;
+    *dst = edges->dst + edges->first[row];
+    *count = edges->first[row + 1] - edges->first[row];
+    return DRVIS_SUCCESS;
+}
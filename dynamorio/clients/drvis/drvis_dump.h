@@ -0,0 +1,239 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Binary columnar dump format for basic block and edge traces.
+ *
+ * The text dump (BB(...), INTRA(...), and INTER(...) records described by
+ * a BB_FORMAT(...) header) has to be parsed line by line.  This format
+ * stores each field as its own array so that a reader can map the file and
+ * use the arrays in place: opening a dump only validates the header and
+ * section table, independent of the size of the trace.
+ *
+ * File layout, all integers in host byte order:
+ *   drvis_dump_header_t, including a table of sections
+ *   sections, each 8-byte aligned
+ *
+ * Block rows are sorted by function_id and then by block_id, so the blocks
+ * of each function are contiguous.  The function index gives each
+ * function's range of rows, and the block index maps sorted block ids to
+ * rows.  Edges are stored in compressed sparse row form: the edges of each
+ * kind are sorted by the row of their source block, and first_edge[row]
+ * through first_edge[row + 1] gives the edges leaving a row.  Edges whose
+ * source block is not in the dump follow the edges of the last row.
+ */
+
+#ifndef _DRVIS_DUMP_H_
+#define _DRVIS_DUMP_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DRVIS_DUMP_MAGIC   "DRVISDMP"
+#define DRVIS_DUMP_VERSION 1
+
+/* Sections of a dump.  The count of each is given in the header. */
+typedef enum {
+    /* per-block columns, num_blocks entries each */
+    DRVIS_SEC_BLOCK_ID,         /* uint32_t */
+    DRVIS_SEC_FUNCTION_ID,      /* uint32_t */
+    DRVIS_SEC_NUM_EXECUTIONS,   /* uint64_t */
+    DRVIS_SEC_USED_REGS,        /* uint32_t */
+    DRVIS_SEC_ENTRY_REGS,       /* uint32_t */
+    DRVIS_SEC_NUM_OUT_JUMPS,    /* uint32_t */
+    DRVIS_SEC_NUM_INTERRUPTS,   /* uint32_t */
+    DRVIS_SEC_APP_ID,           /* uint32_t, index into the app names */
+    DRVIS_SEC_APP_OFFS_BEGIN,   /* uint64_t */
+    DRVIS_SEC_APP_OFFS_END,     /* uint64_t */
+    DRVIS_SEC_FLAGS,            /* uint8_t, drvis_block_flags_t */
+    /* block index, num_blocks entries each, sorted by block id */
+    DRVIS_SEC_BLOCK_INDEX_ID,   /* uint32_t */
+    DRVIS_SEC_BLOCK_INDEX_ROW,  /* uint32_t */
+    /* function index, num_functions entries each, sorted by function id */
+    DRVIS_SEC_FUNC_ID,          /* uint32_t */
+    DRVIS_SEC_FUNC_FIRST_ROW,   /* uint32_t */
+    DRVIS_SEC_FUNC_NUM_ROWS,    /* uint32_t */
+    /* intra-function edges */
+    DRVIS_SEC_INTRA_FIRST,      /* uint32_t, num_blocks + 1 entries */
+    DRVIS_SEC_INTRA_SRC,        /* uint32_t block id, num_intra entries */
+    DRVIS_SEC_INTRA_DST,        /* uint32_t block id, num_intra entries */
+    /* inter-function edges */
+    DRVIS_SEC_INTER_FIRST,      /* uint32_t, num_blocks + 1 entries */
+    DRVIS_SEC_INTER_SRC,        /* uint32_t block id, num_inter entries */
+    DRVIS_SEC_INTER_DST,        /* uint32_t block id, num_inter entries */
+    /* app names */
+    DRVIS_SEC_APP_NAME_OFFS,    /* uint32_t, num_apps entries */
+    DRVIS_SEC_APP_NAMES,        /* char, null-terminated strings */
+    DRVIS_SEC_COUNT,
+} drvis_section_t;
+
+typedef enum {
+    DRVIS_BLOCK_ROOT           = 0x01,
+    DRVIS_BLOCK_FUNCTION_ENTRY = 0x02,
+    DRVIS_BLOCK_FUNCTION_EXIT  = 0x04,
+    DRVIS_BLOCK_APP_CODE       = 0x08,
+    DRVIS_BLOCK_ALLOCATOR      = 0x10,
+    DRVIS_BLOCK_DEALLOCATOR    = 0x20,
+    DRVIS_BLOCK_INDIRECT_JMP   = 0x40, /* has_outgoing_indirect_jmp */
+} drvis_block_flags_t;
+
+typedef enum {
+    DRVIS_EDGE_INTRA, /* INTRA(src, dst): within a function */
+    DRVIS_EDGE_INTER, /* INTER(src, dst): across functions */
+    DRVIS_EDGE_KINDS,
+} drvis_edge_kind_t;
+
+typedef struct _drvis_section_entry_t {
+    uint64_t offs;  /* from the start of the file */
+    uint64_t size;  /* in bytes */
+} drvis_section_entry_t;
+
+typedef struct _drvis_dump_header_t {
+    char     magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t file_size;
+    uint64_t num_blocks;
+    uint64_t num_functions;
+    uint64_t num_intra;
+    uint64_t num_inter;
+    uint64_t num_apps;
+    drvis_section_entry_t sections[DRVIS_SEC_COUNT];
+} drvis_dump_header_t;
+
+typedef enum {
+    DRVIS_SUCCESS,
+    DRVIS_ERROR,                    /* generic failure */
+    DRVIS_ERROR_INVALID_PARAMETER,
+    DRVIS_ERROR_OPEN_FAILED,        /* could not open or map the file */
+    DRVIS_ERROR_BAD_FORMAT,         /* not a dump or wrong version */
+    DRVIS_ERROR_CORRUPT,            /* a section is out of bounds or inconsistent */
+    DRVIS_ERROR_NOT_FOUND,
+} drvis_error_t;
+
+/* The per-block columns of a dump, pointing into the mapping */
+typedef struct _drvis_blocks_t {
+    size_t          count;
+    const uint32_t *block_id;
+    const uint32_t *function_id;
+    const uint64_t *num_executions;
+    const uint32_t *used_regs;
+    const uint32_t *entry_regs;
+    const uint32_t *num_out_jumps;
+    const uint32_t *num_interrupts;
+    const uint32_t *app_id;
+    const uint64_t *app_offs_begin;
+    const uint64_t *app_offs_end;
+    const uint8_t  *flags;
+} drvis_blocks_t;
+
+/* The edges of one kind, pointing into the mapping */
+typedef struct _drvis_edges_t {
+    size_t          count;
+    const uint32_t *first;  /* count of blocks + 1 entries */
+    const uint32_t *src;
+    const uint32_t *dst;
+} drvis_edges_t;
+
+/* The function index, pointing into the mapping */
+typedef struct _drvis_functions_t {
+    size_t          count;
+    const uint32_t *function_id;
+    const uint32_t *first_row;
+    const uint32_t *num_rows;
+} drvis_functions_t;
+
+typedef struct _drvis_dump_t drvis_dump_t;
+
+/* Maps the dump at path read-only.  Only the header and the section table
+ * are checked, so this takes constant time; use drvis_dump_validate() for
+ * untrusted files.
+ */
+drvis_error_t
+drvis_dump_open(const char *path, drvis_dump_t **dump /* OUT */);
+
+/* Like drvis_dump_open(), for a dump that is already in memory.  The
+ * memory must stay valid until drvis_dump_close().
+ */
+drvis_error_t
+drvis_dump_open_memory(const void *data, size_t size, drvis_dump_t **dump /* OUT */);
+
+void
+drvis_dump_close(drvis_dump_t *dump);
+
+/* Checks the sort orders and indexes that lookups rely on.  Takes time
+ * linear in the size of the dump.
+ */
+drvis_error_t
+drvis_dump_validate(drvis_dump_t *dump);
+
+const drvis_dump_header_t *
+drvis_dump_header(drvis_dump_t *dump);
+
+const drvis_blocks_t *
+drvis_dump_blocks(drvis_dump_t *dump);
+
+const drvis_functions_t *
+drvis_dump_functions(drvis_dump_t *dump);
+
+const drvis_edges_t *
+drvis_dump_edges(drvis_dump_t *dump, drvis_edge_kind_t kind);
+
+/* Returns the name of the app with index app_id, or NULL */
+const char *
+drvis_dump_app_name(drvis_dump_t *dump, uint32_t app_id);
+
+/* Looks up the row of block_id with a binary search of the block index */
+drvis_error_t
+drvis_dump_block_row(drvis_dump_t *dump, uint32_t block_id, size_t *row /* OUT */);
+
+/* Returns the range of rows holding the blocks of function_id */
+drvis_error_t
+drvis_dump_function_rows(drvis_dump_t *dump, uint32_t function_id,
+                         size_t *first_row /* OUT */, size_t *num_rows /* OUT */);
+
+/* Returns the target block ids of the edges of the given kind that leave
+ * the block at row.
+ */
+drvis_error_t
+drvis_dump_out_edges(drvis_dump_t *dump, drvis_edge_kind_t kind, size_t row,
+                     const uint32_t **dst /* OUT */, size_t *count /* OUT */);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRVIS_DUMP_H_ */
@@ -0,0 +1,673 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Barnes-Hut force-directed layout, see drvis_layout.h */
+
+#include "drvis_layout.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+/* The ideal edge length.  The layout covers an area of about one square
+ * edge length per node.
+ */
+#define EDGE_LEN 1.0f
+/* below this squared distance two nodes are treated as coincident */
+#define MIN_DIST2 1e-8f
+/* beyond this depth coincident nodes share a leaf */
+#define MAX_TREE_DEPTH 32
+/* nodes handed to a worker at a time */
+#define WORK_CHUNK 256
+
+enum {
+    CELL_EMPTY    = -1, /* a leaf with no node: only the root */
+    CELL_INTERNAL = -2, /* has children */
+    CELL_MANY     = -3, /* a leaf holding several nodes at max depth */
+};
+
+typedef struct _cell_t {
+    float cx, cy, half;  /* center and half the side of the square */
+    float mx, my;        /* center of mass (a sum while building) */
+    float mass;          /* number of nodes */
+    int32_t child[4];
+    int32_t body;        /* the node in a leaf, or a CELL_ value */
+} cell_t;
+
+struct _drvis_layout_t {
+    drvis_layout_options_t ops;
+    unsigned int num_threads;
+    uint32_t rng;
+    /* nodes */
+    size_t num_nodes, cap_nodes;
+    size_t num_placed; /* nodes [0, num_placed) have positions */
+    float *x, *y;
+    float *dx, *dy;    /* displacement for the current step */
+    /* edges */
+    size_t num_edges, cap_edges;
+    uint32_t *edge_a, *edge_b;
+    float *edge_w;
+    /* adjacency in compressed sparse row form, rebuilt after changes */
+    int adj_stale;
+    uint32_t *adj_first;
+    uint32_t *adj_node;
+    float *adj_w;
+    /* quadtree, rebuilt every step */
+    cell_t *cells;
+    size_t num_cells, cap_cells;
+    /* current step */
+    float temperature;
+    volatile size_t next_work;
+};
+
+/****************************************************************************
+ * Utilities
+ */
+
+static int
+grow(void **array, size_t *cap, size_t need, size_t elem_size)
+{
+    size_t new_cap;
+    void *p;
+    if (need <= *cap)
+        return 1;
+    new_cap = *cap == 0 ? 1024 : *cap;
+    while (new_cap < need)
+        new_cap *= 2;
+    p = realloc(*array, new_cap * elem_size);
+    if (p == NULL)
+        return 0;
+    *array = p;
+    *cap = new_cap;
+    return 1;
+}
+
+/* xorshift, for a reproducible initial placement */
+static float
+random_float(drvis_layout_t *layout)
+{
+    uint32_t r = layout->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    layout->rng = r;
+    return (float)(r >> 8) / (float)(1 << 24);
+}
+
+static unsigned int
+num_cpus(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+#endif
+}
+
+/****************************************************************************
+ * Parallel loops
+ */
+
+typedef void (*work_func_t)(drvis_layout_t *layout, size_t start, size_t end);
+
+typedef struct _worker_t {
+    drvis_layout_t *layout;
+    work_func_t func;
+    size_t count;
+} worker_t;
+
+/* Claims the next chunk of work, returning its first index */
+static size_t
+next_chunk(drvis_layout_t *layout)
+{
+#ifdef _WIN64
+    return (size_t)InterlockedExchangeAdd64((volatile LONG64 *)&layout->next_work,
+                                            WORK_CHUNK);
+#elif defined(_WIN32)
+    return (size_t)InterlockedExchangeAdd((volatile LONG *)&layout->next_work,
+                                          WORK_CHUNK);
+#else
+    return __sync_fetch_and_add(&layout->next_work, WORK_CHUNK);
+#endif
+}
+
+/* Workers grab chunks of nodes until none are left, which balances the
+ * uneven cost of nodes in dense and sparse regions.
+ */
+static void *
+worker_main(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    for (;;) {
+        size_t start = next_chunk(w->layout);
+        if (start >= w->count)
+            break;
+        w->func(w->layout, start,
+                start + WORK_CHUNK < w->count ? start + WORK_CHUNK : w->count);
+    }
+    return NULL;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+worker_thread(LPVOID arg)
+{
+    worker_main(arg);
+    return 0;
+}
+#endif
+
+static void
+parallel_for(drvis_layout_t *layout, work_func_t func, size_t count)
+{
+    worker_t w;
+#ifdef _WIN32
+    HANDLE threads[64];
+#else
+    pthread_t threads[64];
+#endif
+    unsigned int i, num = layout->num_threads;
+    w.layout = layout;
+    w.func = func;
+    w.count = count;
+    layout->next_work = 0;
+    /* not worth a thread for small graphs */
+    if (count < 2 * WORK_CHUNK)
+        num = 1;
+    if (num > sizeof(threads)/sizeof(threads[0]))
+        num = sizeof(threads)/sizeof(threads[0]);
+    /* the calling thread is one of the workers */
+    for (i = 1; i < num; i++) {
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, worker_thread, &w, 0, NULL);
+        if (threads[i] == NULL)
+            break;
+#else
+        if (pthread_create(&threads[i], NULL, worker_main, &w) != 0)
+            break;
+#endif
+    }
+    num = i;
+    worker_main(&w);
+    for (i = 1; i < num; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+/****************************************************************************
+ * Barnes-Hut quadtree
+ */
+
+static int32_t
+cell_new(drvis_layout_t *layout, float cx, float cy, float half)
+{
+    cell_t *c;
+    if (!grow((void **)&layout->cells, &layout->cap_cells, layout->num_cells + 1,
+              sizeof(cell_t)))
+        return -1;
+    c = &layout->cells[layout->num_cells];
+    c->cx = cx;
+    c->cy = cy;
+    c->half = half;
+    c->mx = c->my = c->mass = 0.f;
+    c->child[0] = c->child[1] = c->child[2] = c->child[3] = -1;
+    c->body = CELL_EMPTY;
+    return (int32_t)layout->num_cells++;
+}
+
+static int
+quadrant(const cell_t *c, float x, float y)
+{
+    return (x >= c->cx ? 1 : 0) | (y >= c->cy ? 2 : 0);
+}
+
+/* Creates the child of cell in quadrant q, returning its index */
+static int32_t
+cell_new_child(drvis_layout_t *layout, int32_t cell, int q)
+{
+    cell_t *c = &layout->cells[cell];
+    float quarter = c->half / 2;
+    int32_t child = cell_new(layout,
+                             c->cx + (((q) & 1) ? quarter : -quarter),
+                             c->cy + (((q) & 2) ? quarter : -quarter),
+                             quarter);
+    /* cell_new may have moved the cells */
+    if (child >= 0)
+        layout->cells[cell].child[q] = child;
+    return child;
+}
+
+static int
+tree_insert(drvis_layout_t *layout, uint32_t node)
+{
+    float x = layout->x[node], y = layout->y[node];
+    int32_t cell = 0;
+    int depth;
+    for (depth = 0; ; depth++) {
+        cell_t *c = &layout->cells[cell];
+        int q;
+        /* every cell on the path includes the node */
+        c->mass += 1.f;
+        c->mx += x;
+        c->my += y;
+        if (c->body == CELL_EMPTY) {
+            c->body = (int32_t)node;
+            return 1;
+        }
+        if (c->body == CELL_MANY)
+            return 1;
+        if (c->body >= 0) {
+            /* a leaf with one node: push that node down a level */
+            uint32_t old = (uint32_t)c->body;
+            int32_t child;
+            if (depth >= MAX_TREE_DEPTH) {
+                c->body = CELL_MANY;
+                return 1;
+            }
+            q = quadrant(c, layout->x[old], layout->y[old]);
+            c->body = CELL_INTERNAL;
+            child = cell_new_child(layout, cell, q);
+            if (child < 0)
+                return 0;
+            c = &layout->cells[child];
+            c->body = (int32_t)old;
+            c->mass = 1.f;
+            c->mx = layout->x[old];
+            c->my = layout->y[old];
+            c = &layout->cells[cell];
+        }
+        q = quadrant(c, x, y);
+        if (c->child[q] < 0) {
+            int32_t child = cell_new_child(layout, cell, q);
+            if (child < 0)
+                return 0;
+            c = &layout->cells[child];
+            c->body = (int32_t)node;
+            c->mass = 1.f;
+            c->mx = x;
+            c->my = y;
+            return 1;
+        }
+        cell = c->child[q];
+    }
+}
+
+static int
+tree_build(drvis_layout_t *layout)
+{
+    float min_x, max_x, min_y, max_y, half;
+    size_t i, n = layout->num_nodes;
+    min_x = max_x = layout->x[0];
+    min_y = max_y = layout->y[0];
+    for (i = 1; i < n; i++) {
+        if (layout->x[i] < min_x) min_x = layout->x[i];
+        if (layout->x[i] > max_x) max_x = layout->x[i];
+        if (layout->y[i] < min_y) min_y = layout->y[i];
+        if (layout->y[i] > max_y) max_y = layout->y[i];
+    }
+    half = (max_x - min_x > max_y - min_y ? max_x - min_x : max_y - min_y) / 2;
+    /* leave room so that nodes on the far edges fall inside */
+    half = half * 1.01f + EDGE_LEN;
+    layout->num_cells = 0;
+    if (!grow((void **)&layout->cells, &layout->cap_cells, 2 * n + 1,
+              sizeof(cell_t)))
+        return 0;
+    cell_new(layout, (min_x + max_x) / 2, (min_y + max_y) / 2, half);
+    for (i = 0; i < n; i++) {
+        if (!tree_insert(layout, (uint32_t)i))
+            return 0;
+    }
+    for (i = 0; i < layout->num_cells; i++) {
+        cell_t *c = &layout->cells[i];
+        if (c->mass > 0.f) {
+            c->mx /= c->mass;
+            c->my /= c->mass;
+        }
+    }
+    return 1;
+}
+
+/****************************************************************************
+ * Forces
+ */
+
+/* Repulsion of k^2/d from every other node, approximated by the tree */
+static void
+repulse(drvis_layout_t *layout, uint32_t node, float *fx, float *fy)
+{
+    int32_t stack[4 * MAX_TREE_DEPTH + 4];
+    int top = 0;
+    float x = layout->x[node], y = layout->y[node];
+    float theta2 = layout->ops.theta * layout->ops.theta;
+    float sum_x = 0.f, sum_y = 0.f;
+    stack[top++] = 0;
+    while (top > 0) {
+        const cell_t *c = &layout->cells[stack[--top]];
+        float vx = x - c->mx, vy = y - c->my;
+        float d2 = vx * vx + vy * vy;
+        if (c->mass == 0.f || c->body == (int32_t)node)
+            continue;
+        if (c->body != CELL_INTERNAL ||
+            4 * c->half * c->half < theta2 * d2) {
+            float f;
+            /* coincident nodes are separated by the random placement of
+             * new nodes and by attraction, not here
+             */
+            if (d2 < MIN_DIST2)
+                continue;
+            f = EDGE_LEN * EDGE_LEN * c->mass / d2;
+            sum_x += vx * f;
+            sum_y += vy * f;
+        } else {
+            int q;
+            for (q = 0; q < 4; q++) {
+                if (c->child[q] >= 0)
+                    stack[top++] = c->child[q];
+            }
+        }
+    }
+    *fx += sum_x;
+    *fy += sum_y;
+}
+
+/* Attraction of w*d^2/k along each edge */
+static void
+attract(drvis_layout_t *layout, uint32_t node, float *fx, float *fy)
+{
+    uint32_t i;
+    float x = layout->x[node], y = layout->y[node];
+    for (i = layout->adj_first[node]; i < layout->adj_first[node + 1]; i++) {
+        uint32_t other = layout->adj_node[i];
+        float vx = layout->x[other] - x, vy = layout->y[other] - y;
+        float d = sqrtf(vx * vx + vy * vy);
+        float f = layout->adj_w[i] * d / EDGE_LEN;
+        *fx += vx * f;
+        *fy += vy * f;
+    }
+}
+
+static void
+compute_forces(drvis_layout_t *layout, size_t start, size_t end)
+{
+    size_t i;
+    for (i = start; i < end; i++) {
+        float fx = 0.f, fy = 0.f;
+        repulse(layout, (uint32_t)i, &fx, &fy);
+        attract(layout, (uint32_t)i, &fx, &fy);
+        layout->dx[i] = fx;
+        layout->dy[i] = fy;
+    }
+}
+
+/* Moves each node along its force, by at most the temperature */
+static void
+apply_forces(drvis_layout_t *layout, size_t start, size_t end)
+{
+    size_t i;
+    float t = layout->temperature;
+    for (i = start; i < end; i++) {
+        float len = sqrtf(layout->dx[i] * layout->dx[i] +
+                          layout->dy[i] * layout->dy[i]);
+        if (len > 0.f) {
+            float step = len < t ? len : t;
+            layout->x[i] += layout->dx[i] / len * step;
+            layout->y[i] += layout->dy[i] / len * step;
+        }
+    }
+}
+
+/****************************************************************************
+ * Setup
+ */
+
+static int
+build_adjacency(drvis_layout_t *layout)
+{
+    size_t n = layout->num_nodes, i;
+    uint32_t *pos;
+    free(layout->adj_first);
+    free(layout->adj_node);
+    free(layout->adj_w);
+    layout->adj_first = calloc(n + 1, sizeof(uint32_t));
+    layout->adj_node = malloc(2 * layout->num_edges * sizeof(uint32_t) + 1);
+    layout->adj_w = malloc(2 * layout->num_edges * sizeof(float) + 1);
+    pos = malloc((n + 1) * sizeof(uint32_t));
+    if (layout->adj_first == NULL || layout->adj_node == NULL ||
+        layout->adj_w == NULL || pos == NULL) {
+        free(pos);
+        return 0;
+    }
+    /* each edge is in the lists of both of its ends */
+    for (i = 0; i < layout->num_edges; i++) {
+        layout->adj_first[layout->edge_a[i] + 1]++;
+        layout->adj_first[layout->edge_b[i] + 1]++;
+    }
+    for (i = 0; i < n; i++)
+        layout->adj_first[i + 1] += layout->adj_first[i];
+    memcpy(pos, layout->adj_first, (n + 1) * sizeof(uint32_t));
+    for (i = 0; i < layout->num_edges; i++) {
+        uint32_t a = layout->edge_a[i], b = layout->edge_b[i];
+        layout->adj_node[pos[a]] = b;
+        layout->adj_w[pos[a]++] = layout->edge_w[i];
+        layout->adj_node[pos[b]] = a;
+        layout->adj_w[pos[b]++] = layout->edge_w[i];
+    }
+    free(pos);
+    layout->adj_stale = 0;
+    return 1;
+}
+
+/* Places the nodes added since the last run: next to the average of their
+ * placed neighbors if any, or anywhere in the layout's area otherwise.
+ */
+static void
+place_new_nodes(drvis_layout_t *layout)
+{
+    size_t i;
+    float side = sqrtf((float)layout->num_nodes) * EDGE_LEN;
+    for (i = layout->num_placed; i < layout->num_nodes; i++) {
+        float sum_x = 0.f, sum_y = 0.f;
+        uint32_t j, count = 0;
+        for (j = layout->adj_first[i]; j < layout->adj_first[i + 1]; j++) {
+            uint32_t other = layout->adj_node[j];
+            /* nodes placed earlier in this loop count too */
+            if (other < i) {
+                sum_x += layout->x[other];
+                sum_y += layout->y[other];
+                count++;
+            }
+        }
+        if (count > 0) {
+            layout->x[i] = sum_x / count + (random_float(layout) - 0.5f) * EDGE_LEN;
+            layout->y[i] = sum_y / count + (random_float(layout) - 0.5f) * EDGE_LEN;
+        } else {
+            layout->x[i] = (random_float(layout) - 0.5f) * side;
+            layout->y[i] = (random_float(layout) - 0.5f) * side;
+        }
+    }
+}
+
+/****************************************************************************
+ * Interface
+ */
+
+void
+drvis_layout_options_init(drvis_layout_options_t *ops)
+{
+    memset(ops, 0, sizeof(*ops));
+    ops->struct_size = sizeof(*ops);
+    ops->num_threads = 0;
+    ops->theta = 0.8f;
+    ops->seed = 1;
+}
+
+drvis_layout_t *
+drvis_layout_create(const drvis_layout_options_t *ops)
+{
+    drvis_layout_t *layout = calloc(1, sizeof(*layout));
+    if (layout == NULL)
+        return NULL;
+    if (ops != NULL && ops->struct_size != sizeof(*ops)) {
+        free(layout);
+        return NULL;
+    }
+    if (ops != NULL)
+        layout->ops = *ops;
+    else
+        drvis_layout_options_init(&layout->ops);
+    layout->num_threads = layout->ops.num_threads != 0 ?
+        layout->ops.num_threads : num_cpus();
+    layout->rng = layout->ops.seed != 0 ? layout->ops.seed : 1;
+    return layout;
+}
+
+void
+drvis_layout_destroy(drvis_layout_t *layout)
+{
+    if (layout == NULL)
+        return;
+    free(layout->x);
+    free(layout->y);
+    free(layout->dx);
+    free(layout->dy);
+    free(layout->edge_a);
+    free(layout->edge_b);
+    free(layout->edge_w);
+    free(layout->adj_first);
+    free(layout->adj_node);
+    free(layout->adj_w);
+    free(layout->cells);
+    free(layout);
+}
+
+size_t
+drvis_layout_add_nodes(drvis_layout_t *layout, size_t count)
+{
+    size_t first = layout->num_nodes, need = first + count, cap = layout->cap_nodes;
+    if (need >= UINT32_MAX)
+        return (size_t)-1;
+    /* the four arrays share a capacity */
+    if (need > cap) {
+        size_t c;
+        c = cap; if (!grow((void **)&layout->x, &c, need, sizeof(float))) return (size_t)-1;
+        c = cap; if (!grow((void **)&layout->y, &c, need, sizeof(float))) return (size_t)-1;
+        c = cap; if (!grow((void **)&layout->dx, &c, need, sizeof(float))) return (size_t)-1;
+        c = cap; if (!grow((void **)&layout->dy, &c, need, sizeof(float))) return (size_t)-1;
+        layout->cap_nodes = c;
+    }
+    layout->num_nodes = need;
+    layout->adj_stale = 1;
+    return first;
+}
+
+int
+drvis_layout_add_edge(drvis_layout_t *layout, size_t a, size_t b, float weight)
+{
+    size_t cap = layout->cap_edges, c;
+    if (a >= layout->num_nodes || b >= layout->num_nodes || weight <= 0.f)
+        return 0;
+    /* self loops exert no force */
+    if (a == b)
+        return 1;
+    if (layout->num_edges == cap) {
+        c = cap; if (!grow((void **)&layout->edge_a, &c, cap + 1, sizeof(uint32_t))) return 0;
+        c = cap; if (!grow((void **)&layout->edge_b, &c, cap + 1, sizeof(uint32_t))) return 0;
+        c = cap; if (!grow((void **)&layout->edge_w, &c, cap + 1, sizeof(float))) return 0;
+        layout->cap_edges = c;
+    }
+    layout->edge_a[layout->num_edges] = (uint32_t)a;
+    layout->edge_b[layout->num_edges] = (uint32_t)b;
+    layout->edge_w[layout->num_edges] = weight;
+    layout->num_edges++;
+    layout->adj_stale = 1;
+    return 1;
+}
+
+size_t
+drvis_layout_num_nodes(drvis_layout_t *layout)
+{
+    return layout->num_nodes;
+}
+
+int
+drvis_layout_run(drvis_layout_t *layout, unsigned int iterations)
+{
+    unsigned int it;
+    float t0;
+    if (layout->num_nodes == 0)
+        return 1;
+    if (layout->adj_stale && !build_adjacency(layout))
+        return 0;
+    /* A fresh layout starts hot enough to untangle globally.  An
+     * incremental one only lets the new nodes settle in and their
+     * neighborhoods adjust, so it starts cooler than a fresh layout of the
+     * same graph even when that graph is small.
+     */
+    t0 = sqrtf((float)layout->num_nodes) * EDGE_LEN / 10;
+    if (layout->num_placed > 0)
+        t0 = t0 / 2 < 2 * EDGE_LEN ? t0 / 2 : 2 * EDGE_LEN;
+    place_new_nodes(layout);
+    layout->num_placed = layout->num_nodes;
+    for (it = 0; it < iterations; it++) {
+        /* cool linearly, keeping a little movement at the end */
+        layout->temperature = t0 * (1.f - (float)it / iterations) + 0.01f * EDGE_LEN;
+        if (!tree_build(layout))
+            return 0;
+        parallel_for(layout, compute_forces, layout->num_nodes);
+        parallel_for(layout, apply_forces, layout->num_nodes);
+    }
+    return 1;
+}
+
+void
+drvis_layout_positions(drvis_layout_t *layout, const float **x, const float **y)
+{
+    *x = layout->x;
+    *y = layout->y;
+}
@@ -0,0 +1,115 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Force-directed graph layout for block and function graphs.
+ *
+ * Nodes repel each other and edges pull their endpoints together, in the
+ * style of Fruchterman and Reingold.  Repulsion is approximated with a
+ * Barnes-Hut quadtree, so an iteration takes O(n log n) time rather than
+ * O(n^2), and the force computations are split across threads.
+ *
+ * Nodes may be added after a layout has run: the next run places each new
+ * node next to its already placed neighbors and starts at a lower
+ * temperature, so the existing layout only shifts locally.
+ */
+
+#ifndef _DRVIS_LAYOUT_H_
+#define _DRVIS_LAYOUT_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _drvis_layout_options_t {
+    /* Set to sizeof(drvis_layout_options_t) */
+    size_t struct_size;
+    /* Worker threads for the force computations; 0 picks the number of CPUs */
+    unsigned int num_threads;
+    /* Barnes-Hut opening angle: cells smaller than theta times their
+     * distance are treated as a single body.  0 gives the exact O(n^2)
+     * forces; 0.5 to 1.0 are typical.
+     */
+    float theta;
+    /* Seed for the initial placement, so layouts are reproducible */
+    uint32_t seed;
+} drvis_layout_options_t;
+
+typedef struct _drvis_layout_t drvis_layout_t;
+
+/* Fills in the default options */
+void
+drvis_layout_options_init(drvis_layout_options_t *ops);
+
+/* Returns NULL on failure; ops may be NULL for the defaults */
+drvis_layout_t *
+drvis_layout_create(const drvis_layout_options_t *ops);
+
+void
+drvis_layout_destroy(drvis_layout_t *layout);
+
+/* Adds count nodes and returns the index of the first, or (size_t)-1 on
+ * failure.  Node indices are assigned consecutively from 0.
+ */
+size_t
+drvis_layout_add_nodes(drvis_layout_t *layout, size_t count);
+
+/* Adds an undirected edge.  Heavier edges pull harder: the weight typically
+ * grows with the execution count of the edge, e.g. 1 + log(1 + count).
+ * Returns 0 on failure.
+ */
+int
+drvis_layout_add_edge(drvis_layout_t *layout, size_t a, size_t b, float weight);
+
+size_t
+drvis_layout_num_nodes(drvis_layout_t *layout);
+
+/* Runs iterations steps of the layout.  Returns 0 on failure. */
+int
+drvis_layout_run(drvis_layout_t *layout, unsigned int iterations);
+
+/* Returns pointers to the coordinates, valid until the next call that adds
+ * nodes or runs the layout.  Coordinates are roughly within a square whose
+ * side is the square root of the number of nodes.
+ */
+void
+drvis_layout_positions(drvis_layout_t *layout, const float **x /* OUT */,
+                       const float **y /* OUT */);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRVIS_LAYOUT_H_ */
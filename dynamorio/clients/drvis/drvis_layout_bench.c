@@ -0,0 +1,182 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_layout_bench.c
+ *
+ * Measures how the layout scales: lays out synthetic scale-free graphs of
+ * 1K to 1M nodes with each thread count, then times an incremental relayout
+ * after adding 1% more nodes.
+ */
+
+#include "drvis_layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+# include <windows.h>
+#endif
+
+#define ASSERT(val, ...) do {                               \
+    if (!(val)) {                                           \
+        fprintf(stderr, "[DRVIS_LAYOUT_BENCH] ERROR:    "); \
+        fprintf(stderr, __VA_ARGS__);                       \
+        exit(1);                                            \
+    }                                                       \
+} while (0)
+
+const char *usage_str =
+    "drvis_layout_bench: time the layout of synthetic graphs\n"
+    "usage: drvis_layout_bench [options]\n"
+    "      --help                          Print this message.\n"
+    "      --max_nodes <int>               Largest graph (default 1000000).\n"
+    "      --iters <int>                   Iterations per measurement (default 5).\n"
+    "      --threads <int>                 Largest thread count (default 8).\n";
+
+static double
+now_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+static uint32_t rand_state = 12345;
+
+static uint32_t
+next_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+/* Adds count nodes attached by preferential attachment (Barabasi-Albert with
+ * two edges per node), which gives the hub-heavy degree distribution of real
+ * call graphs.  Edge endpoints are remembered in ends so that picking a
+ * random entry picks a node proportionally to its degree.
+ */
+static void
+grow_graph(drvis_layout_t *layout, size_t count, uint32_t **ends, size_t *num_ends,
+           size_t *cap_ends)
+{
+    size_t first = drvis_layout_add_nodes(layout, count);
+    size_t i, j;
+    ASSERT(first != (size_t)-1, "out of memory\n");
+    for (i = first; i < first + count; i++) {
+        for (j = 0; j < 2 && i > 0; j++) {
+            size_t target = *num_ends == 0 ? 0 : (*ends)[next_rand() % *num_ends];
+            ASSERT(drvis_layout_add_edge(layout, i, target,
+                                         1.f + (float)(next_rand() % 8)),
+                   "out of memory\n");
+            if (*num_ends + 2 > *cap_ends) {
+                *cap_ends = *cap_ends == 0 ? 1024 : *cap_ends * 2;
+                *ends = realloc(*ends, *cap_ends * sizeof(**ends));
+                ASSERT(*ends != NULL, "out of memory\n");
+            }
+            (*ends)[(*num_ends)++] = (uint32_t)i;
+            (*ends)[(*num_ends)++] = (uint32_t)target;
+        }
+    }
+}
+
+static void
+bench(size_t nodes, unsigned int threads, unsigned int iters)
+{
+    drvis_layout_options_t ops;
+    drvis_layout_t *layout;
+    uint32_t *ends = NULL;
+    size_t num_ends = 0, cap_ends = 0;
+    double start, full, incr;
+
+    drvis_layout_options_init(&ops);
+    ops.num_threads = threads;
+    layout = drvis_layout_create(&ops);
+    ASSERT(layout != NULL, "failed to create the layout\n");
+    rand_state = 12345;
+    grow_graph(layout, nodes, &ends, &num_ends, &cap_ends);
+
+    start = now_seconds();
+    ASSERT(drvis_layout_run(layout, iters), "layout failed\n");
+    full = (now_seconds() - start) / iters;
+
+    grow_graph(layout, nodes / 100 + 1, &ends, &num_ends, &cap_ends);
+    start = now_seconds();
+    ASSERT(drvis_layout_run(layout, iters), "layout failed\n");
+    incr = (now_seconds() - start) / iters;
+
+    fprintf(stdout, "%9zu %7u %14.2f %14.2f\n", nodes, threads, full * 1e3, incr * 1e3);
+    fflush(stdout);
+    drvis_layout_destroy(layout);
+    free(ends);
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t max_nodes = 1000000, nodes;
+    unsigned int max_threads = 8, iters = 5, threads;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            fprintf(stdout, "%s", usage_str);
+            return 0;
+        } else if (strcmp(argv[i], "--max_nodes") == 0 && i + 1 < argc) {
+            max_nodes = (size_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            iters = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = (unsigned int)atoi(argv[++i]);
+        } else {
+            ASSERT(0, "unknown option %s\n%s", argv[i], usage_str);
+        }
+    }
+    ASSERT(iters > 0 && max_threads > 0, "%s", usage_str);
+
+    fprintf(stdout, "%9s %7s %14s %14s\n", "nodes", "threads", "ms/iter", "incr ms/iter");
+    for (nodes = 1000; nodes <= max_nodes; nodes *= 10) {
+        for (threads = 1; threads <= max_threads; threads *= 2)
+            bench(nodes, threads, iters);
+    }
+    return 0;
+}
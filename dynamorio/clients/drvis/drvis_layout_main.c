@@ -0,0 +1,433 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drvis_layout_main.c
+ *
+ * Lays out the block or function graph of a binary dump (see drvis_dump.h),
+ * or the graph in a DOT file, and writes the coordinates of each node for
+ * the renderer.
+ */
+
+#include "drvis_dump.h"
+#include "drvis_layout.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int verbose = 1;
+
+#define PRINT(lvl, ...) do {                                \
+    if (verbose >= lvl) {                                   \
+        fprintf(stdout, "[DRVIS_LAYOUT] INFO(%d):  ", lvl); \
+        fprintf(stdout, __VA_ARGS__);                       \
+    }                                                       \
+} while (0)
+
+#define ASSERT(val, ...) do {                               \
+    if (!(val)) {                                           \
+        fprintf(stderr, "[DRVIS_LAYOUT] ERROR:    ");       \
+        fprintf(stderr, __VA_ARGS__);                       \
+        exit(1);                                            \
+    }                                                       \
+} while (0)
+
+const char *usage_str =
+    "drvis_layout: compute a force-directed layout of a block or call graph\n"
+    "usage: drvis_layout [options] <binary dump or DOT file> <output file>\n"
+    "      --help                          Print this message.\n"
+    "      --verbose <int>                 Verbose level.\n"
+    "      --threads <int>                 Worker threads, 0 for one per CPU (default).\n"
+    "      --iters <int>                   Layout iterations (default 100).\n"
+    "      --theta <float>                 Barnes-Hut opening angle (default 0.8).\n"
+    "      --seed <int>                    Seed for the initial placement.\n"
+    "      --functions                     Lay out the function graph of a dump\n"
+    "                                      rather than its blocks.\n"
+    "      --stage <int>                   Lay out only the first <int> nodes, then\n"
+    "                                      add the rest and continue, as a viewer\n"
+    "                                      does when the graph grows.\n"
+    "      --stage_output <file>           Where to write the first stage's layout.\n"
+    "The output has one \"<id> <x> <y>\" line per node, after a # comment line.\n";
+
+/* The id of each layout node, for the output */
+static char **node_names;    /* for DOT input */
+static uint32_t *node_ids;   /* for dump input */
+static size_t num_names, cap_names;
+
+/* With --stage, only the first stage_size nodes and the edges among them are
+ * added to the layout while reading; the other edges are held back until the
+ * first stage has run.
+ */
+typedef struct _held_edge_t {
+    size_t a, b;
+    float weight;
+} held_edge_t;
+
+static size_t stage_size;
+static size_t num_read;
+static held_edge_t *held;
+static size_t num_held, cap_held;
+
+/* Returns the index of the first of count new nodes */
+static size_t
+add_nodes(drvis_layout_t *layout, size_t count)
+{
+    size_t first = num_read, now = count;
+    if (stage_size > 0 && first + count > stage_size)
+        now = first >= stage_size ? 0 : stage_size - first;
+    if (now > 0)
+        ASSERT(drvis_layout_add_nodes(layout, now) == first, "out of memory\n");
+    num_read += count;
+    return first;
+}
+
+static void
+add_edge(drvis_layout_t *layout, size_t a, size_t b, float weight)
+{
+    if (stage_size > 0 && (a >= stage_size || b >= stage_size)) {
+        if (num_held == cap_held) {
+            cap_held = cap_held == 0 ? 1024 : cap_held * 2;
+            held = realloc(held, cap_held * sizeof(*held));
+            ASSERT(held != NULL, "out of memory\n");
+        }
+        held[num_held].a = a;
+        held[num_held].b = b;
+        held[num_held].weight = weight;
+        num_held++;
+    } else
+        ASSERT(drvis_layout_add_edge(layout, a, b, weight), "out of memory\n");
+}
+
+/* Adds the nodes and edges held back from the first stage */
+static void
+add_held(drvis_layout_t *layout)
+{
+    size_t i, have = drvis_layout_num_nodes(layout);
+    stage_size = 0;
+    if (num_read > have)
+        ASSERT(drvis_layout_add_nodes(layout, num_read - have) == have, "out of memory\n");
+    for (i = 0; i < num_held; i++)
+        add_edge(layout, held[i].a, held[i].b, held[i].weight);
+    free(held);
+    held = NULL;
+    num_held = 0;
+}
+
+/* Edge weights grow with the log of the execution count, so that hot paths
+ * pull together without collapsing the rest of the graph.
+ */
+static float
+edge_weight(uint64_t count)
+{
+    return 1.f + (float)log(1.0 + (double)count);
+}
+
+/****************************************************************************
+ * Binary dump input
+ */
+
+static void
+read_dump(drvis_dump_t *dump, drvis_layout_t *layout, bool functions)
+{
+    const drvis_blocks_t *blocks = drvis_dump_blocks(dump);
+    const drvis_functions_t *funcs = drvis_dump_functions(dump);
+    uint32_t *node_of_row;
+    size_t kind, i, num_nodes;
+
+    ASSERT(drvis_dump_validate(dump) == DRVIS_SUCCESS, "corrupt dump\n");
+    num_nodes = functions ? funcs->count : blocks->count;
+    ASSERT(add_nodes(layout, num_nodes) == 0, "out of memory\n");
+    node_ids = malloc(num_nodes * sizeof(*node_ids) + 1);
+    node_of_row = malloc(blocks->count * sizeof(*node_of_row) + 1);
+    ASSERT(node_ids != NULL && node_of_row != NULL, "out of memory\n");
+    memcpy(node_ids, functions ? funcs->function_id : blocks->block_id,
+           num_nodes * sizeof(*node_ids));
+    num_names = num_nodes;
+    if (functions) {
+        /* the rows of each function are contiguous */
+        for (i = 0; i < funcs->count; i++) {
+            uint32_t row;
+            for (row = funcs->first_row[i];
+                 row < funcs->first_row[i] + funcs->num_rows[i]; row++)
+                node_of_row[row] = (uint32_t)i;
+        }
+    } else {
+        for (i = 0; i < blocks->count; i++)
+            node_of_row[i] = (uint32_t)i;
+    }
+
+    for (kind = 0; kind < DRVIS_EDGE_KINDS; kind++) {
+        const drvis_edges_t *edges = drvis_dump_edges(dump, (drvis_edge_kind_t)kind);
+        /* intra edges stay within a function node */
+        if (functions && kind == DRVIS_EDGE_INTRA)
+            continue;
+        for (i = 0; i < blocks->count; i++) {
+            uint32_t e;
+            for (e = edges->first[i]; e < edges->first[i + 1]; e++) {
+                size_t dst;
+                if (drvis_dump_block_row(dump, edges->dst[e], &dst) != DRVIS_SUCCESS)
+                    continue;
+                add_edge(layout, node_of_row[i], node_of_row[dst],
+                         edge_weight(blocks->num_executions[i]));
+            }
+        }
+    }
+    free(node_of_row);
+    PRINT(1, "read %zu %s\n", num_nodes, functions ? "functions" : "blocks");
+}
+
+/****************************************************************************
+ * DOT input
+ *
+ * We handle the subset of DOT that our tools write: one node or edge
+ * statement per line, such as
+ *   b7195 [color=blue label="tcp_rcv_state_process"] ;
+ *   b7195 -> b7349 [weight=3];
+ * and ignore graph-level lines.
+ */
+
+#define NAME_HASH_BITS 16
+#define NAME_HASH_SIZE (1 << NAME_HASH_BITS)
+#define MAX_LINE 4096
+
+typedef struct _name_entry_t {
+    struct _name_entry_t *next;
+    size_t node;
+} name_entry_t;
+
+static name_entry_t *name_table[NAME_HASH_SIZE];
+
+static uint32_t
+name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name != '\0'; name++)
+        h = (h ^ (uint8_t)*name) * 16777619u;
+    return h & (NAME_HASH_SIZE - 1);
+}
+
+static size_t
+node_lookup_or_add(drvis_layout_t *layout, const char *name)
+{
+    uint32_t h = name_hash(name);
+    name_entry_t *e;
+    for (e = name_table[h]; e != NULL; e = e->next) {
+        if (strcmp(node_names[e->node], name) == 0)
+            return e->node;
+    }
+    e = malloc(sizeof(*e));
+    ASSERT(e != NULL, "out of memory\n");
+    e->node = add_nodes(layout, 1);
+    if (num_names == cap_names) {
+        cap_names = cap_names == 0 ? 1024 : cap_names * 2;
+        node_names = realloc(node_names, cap_names * sizeof(*node_names));
+        ASSERT(node_names != NULL, "out of memory\n");
+    }
+    node_names[num_names++] = strdup(name);
+    ASSERT(node_names[e->node] != NULL, "out of memory\n");
+    e->next = name_table[h];
+    name_table[h] = e;
+    return e->node;
+}
+
+/* Copies the node id at *pos into name, advancing *pos past it */
+static bool
+read_id(const char **pos, char *name, size_t size)
+{
+    const char *p = *pos;
+    size_t len = 0;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '"') {
+        for (p++; *p != '\0' && *p != '"'; p++) {
+            if (len + 1 < size)
+                name[len++] = *p;
+        }
+        if (*p != '"')
+            return false;
+        p++;
+    } else {
+        for (; *p == '_' || *p == '.' || (*p >= '0' && *p <= '9') ||
+                 (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'); p++) {
+            if (len + 1 < size)
+                name[len++] = *p;
+        }
+    }
+    name[len] = '\0';
+    *pos = p;
+    return len > 0;
+}
+
+static void
+read_dot(const char *path, drvis_layout_t *layout)
+{
+    char line[MAX_LINE], name[MAX_LINE];
+    size_t line_num = 0, num_edges = 0;
+    FILE *f = fopen(path, "r");
+    ASSERT(f != NULL, "failed to open %s\n", path);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        const char *p = line;
+        size_t src;
+        line_num++;
+        if (strstr(line, "graph") != NULL || strchr(line, '}') != NULL ||
+            !read_id(&p, name, sizeof(name)))
+            continue;
+        /* keywords for attribute defaults */
+        if (strcmp(name, "node") == 0 || strcmp(name, "edge") == 0)
+            continue;
+        src = node_lookup_or_add(layout, name);
+        /* a chain a -> b -> c adds an edge per arrow */
+        for (;;) {
+            const char *w;
+            float weight = 1.f;
+            size_t dst;
+            while (*p == ' ' || *p == '\t')
+                p++;
+            if (strncmp(p, "->", 2) != 0 && strncmp(p, "--", 2) != 0)
+                break;
+            p += 2;
+            ASSERT(read_id(&p, name, sizeof(name)),
+                   "line %zu: missing edge target\n", line_num);
+            dst = node_lookup_or_add(layout, name);
+            w = strstr(p, "weight=");
+            if (w != NULL)
+                weight = (float)atof(w + strlen("weight="));
+            add_edge(layout, src, dst, weight > 0 ? weight : 1.f);
+            num_edges++;
+            src = dst;
+        }
+    }
+    fclose(f);
+    PRINT(1, "read %zu nodes and %zu edges from %s\n", num_names, num_edges, path);
+}
+
+/****************************************************************************
+ * Output
+ */
+
+static void
+write_layout(const char *path, drvis_layout_t *layout, const char *kind)
+{
+    const float *x, *y;
+    size_t i, n = drvis_layout_num_nodes(layout);
+    FILE *f = fopen(path, "w");
+    ASSERT(f != NULL, "failed to create %s\n", path);
+    drvis_layout_positions(layout, &x, &y);
+    fprintf(f, "# drvis layout: %zu %s\n", n, kind);
+    for (i = 0; i < n; i++) {
+        if (node_names != NULL)
+            fprintf(f, "%s %.3f %.3f\n", node_names[i], x[i], y[i]);
+        else
+            fprintf(f, "%u %.3f %.3f\n", node_ids[i], x[i], y[i]);
+    }
+    ASSERT(fclose(f) == 0, "failed to write %s\n", path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    drvis_layout_options_t ops;
+    drvis_layout_t *layout;
+    drvis_dump_t *dump = NULL;
+    const char *input = NULL, *output = NULL, *stage_output = NULL, *kind;
+    unsigned int iters = 100;
+    bool functions = false;
+    drvis_error_t res;
+    clock_t start;
+    int i;
+
+    drvis_layout_options_init(&ops);
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            fprintf(stdout, "%s", usage_str);
+            return 0;
+        } else if (strcmp(argv[i], "--verbose") == 0 && i + 1 < argc) {
+            verbose = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            ops.num_threads = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            iters = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--theta") == 0 && i + 1 < argc) {
+            ops.theta = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            ops.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--functions") == 0) {
+            functions = true;
+        } else if (strcmp(argv[i], "--stage") == 0 && i + 1 < argc) {
+            stage_size = (size_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--stage_output") == 0 && i + 1 < argc) {
+            stage_output = argv[++i];
+        } else if (argv[i][0] != '-' && input == NULL) {
+            input = argv[i];
+        } else if (argv[i][0] != '-' && output == NULL) {
+            output = argv[i];
+        } else {
+            ASSERT(false, "unknown option %s\n%s", argv[i], usage_str);
+        }
+    }
+    ASSERT(input != NULL && output != NULL, "%s", usage_str);
+    ASSERT(stage_output == NULL || stage_size > 0, "--stage_output requires --stage\n");
+
+    layout = drvis_layout_create(&ops);
+    ASSERT(layout != NULL, "failed to create the layout\n");
+    res = drvis_dump_open(input, &dump);
+    if (res == DRVIS_SUCCESS) {
+        read_dump(dump, layout, functions);
+        drvis_dump_close(dump);
+        kind = functions ? "functions" : "blocks";
+    } else {
+        ASSERT(res == DRVIS_ERROR_BAD_FORMAT, "failed to open %s: %d\n", input, res);
+        ASSERT(!functions, "--functions requires a binary dump\n");
+        read_dot(input, layout);
+        kind = "nodes";
+    }
+
+    start = clock();
+    if (stage_size > 0) {
+        ASSERT(drvis_layout_run(layout, iters), "layout failed\n");
+        if (stage_output != NULL)
+            write_layout(stage_output, layout, kind);
+        PRINT(1, "laid out the first %zu of %zu nodes\n",
+              drvis_layout_num_nodes(layout), num_read);
+        add_held(layout);
+    }
+    ASSERT(drvis_layout_run(layout, iters), "layout failed\n");
+    PRINT(1, "%u iterations took %.2fs of cpu time\n", iters,
+          (double)(clock() - start) / CLOCKS_PER_SEC);
+    write_layout(output, layout, kind);
+    drvis_layout_destroy(layout);
+    return 0;
+}
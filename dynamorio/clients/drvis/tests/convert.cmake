@@ -0,0 +1,66 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Script for tool.drvis_convert, run via cmake -P with the path to
+# drvis_convert passed in as convert and a scratch dir as tmpdir.  Converts
+# an empty text dump and a small one with --verify, which reads each binary
+# dump back and compares it with the input.
+
+file(REMOVE_RECURSE "${tmpdir}")
+file(MAKE_DIRECTORY "${tmpdir}")
+
+function (convert name text expect_blocks expect_funcs)
+  file(WRITE "${tmpdir}/${name}.txt" "${text}")
+  execute_process(COMMAND ${convert} --verify
+    "${tmpdir}/${name}.txt" "${tmpdir}/${name}.dump"
+    RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+  if (result)
+    message(FATAL_ERROR "failed to convert the ${name} dump: ${output}")
+  endif ()
+  if (NOT "${output}" MATCHES "wrote ${expect_blocks} blocks in ${expect_funcs} functions")
+    message(FATAL_ERROR "wrong counts for the ${name} dump: ${output}")
+  endif ()
+  if (NOT "${output}" MATCHES "verified ")
+    message(FATAL_ERROR "the ${name} dump was not verified: ${output}")
+  endif ()
+endfunction ()
+
+convert(empty "" 0 0)
+# block 3 is listed twice, and the INTER edge leaves an unknown block
+convert(small "BB_FORMAT(block_id,function_id,num_executions,app_name,is_root)
+BB(3,1,10,app,1)
+BB(1,1,5,app,0)
+BB(2,2,7,lib,0)
+BB(3,1,10,app,1)
+INTRA(3,1)
+INTRA(1,3)
+INTER(1,2)
+INTER(9,2)
+" 3 2)
@@ -0,0 +1,157 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Script for tool.drvis_layout, run via cmake -P with the paths to
+# drvis_convert and drvis_layout passed in as convert and layout and a
+# scratch dir as tmpdir.  Lays out a small dump of four functions in two
+# stages, as a viewer does when new blocks show up: the first three
+# functions, then the fourth.  Checks that every node has finite coordinates,
+# that no two nodes overlap, and that adding the fourth function leaves the
+# nodes laid out in the first stage near where they were.
+
+file(REMOVE_RECURSE "${tmpdir}")
+file(MAKE_DIRECTORY "${tmpdir}")
+
+# Coordinates are printed with three decimals; we compare them in
+# thousandths of an edge length, as cmake only has integer math.
+set(min_dist 100)
+set(max_shift 2000)
+
+file(WRITE "${tmpdir}/small.txt" "BB_FORMAT(block_id,function_id,num_executions,app_name,is_root)
+BB(1,1,3,app,1)
+BB(2,1,6,app,0)
+BB(3,1,9,app,0)
+BB(4,1,12,app,0)
+BB(5,2,15,app,0)
+BB(6,2,18,app,0)
+BB(7,2,21,app,0)
+BB(8,2,24,app,0)
+BB(9,3,27,app,0)
+BB(10,3,30,app,0)
+BB(11,3,33,app,0)
+BB(12,3,36,app,0)
+BB(13,4,39,app,0)
+BB(14,4,42,app,0)
+BB(15,4,45,app,0)
+BB(16,4,48,app,0)
+INTRA(1,2)
+INTRA(2,3)
+INTRA(3,4)
+INTRA(3,2)
+INTRA(5,6)
+INTRA(6,7)
+INTRA(7,8)
+INTRA(7,6)
+INTRA(9,10)
+INTRA(10,11)
+INTRA(11,12)
+INTRA(11,10)
+INTER(2,5)
+INTER(8,3)
+INTER(6,9)
+INTER(12,7)
+INTER(10,13)
+INTRA(13,14)
+INTRA(14,15)
+INTRA(15,16)
+INTER(16,11)
+")
+execute_process(COMMAND ${convert} "${tmpdir}/small.txt" "${tmpdir}/small.dump"
+  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+if (result)
+  message(FATAL_ERROR "failed to convert the dump: ${output}")
+endif ()
+execute_process(COMMAND ${layout} --stage 12 --stage_output "${tmpdir}/stage.txt"
+  "${tmpdir}/small.dump" "${tmpdir}/layout.txt"
+  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+if (result)
+  message(FATAL_ERROR "failed to lay out the dump: ${output}")
+endif ()
+if (NOT "${output}" MATCHES "laid out the first 12 of 16 nodes")
+  message(FATAL_ERROR "the layout did not run in two stages: ${output}")
+endif ()
+
+# Reads a layout file into ${prefix}_ids and ${prefix}_x_<id>, ${prefix}_y_<id>
+# in thousandths, checking the header and that every coordinate is finite.
+function (read_layout file prefix expect_nodes)
+  file(STRINGS "${file}" lines)
+  list(GET lines 0 header)
+  if (NOT "${header}" STREQUAL "# drvis layout: ${expect_nodes} blocks")
+    message(FATAL_ERROR "bad header in ${file}: ${header}")
+  endif ()
+  list(REMOVE_AT lines 0)
+  list(LENGTH lines count)
+  if (NOT count EQUAL ${expect_nodes})
+    message(FATAL_ERROR "${file} has ${count} nodes, not ${expect_nodes}")
+  endif ()
+  set(ids "")
+  foreach (line ${lines})
+    # nan and inf do not match
+    if (NOT "${line}" MATCHES "^([0-9]+) (-?[0-9]+)\\.([0-9]+) (-?[0-9]+)\\.([0-9]+)$")
+      message(FATAL_ERROR "bad coordinates in ${file}: ${line}")
+    endif ()
+    set(id ${CMAKE_MATCH_1})
+    # "-0.155" becomes -0155, which math reads as -155
+    set(${prefix}_x_${id} "${CMAKE_MATCH_2}${CMAKE_MATCH_3}" PARENT_SCOPE)
+    set(${prefix}_y_${id} "${CMAKE_MATCH_4}${CMAKE_MATCH_5}" PARENT_SCOPE)
+    list(APPEND ids ${id})
+  endforeach ()
+  set(${prefix}_ids ${ids} PARENT_SCOPE)
+endfunction ()
+
+# Sets var to the squared distance in thousandths
+function (dist2 var x1 y1 x2 y2)
+  math(EXPR d "(${x1} - (${x2})) * (${x1} - (${x2})) + (${y1} - (${y2})) * (${y1} - (${y2}))")
+  set(${var} ${d} PARENT_SCOPE)
+endfunction ()
+
+read_layout("${tmpdir}/stage.txt" stage 12)
+read_layout("${tmpdir}/layout.txt" final 16)
+
+math(EXPR min_dist2 "${min_dist} * ${min_dist}")
+set(done "")
+foreach (a ${final_ids})
+  foreach (b ${done})
+    dist2(d ${final_x_${a}} ${final_y_${a}} ${final_x_${b}} ${final_y_${b}})
+    if (d LESS ${min_dist2})
+      message(FATAL_ERROR "nodes ${a} and ${b} overlap")
+    endif ()
+  endforeach ()
+  list(APPEND done ${a})
+endforeach ()
+
+math(EXPR max_shift2 "${max_shift} * ${max_shift}")
+foreach (id ${stage_ids})
+  dist2(d ${stage_x_${id}} ${stage_y_${id}} ${final_x_${id}} ${final_y_${id}})
+  if (d GREATER ${max_shift2})
+    message(FATAL_ERROR "node ${id} moved too far when the layout grew: from "
+      "${stage_x_${id}},${stage_y_${id}} to ${final_x_${id}},${final_y_${id}}")
+  endif ()
+endforeach ()
@@ -0,0 +1,87 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Script for tool.drvis_view, run via cmake -P with the paths to
+# drvis_convert and drvis_view_bench passed in as convert and view and a
+# scratch dir as tmpdir.  Converts a small dump and loads it into the drgui
+# graph view on Qt's offscreen platform, checking that the loader delivers
+# every function and block and that each zoom level draws something, down to
+# the blocks of the hottest function.
+
+file(REMOVE_RECURSE "${tmpdir}")
+file(MAKE_DIRECTORY "${tmpdir}")
+
+file(WRITE "${tmpdir}/small.txt" "BB_FORMAT(block_id,function_id,num_executions,app_name,is_root)
+BB(1,1,10,app,1)
+BB(2,1,200,app,0)
+BB(3,1,10,app,0)
+BB(4,2,50,app,0)
+BB(5,2,50,app,0)
+BB(6,3,5,lib,0)
+INTRA(1,2)
+INTRA(2,2)
+INTRA(2,3)
+INTER(2,4)
+INTRA(4,5)
+INTER(5,2)
+INTER(3,6)
+")
+execute_process(COMMAND ${convert} "${tmpdir}/small.txt" "${tmpdir}/small.dump"
+  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+if (result)
+  message(FATAL_ERROR "failed to convert the dump: ${output}")
+endif ()
+
+set(ENV{QT_QPA_PLATFORM} "offscreen")
+execute_process(COMMAND ${view} --width 640 --height 400 --frames 2
+  "${tmpdir}/small.dump"
+  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+if (result)
+  message(FATAL_ERROR "the view failed: ${output}${error}")
+endif ()
+if (NOT "${output}" MATCHES "loaded 3 functions and 6 blocks")
+  message(FATAL_ERROR "the view did not load the whole dump: ${output}")
+endif ()
+
+# One row per zoom level: zoom, level, nodes drawn, avg ms, max ms
+string(REGEX MATCHALL "\n *[0-9.e+]+ +(funcs|blocks) +[0-9]+ " rows "${output}")
+list(LENGTH rows num_rows)
+if (NOT num_rows EQUAL 7)
+  message(FATAL_ERROR "expected 7 zoom levels: ${output}")
+endif ()
+foreach (row ${rows})
+  if ("${row}" MATCHES " 0 $")
+    message(FATAL_ERROR "a zoom level drew nothing: ${output}")
+  endif ()
+endforeach ()
+list(GET rows 6 deepest)
+if (NOT "${deepest}" MATCHES "blocks")
+  message(FATAL_ERROR "the deepest zoom did not open a function: ${output}")
+endif ()
@@ -47,6 +47,7 @@
 #include "synch.h"
 #include "perscache.h"
 #include "native_exec.h"
+#include "perfctr.h"
 #include <string.h> /* for strstr */
 
 #ifdef CLIENT_INTERFACE
@@ -364,6 +365,7 @@ dispatch_enter_fcache(dcontext_t *dcontext, fragment_t *targetf)
     }
 
     dispatch_enter_fcache_stats(dcontext, targetf);
+    perfctr_enter_fcache(dcontext);
                     
     /* FIXME: for now we do this before the synch point to avoid complexity of
      * missing a KSTART(fcache_* for cases like NtSetContextThread where a thread
@@ -740,6 +742,7 @@ dispatch_enter_dynamorio(dcontext_t *dcontext)
             }
         }
 
+        perfctr_exit_fcache(dcontext);
         dispatch_exit_fcache_stats(dcontext);
         /* Maybe-permanent native transitions (dr_app_stop()) have to pop kstack,
          * and thus so do temporary native_exec transitions.  Thus, for neither
@@ -1641,6 +1644,7 @@ handle_system_call(dcontext_t *dcontext)
         IF_NOT_X64(IF_VMX86(ASSERT(!is_vmkuw_sysnum(mc->xax))));
     }
 #endif
+    EVTRACE_INSTANT(syscall, get_mcontext(dcontext)->xax);
 
 #ifdef CLIENT_INTERFACE 
     /* We invoke here rather than inside pre_syscall() primarily so we can
@@ -52,9 +52,7 @@
 #ifdef SIDELINE
 # include "sideline.h"
 #endif
-#ifdef PAPI
-# include "perfctr.h"
-#endif
+#include "perfctr.h"
 #ifdef CLIENT_INTERFACE
 # include "instrument.h"
 #endif
@@ -429,16 +427,11 @@ dynamorio_app_init(void)
             main_logfile = INVALID_FILE;
         }
 
-# ifdef PAPI
-        /* setup hardware performance counting */
-        hardware_perfctr_init();
-# endif
-
         DOLOG(1, LOG_TOP, {
             print_version_and_app_info(GLOBAL);
         });
 
-        /* now exit if nullcalls, now that perfctrs are set up */
+        /* now exit if nullcalls */
         if (INTERNAL_OPTION(nullcalls)) {
             print_file(main_logfile,
                        "** nullcalls is set, NOT taking over execution **\n\n");
@@ -538,6 +531,8 @@ dynamorio_app_init(void)
 #ifdef KSTATS
         kstat_init();
 #endif
+        evtrace_init();
+        perfctr_init();
         monitor_init();
         fcache_init();
         link_init();
@@ -798,8 +793,9 @@ dynamorio_fork_init(dcontext_t *dcontext)
      * on a fork -- probably everyone who makes a log file on init.
      */
     fragment_fork_init(dcontext);
-    /* this must be called after dynamo_other_thread_exit() above */
+    /* these must be called after dynamo_other_thread_exit() above */
     signal_fork_init(dcontext);
+    perfctr_fork_init(dcontext);
 
 # ifdef CLIENT_INTERFACE
     if (!IS_INTERNAL_STRING_OPTION_EMPTY(client_lib)) {
@@ -919,9 +915,6 @@ dynamo_shared_exit(IF_WINDOWS_(thread_record_t *toexit)
     LOG(GLOBAL, LOG_STATS, 1, "Total running time: %d seconds\n",
         endtime - starttime);
     
-#ifdef PAPI
-    hardware_perfctr_exit();
-#endif
 #ifdef DEBUG
 #  ifdef INTERNAL
     print_optimization_stats();
@@ -1052,6 +1045,8 @@ dynamo_shared_exit(IF_WINDOWS_(thread_record_t *toexit)
 #ifdef KSTATS
     kstat_exit();
 #endif
+    evtrace_exit();
+    perfctr_exit();
 
     DELETE_LOCK(all_threads_lock);
     DELETE_LOCK(thread_initexit_lock);
@@ -1234,13 +1229,8 @@ dynamo_process_exit_cleanup(void)
 int
 dynamo_nullcalls_exit(void)
 {
-    /* this routine is used when nullcalls is turned on
-     * simply to get perfctr numbers in a log file
-     */
+    /* this routine is used when nullcalls is turned on */
     ASSERT(INTERNAL_OPTION(nullcalls));
-#ifdef PAPI
-    hardware_perfctr_exit();
-#endif
 
 #ifdef DEBUG
     if (main_logfile != STDERR) {
@@ -1308,6 +1298,7 @@ dynamo_process_exit(void)
 # ifdef KSTATS
     each_thread = each_thread || DYNAMO_OPTION(kstats);
 # endif
+    each_thread = each_thread || DYNAMO_OPTION(evtrace) || DYNAMO_OPTION(perfctr);
 # ifdef CLIENT_INTERFACE
     each_thread = each_thread ||
         /* If we don't need a thread exit event, avoid the possibility of
@@ -1357,11 +1348,14 @@ dynamo_process_exit(void)
             if (DYNAMO_OPTION(kstats))
                 kstat_thread_exit(threads[i]->dcontext);
 # endif
+            evtrace_thread_exit(threads[i]->dcontext);
 # ifdef CLIENT_INTERFACE
             /* Inform client of all thread exits */
             if (!INTERNAL_OPTION(nullcalls) && !DYNAMO_OPTION(skip_thread_exit_at_exit))
                 instrument_thread_exit_event(threads[i]->dcontext);
 # endif
+            /* after the client's thread exit so it can still read the counters */
+            perfctr_thread_exit(threads[i]->dcontext);
         }
         global_heap_free(threads, num*sizeof(thread_record_t*) 
                          HEAPACCT(ACCT_THREAD_MGT));
@@ -1410,6 +1404,8 @@ dynamo_process_exit(void)
     if (DYNAMO_OPTION(kstats))
         kstat_exit();
 # endif
+    evtrace_exit();
+    perfctr_exit();
     /* so make sure eventlog connection is terminated (if present)  */
     os_fast_exit();
     /* make sure to delete .1config */
@@ -2130,6 +2126,8 @@ dynamo_thread_init(byte *dstack_in, priv_mcontext_t *mc
 #ifdef KSTATS
     kstat_thread_init(dcontext);
 #endif
+    evtrace_thread_init(dcontext);
+    perfctr_thread_init(dcontext);
     os_thread_init(dcontext);
     arch_thread_init(dcontext);
     synch_thread_init(dcontext);
@@ -2377,6 +2375,8 @@ dynamo_thread_exit_common(dcontext_t *dcontext, thread_id_t id,
 #ifdef KSTATS
     kstat_thread_exit(dcontext);
 #endif
+    evtrace_thread_exit(dcontext);
+    perfctr_thread_exit(dcontext);
     DOSTATS({ stats_thread_exit(dcontext); });
     heap_thread_exit(dcontext);
 #ifdef DEADLOCK_AVOIDANCE
@@ -0,0 +1,362 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * evtrace.c - internal event tracing
+ *
+ * Records timestamped begin/end events for DR's own activity (every kstat
+ * path plus a few explicit events) into a per-thread ring buffer, and writes
+ * them out in the Chrome trace-event JSON array format so they can be loaded
+ * into a timeline viewer such as chrome://tracing.
+ *
+ * Each buffer has a single writer, its owning thread, which never takes a
+ * lock: it stores the entry and then bumps the event count.  Buffers are
+ * written out by their owner at thread exit, and by whichever thread handles
+ * an evtrace nudge.  The latter reads the buffers of running threads, so a
+ * thread that records more than a full buffer's worth of events while it is
+ * being written out can produce a garbled entry; and a signal arriving in the
+ * middle of recording can drop an event.  Neither matters for a diagnostic
+ * timeline.  Older events are overwritten once a buffer wraps around.
+ */
+
+#include "globals.h"
+#include "evtrace.h"
+#include <string.h>
+
+/* "ph" values in the trace-event format */
+enum {
+    EVTRACE_PHASE_BEGIN   = 'B',
+    EVTRACE_PHASE_END     = 'E',
+    EVTRACE_PHASE_INSTANT = 'i',
+};
+
+enum { EVTRACE_MAX_DEPTH = 32 };
+
+typedef struct _evtrace_entry_t {
+    timestamp_t timestamp;
+    ushort id;
+    ushort phase;
+    uint arg;
+} evtrace_entry_t;
+
+typedef struct _evtrace_thread_t {
+    /* total number of events recorded: wraps around, only differences matter */
+    volatile uint num_recorded;
+    /* value of num_recorded when we last wrote this buffer out */
+    uint num_dumped;
+    /* open begin events, so that mismatched and rewinding stops can be closed */
+    uint depth;
+    ushort stack[EVTRACE_MAX_DEPTH];
+    thread_id_t tid;
+    evtrace_entry_t *entries; /* power-of-2 sized */
+    uint num_entries;
+} evtrace_thread_t;
+
+static const char * const evtrace_names[] = {
+#define KSTAT_DEF(desc, name) #name,
+#define KSTAT_SUM(desc, name, var1, var2) /* nothing */
+#include "kstatsx.h"
+#undef KSTAT_SUM
+#undef KSTAT_DEF
+#define EVTRACE_DEF(name) #name,
+    EVTRACE_DEFINITIONS()
+#undef EVTRACE_DEF
+};
+
+/* protects evtrace_file and the num_dumped fields */
+DECLARE_CXTSWPROT_VAR(static mutex_t evtrace_lock, INIT_LOCK_FREE(evtrace_lock));
+static file_t evtrace_file = INVALID_FILE;
+static timestamp_t evtrace_start_time;
+static timestamp_t evtrace_cycles_per_us;
+/* whether any event has been written, for the separating commas */
+static bool evtrace_wrote_event;
+
+void
+evtrace_init(void)
+{
+    char name[MAXIMUM_PATH];
+    uint name_size = BUFFER_SIZE_ELEMENTS(name);
+    if (!DYNAMO_OPTION(evtrace))
+        return;
+    ASSERT(BUFFER_SIZE_ELEMENTS(evtrace_names) == EVTRACE_ID_NUM);
+    RDTSC_LL(evtrace_start_time);
+    evtrace_cycles_per_us = get_timer_frequency() / 1000;
+    if (evtrace_cycles_per_us == 0)
+        evtrace_cycles_per_us = 1;
+
+    name[0] = '\0';
+    if (!get_log_dir(PROCESS_DIR, name, &name_size)) {
+        create_log_dir(PROCESS_DIR);
+        if (!get_log_dir(PROCESS_DIR, name, &name_size))
+            name[0] = '\0';
+    }
+    NULL_TERMINATE_BUFFER(name);
+    if (name[0] == '\0') {
+        SYSLOG_INTERNAL_WARNING("-evtrace requires a log directory");
+        return;
+    }
+    snprintf(&name[strlen(name)], BUFFER_SIZE_ELEMENTS(name) - strlen(name),
+             "%cevtrace.%d.json", DIRSEP, get_process_id());
+    NULL_TERMINATE_BUFFER(name);
+    evtrace_file = os_open_protected(name, OS_OPEN_WRITE|OS_OPEN_ALLOW_LARGE|
+                                     OS_OPEN_CLOSE_ON_FORK|OS_OPEN_REQUIRE_NEW);
+    if (evtrace_file == INVALID_FILE) {
+        SYSLOG_INTERNAL_WARNING("Cannot create event trace file %s", name);
+        return;
+    }
+    /* The array format lets us append events for as long as we run; viewers
+     * accept a missing closing bracket if we never get to write it.
+     */
+    print_file(evtrace_file, "[\n");
+}
+
+void
+evtrace_exit(void)
+{
+    if (evtrace_file != INVALID_FILE) {
+        print_file(evtrace_file, "\n]\n");
+        os_close_protected(evtrace_file);
+        evtrace_file = INVALID_FILE;
+    }
+    DELETE_LOCK(evtrace_lock);
+}
+
+void
+evtrace_thread_init(dcontext_t *dcontext)
+{
+    evtrace_thread_t *et;
+    uint num_entries;
+    dcontext->evtrace_field = NULL;
+    if (!DYNAMO_OPTION(evtrace) || DYNAMO_OPTION(evtrace_buffer_size) == 0)
+        return;
+    /* round up to a power of 2 so we can mask */
+    for (num_entries = 1; num_entries < DYNAMO_OPTION(evtrace_buffer_size);
+         num_entries <<= 1)
+        ; /* nothing */
+    et = HEAP_TYPE_ALLOC(dcontext, evtrace_thread_t, ACCT_OTHER, UNPROTECTED);
+    memset(et, 0, sizeof(*et));
+    et->tid = dcontext->owning_thread;
+    et->num_entries = num_entries;
+    et->entries = HEAP_ARRAY_ALLOC(dcontext, evtrace_entry_t, num_entries,
+                                   ACCT_OTHER, UNPROTECTED);
+    dcontext->evtrace_field = (void *) et;
+}
+
+/* Appends et's events that have not yet been written to evtrace_file.
+ * Caller must hold evtrace_lock.
+ */
+static void
+evtrace_dump_thread(evtrace_thread_t *et)
+{
+    char buf[4096];
+    size_t len = 0;
+    uint recorded = et->num_recorded;
+    uint i, num = recorded - et->num_dumped;
+    ASSERT_OWN_MUTEX(true, &evtrace_lock);
+    if (evtrace_file == INVALID_FILE)
+        return;
+    if (num > et->num_entries) {
+        /* the ring wrapped around since we last wrote it out */
+        print_file(evtrace_file, "%s{\"name\":\"evtrace_dropped\",\"ph\":\"i\","
+                   "\"s\":\"t\",\"ts\":0,\"pid\":%d,\"tid\":%d,"
+                   "\"args\":{\"events\":%u}}",
+                   evtrace_wrote_event ? ",\n" : "", get_process_id(), (int) et->tid,
+                   num - et->num_entries);
+        evtrace_wrote_event = true;
+        num = et->num_entries;
+    }
+    for (i = recorded - num; i != recorded; i++) {
+        evtrace_entry_t *e = &et->entries[i & (et->num_entries - 1)];
+        /* the format wants microseconds, which we print with ns precision */
+        timestamp_t ns = (e->timestamp - evtrace_start_time) * 1000 /
+            evtrace_cycles_per_us;
+        char arg[64];
+        int res;
+        if (e->id >= EVTRACE_ID_NUM)
+            continue; /* torn entry */
+        if (BUFFER_SIZE_ELEMENTS(buf) - len < 256) {
+            os_write(evtrace_file, buf, len);
+            len = 0;
+        }
+        arg[0] = '\0';
+        if (e->phase == EVTRACE_PHASE_INSTANT) {
+            snprintf(arg, BUFFER_SIZE_ELEMENTS(arg),
+                     ",\"s\":\"t\",\"args\":{\"arg\":%u}", e->arg);
+            NULL_TERMINATE_BUFFER(arg);
+        }
+        res = snprintf(buf + len, BUFFER_SIZE_ELEMENTS(buf) - len,
+                       "%s{\"name\":\"%s\",\"cat\":\"dr\",\"ph\":\"%c\","
+                       "\"ts\":"UINT64_FORMAT_STRING".%03u,\"pid\":%d,\"tid\":%d%s}",
+                       evtrace_wrote_event ? ",\n" : "", evtrace_names[e->id],
+                       (char) e->phase, ns / 1000, (uint) (ns % 1000),
+                       get_process_id(), (int) et->tid, arg);
+        ASSERT(res > 0 && (size_t)res < BUFFER_SIZE_ELEMENTS(buf) - len);
+        if (res > 0 && (size_t)res < BUFFER_SIZE_ELEMENTS(buf) - len) {
+            len += res;
+            evtrace_wrote_event = true;
+        }
+    }
+    if (len > 0)
+        os_write(evtrace_file, buf, len);
+    et->num_dumped = recorded;
+}
+
+void
+evtrace_thread_exit(dcontext_t *dcontext)
+{
+    evtrace_thread_t *et = (evtrace_thread_t *) dcontext->evtrace_field;
+    if (et == NULL)
+        return;
+    mutex_lock(&evtrace_lock);
+    evtrace_dump_thread(et);
+    mutex_unlock(&evtrace_lock);
+    dcontext->evtrace_field = NULL;
+    HEAP_ARRAY_FREE(dcontext, et->entries, evtrace_entry_t, et->num_entries,
+                    ACCT_OTHER, UNPROTECTED);
+    HEAP_TYPE_FREE(dcontext, et, evtrace_thread_t, ACCT_OTHER, UNPROTECTED);
+}
+
+void
+evtrace_dump_all_threads(void)
+{
+    thread_record_t **threads;
+    int num_threads, i;
+    if (!DYNAMO_OPTION(evtrace))
+        return;
+    mutex_lock(&thread_initexit_lock);
+    get_list_of_threads(&threads, &num_threads);
+    mutex_lock(&evtrace_lock);
+    for (i = 0; i < num_threads; i++) {
+        evtrace_thread_t *et = (evtrace_thread_t *) threads[i]->dcontext->evtrace_field;
+        if (et != NULL)
+            evtrace_dump_thread(et);
+    }
+    mutex_unlock(&evtrace_lock);
+    global_heap_free(threads, num_threads*sizeof(thread_record_t*)
+                     HEAPACCT(ACCT_THREAD_MGT));
+    mutex_unlock(&thread_initexit_lock);
+}
+
+static inline evtrace_thread_t *
+evtrace_get_thread(dcontext_t *dcontext)
+{
+    if (dcontext == NULL)
+        dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    return (evtrace_thread_t *) dcontext->evtrace_field;
+}
+
+static inline void
+evtrace_record(evtrace_thread_t *et, uint id, uint phase, uint arg)
+{
+    uint idx = et->num_recorded;
+    evtrace_entry_t *e = &et->entries[idx & (et->num_entries - 1)];
+    RDTSC_LL(e->timestamp);
+    e->id = (ushort) id;
+    e->phase = (ushort) phase;
+    e->arg = arg;
+    et->num_recorded = idx + 1;
+}
+
+void
+evtrace_begin(dcontext_t *dcontext, uint id)
+{
+    evtrace_thread_t *et = evtrace_get_thread(dcontext);
+    if (et == NULL)
+        return;
+    /* if we overflow our stack we stop recording nested events, to keep
+     * the begins and ends balanced
+     */
+    if (et->depth < EVTRACE_MAX_DEPTH) {
+        et->stack[et->depth] = (ushort) id;
+        evtrace_record(et, id, EVTRACE_PHASE_BEGIN, 0);
+    }
+    et->depth++;
+}
+
+static void
+evtrace_pop(evtrace_thread_t *et)
+{
+    ASSERT(et->depth > 0);
+    et->depth--;
+    if (et->depth < EVTRACE_MAX_DEPTH)
+        evtrace_record(et, et->stack[et->depth], EVTRACE_PHASE_END, 0);
+}
+
+void
+evtrace_end(dcontext_t *dcontext)
+{
+    evtrace_thread_t *et = evtrace_get_thread(dcontext);
+    /* we ignore stops for starts that preceded thread init */
+    if (et == NULL || et->depth == 0)
+        return;
+    evtrace_pop(et);
+}
+
+/* Ends the current event and begins id in its place, as kstats attribute the
+ * whole path to the switched-to name.
+ */
+void
+evtrace_switch(dcontext_t *dcontext, uint id)
+{
+    evtrace_thread_t *et = evtrace_get_thread(dcontext);
+    if (et == NULL || et->depth == 0)
+        return;
+    evtrace_pop(et);
+    evtrace_begin(dcontext, id);
+}
+
+void
+evtrace_rewind(dcontext_t *dcontext, uint id, bool inclusive)
+{
+    evtrace_thread_t *et = evtrace_get_thread(dcontext);
+    if (et == NULL)
+        return;
+    while (et->depth > 0) {
+        bool match = (et->depth <= EVTRACE_MAX_DEPTH && et->stack[et->depth-1] == id);
+        if (match && !inclusive)
+            break;
+        evtrace_pop(et);
+        if (match)
+            break;
+    }
+}
+
+void
+evtrace_instant(dcontext_t *dcontext, uint id, uint arg)
+{
+    evtrace_thread_t *et = evtrace_get_thread(dcontext);
+    if (et == NULL)
+        return;
+    evtrace_record(et, id, EVTRACE_PHASE_INSTANT, arg);
+}
@@ -0,0 +1,102 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * evtrace.h - internal event tracing exports
+ */
+
+#ifndef _EVTRACE_H_
+#define _EVTRACE_H_ 1
+
+/* Events that are not kstats.  Instant events carry a single integer argument.
+ * To use as an iterator define EVTRACE_DEF(name).
+ */
+#define EVTRACE_DEFINITIONS()                                           \
+    EVTRACE_DEF(synchall)      /* synch_with_all_threads() */           \
+    EVTRACE_DEF(signal)        /* instant: app signal delivered */      \
+    EVTRACE_DEF(syscall)       /* instant: app syscall handled */       \
+    EVTRACE_DEF(nudge)         /* instant: nudge received */
+
+/* Event ids: every kstat is an event, followed by the ones above */
+typedef enum {
+#define KSTAT_DEF(desc, name) EVTRACE_ID_##name,
+#define KSTAT_SUM(desc, name, var1, var2) /* nothing */
+#include "kstatsx.h"
+#undef KSTAT_SUM
+#undef KSTAT_DEF
+#define EVTRACE_DEF(name) EVTRACE_ID_##name,
+    EVTRACE_DEFINITIONS()
+#undef EVTRACE_DEF
+    EVTRACE_ID_NUM
+} evtrace_id_t;
+
+void evtrace_init(void);
+void evtrace_exit(void);
+void evtrace_thread_init(dcontext_t *dcontext);
+void evtrace_thread_exit(dcontext_t *dcontext);
+/* Writes out the events of all live threads that have not been written yet */
+void evtrace_dump_all_threads(void);
+
+/* dcontext may be NULL to indicate the current thread */
+void evtrace_begin(dcontext_t *dcontext, uint id);
+void evtrace_end(dcontext_t *dcontext);
+void evtrace_switch(dcontext_t *dcontext, uint id);
+void evtrace_rewind(dcontext_t *dcontext, uint id, bool inclusive);
+void evtrace_instant(dcontext_t *dcontext, uint id, uint arg);
+
+/* The recording macros are always compiled in and cost one option check
+ * when -evtrace is off.  The kstat macros in utils.h expand to these.
+ */
+#define EVTRACE_DO(statement) do {              \
+    if (DYNAMO_OPTION(evtrace)) {               \
+        statement;                              \
+    }                                           \
+} while (0)
+
+#define EVTRACE_BEGIN(name) EVTRACE_DO(evtrace_begin(NULL, EVTRACE_ID_##name))
+#define EVTRACE_END() EVTRACE_DO(evtrace_end(NULL))
+#define EVTRACE_SWITCH(name) EVTRACE_DO(evtrace_switch(NULL, EVTRACE_ID_##name))
+/* pops events up to and including name */
+#define EVTRACE_REWIND(name) \
+    EVTRACE_DO(evtrace_rewind(NULL, EVTRACE_ID_##name, true))
+/* pops events down to but not including name */
+#define EVTRACE_REWIND_UNTIL(name) \
+    EVTRACE_DO(evtrace_rewind(NULL, EVTRACE_ID_##name, false))
+#define EVTRACE_INSTANT(name, arg) \
+    EVTRACE_DO(evtrace_instant(NULL, EVTRACE_ID_##name, (uint)(arg)))
+
+#define EVTRACE_BEGIN_DC(dc, name) EVTRACE_DO(evtrace_begin(dc, EVTRACE_ID_##name))
+#define EVTRACE_END_DC(dc) EVTRACE_DO(evtrace_end(dc))
+#define EVTRACE_REWIND_DC(dc, name) \
+    EVTRACE_DO(evtrace_rewind(dc, EVTRACE_ID_##name, true))
+
+#endif /* _EVTRACE_H_ */
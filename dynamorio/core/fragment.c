@@ -1871,6 +1871,8 @@ fragment_thread_reset_init(dcontext_t *dcontext)
                                 _IF_DEBUG("trace"));
     }
 
+    recreate_cache_thread_reset_init(dcontext);
+
     /* We'll now have more control over hashtables based on branch
      * type.  The most important of all is of course the return
      * target table.  These tables should be populated only when
@@ -2069,6 +2071,9 @@ fragment_thread_reset_free(dcontext_t *dcontext)
     /* Dec ref count on any shared tables that are pointed to. */
     dec_all_table_ref_counts(dcontext, pt);
 
+    /* the cached ilists live in non-persistent heap */
+    recreate_cache_thread_reset_free(dcontext);
+
 #ifdef DEBUG
     /* for non-debug we do fast exit path and don't free local heap */
     SELF_PROTECT_CACHE(dcontext, NULL, WRITABLE);
@@ -6123,6 +6128,7 @@ flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
             LOG(THREAD, LOG_FRAGMENT, 2,
                 "\tremoved %d ibl entries in "PFX"-"PFX"\n",
                 removed, exec_start, exec_end);
+            recreate_cache_invalidate(dcontext, base, base+size);
             /* Free any fine private fragments in the region */
             vm_area_allsynch_flush_fragments(dcontext, dcontext, base, base+size,
                                              exec_invalid, all_synched/*ignored*/);
@@ -6359,6 +6365,18 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
             goto next_thread;
         }
 
+        /* the app code may have changed, or a client may want to change its
+         * instrumentation, so drop any decoded blocks cached for translation.
+         * tgt_dcontext is not suspended and may be using its table, so we
+         * only mark it stale for its owner to empty.
+         */
+        if (size > 0) {
+            if (tgt_dcontext == get_thread_private_dcontext())
+                recreate_cache_invalidate(tgt_dcontext, base, base+size);
+            else
+                recreate_cache_mark_stale(tgt_dcontext);
+        }
+
         /* if a trace-in-progress crosses this region, must squash the trace
          * (all traces are essentially frozen now since threads stop in dispatch)
          */
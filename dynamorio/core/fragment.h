@@ -484,6 +484,10 @@ typedef struct _per_thread_t {
      * not used while not flushing.
      */
     bool           at_syscall_at_flush;
+    /* interp.c's cache of decoded bbs for state translation */
+    void           *recreate_cache;
+    /* set by another thread's flush to have the owner drop recreate_cache */
+    volatile bool  recreate_cache_stale;
 
 #ifdef PROFILE_LINKCOUNT
     uint tracedump_num_below_threshold;
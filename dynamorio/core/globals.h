@@ -204,10 +204,6 @@ typedef byte * cache_pc;  /* fragment cache pc */
 #error Must define X86, no other platforms are supported
 #endif
 
-#if defined(PAPI) && defined(WINDOWS)
-# error PAPI does not work on WINDOWS
-#endif
-
 #if defined(DCONTEXT_IN_EDI) && !defined(STEAL_REGISTER)
 # error Must steal register to keep dcontext in edi
 #endif
@@ -335,6 +331,7 @@ typedef uint64 linkcount_type_t;
 #include "vmareas.h"
 #include "instrlist.h"
 #include "dispatch.h"
+#include "evtrace.h"
 
 #include "dr_stats.h"
 
@@ -812,6 +809,8 @@ struct _dcontext_t {
     void *         vm_areas_field;
     void *         os_field;
     void *         synch_field;
+    void *         evtrace_field;
+    void *         perfctr_field;
 #ifdef UNIX
     void *         signal_field;
     void *         pcprofile_field;
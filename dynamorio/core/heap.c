@@ -263,10 +263,27 @@ typedef struct _thread_units_t {
 #endif
 } thread_units_t;
 
+/* Per-thread cache of free blocks of the global heap (heapmgt->global_units).
+ * Every small global allocation (dr_global_alloc, drcontainers nodes, vmarea
+ * entries, ...) otherwise serializes on global_alloc_lock.  For each fixed-size
+ * bucket a thread keeps a short free list (a "magazine") that it allocates from
+ * and frees to without any lock; blocks move between it and the shared free
+ * lists in batches of half of -global_heap_cache_size.  Like the thread-private
+ * heap, a magazine is only touched by its owner, or by whoever cleans the owner
+ * up once it is no longer running.
+ * Blocks sitting in a magazine are free as far as heap accounting is concerned.
+ */
+typedef struct _global_cache_t {
+    heap_pc free_list[BLOCK_TYPES-1];
+    uint count[BLOCK_TYPES-1];
+    bool enabled;
+} global_cache_t;
+
 /* per-thread structure: */
 typedef struct _thread_heap_t {
     thread_units_t *local_heap;
     thread_units_t *nonpersistent_heap;
+    global_cache_t global_cache;
 } thread_heap_t;
 
 /* global, unique thread-shared structure: 
@@ -526,6 +543,8 @@ static void *common_heap_alloc(thread_units_t *tu, size_t size
                                HEAPACCT(which_heap_t which));
 static bool common_heap_free(thread_units_t *tu, void *p, size_t size
                              HEAPACCT(which_heap_t which));
+static inline void heap_bucket_stats_alloc(int bucket, size_t size, size_t aligned_size,
+                                           size_t alloc_size HEAPACCT(which_heap_t which));
 static void release_real_memory(void *p, size_t size, bool remove_vm);
 static void release_guarded_real_memory(vm_addr_t p, size_t size, bool remove_vm,
                                         bool guarded);
@@ -2626,11 +2645,217 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size HEAPACCT(which_
     ASSERT(ok);
 }
 
+/* returns the calling thread's global heap cache, or NULL if it has none */
+static inline global_cache_t *
+get_global_cache(void)
+{
+    dcontext_t *dcontext;
+    thread_heap_t *th;
+    if (DYNAMO_OPTION(global_heap_cache_size) == 0)
+        return NULL;
+    dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    th = (thread_heap_t *) dcontext->heap_field;
+    if (th == NULL || !th->global_cache.enabled)
+        return NULL;
+    return &th->global_cache;
+}
+
+/* returns the fixed-size bucket for size, or -1 if size is not cached */
+static inline int
+global_cache_bucket(size_t size)
+{
+    int bucket = 0;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    if (size == 0 || aligned_size > BLOCK_SIZES[BLOCK_TYPES-2])
+        return -1;
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+    return bucket;
+}
+
+/* moves up to half a magazine of blocks from the shared free list into cache;
+ * returns false if the shared free list was empty
+ */
+static bool
+global_cache_refill(global_cache_t *cache, int bucket)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    uint batch = MAX(DYNAMO_OPTION(global_heap_cache_size) / 2, 1);
+    uint n = 0;
+    ASSERT(cache->free_list[bucket] == NULL && cache->count[bucket] == 0);
+    acquire_recursive_lock(&global_alloc_lock);
+    while (n < batch && tu->free_list[bucket] != NULL) {
+        heap_pc p = tu->free_list[bucket];
+        tu->free_list[bucket] = *((heap_pc *)p);
+        *((heap_pc *)p) = cache->free_list[bucket];
+        cache->free_list[bucket] = p;
+        n++;
+    }
+    release_recursive_lock(&global_alloc_lock);
+    cache->count[bucket] = n;
+    if (n == 0)
+        return false;
+    STATS_INC(global_heap_cache_refills);
+    return true;
+}
+
+/* returns the num least recently freed blocks of cache's bucket to the
+ * shared free list
+ */
+static void
+global_cache_flush(global_cache_t *cache, int bucket, uint num)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    heap_pc first = cache->free_list[bucket], prev = NULL, last;
+    uint keep, i;
+    ASSERT(num <= cache->count[bucket]);
+    if (num == 0)
+        return;
+    /* the head of the list is the most recently freed, so keep that part */
+    keep = cache->count[bucket] - num;
+    for (i = 0; i < keep; i++) {
+        prev = first;
+        first = *((heap_pc *)first);
+    }
+    ASSERT(first != NULL);
+    if (prev == NULL)
+        cache->free_list[bucket] = NULL;
+    else
+        *((heap_pc *)prev) = NULL;
+    cache->count[bucket] = keep;
+    for (last = first; *((heap_pc *)last) != NULL; last = *((heap_pc *)last))
+        ; /* nothing */
+    acquire_recursive_lock(&global_alloc_lock);
+    *((heap_pc *)last) = tu->free_list[bucket];
+    tu->free_list[bucket] = first;
+    release_recursive_lock(&global_alloc_lock);
+    STATS_INC(global_heap_cache_flushes);
+}
+
+/* returns NULL if neither cache nor the shared free list has a block */
+static void *
+global_cache_alloc(global_cache_t *cache, int bucket, size_t size
+                   HEAPACCT(which_heap_t which))
+{
+    heap_pc p;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    size_t alloc_size = BLOCK_SIZES[bucket];
+#ifdef DEBUG_MEMORY
+    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
+#endif
+    if (cache->free_list[bucket] == NULL && !global_cache_refill(cache, bucket))
+        return NULL;
+    p = cache->free_list[bucket];
+    cache->free_list[bucket] = *((heap_pc *)p);
+    cache->count[bucket]--;
+    ASSERT(ALIGNED(p, HEAP_ALIGNMENT));
+    STATS_INC(global_heap_cache_hits);
+#ifdef HEAP_ACCOUNTING
+    /* the accurate global stats are only ever updated under global_alloc_lock */
+    acquire_recursive_lock(&global_alloc_lock);
+    ACCOUNT_FOR_ALLOC(alloc_reuse, &heapmgt->global_units, which,
+                      alloc_size, aligned_size);
+    release_recursive_lock(&global_alloc_lock);
+#endif
+    heap_bucket_stats_alloc(bucket, size, aligned_size, alloc_size HEAPACCT(which));
+#ifdef DEBUG_MEMORY
+    /* verify is unallocated memory, skip free list next pointer */
+    DOCHECK(chklvl, {
+        CLIENT_ASSERT(is_region_memset_to_char
+                      (p+sizeof(heap_pc *), alloc_size-sizeof(heap_pc *),
+                       HEAP_UNALLOCATED_BYTE), "memory corruption detected");
+    });
+    DOCHECK(chklvl, memset(p+size, HEAP_PAD_BYTE, alloc_size-size););
+    DOCHECK(chklvl, memset(p, HEAP_ALLOCATED_BYTE, size););
+#endif
+    return (void *) p;
+}
+
+#ifdef DEBUG_MEMORY
+/* FIXME i#417: This curiosity assertion is trying to make sure we don't
+ * perform a double free, but it can fire if we ever free a data structure
+ * that has the 0xcdcdcdcd bitpattern in the first or last 4 bytes.  This
+ * has happened a few times:
+ *
+ * - case 8802: App's eax is 0xcdcdcdcd (from an app dbg memset) and we have
+ *   dcontext->allocated_start==dcontext.
+ * - i#417: On Linux x64 we get rax == 0xcdcdcdcd from a memset, and
+ *   opnd_create_reg() only updates part of the register before returning by
+ *   value in RAX:RDX.  We initialize to zero in debug mode to work around
+ *   this.
+ * - i#540: On Win7 x64 we see this assert when running the TSan tests in
+ *   NegativeTests.WindowsRegisterWaitForSingleObjectTest.
+ *
+ * For now, we've downgraded this to a curiosity, but if it fires too much
+ * in the future we should maintain a separate data structure in debug mode
+ * to perform this check.  We accept objects that start with 0xcdcdcdcd so
+ * long as the second four bytes are not also 0xcdcdcdcd.
+ */
+static void
+check_not_double_free(heap_pc p, size_t size)
+{
+    ASSERT_CURIOSITY(
+        (*(uint *)p != HEAP_UNALLOCATED_UINT ||
+         (size >= 2*sizeof(uint) && *(((uint *)p)+1) != HEAP_UNALLOCATED_UINT)) &&
+        *(uint *)(p+size-sizeof(int)) != HEAP_UNALLOCATED_UINT &&
+        "attempting to free memory containing HEAP_UNALLOCATED pattern, "
+        "possible double free!");
+}
+#endif
+
+static void
+global_cache_free(global_cache_t *cache, int bucket, void *p_void, size_t size
+                  HEAPACCT(which_heap_t which))
+{
+    heap_pc p = (heap_pc) p_void;
+    DEBUG_DECLARE(size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);)
+#if defined(DEBUG) || defined(HEAP_ACCOUNTING)
+    size_t alloc_size = BLOCK_SIZES[bucket];
+#endif
+    uint max = DYNAMO_OPTION(global_heap_cache_size);
+#ifdef DEBUG_MEMORY
+    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
+    /* the same check common_heap_free() does for frees that bypass the cache */
+    DOCHECK(chklvl, check_not_double_free(p, size););
+    ASSERT_MESSAGE(chklvl, "heap overflow",
+                   is_region_memset_to_char(p+size, alloc_size-size, HEAP_PAD_BYTE));
+    /* set used and padding memory back to unallocated */
+    DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, alloc_size););
+#endif
+    STATS_SUB(heap_bucket_pad, (alloc_size - aligned_size));
+    STATS_SUB(heap_align, (aligned_size - size));
+    DOSTATS({
+        ATOMIC_ADD(int, block_count[bucket], -1);
+        ATOMIC_ADD(int, block_wasted[bucket], -(int)(alloc_size - aligned_size));
+        ATOMIC_ADD(int, block_align_pad[bucket], -(int)(aligned_size - size));
+    });
+#ifdef HEAP_ACCOUNTING
+    acquire_recursive_lock(&global_alloc_lock);
+    ACCOUNT_FOR_FREE(&heapmgt->global_units, which, alloc_size);
+    release_recursive_lock(&global_alloc_lock);
+#endif
+    *((heap_pc *)p) = cache->free_list[bucket];
+    cache->free_list[bucket] = p;
+    cache->count[bucket]++;
+    if (cache->count[bucket] > max)
+        global_cache_flush(cache, bucket, cache->count[bucket] - max/2);
+}
+
 /* these functions use the global heap instead of a thread's heap: */
 void *
 global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 {
-    void *p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
+    void *p = NULL;
+    global_cache_t *cache = get_global_cache();
+    if (cache != NULL) {
+        int bucket = global_cache_bucket(size);
+        if (bucket >= 0)
+            p = global_cache_alloc(cache, bucket, size HEAPACCT(which));
+    }
+    if (p == NULL)
+        p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
     ASSERT(p != NULL);
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: "PFX" (%d bytes)\n", p, size);
     return p;
@@ -2639,7 +2864,12 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 void
 global_heap_free(void *p, size_t size HEAPACCT(which_heap_t which))
 {
-    common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
+    global_cache_t *cache = get_global_cache();
+    int bucket = (cache == NULL || p == NULL) ? -1 : global_cache_bucket(size);
+    if (bucket >= 0)
+        global_cache_free(cache, bucket, p, size HEAPACCT(which));
+    else
+        common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: "PFX" (%d bytes)\n", p, size);
 }
 
@@ -3090,6 +3320,7 @@ heap_thread_init(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *)
         global_heap_alloc(sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    memset(&th->global_cache, 0, sizeof(th->global_cache));
     dcontext->heap_field = (void *) th;
     th->local_heap = (thread_units_t *) global_heap_alloc(sizeof(thread_units_t)
                                                        HEAPACCT(ACCT_MEM_MGT));
@@ -3100,6 +3331,7 @@ heap_thread_init(dcontext_t *dcontext)
     } else
         th->nonpersistent_heap = NULL;
     heap_thread_reset_init(dcontext);
+    th->global_cache.enabled = (DYNAMO_OPTION(global_heap_cache_size) > 0);
 }
 
 void
@@ -3121,6 +3353,13 @@ void
 heap_thread_exit(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
+    int i;
+    /* hand back the cached global blocks before freeing anything else, so that
+     * the frees below (including of th itself) go straight to the shared lists
+     */
+    th->global_cache.enabled = false;
+    for (i = 0; i < BLOCK_TYPES-1; i++)
+        global_cache_flush(&th->global_cache, i, th->global_cache.count[i]);
     threadunits_exit(th->local_heap, dcontext);
     heap_thread_reset_free(dcontext);
     global_heap_free(th->local_heap, sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
@@ -3130,6 +3369,8 @@ heap_thread_exit(dcontext_t *dcontext)
                          HEAPACCT(ACCT_MEM_MGT));
     }
     global_heap_free(th, sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    /* later global frees on this thread must not look at the freed cache */
+    dcontext->heap_field = NULL;
 }
 
 #if defined(DEBUG_MEMORY) && defined(DEBUG)
@@ -3204,6 +3445,47 @@ heap_unit_extend_commitment(heap_unit_t *u, size_t size_need, uint prot)
                                       size_need, prot);
 }
 
+/* bucket usage stats, shared by common_heap_alloc and the global heap cache */
+static inline void
+heap_bucket_stats_alloc(int bucket, size_t size, size_t aligned_size, size_t alloc_size
+                        HEAPACCT(which_heap_t which))
+{
+    DOSTATS({
+        ATOMIC_ADD(int, block_count[bucket], 1);
+        ATOMIC_ADD(int, block_total_count[bucket], 1);
+        /* FIXME: should atomically store inc-ed val in temp to avoid races w/ max */
+        ATOMIC_MAX(int, block_peak_count[bucket], block_count[bucket]);
+        ASSERT(CHECK_TRUNCATE_TYPE_uint(alloc_size - aligned_size));
+        ATOMIC_ADD(int, block_wasted[bucket], (int) (alloc_size - aligned_size));
+        /* FIXME: should atomically store val in temp to avoid races w/ max */
+        ATOMIC_MAX(int, block_peak_wasted[bucket], block_wasted[bucket]);
+        if (aligned_size > size) {
+            ASSERT(CHECK_TRUNCATE_TYPE_uint(aligned_size - size));
+            ATOMIC_ADD(int, block_align_pad[bucket], (int) (aligned_size - size));
+            /* FIXME: should atomically store val in temp to avoid races w/ max */
+            ATOMIC_MAX(int, block_peak_align_pad[bucket], block_align_pad[bucket]);
+            STATS_ADD_PEAK(heap_align, aligned_size - size);
+            LOG(GLOBAL, LOG_STATS, 5,
+                "alignment mismatch: %s ask %d, aligned is %d -> %d pad\n",
+                IF_HEAPACCT_ELSE(whichheap_name[which], ""),
+                size, aligned_size, aligned_size-size);
+        }
+        if (bucket == BLOCK_TYPES-1) {
+            STATS_ADD(heap_headers, HEADER_SIZE);
+            STATS_INC(heap_allocs_variable);
+        } else {
+            STATS_INC(heap_allocs_buckets);
+            if (alloc_size > aligned_size) {
+                STATS_ADD_PEAK(heap_bucket_pad, alloc_size - aligned_size);
+                LOG(GLOBAL, LOG_STATS, 5,
+                    "bucket mismatch: %s ask (aligned) %d, got %d, -> %d\n",
+                    IF_HEAPACCT_ELSE(whichheap_name[which], ""),
+                    aligned_size, alloc_size, alloc_size-aligned_size);
+            }
+        }
+    });
+}
+
 /* allocate storage on the DR heap
  * returns NULL iff caller needs to grab dynamo_vm_areas_lock() and retry
  */
@@ -3444,41 +3726,8 @@ common_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which))
 
         ACCOUNT_FOR_ALLOC(alloc_new, tu, which, alloc_size, aligned_size);
     }
-    DOSTATS({
-        /* do this before done_allocating: want to ignore special-unit allocs */
-        ATOMIC_ADD(int, block_count[bucket], 1);
-        ATOMIC_ADD(int, block_total_count[bucket], 1);
-        /* FIXME: should atomically store inc-ed val in temp to avoid races w/ max */
-        ATOMIC_MAX(int, block_peak_count[bucket], block_count[bucket]);
-        ASSERT(CHECK_TRUNCATE_TYPE_uint(alloc_size - aligned_size));
-        ATOMIC_ADD(int, block_wasted[bucket], (int) (alloc_size - aligned_size));
-        /* FIXME: should atomically store val in temp to avoid races w/ max */
-        ATOMIC_MAX(int, block_peak_wasted[bucket], block_wasted[bucket]);
-        if (aligned_size > size) {
-            ASSERT(CHECK_TRUNCATE_TYPE_uint(aligned_size - size));
-            ATOMIC_ADD(int, block_align_pad[bucket], (int) (aligned_size - size));
-            /* FIXME: should atomically store val in temp to avoid races w/ max */
-            ATOMIC_MAX(int, block_peak_align_pad[bucket], block_align_pad[bucket]);
-            STATS_ADD_PEAK(heap_align, aligned_size - size);
-            LOG(GLOBAL, LOG_STATS, 5,
-                "alignment mismatch: %s ask %d, aligned is %d -> %d pad\n",
-                IF_HEAPACCT_ELSE(whichheap_name[which], ""),
-                size, aligned_size, aligned_size-size);
-        }
-        if (bucket == BLOCK_TYPES-1) {
-            STATS_ADD(heap_headers, HEADER_SIZE);
-            STATS_INC(heap_allocs_variable);
-        } else {
-            STATS_INC(heap_allocs_buckets);
-            if (alloc_size > aligned_size) {
-                STATS_ADD_PEAK(heap_bucket_pad, alloc_size - aligned_size);
-                LOG(GLOBAL, LOG_STATS, 5,
-                    "bucket mismatch: %s ask (aligned) %d, got %d, -> %d\n",
-                    IF_HEAPACCT_ELSE(whichheap_name[which], ""),
-                    aligned_size, alloc_size, alloc_size-aligned_size);
-            }
-        }
-    });
+    /* do this before done_allocating: want to ignore special-unit allocs */
+    heap_bucket_stats_alloc(bucket, size, aligned_size, alloc_size HEAPACCT(which));
  done_allocating:
 #ifdef DEBUG_MEMORY
     if (bucket == BLOCK_TYPES-1 && check_alloc_size <= MAXROOM) {
@@ -3551,33 +3800,7 @@ common_heap_free(thread_units_t *tu, void *p_void, size_t size HEAPACCT(which_he
     ASSERT(size > 0); /* we don't want to pay check cost in release */
     ASSERT(p != NULL);
 #ifdef DEBUG_MEMORY
-    /* FIXME i#417: This curiosity assertion is trying to make sure we don't
-     * perform a double free, but it can fire if we ever free a data structure
-     * that has the 0xcdcdcdcd bitpattern in the first or last 4 bytes.  This
-     * has happened a few times:
-     *
-     * - case 8802: App's eax is 0xcdcdcdcd (from an app dbg memset) and we have
-     *   dcontext->allocated_start==dcontext.
-     * - i#417: On Linux x64 we get rax == 0xcdcdcdcd from a memset, and
-     *   opnd_create_reg() only updates part of the register before returning by
-     *   value in RAX:RDX.  We initialize to zero in debug mode to work around
-     *   this.
-     * - i#540: On Win7 x64 we see this assert when running the TSan tests in
-     *   NegativeTests.WindowsRegisterWaitForSingleObjectTest.
-     *
-     * For now, we've downgraded this to a curiosity, but if it fires too much
-     * in the future we should maintain a separate data structure in debug mode
-     * to perform this check.  We accept objects that start with 0xcdcdcdcd so
-     * long as the second four bytes are not also 0xcdcdcdcd.
-     */
-    DOCHECK(chklvl, {
-        ASSERT_CURIOSITY(
-            (*(uint *)p != HEAP_UNALLOCATED_UINT ||
-             (size >= 2*sizeof(uint) && *(((uint *)p)+1) != HEAP_UNALLOCATED_UINT)) &&
-            *(uint *)(p+size-sizeof(int)) != HEAP_UNALLOCATED_UINT &&
-            "attempting to free memory containing HEAP_UNALLOCATED pattern, "
-            "possible double free!");
-    });
+    DOCHECK(chklvl, check_not_double_free(p, size););
 #endif
 
     while (aligned_size > BLOCK_SIZES[bucket])
@@ -1215,6 +1215,8 @@ enum {
     NUDGE_DEF(client, "Client nudge")                                           \
     /* security testing */                                                      \
     NUDGE_DEF(violation, "Simulate a security violation")                       \
+    /* internal event tracing */                                                \
+    NUDGE_DEF(evtrace, "Write out -evtrace event buffers")                      \
     /* ADD NEW NUDGE_DEFs only immediately above this line  */                  \
     /* Since these are used as a bitmask only 32 types can be supported:
      * but on Linux only 28.  If we want more we can simply use the client_arg
@@ -118,6 +118,8 @@
     STATS_DEF("VMKUW non-ignorable system calls", vmkuw_syscalls_intercept)
 #endif
     RSTATS_DEF("Native modules present", num_native_module_loads)
+    STATS_DEF("Native modules moved by the client", num_native_module_client_moves)
+    STATS_DEF("Threads sent native by the client", num_threads_sent_native)
     STATS_DEF("Native module entrance checks", num_native_entrance_checks)
     STATS_DEF("Native module entrance TOS checks", num_native_entrance_TOS_checks)
     STATS_DEF("Native module entrance TOS decodes", num_native_entrance_TOS_decodes)
@@ -147,6 +149,11 @@
 #endif
     STATS_DEF("Application modules with long names", app_modname_too_long)
     STATS_DEF("Application modules with code", num_app_code_modules)
+#ifdef UNIX
+    STATS_DEF("Private libraries relocated", num_privload_relocated)
+    STATS_DEF("Private libraries mapped from relocation cache", num_privload_cache_hits)
+    STATS_DEF("Private libraries written to relocation cache", num_privload_cache_stores)
+#endif
     STATS_DEF("Application code seen (bytes)", app_code_seen)
     STATS_DEF("Interpreted calls, direct and indirect", num_all_calls)
     STATS_DEF("Interpreted indirect calls", num_indirect_calls)
@@ -554,11 +561,16 @@
     STATS_DEF("Custom traces extended beyond normal stop", custom_traces_stop_late)
     STATS_DEF("Custom traces stopped early", custom_traces_stop_early)
     STATS_DEF("Shadowed bbs built for custom traces", custom_traces_bbs_built)
+    STATS_DEF("Custom trace region blocks added", custom_trace_region_bbs)
 #endif
     STATS_DEF("Recreated fragments, total", num_recreated_fragments)
     STATS_DEF("Recreated fragments, traces", num_recreated_traces)
     STATS_DEF("Recreations via app re-decode", recreate_via_app_ilist)
     STATS_DEF("Recreations via stored info", recreate_via_stored_info)
+    STATS_DEF("Recreate cache hits", recreate_cache_hits)
+    STATS_DEF("Recreate cache misses", recreate_cache_misses)
+    STATS_DEF("Recreate cache stale entries", recreate_cache_stale)
+    STATS_DEF("Recreate cache entries invalidated", recreate_cache_invalidations)
     STATS_DEF("Recreation spill value restores", recreate_spill_restores)
     STATS_DEF("IBL stubs updated on table resize", num_ibl_stub_resize_updates)
 
@@ -901,6 +913,9 @@
     STATS_DEF("Peak heap bucket pad space (bytes)", peak_heap_bucket_pad)
     STATS_DEF("Heap allocs in buckets", heap_allocs_buckets)
     STATS_DEF("Heap allocs variable-sized", heap_allocs_variable)
+    STATS_DEF("Global heap allocs from thread cache", global_heap_cache_hits)
+    STATS_DEF("Global heap thread cache refills", global_heap_cache_refills)
+    STATS_DEF("Global heap thread cache flushes", global_heap_cache_flushes)
     STATS_DEF("Total reserved memory", reserved_memory_capacity)
     STATS_DEF("Peak total reserved memory", peak_reserved_memory_capacity)
     STATS_DEF("Guard pages, reserved virtual pages", guard_pages)
@@ -1100,6 +1115,10 @@
     STATS_DEF("Num synch yields for exiting threads", synch_yields_for_exiting_thread)
     STATS_DEF("Num synch yields", synch_yields)
     STATS_DEF("Num synch loops in wait_at_safe_spot", synch_loops_wait_safe)
+    STATS_DEF("Synchall batched suspend requests", synchall_batch_requests)
+    STATS_DEF("Synchall batched threads resumed outside the cache",
+              synchall_batch_released)
+    STATS_DEF("Synchall waits for suspend acks", synchall_batch_ack_waits)
     STATS_DEF("Multiple setcontexts while in wait_at_safe_spot", wait_multiple_setcxt)
 
 #ifdef WINDOWS
@@ -1200,6 +1219,8 @@
     STATS_DEF("Clean Call xmm skipped", cleancall_xmm_skipped)
     STATS_DEF("Clean Call aflags save skipped", cleancall_aflags_save_skipped)
     STATS_DEF("Clean Call aflags clear skipped", cleancall_aflags_clear_skipped)
+    STATS_DEF("One-shot calls inserted", oneshot_calls_inserted)
+    STATS_DEF("One-shot calls fired", oneshot_calls_fired)
     /* i#107 handle application using same segment register */
     STATS_DEF("App reference with FS/GS seg being mangled", app_seg_refs_mangled)
     STATS_DEF("App access FS/GS seg being mangled", app_mov_seg_mangled)
@@ -197,6 +197,8 @@ enum {
 #endif
 #ifdef CLIENT_INTERFACE
     MODULE_NULL_INSTRUMENT = 0x00000080,
+    /* the client moved this module to native execution at runtime */
+    MODULE_CLIENT_NATIVE   = 0x00000100,
 #endif
 };
 
@@ -1640,8 +1640,12 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
          * pc translation, which currently walks the htable.
          */
         !TEST(FRAG_COARSE_GRAIN, trace_head_f->flags) &&
-        /* if both shared only remove if option on, and no custom tracing */
-        IF_CUSTOM_TRACES(!dr_end_trace_hook_exists() &&)
+        /* if both shared only remove if option on, and no custom tracing:
+         * a head that is part of a client trace region is kept for later
+         * region traces, but other heads can still go
+         */
+        IF_CUSTOM_TRACES(!dr_end_trace_hook_exists() &&
+                         !instrument_trace_region_has_tag(trace_head_f->tag) &&)
         INTERNAL_OPTION(remove_shared_trace_heads)) {
         fragment_remove_shared_no_flush(dcontext, trace_head_f);
         trace_head_f = NULL;
@@ -1977,6 +1981,7 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     bool end_trace = false;
 #ifdef CUSTOM_TRACES
     dr_custom_trace_action_t client = CUSTOM_TRACE_DR_DECIDES;
+    bool region = false;
 #endif
     trace_head_counter_t *ctr;
     uint add_size = 0, prev_mangle_size = 0; /* NOTE these aren't set if end_trace */
@@ -2012,8 +2017,17 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
                      TEST(FRAG_IS_TRACE, f->flags ) ||
                      TEST(FRAG_IS_TRACE_HEAD, f->flags));
 #ifdef CUSTOM_TRACES
-        if (dr_end_trace_hook_exists()) {
+        /* A client-registered region decides for its own traces and takes
+         * precedence over the end-trace event.
+         */
+        if (dr_trace_regions_exist()) {
+            client = instrument_trace_region(dcontext, md->trace_tag, f->tag,
+                                             md->num_blks);
+            region = (client != CUSTOM_TRACE_DR_DECIDES);
+        }
+        if (!region && dr_end_trace_hook_exists())
             client = instrument_end_trace(dcontext, md->trace_tag, f->tag);
+        if (client != CUSTOM_TRACE_DR_DECIDES) {
             /* Return values:
              *   CUSTOM_TRACE_DR_DECIDES = use standard termination criteria
              *   CUSTOM_TRACE_END_NOW    = end trace
@@ -2152,7 +2166,9 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
             }
         }
         if (DYNAMO_OPTION(max_trace_bbs) > 0 &&
-            md->num_blks >= DYNAMO_OPTION(max_trace_bbs) && !end_trace) {
+            md->num_blks >= DYNAMO_OPTION(max_trace_bbs) && !end_trace
+            /* a region's own block limit replaces -max_trace_bbs */
+            IF_CUSTOM_TRACES(&& !region)) {
             end_trace = true;
             STATS_INC(num_max_trace_bbs_enforced);
         }
@@ -2178,6 +2194,10 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
             LOG(THREAD, LOG_MONITOR, 3,
                 "Extending hot trace (tag "PFX") with F%d ("PFX")\n",
                 md->trace_tag, f->id, f->tag);
+#ifdef CUSTOM_TRACES
+            if (region)
+                STATS_INC(custom_trace_region_bbs);
+#endif
             /* add_size is set when !end_trace */
             f = internal_extend_trace(dcontext, f, dcontext->last_exit, add_size);
         }
@@ -130,6 +130,10 @@ check_and_mark_native_exec(module_area_t *ma, bool add)
             "module %s is on native_exec list\n", name);
         is_native = true;
     }
+#ifdef CLIENT_INTERFACE
+    if (TEST(MODULE_CLIENT_NATIVE, ma->flags))
+        is_native = true;
+#endif
 
     if (add && is_native) {
         RSTATS_INC(num_native_module_loads);
@@ -162,6 +166,47 @@ native_exec_module_unload(module_area_t *ma)
         native_module_unhook(ma);
 }
 
+#ifdef CLIENT_INTERFACE
+/* Moves a loaded module into or out of native execution on behalf of
+ * dr_module_set_native().  The caller must hold the module info write lock and
+ * must flush the module's fragments afterward, as code already in the cache
+ * keeps running under DR until it is flushed.  Returns false if native
+ * execution is disabled.
+ */
+bool
+native_exec_module_set_native(module_area_t *ma, bool native)
+{
+    bool was_native;
+    ASSERT(os_get_module_info_write_locked());
+    if (native_exec_areas == NULL)
+        return false;
+    was_native = vmvector_overlap(native_exec_areas, ma->start, ma->end);
+    if (native) {
+        ma->flags |= MODULE_CLIENT_NATIVE;
+        if (!was_native) {
+            LOG(GLOBAL, LOG_INTERP|LOG_VMAREAS, 1,
+                "client moved module "PFX"-"PFX" to native execution\n",
+                ma->start, ma->end);
+            STATS_INC(num_native_module_client_moves);
+            vmvector_add(native_exec_areas, ma->start, ma->end, NULL);
+            if (DYNAMO_OPTION(native_exec_retakeover))
+                native_module_hook(ma, false/*!at_map*/);
+        }
+    } else {
+        ma->flags &= ~MODULE_CLIENT_NATIVE;
+        if (was_native) {
+            LOG(GLOBAL, LOG_INTERP|LOG_VMAREAS, 1,
+                "client moved module "PFX"-"PFX" back under DR\n",
+                ma->start, ma->end);
+            vmvector_remove(native_exec_areas, ma->start, ma->end);
+            if (DYNAMO_OPTION(native_exec_retakeover))
+                native_module_unhook(ma);
+        }
+    }
+    return true;
+}
+#endif
+
 /* Clean call called on every fcache to native transition.  Turns on and off
  * asynch handling and updates some state.  Called from native bbs built by
  * build_native_exec_bb() in x86/interp.c.
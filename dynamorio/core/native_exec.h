@@ -44,6 +44,10 @@ void
 native_exec_module_load(module_area_t *ma, bool at_map);
 void
 native_exec_module_unload(module_area_t *ma);
+#ifdef CLIENT_INTERFACE
+bool
+native_exec_module_set_native(module_area_t *ma, bool native);
+#endif
 
 void
 native_exec_init(void);
@@ -291,6 +291,7 @@ handle_nudge(dcontext_t *dcontext, nudge_arg_t *arg)
     ASSERT_OWN_NO_LOCKS();
 
     STATS_INC(num_nudges);
+    EVTRACE_INSTANT(nudge, nudge_action_mask);
 
 #ifdef WINDOWS
     /* Linux does this in signal.c */
@@ -374,6 +375,10 @@ handle_nudge(dcontext_t *dcontext, nudge_arg_t *arg)
         nudge_action_mask &= ~NUDGE_GENERIC(persist);
         coarse_units_freeze_all(false/*!in-place==persist*/);
     }
+    if (TEST(NUDGE_GENERIC(evtrace), nudge_action_mask)) {
+        nudge_action_mask &= ~NUDGE_GENERIC(evtrace);
+        evtrace_dump_all_threads();
+    }
 #ifdef CLIENT_INTERFACE
     if (TEST(NUDGE_GENERIC(client), nudge_action_mask)) {
         nudge_action_mask &= ~NUDGE_GENERIC(client);
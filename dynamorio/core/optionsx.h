@@ -291,6 +291,14 @@
      /* turn on kstats by default for debug builds */
     OPTION_DEFAULT(bool, kstats, IF_DEBUG_ELSE_0(true), "enable path timing statistics")
 #endif
+    /* Available in all builds: see evtrace.c. */
+    OPTION_DEFAULT(bool, evtrace, false,
+                   "record internal events and write them out in Chrome trace format")
+    OPTION_DEFAULT(uint, evtrace_buffer_size, 65536,
+                   "per-thread -evtrace ring buffer size in events (rounded up to a power of 2)")
+    /* Linux only: see perfctr.c. */
+    OPTION_DEFAULT(bool, perfctr, false,
+                   "count hardware and software events per thread, split between DR and the code cache")
 
 #ifdef DEADLOCK_AVOIDANCE
     OPTION_DEFAULT_INTERNAL(bool, deadlock_avoidance, true, "enable deadlock avoidance checks")
@@ -351,6 +359,14 @@
      */
     OPTION_DEFAULT_INTERNAL(bool, privload_register_gdb, true,
                             "register private loader DLLs with gdb")
+    /* Caches the relocated writable segments of privately loaded libraries
+     * in this directory, keyed by file identity and load base, and maps them
+     * in on later runs instead of re-applying relocations.  The results of
+     * ifunc resolvers are cached too, so the directory should not be shared
+     * across machines.
+     */
+    OPTION_DEFAULT(pathstring_t, privload_cache_dir, EMPTY_STRING,
+                   "directory for caching relocated private library images")
 # endif
 # ifdef WINDOWS
     /* Heap isolation for private dll copies.  Valid only with -private_loader. */
@@ -1068,6 +1084,10 @@
      */
     OPTION_DEFAULT_INTERNAL(uint_size, max_heap_unit_size, 256*1024, "maximum heap unit size")
     OPTION_DEFAULT(uint_size, heap_commit_increment, 4*1024, "heap commit increment")
+    /* blocks per bucket a thread may keep cached for global heap allocs without
+     * taking global_alloc_lock; 0 sends every global alloc to the shared lists
+     */
+    OPTION_DEFAULT(uint, global_heap_cache_size, 16, "per-thread global heap cache size")
     OPTION_DEFAULT(uint, cache_commit_increment, 4*1024, "cache commit increment")
 
     /* cache capacity control
@@ -1436,6 +1456,11 @@
         "true use sleep in synch_with_* wait loops instead of yield")
     OPTION_DEFAULT(uint_time, synch_with_sleep_time, 5, "time in ms to sleep for each "
         "wait loop in synch_with_* routines")
+#ifdef UNIX
+    OPTION_DEFAULT(uint, synch_all_threads_batch, 64, "max number of threads "
+        "synch_with_all_threads signals to suspend before waiting on any of them "
+        "(0 or 1 suspends one thread at a time)")
+#endif
 #ifdef WINDOWS
     /* FIXME - only an option since late in the release cycle - should always be on */
     OPTION_DEFAULT(bool, suspend_on_synch_failure_for_app_suspend, true, "if we fail "
@@ -1873,6 +1898,8 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
         "store info at flush time for safe post-flush translation")
     PC_OPTION_INTERNAL(bool, store_translations,
         "store info at emit time for fragment translation")
+    OPTION_DEFAULT(uint, recreate_cache_size, 64,
+        "number of decoded bbs cached per thread for state translation (0 disables)")
     /* i#698: our fpu state xl8 is a perf hit for some apps */
     PC_OPTION(bool, translate_fpu_pc,
         "translate the saved last floating-point pc when FPU state is saved")
@@ -165,6 +165,14 @@ void thread_set_self_mcontext(priv_mcontext_t *mc);
 bool
 os_thread_take_over_suspended_native(dcontext_t *dcontext);
 
+/* Assumes target thread is suspended in the code cache */
+bool
+os_thread_send_suspended_native(dcontext_t *dcontext);
+
+/* Catches up with memory, module, and thread changes made by native threads */
+void
+os_rescan_after_native(dcontext_t *dcontext);
+
 dcontext_t *get_thread_private_dcontext(void);
 void set_thread_private_dcontext(dcontext_t *dcontext);
 
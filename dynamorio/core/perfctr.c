@@ -33,130 +33,362 @@
 /* Copyright (c) 2003-2007 Determina Corp. */
 /* Copyright (c) 2001-2003 Massachusetts Institute of Technology */
 
+/*
+ * perfctr.c - per-thread performance counters
+ *
+ * With -perfctr each thread opens a group of perf_event_open counters on
+ * itself and reads the group at every dispatch transition, so that counts
+ * are split between time in DR (including clients) and time in the code
+ * cache.  Reading a group costs a single read syscall per transition.
+ *
+ * Only user-mode counts are requested, which works with the kernel's
+ * default perf_event_paranoid setting; a syscall's kernel time is thus
+ * not counted anywhere.  When the kernel multiplexes the counters we scale
+ * the raw counts by the time the group was enabled over the time it ran.
+ */
+
 #include "globals.h"
+#include "perfctr.h"
+#include <string.h>
+#include <stddef.h> /* offsetof */
 
-#ifdef PAPI /* around entire file */
+#ifdef LINUX
+# include "unix/include/syscall.h"
+#endif
 
-#include "perfctr.h"
-#include "x86-events.h"
-#include "papi.h"
-#include <stdlib.h>
-#include <stdio.h>
-#include <time.h>
-
-extern dr_statistics_t *stats;
-int perfctr_eventset;
-struct {int num;char *name;} papi_events[]={
-    {P6_CPU_CLK_UNHALTED<<8,"Total cycles"},
-    {P6_INST_DECODER<<8,"Instructions decoded"},
-    {P6_INST_RETIRED<<8,"Instructions Retired"},
-    {P6_UOPS_RETIRED<<8,"Micro-ops retired"},
-    {P6_DATA_MEM_REFS<<8,"Total data memory refs (loads + stores"},
-    {P6_DCU_MISS_OUTSTANDING<<8,"DCU miss cycles outstanding"},
-    {P6_IFU_FETCH<<8,"Instruction Fetches"},
-    {P6_IFU_FETCH_MISS<<8,"IFU (instruction L1 ?) misses"},
-    {P6_ITLB_MISS<<8,"ITLB misses"},
-    {P6_IFU_MEM_STALL<<8,"Cycles instruction fetch is stalled"},
-    {P6_ILD_STALL<<8,"Cycles instruction length decoder stalled"},
-    {((0x0f<<8)|P6_L2_IFETCH)<<8,"L2 instruction fetches"},
-    {((0x0f<<8)|P6_L2_LD)<<8,"L2 loads"},
-    {((0x0f<<8)|P6_L2_ST)<<8,"L2 stores"},
-    {P6_BR_INST_DECODED<<8,"Branch instructions decoded"},
-    {P6_BR_INST_RETIRED<<8,"Branch instructions retired"},
-    {P6_BR_MISS_PRED_RETIRED<<8,"Branch insts mispredicted retired"},
-    {P6_BR_TAKEN_RETIRED<<8,"Branch insts taken retired"},
-    {P6_BR_MISS_PRED_TAKEN_RET<<8,"Branch insts mispredicted, taken retired"},
-    {P6_BTB_MISSES<<8,"BTB misses"},
-    {P6_BR_BOGUS<<8,"Bogus Branches"},
-    {P6_RESOURCE_STALLS<<8,"Misc. resource stalls"},
-    {P6_BACLEARS<<8,"BACLEAR asserted"},
-    {P6_DCU_LINES_IN<<8,"DCU lines allocated"},
-    {P6_L2_LINES_IN<<8,"L2 lines allocated"},
-    {PIII_EMON_KNI_PREF_DISPATCHED<<8,"Prefetch NTA dispatched"},
-    {PIII_EMON_KNI_PREF_MISS<<8,"Prefetch NTA miss all caches"}
+/* The first version of struct perf_event_attr from linux/perf_event.h,
+ * which every kernel that has perf_event_open accepts.
+ */
+typedef struct _perf_event_attr_t {
+    uint type;
+    uint size;
+    uint64 config;
+    uint64 sample_period;
+    uint64 sample_type;
+    uint64 read_format;
+    uint64 flags;
+    uint wakeup_events;
+    uint bp_type;
+    uint64 config1;
+} perf_event_attr_t;
+
+#define PERF_ATTR_SIZE_VER0             64
+#define PERF_FORMAT_TOTAL_TIME_ENABLED  0x1
+#define PERF_FORMAT_TOTAL_TIME_RUNNING  0x2
+#define PERF_FORMAT_GROUP               0x8
+#define PERF_ATTR_FLAG_EXCLUDE_KERNEL   0x20
+#define PERF_ATTR_FLAG_EXCLUDE_HV       0x40
+
+/* the layout of a group read with the read_format above */
+typedef struct _perfctr_read_t {
+    uint64 num;
+    uint64 time_enabled;
+    uint64 time_running;
+    uint64 value[PERFCTR_NUM];
+} perfctr_read_t;
+
+typedef struct _perfctr_event_t {
+    const char *desc;
+    uint type;
+    uint64 config;
+} perfctr_event_t;
+
+static const perfctr_event_t perfctr_events[] = {
+#define PERFCTR_DEF(name, desc, type, config) {desc, type, config},
+    PERFCTR_DEFINITIONS()
+#undef PERFCTR_DEF
 };
-    
 
+enum {
+    PERFCTR_IN_DR,
+    PERFCTR_IN_CACHE,
+    PERFCTR_WHERE_NUM,
+};
 
+typedef struct _perfctr_counts_t {
+    uint64 count[PERFCTR_NUM][PERFCTR_WHERE_NUM];
+    /* the group's enabled and running times, for scaling */
+    uint64 time_enabled;
+    uint64 time_running;
+    /* bitmask of the PERFCTR_ ids that were open */
+    uint available;
+} perfctr_counts_t;
 
-void hardware_perfctr_init()
-{
-    int a;
-    perfctr_eventset=PAPI_NULL;
+typedef struct _perfctr_thread_t {
+    file_t group_fd;
+    file_t fd[PERFCTR_NUM];
+    /* index into perfctr_read_t.value, or -1 if not open */
+    int slot[PERFCTR_NUM];
+    uint num_open;
+    bool in_cache;
+    /* the raw values at the last read */
+    perfctr_read_t last;
+    perfctr_counts_t counts;
+} perfctr_thread_t;
 
-    ASSERT(NUM_EVENTS==(sizeof(papi_events)/8));
+/* totals of the threads that have exited, protected by perfctr_lock */
+static perfctr_counts_t process_counts;
+DECLARE_CXTSWPROT_VAR(static mutex_t perfctr_lock, INIT_LOCK_FREE(perfctr_lock));
 
-#ifdef UNIX
-    ASSERT(!INTERNAL_OPTION(profile_pcs)); 
+void
+perfctr_init(void)
+{
+    ASSERT(sizeof(perf_event_attr_t) == PERF_ATTR_SIZE_VER0);
+    ASSERT(BUFFER_SIZE_ELEMENTS(perfctr_events) == PERFCTR_NUM);
+#ifndef LINUX
+    if (DYNAMO_OPTION(perfctr))
+        SYSLOG_INTERNAL_WARNING("-perfctr is only supported on Linux");
 #endif
+}
 
-    LOG(GLOBAL, LOG_TOP, 1,"Initializing PAPI\n");
+void
+perfctr_exit(void)
+{
+    if (DYNAMO_OPTION(perfctr)) {
+        /* kstats print our process totals in their own report */
+        if (IF_KSTATS(!DYNAMO_OPTION(kstats) &&) true) {
+            DOLOG(1, LOG_STATS, { perfctr_report(NULL, GLOBAL); });
+        }
+    }
+    DELETE_LOCK(perfctr_lock);
+}
 
-    
-    if (PAPI_library_init(PAPI_VER_CURRENT) !=PAPI_VER_CURRENT) {
-            LOG(GLOBAL, LOG_TOP, 1,"Error initializing PAPI.\n");
+static void
+perfctr_open(perfctr_thread_t *pt)
+{
+#ifdef LINUX
+    perf_event_attr_t attr;
+    uint i;
+    pt->group_fd = INVALID_FILE;
+    pt->num_open = 0;
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.type = perfctr_events[i].type;
+        attr.size = sizeof(attr);
+        attr.config = perfctr_events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.flags = PERF_ATTR_FLAG_EXCLUDE_KERNEL | PERF_ATTR_FLAG_EXCLUDE_HV;
+        /* the first counter we can open leads the group */
+        pt->fd[i] = os_perf_event_open(&attr, pt->group_fd);
+        if (pt->fd[i] == INVALID_FILE) {
+            pt->slot[i] = -1;
+            continue;
+        }
+        if (pt->group_fd == INVALID_FILE)
+            pt->group_fd = pt->fd[i];
+        pt->slot[i] = pt->num_open++;
+        pt->counts.available |= (1 << i);
+    }
+#else
+    uint i;
+    pt->group_fd = INVALID_FILE;
+    pt->num_open = 0;
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        pt->fd[i] = INVALID_FILE;
+        pt->slot[i] = -1;
     }
-    
-    if (NUM_EVENTS > 2) {
-        LOG(GLOBAL, LOG_TOP, 3,"Initializing PAPI multiplexing\n");
-        if (PAPI_multiplex_init() != PAPI_OK) {
-            if (stats->loglevel > 0 && (stats->logmask & LOG_TOP) != 0) 
-                LOG(GLOBAL, LOG_TOP, 1,"Error initializing PAPI multiplexing\n");
+#endif
+}
+
+static void
+perfctr_close(perfctr_thread_t *pt)
+{
+    uint i;
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (pt->fd[i] != INVALID_FILE) {
+            os_close_protected(pt->fd[i]);
+            pt->fd[i] = INVALID_FILE;
         }
     }
-    if (PAPI_create_eventset(&perfctr_eventset) != PAPI_OK) {
-        LOG(GLOBAL, LOG_TOP, 1,"Error creating PAPI eventset\n");
+    pt->group_fd = INVALID_FILE;
+    pt->num_open = 0;
+}
+
+/* Reads the group and adds what was counted since the last read to where */
+static void
+perfctr_sample(perfctr_thread_t *pt, uint where)
+{
+    perfctr_read_t cur;
+    uint i;
+    size_t size = offsetof(perfctr_read_t, value) + pt->num_open * sizeof(uint64);
+    if (pt->num_open == 0)
+        return;
+    if (os_read(pt->group_fd, &cur, size) != (ssize_t) size) {
+        ASSERT_CURIOSITY(false && "perfctr group read failed");
+        return;
     }
+    ASSERT(cur.num == pt->num_open);
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        int slot = pt->slot[i];
+        if (slot >= 0)
+            pt->counts.count[i][where] += cur.value[slot] - pt->last.value[slot];
+    }
+    pt->counts.time_enabled = cur.time_enabled;
+    pt->counts.time_running = cur.time_running;
+    memcpy(&pt->last, &cur, size);
+}
 
+void
+perfctr_thread_init(dcontext_t *dcontext)
+{
+    perfctr_thread_t *pt;
+    dcontext->perfctr_field = NULL;
+    if (!DYNAMO_OPTION(perfctr))
+        return;
+    pt = HEAP_TYPE_ALLOC(dcontext, perfctr_thread_t, ACCT_STATS, UNPROTECTED);
+    memset(pt, 0, sizeof(*pt));
+    perfctr_open(pt);
+    LOG(THREAD, LOG_STATS, 1, "perfctr: opened %d of %d counters (mask 0x%x)\n",
+        pt->num_open, PERFCTR_NUM, pt->counts.available);
+    /* start from zero: everything before our first read is DR time */
+    perfctr_sample(pt, PERFCTR_IN_DR);
+    memset(&pt->counts.count, 0, sizeof(pt->counts.count));
+    dcontext->perfctr_field = (void *) pt;
+}
 
-    
-    if (NUM_EVENTS>2) {
-        if (PAPI_set_multiplex(&perfctr_eventset)!=PAPI_OK) {
-            LOG(GLOBAL, LOG_TOP, 1,"Error setting multiplexed eventset in PAPI\n");
-        }
+void
+perfctr_thread_exit(dcontext_t *dcontext)
+{
+    perfctr_thread_t *pt = (perfctr_thread_t *) dcontext->perfctr_field;
+    uint i;
+    if (pt == NULL)
+        return;
+    perfctr_sample(pt, pt->in_cache ? PERFCTR_IN_CACHE : PERFCTR_IN_DR);
+    if (IF_KSTATS(!DYNAMO_OPTION(kstats) &&) true) {
+        DOLOG(1, LOG_STATS, { perfctr_report(dcontext, THREAD); });
     }
-    
-    for (a=0;a<NUM_EVENTS;a++) {
-        if (PAPI_add_event(&perfctr_eventset,papi_events[a].num)!=PAPI_OK) {
-                LOG(GLOBAL, LOG_TOP, 1,"Error adding events in PAPI\n");
+
+    mutex_lock(&perfctr_lock);
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        process_counts.count[i][PERFCTR_IN_DR] += pt->counts.count[i][PERFCTR_IN_DR];
+        process_counts.count[i][PERFCTR_IN_CACHE] +=
+            pt->counts.count[i][PERFCTR_IN_CACHE];
+        /* the drmarker stats export totals in the old PAPI slots */
+        if (stats != NULL && i < NUM_EVENTS) {
+            stats->perfctr_vals[i] = process_counts.count[i][PERFCTR_IN_DR] +
+                process_counts.count[i][PERFCTR_IN_CACHE];
         }
     }
+    process_counts.time_enabled += pt->counts.time_enabled;
+    process_counts.time_running += pt->counts.time_running;
+    process_counts.available |= pt->counts.available;
+    mutex_unlock(&perfctr_lock);
 
-    if (PAPI_start(perfctr_eventset)!=PAPI_OK) {
-        LOG(GLOBAL, LOG_TOP, 1,"Error starting hardware performance counters\n");
-    }
-    
+    perfctr_close(pt);
+    dcontext->perfctr_field = NULL;
+    HEAP_TYPE_FREE(dcontext, pt, perfctr_thread_t, ACCT_STATS, UNPROTECTED);
 }
 
-        
-void hardware_perfctr_exit()
+#ifdef UNIX
+/* The parent's counters come along across a fork but they count the parent
+ * thread, so the child reopens them and starts from zero.
+ */
+void
+perfctr_fork_init(dcontext_t *dcontext)
 {
-    int a;
-    uint64 vals[NUM_EVENTS]; /* only used if nullcalls */
-    uint64 *val_array;
+    perfctr_thread_t *pt = (perfctr_thread_t *) dcontext->perfctr_field;
+    /* any other threads were exited into our totals */
+    memset(&process_counts, 0, sizeof(process_counts));
+    if (pt == NULL)
+        return;
+    perfctr_close(pt);
+    memset(pt, 0, sizeof(*pt));
+    perfctr_open(pt);
+    perfctr_sample(pt, PERFCTR_IN_DR);
+    memset(&pt->counts.count, 0, sizeof(pt->counts.count));
+}
+#endif
+
+void
+perfctr_enter_fcache(dcontext_t *dcontext)
+{
+    perfctr_thread_t *pt = (perfctr_thread_t *) dcontext->perfctr_field;
+    /* syscalls are re-executed from the cache without coming back through
+     * here, so we only switch on an actual change
+     */
+    if (pt == NULL || pt->in_cache)
+        return;
+    perfctr_sample(pt, PERFCTR_IN_DR);
+    pt->in_cache = true;
+}
 
-    if (dynamo_options.nullcalls) {
-        val_array = vals;
+void
+perfctr_exit_fcache(dcontext_t *dcontext)
+{
+    perfctr_thread_t *pt = (perfctr_thread_t *) dcontext->perfctr_field;
+    if (pt == NULL || !pt->in_cache)
+        return;
+    perfctr_sample(pt, PERFCTR_IN_CACHE);
+    pt->in_cache = false;
+}
+
+/* Multiplexed counters only ran for time_running out of time_enabled: we
+ * extrapolate, in 10-bit fixed point to avoid floating point and overflow.
+ */
+static uint64
+perfctr_scale(const perfctr_counts_t *counts, uint64 value)
+{
+    uint64 factor;
+    if (counts->time_running == 0 || counts->time_running >= counts->time_enabled)
+        return value;
+    factor = (counts->time_enabled << 10) / counts->time_running;
+    return (value >> 10) * factor + (((value & 0x3ff) * factor) >> 10);
+}
+
+static void
+perfctr_values(const perfctr_counts_t *counts, OUT uint64 in_dr[PERFCTR_NUM],
+               OUT uint64 in_cache[PERFCTR_NUM])
+{
+    uint i;
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        in_dr[i] = perfctr_scale(counts, counts->count[i][PERFCTR_IN_DR]);
+        in_cache[i] = perfctr_scale(counts, counts->count[i][PERFCTR_IN_CACHE]);
+    }
+}
+
+void
+perfctr_report(dcontext_t *dcontext, file_t outf)
+{
+    perfctr_counts_t counts;
+    uint64 in_dr[PERFCTR_NUM], in_cache[PERFCTR_NUM];
+    uint i;
+    if (dcontext != NULL) {
+        perfctr_thread_t *pt = (perfctr_thread_t *) dcontext->perfctr_field;
+        if (pt == NULL)
+            return;
+        perfctr_sample(pt, pt->in_cache ? PERFCTR_IN_CACHE : PERFCTR_IN_DR);
+        counts = pt->counts;
     } else {
-        val_array = stats->perfctr_vals;
+        mutex_lock(&perfctr_lock);
+        counts = process_counts;
+        mutex_unlock(&perfctr_lock);
     }
-    if (PAPI_stop(perfctr_eventset, val_array) != PAPI_OK) {
-        LOG(GLOBAL, LOG_TOP, 1,
-            "Error stopping and reading hardware performance counters\n");
+    perfctr_values(&counts, in_dr, in_cache);
+    print_file(outf, "%s performance counters:\n%20s  %20s %20s\n",
+               dcontext == NULL ? "Process" : "Thread", "", "in DR", "in cache");
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (!TEST(1 << i, counts.available))
+            continue;
+        print_file(outf, "%20s: %20"UINT64_FORMAT_CODE" %20"UINT64_FORMAT_CODE"\n",
+                   perfctr_events[i].desc, in_dr[i], in_cache[i]);
     }
-    for (a=0; a<NUM_EVENTS; a++) {
-        LOG(GLOBAL, LOG_TOP, 1, "Counter %d = %llu (%s)\n",
-            a+1, val_array[a], papi_events[a].name);
+    if (counts.time_running < counts.time_enabled) {
+        print_file(outf, "%20s: counters ran "UINT64_FORMAT_STRING" of "
+                   UINT64_FORMAT_STRING" ns and were scaled\n", "note",
+                   counts.time_running, counts.time_enabled);
     }
-    
 }
 
-void perfctr_update_gui()
+bool
+perfctr_get_values(dcontext_t *dcontext, OUT uint *available,
+                   OUT uint64 in_dr[PERFCTR_NUM], OUT uint64 in_cache[PERFCTR_NUM])
 {
-    if (PAPI_read(perfctr_eventset,stats->perfctr_vals) != PAPI_OK) {
-        LOG(GLOBAL, LOG_TOP, 1,
-            "Error stopping and reading hardware performance counters\n");
-    }
+    perfctr_thread_t *pt = (perfctr_thread_t *) dcontext->perfctr_field;
+    if (pt == NULL || pt->num_open == 0)
+        return false;
+    perfctr_sample(pt, pt->in_cache ? PERFCTR_IN_CACHE : PERFCTR_IN_DR);
+    perfctr_values(&pt->counts, in_dr, in_cache);
+    *available = pt->counts.available;
+    return true;
 }
-
-#endif /* PAPI */
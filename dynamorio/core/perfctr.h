@@ -33,18 +33,62 @@
 /* Copyright (c) 2003-2007 Determina Corp. */
 /* Copyright (c) 2001-2003 Massachusetts Institute of Technology */
 
-#ifdef PAPI
+/*
+ * perfctr.h - per-thread performance counter exports
+ */
+
+#ifndef _PERFCTR_H_
+#define _PERFCTR_H_ 1
+
+/* The counters we try to open for each thread with -perfctr.  Any that the
+ * kernel or processor does not support are left out, so on a machine or in
+ * a VM without a hardware PMU we still have the software events.
+ * The order must match dr_perfctr_t in instrument.h.
+ * To use as an iterator define PERFCTR_DEF(name, description, type, config)
+ * where type and config are the perf_event_attr fields.
+ */
+#define PERFCTR_TYPE_HARDWARE  0
+#define PERFCTR_TYPE_SOFTWARE  1
+#define PERFCTR_TYPE_HW_CACHE  3
+/* cache events are (cache | op << 8 | result << 16): read misses here */
+#define PERFCTR_HW_CACHE_READ_MISS(cache) ((cache) | (0 << 8) | (1 << 16))
 
-#include "x86-events.h"
-#define GUI_ALARM_UPDATE_RATIO 1
-extern int perfctr_eventset;
+#define PERFCTR_DEFINITIONS()                                                   \
+    PERFCTR_DEF(cycles, "Cycles", PERFCTR_TYPE_HARDWARE, 0)                     \
+    PERFCTR_DEF(instructions, "Instructions", PERFCTR_TYPE_HARDWARE, 1)         \
+    PERFCTR_DEF(l1i_misses, "L1 icache misses", PERFCTR_TYPE_HW_CACHE,          \
+                PERFCTR_HW_CACHE_READ_MISS(1))                                  \
+    PERFCTR_DEF(itlb_misses, "iTLB misses", PERFCTR_TYPE_HW_CACHE,              \
+                PERFCTR_HW_CACHE_READ_MISS(4))                                  \
+    PERFCTR_DEF(task_clock, "Task clock (ns)", PERFCTR_TYPE_SOFTWARE, 1)        \
+    PERFCTR_DEF(page_faults, "Page faults", PERFCTR_TYPE_SOFTWARE, 2)
 
+typedef enum {
+#define PERFCTR_DEF(name, desc, type, config) PERFCTR_##name,
+    PERFCTR_DEFINITIONS()
+#undef PERFCTR_DEF
+    PERFCTR_NUM
+} perfctr_id_t;
 
+void perfctr_init(void);
+void perfctr_exit(void);
+void perfctr_thread_init(dcontext_t *dcontext);
+void perfctr_thread_exit(dcontext_t *dcontext);
+#ifdef UNIX
+void perfctr_fork_init(dcontext_t *dcontext);
+#endif
 
+/* Called at the dispatch transitions to attribute counts to DR or the cache */
+void perfctr_enter_fcache(dcontext_t *dcontext);
+void perfctr_exit_fcache(dcontext_t *dcontext);
 
-void hardware_perfctr_init(void);
-void hardware_perfctr_exit(void);
-void perfctr_update_gui(void);
+/* Prints a table of the thread's (or, for NULL, the exited threads') counts */
+void perfctr_report(dcontext_t *dcontext, file_t outf);
 
+/* Reads dcontext's counts, which must be the current thread's or a
+ * suspended thread's.  Returns false if none are open.
+ */
+bool perfctr_get_values(dcontext_t *dcontext, OUT uint *available,
+                        OUT uint64 in_dr[PERFCTR_NUM], OUT uint64 in_cache[PERFCTR_NUM]);
 
-#endif
+#endif /* _PERFCTR_H_ */
@@ -59,6 +59,7 @@
 #include "globals.h"
 #include "dr_stats.h"
 #include "stats.h"
+#include "perfctr.h"
 
 #include <string.h>  /* for memset */
 
@@ -227,6 +228,8 @@ kstat_exit()
     print_file(process_kstats_outfile, "Process KSTATS:\n");
     kstat_report(process_kstats_outfile, &process_kstats);
     mutex_unlock(&process_kstats_lock);
+    if (DYNAMO_OPTION(perfctr))
+        perfctr_report(NULL, process_kstats_outfile);
 
     DELETE_LOCK(process_kstats_lock);
 
@@ -324,6 +327,7 @@ dump_thread_kstats(dcontext_t *dcontext)
                dcontext->thread_kstats->thread_id);
     kstat_report(dcontext->thread_kstats->outfile_kstats, 
                  &dcontext->thread_kstats->vars_kstats);
+    perfctr_report(dcontext, dcontext->thread_kstats->outfile_kstats);
     print_file(dcontext->thread_kstats->outfile_kstats, "} KSTATS\n");
 }
 
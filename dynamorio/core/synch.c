@@ -786,6 +786,75 @@ synch_thread_yield()
     }
 }
 
+#ifdef UNIX
+/* With many threads, signalling one thread and waiting for it to arrive at its
+ * suspend point before moving on to the next makes synch_with_all_threads()
+ * latency the sum of every thread's signal delivery time.  Instead we signal a
+ * window of up to -synch_all_threads_batch threads at once and collect their
+ * acknowledgements together.  The acks counter is incremented by each target's
+ * suspend signal handler; it is protected by all_threads_synch_lock.
+ */
+static volatile int synchall_suspend_acks;
+
+/* Waits for every batched thread in [start, end) to reach its suspend point.
+ * A thread that stays suspended while we synch with the others must not hold
+ * any lock that synching them needs (recreate_app_state() takes the
+ * executable_areas, fragment table and heap locks, among others), and must not
+ * need to run to reach a safe spot.  Thus we only keep the suspension of
+ * threads that stopped in the code cache proper; the rest are resumed as soon
+ * as they arrive and left to synch_with_thread().
+ * We take no locks here beyond each target's suspend_lock.
+ */
+static void
+synchall_batch_settle(thread_record_t **threads, bool *batched, int start, int end)
+{
+    priv_mcontext_t mc;
+    int i, seen;
+    for (i = start; i < end; i++) {
+        if (!batched[i])
+            continue;
+        while (true) {
+            seen = synchall_suspend_acks;
+            if (thread_suspend_arrived(threads[i]))
+                break;
+            STATS_INC(synchall_batch_ack_waits);
+            thread_suspend_wait_acks(&synchall_suspend_acks, seen, SYNCH_WITH_WAIT_MS);
+        }
+        /* whereami is only advisory (e.g., a clean callee is still WHERE_FCACHE)
+         * so we also require the pc to be in the cache itself: a pc in DR, a
+         * client library, a private library or gencode could hold a lock.
+         * As in at_safe_spot(), we avoid in_fcache() if the target could hold
+         * fcache_unit_areas->lock.
+         */
+        if (threads[i]->dcontext->whereami != WHERE_FCACHE ||
+            !thread_get_mcontext(threads[i], &mc) ||
+            WRITE_LOCK_HELD(&fcache_unit_areas->lock) ||
+            READ_LOCK_HELD(&fcache_unit_areas->lock) ||
+            !in_fcache((app_pc) mc.pc)) {
+            STATS_INC(synchall_batch_released);
+            thread_resume(threads[i]);
+            batched[i] = false;
+        }
+    }
+}
+
+/* Drops the batched suspensions we have not consumed yet.  These have all
+ * been through synchall_batch_settle(), so the targets have arrived, which
+ * thread_resume() requires.
+ */
+static void
+synchall_batch_release(thread_record_t **threads, bool *batched, int num_threads)
+{
+    int i;
+    for (i = 0; i < num_threads; i++) {
+        if (!batched[i])
+            continue;
+        thread_resume(threads[i]);
+        batched[i] = false;
+    }
+}
+#endif
+
 /* returns a thread_synch_result_t value
  * id - the thread you want to synch with
  * block - whether or not should spin until synch is successful
@@ -1080,6 +1149,14 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
     thread_synch_result_t synch_res;
     const uint max_loops = TEST(THREAD_SYNCH_SMALL_LOOP_MAX, flags) ?
         (SYNCH_ALL_THREADS_MAXIMUM_LOOPS/10) : SYNCH_ALL_THREADS_MAXIMUM_LOOPS;
+#ifdef UNIX
+    /* threads whose ostd is freed can't be batched */
+    const int batch_size = (THREAD_SYNCH_IS_TERMINATED(desired_synch_state) ||
+                            THREAD_SYNCH_IS_CLEANED(desired_synch_state)) ? 0 :
+        (int) DYNAMO_OPTION(synch_all_threads_batch);
+    bool *batched = NULL;
+    int batch_end = 0;
+#endif
 #ifdef CLIENT_INTERFACE
     /* We treat client-owned threads as native but they don't have a clean native state
      * for us to suspend them in (they are always in client or dr code).  We need to be
@@ -1095,6 +1172,7 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
     bool finished_non_client_threads;
 #endif
 
+    EVTRACE_BEGIN(synchall);
     ASSERT(!dynamo_all_threads_synched);
     /* flag any caller who does not give up enough permissions to avoid livelock
      * with other synch_with_all_threads callers
@@ -1256,7 +1334,41 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         num_threads_temp = num_threads;
         synch_array_temp = synch_array;
 
+#ifdef UNIX
+        if (batch_size > 1) {
+            batched = (bool *) global_heap_alloc(num_threads * sizeof(bool)
+                                                 HEAPACCT(ACCT_THREAD_MGT));
+            for (i = 0; i < num_threads; i++)
+                batched[i] = false;
+            batch_end = 0;
+        }
+#endif
         for (i = 0; i < num_threads; i++) {
+#ifdef UNIX
+            if (batched != NULL && i == batch_end) {
+                /* Signal the whole next window before waiting on any of it.
+                 * Client threads are left to the one-at-a-time path below
+                 * as they may be skipped or deferred.
+                 */
+                for (; batch_end < num_threads && batch_end - i < batch_size;
+                     batch_end++) {
+                    thread_record_t *trec = threads[batch_end];
+                    if (synch_array[batch_end] == SYNCH_WITH_ALL_SYNCHED ||
+                        trec->id == my_id || trec->execve
+                        IF_CLIENT_INTERFACE(|| IS_CLIENT_THREAD(trec->dcontext)))
+                        continue;
+                    if (synch_array[batch_end] != SYNCH_WITH_ALL_NOTIFIED) {
+                        adjust_wait_at_safe_spot(trec->dcontext, 1);
+                        synch_array[batch_end] = SYNCH_WITH_ALL_NOTIFIED;
+                    }
+                    if (thread_suspend_request(trec, &synchall_suspend_acks)) {
+                        STATS_INC(synchall_batch_requests);
+                        batched[batch_end] = true;
+                    }
+                }
+                synchall_batch_settle(threads, batched, i, batch_end);
+            }
+#endif
             /* do not de-ref threads[i] after synching if it was cleaned up! */
             if (synch_array[i] != SYNCH_WITH_ALL_SYNCHED && threads[i]->id != my_id) {
 #ifdef CLIENT_INTERFACE
@@ -1296,6 +1408,15 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                 synch_res = synch_with_thread(threads[i]->id, false, true,
                                               THREAD_SYNCH_NONE,
                                               desired_synch_state, flags_one);
+#ifdef UNIX
+                if (batched != NULL && batched[i]) {
+                    /* synch_with_thread() took its own suspend reference, which
+                     * it keeps only on success, so we can drop the batch's.
+                     */
+                    thread_resume(threads[i]);
+                    batched[i] = false;
+                }
+#endif
                 if (synch_res == THREAD_SYNCH_RESULT_SUCCESS) {
                     LOG(THREAD, LOG_SYNCH, 2, "Synch succeeded!\n");
                     /* successful synch */
@@ -1306,8 +1427,17 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                     LOG(THREAD, LOG_SYNCH, 2, "Synch failed!\n");
                     all_synched = false;
                     if (synch_res == THREAD_SYNCH_RESULT_SUSPEND_FAILURE) {
-                        if (TEST(THREAD_SYNCH_SUSPEND_FAILURE_ABORT, flags))
+                        if (TEST(THREAD_SYNCH_SUSPEND_FAILURE_ABORT, flags)) {
+#ifdef UNIX
+                            if (batched != NULL) {
+                                synchall_batch_release(threads, batched, num_threads);
+                                global_heap_free(batched, num_threads * sizeof(bool)
+                                                 HEAPACCT(ACCT_THREAD_MGT));
+                                batched = NULL;
+                            }
+#endif
                             goto synch_with_all_abort;
+                        }
                     } else
                         ASSERT(synch_res == THREAD_SYNCH_RESULT_NOT_SAFE);
                 }
@@ -1316,6 +1446,18 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                     "Skipping synch with thread "IDFMT"\n", thread_ids_temp[i]);
             }
         }
+#ifdef UNIX
+        if (batched != NULL) {
+            /* every batched thread was handled above */
+            DODEBUG({
+                for (i = 0; i < num_threads; i++)
+                    ASSERT(!batched[i]);
+            });
+            global_heap_free(batched, num_threads * sizeof(bool)
+                             HEAPACCT(ACCT_THREAD_MGT));
+            batched = NULL;
+        }
+#endif
         /* We test the exiting thread count to avoid races between exit
          * process (current thread, though we could be here for detach or other
          * reasons) and an exiting thread (who might no longer be on the all
@@ -1403,6 +1545,7 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
     *threads_out = threads;
     *num_threads_out = num_threads;
     dynamo_all_threads_synched = all_synched;
+    EVTRACE_END();
     /* FIXME case 9392: where on all_synch failure we do not release the locks in the
      * non-abort exit path */
     return all_synched;
@@ -123,7 +123,7 @@ privload_call_modules_entry(privmod_t *mod, uint reason);
 static void
 privload_call_lib_func(fp_t func);
 
-static void
+static bool
 privload_relocate_mod(privmod_t *mod);
 
 static void
@@ -135,6 +135,15 @@ privload_delete_os_privmod_data(privmod_t *privmod);
 static void
 privload_mod_tls_init(privmod_t *mod);
 
+static app_pc
+privload_cache_base_hint(const char *filename);
+
+static bool
+privload_cache_map(privmod_t *mod, bool *image_ok OUT);
+
+static void
+privload_cache_store(privmod_t *mod);
+
 /***************************************************************************/
 
 /* os specific loader initialization prologue before finalizing the load. */
@@ -330,17 +339,16 @@ dr_gdb_add_symbol_file(const char *filename, app_pc textaddr)
      */
 }
 
-app_pc
-privload_map_and_relocate(const char *filename, size_t *size OUT, bool reachable)
+/* Maps filename's segments, preferring hint as the base if the file has no
+ * preferred base of its own.  The caller must call elf_loader_destroy().
+ */
+static app_pc
+privload_map_image(elf_loader_t *loader, const char *filename, app_pc hint,
+                   bool reachable)
 {
     map_fn_t map_func;
     unmap_fn_t unmap_func;
     prot_fn_t prot_func;
-    app_pc base = NULL;
-    elf_loader_t loader;
-#if defined(INTERNAL) || defined(CLIENT_INTERFACE)
-    app_pc text_addr;
-#endif
 
     ASSERT_OWN_RECURSIVE_LOCK(true, &privload_lock);
     /* get appropriate function */
@@ -357,12 +365,12 @@ privload_map_and_relocate(const char *filename, size_t *size OUT, bool reachable
         prot_func  = os_set_protection;
     }
 
-    if (!elf_loader_read_headers(&loader, filename)) {
+    if (!elf_loader_read_headers(loader, filename)) {
         /* We may want to move the bitwidth check out if is_elf_so_header_common()
          * but for now we keep that there and do another check here.
          * If loader.buf was not read into it will be all zeroes.
          */
-        ELF_HEADER_TYPE *elf_header = (ELF_HEADER_TYPE *) loader.buf;
+        ELF_HEADER_TYPE *elf_header = (ELF_HEADER_TYPE *) loader->buf;
         ELF_ALTARCH_HEADER_TYPE *altarch = (ELF_ALTARCH_HEADER_TYPE *) elf_header;
         if (elf_header->e_version == 1 &&
             altarch->e_ehsize == sizeof(ELF_ALTARCH_HEADER_TYPE) &&
@@ -372,9 +380,23 @@ privload_map_and_relocate(const char *filename, size_t *size OUT, bool reachable
         }
         return NULL;
     }
-
-    base = elf_loader_map_phdrs(&loader, false /* fixed */, map_func,
+    loader->map_hint = hint;
+    return elf_loader_map_phdrs(loader, false /* fixed */, map_func,
                                 unmap_func, prot_func, reachable);
+}
+
+app_pc
+privload_map_and_relocate(const char *filename, size_t *size OUT, bool reachable)
+{
+    app_pc base = NULL;
+    elf_loader_t loader;
+#if defined(INTERNAL) || defined(CLIENT_INTERFACE)
+    app_pc text_addr;
+#endif
+
+    /* Try for the base our cached relocated image was built at */
+    base = privload_map_image(&loader, filename, privload_cache_base_hint(filename),
+                              reachable);
     if (base != NULL) {
         if (size != NULL)
             *size = loader.image_size;
@@ -446,8 +468,8 @@ privload_process_imports(privmod_t *mod)
         ++dyn;
     }
     /* Relocate library's symbols after load dependent libraries. */
-    if (!mod->externally_loaded)
-        privload_relocate_mod(mod);
+    if (!mod->externally_loaded && !privload_relocate_mod(mod))
+        return false;
     return true;
 }
 
@@ -817,17 +839,12 @@ get_private_library_bounds(IN app_pc modbase, OUT byte **start, OUT byte **end)
     return found;
 }
 
+/* Applies the module's relocations in place */
 static void
-privload_relocate_mod(privmod_t *mod)
+privload_relocate_mod_image(privmod_t *mod)
 {
     os_privmod_data_t *opd = (os_privmod_data_t *) mod->os_privmod_data;
 
-    ASSERT_OWN_RECURSIVE_LOCK(true, &privload_lock);
-
-    /* If module has tls block need update its tls offset value */
-    if (opd->tls_block_size != 0) 
-        privload_mod_tls_init(mod);
-
     if (opd->rel != NULL) {
         module_relocate_rel(mod->base, opd,
                             opd->rel,
@@ -847,6 +864,31 @@ privload_relocate_mod(privmod_t *mod)
                                  (ELF_RELA_TYPE *)(opd->jmprel + opd->pltrelsz));
         }
     }
+}
+
+static bool
+privload_relocate_mod(privmod_t *mod)
+{
+    os_privmod_data_t *opd = (os_privmod_data_t *) mod->os_privmod_data;
+    bool image_ok;
+
+    ASSERT_OWN_RECURSIVE_LOCK(true, &privload_lock);
+
+    /* If module has tls block need update its tls offset value */
+    if (opd->tls_block_size != 0) 
+        privload_mod_tls_init(mod);
+
+    if (privload_cache_map(mod, &image_ok))
+        STATS_INC(num_privload_cache_hits);
+    else if (!image_ok) {
+        LOG(GLOBAL, LOG_LOADER, 1, "%s: unable to restore %s @"PFX"\n",
+            __FUNCTION__, mod->name, mod->base);
+        return false;
+    } else {
+        privload_relocate_mod_image(mod);
+        STATS_INC(num_privload_relocated);
+        privload_cache_store(mod);
+    }
     /* special handling on I/O file */
     if (strstr(mod->name, "libc.so") == mod->name) {
         privmod_stdout = 
@@ -865,6 +907,7 @@ privload_relocate_mod(privmod_t *mod)
                                                               LIBC_STDERR_NAME,
                                                               NULL);
     }
+    return true;
 }
 
 static void
@@ -884,6 +927,9 @@ privload_create_os_privmod_data(privmod_t *privmod)
                                 &opd->os_data);
     module_get_os_privmod_data(privmod->base, privmod->size,
                                false/*!relocated*/, opd);
+    if (DYNAMO_OPTION(privload_cache_dir)[0] != '\0' &&
+        !os_get_file_identity(privmod->path, &opd->file_id))
+        opd->file_id = 0;
 }
 
 static void
@@ -896,6 +942,291 @@ privload_delete_os_privmod_data(privmod_t *privmod)
 }
 
 
+/****************************************************************************
+ *                       Relocated Image Cache                              *
+ ****************************************************************************/
+
+/* With -privload_cache_dir, after relocating a private library we save its
+ * writable segments to a file in that directory, and on later runs we map
+ * that file over those segments instead of processing the relocations again.
+ *
+ * The relocated contents depend on the library's own bytes and base, on the
+ * bases and symbols of every library its imports may bind to (including DR
+ * itself, for redirected imports), and on its TLS module id and offset.  The
+ * cache file is named by the library's file identity, and its header records
+ * the rest, all of which must match for the file to be used: a mismatch just
+ * means we relocate as usual and replace the file.  To make hits likely
+ * across runs, a library with no preferred base is mapped at the base
+ * recorded in its cache file, which the kernel honors when that range is
+ * free.  Libraries with text relocations are never cached.
+ */
+
+#define PRIVLOAD_CACHE_MAGIC 0x43524450 /* "PDRC" */
+#define PRIVLOAD_CACHE_VERSION (1 | IF_X64_ELSE(0x100, 0))
+#define PRIVLOAD_CACHE_MAX_SEGMENTS 8
+
+typedef struct _privload_cache_header_t {
+    uint magic;
+    uint version;
+    uint64 file_id;     /* os_get_file_identity() of the library */
+    app_pc base;
+    size_t size;
+    uint64 deps_id;     /* privload_cache_deps_id() */
+    uint num_segments;
+    struct {
+        app_pc start;
+        size_t size;
+        uint prot;
+        uint64 offset;  /* page-aligned offset of the contents in the file */
+    } segments[PRIVLOAD_CACHE_MAX_SEGMENTS];
+} privload_cache_header_t;
+
+static bool
+privload_cache_enabled(void)
+{
+    return DYNAMO_OPTION(privload_cache_dir)[0] != '\0';
+}
+
+static void
+privload_cache_path(const char *libpath, uint64 file_id, char *buf, size_t bufsz)
+{
+    const char *name = double_strrchr(libpath, DIRSEP, ALT_DIRSEP);
+    name = (name == NULL) ? libpath : name + 1;
+    snprintf(buf, bufsz, "%s/%s-%08x%08x.rcache", DYNAMO_OPTION(privload_cache_dir),
+             name, (uint)(file_id >> 32), (uint)file_id);
+    buf[bufsz - 1] = '\0';
+}
+
+/* Opens the cache file for the library at libpath and reads its header.
+ * Returns INVALID_FILE if there is none or it is for a different build of
+ * the library.  Does not use the heap, as it is called before it exists.
+ */
+static file_t
+privload_cache_open(const char *libpath, uint64 file_id,
+                    privload_cache_header_t *hdr OUT)
+{
+    char path[MAXIMUM_PATH];
+    file_t f;
+    privload_cache_path(libpath, file_id, path, BUFFER_SIZE_ELEMENTS(path));
+    f = os_open(path, OS_OPEN_READ);
+    if (f == INVALID_FILE)
+        return INVALID_FILE;
+    if (os_read(f, hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+        hdr->magic != PRIVLOAD_CACHE_MAGIC ||
+        hdr->version != PRIVLOAD_CACHE_VERSION ||
+        hdr->file_id != file_id ||
+        hdr->num_segments > PRIVLOAD_CACHE_MAX_SEGMENTS) {
+        LOG(GLOBAL, LOG_LOADER, 1, "%s: ignoring invalid %s\n", __FUNCTION__, path);
+        os_close(f);
+        return INVALID_FILE;
+    }
+    return f;
+}
+
+static app_pc
+privload_cache_base_hint(const char *filename)
+{
+    privload_cache_header_t hdr;
+    uint64 file_id;
+    file_t f;
+    if (!privload_cache_enabled() || !os_get_file_identity(filename, &file_id))
+        return NULL;
+    f = privload_cache_open(filename, file_id, &hdr);
+    if (f == INVALID_FILE)
+        return NULL;
+    os_close(f);
+    return hdr.base;
+}
+
+static uint64
+privload_cache_hash(uint64 hash, const void *data, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= ((const byte *)data)[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* Identifies everything besides the library's own file and base that its
+ * relocated contents depend on.
+ */
+static uint64
+privload_cache_deps_id(privmod_t *mod)
+{
+    os_privmod_data_t *opd = (os_privmod_data_t *) mod->os_privmod_data;
+    uint64 hash = 0xcbf29ce484222325ULL; /* FNV-1a */
+    app_pc dr_base = get_dynamorio_dll_start();
+    privmod_t *dep;
+    ASSERT_OWN_RECURSIVE_LOCK(true, &privload_lock);
+    hash = privload_cache_hash(hash, &dr_base, sizeof(dr_base));
+    hash = privload_cache_hash(hash, &opd->tls_modid, sizeof(opd->tls_modid));
+    hash = privload_cache_hash(hash, &opd->tls_offset, sizeof(opd->tls_offset));
+    /* module_lookup_symbol() searches every loaded module in list order */
+    for (dep = privload_first_module(); dep != NULL; dep = privload_next_module(dep)) {
+        os_privmod_data_t *dep_opd = (os_privmod_data_t *) dep->os_privmod_data;
+        if (dep == mod || dep_opd == NULL)
+            continue;
+        hash = privload_cache_hash(hash, &dep->base, sizeof(dep->base));
+        hash = privload_cache_hash(hash, &dep->size, sizeof(dep->size));
+        hash = privload_cache_hash(hash, &dep_opd->file_id, sizeof(dep_opd->file_id));
+    }
+    return hash;
+}
+
+/* Fills in hdr for mod as currently loaded.  Returns false if mod cannot be
+ * cached.
+ */
+static bool
+privload_cache_header(privmod_t *mod, privload_cache_header_t *hdr OUT)
+{
+    os_privmod_data_t *opd = (os_privmod_data_t *) mod->os_privmod_data;
+    uint i;
+    uint64 offset = ALIGN_FORWARD(sizeof(*hdr), PAGE_SIZE);
+    if (!privload_cache_enabled() || opd->file_id == 0 || opd->textrel)
+        return false;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = PRIVLOAD_CACHE_MAGIC;
+    hdr->version = PRIVLOAD_CACHE_VERSION;
+    hdr->file_id = opd->file_id;
+    hdr->base = mod->base;
+    hdr->size = mod->size;
+    hdr->deps_id = privload_cache_deps_id(mod);
+    for (i = 0; i < opd->os_data.num_segments; i++) {
+        module_segment_t *seg = &opd->os_data.segments[i];
+        if (!TEST(MEMPROT_WRITE, seg->prot))
+            continue;
+        if (hdr->num_segments == PRIVLOAD_CACHE_MAX_SEGMENTS)
+            return false;
+        hdr->segments[hdr->num_segments].start = seg->start;
+        hdr->segments[hdr->num_segments].size = seg->end - seg->start;
+        hdr->segments[hdr->num_segments].prot = seg->prot;
+        hdr->segments[hdr->num_segments].offset = offset;
+        offset += ALIGN_FORWARD((seg->end - seg->start), PAGE_SIZE);
+        hdr->num_segments++;
+    }
+    return true;
+}
+
+/* Replaces mod's whole image with a fresh unrelocated mapping of its file at
+ * the same base.  Returns false if the file could not be mapped back there.
+ */
+static bool
+privload_cache_restore(privmod_t *mod)
+{
+    unmap_fn_t unmap_func = dynamo_heap_initialized ? unmap_file : os_unmap_file;
+    size_t size = mod->size;
+    elf_loader_t loader;
+    app_pc base;
+    bool ok;
+    if (INTERNAL_OPTION(separate_private_bss))
+        size += PAGE_SIZE; /* the no-access page after .bss */
+    (*unmap_func)(mod->base, size);
+    base = privload_map_image(&loader, mod->path, mod->base, false/*reachable*/);
+    ok = (base == mod->base && loader.image_size == mod->size);
+    if (!ok && base != NULL) {
+        (*unmap_func)(base, loader.image_size +
+                      (INTERNAL_OPTION(separate_private_bss) ? PAGE_SIZE : 0));
+    }
+    elf_loader_destroy(&loader);
+    return ok;
+}
+
+/* Maps mod's relocated writable segments from its cache file, if it has a
+ * valid one.  Returns false if mod still needs to be relocated, in which case
+ * image_ok is set to whether mod's image is still intact.
+ */
+static bool
+privload_cache_map(privmod_t *mod, bool *image_ok OUT)
+{
+    privload_cache_header_t expect, hdr;
+    file_t f;
+    uint i;
+    *image_ok = true;
+    if (!privload_cache_header(mod, &expect))
+        return false;
+    f = privload_cache_open(mod->path, expect.file_id, &hdr);
+    if (f == INVALID_FILE)
+        return false;
+    if (memcmp(&hdr, &expect, sizeof(hdr)) != 0) {
+        LOG(GLOBAL, LOG_LOADER, 1, "%s: stale cache for %s @"PFX"\n",
+            __FUNCTION__, mod->name, mod->base);
+        os_close(f);
+        return false;
+    }
+    for (i = 0; i < hdr.num_segments; i++) {
+        size_t size = hdr.segments[i].size;
+        /* MAP_FIXED replaces the segment's current pages atomically, so the
+         * range never becomes free for another mapping.
+         */
+        app_pc map = os_map_file(f, &size, hdr.segments[i].offset,
+                                 hdr.segments[i].start, hdr.segments[i].prot,
+                                 MAP_FILE_COPY_ON_WRITE | MAP_FILE_IMAGE |
+                                 MAP_FILE_FIXED);
+        if (map != hdr.segments[i].start) {
+            /* A failed MAP_FIXED may already have discarded the old pages, and
+             * we cannot relocate a partially replaced image, as REL-style
+             * relocations are not idempotent.  We start over from the file.
+             */
+            LOG(GLOBAL, LOG_LOADER, 1, "%s: failed to map cached segment %d of %s\n",
+                __FUNCTION__, i, mod->name);
+            if (map != NULL)
+                os_unmap_file(map, size);
+            os_close(f);
+            *image_ok = privload_cache_restore(mod);
+            return false;
+        }
+    }
+    os_close(f);
+    LOG(GLOBAL, LOG_LOADER, 1, "%s: mapped cached relocated image for %s @"PFX"\n",
+        __FUNCTION__, mod->name, mod->base);
+    return true;
+}
+
+/* Writes mod's just-relocated writable segments to its cache file.  The file
+ * is written under a temporary name and renamed into place, so concurrent
+ * processes never see a partial file.
+ */
+static void
+privload_cache_store(privmod_t *mod)
+{
+    privload_cache_header_t hdr;
+    char path[MAXIMUM_PATH], tmp[MAXIMUM_PATH];
+    file_t f;
+    uint i;
+    bool ok;
+    if (!privload_cache_header(mod, &hdr))
+        return;
+    privload_cache_path(mod->path, hdr.file_id, path, BUFFER_SIZE_ELEMENTS(path));
+    snprintf(tmp, BUFFER_SIZE_ELEMENTS(tmp), "%s.%d.tmp", path, get_process_id());
+    NULL_TERMINATE_BUFFER(tmp);
+    if (!os_file_exists(DYNAMO_OPTION(privload_cache_dir), true/*dir*/))
+        os_create_dir(DYNAMO_OPTION(privload_cache_dir), CREATE_DIR_ALLOW_EXISTING);
+    f = os_open(tmp, OS_OPEN_WRITE);
+    if (f == INVALID_FILE) {
+        LOG(GLOBAL, LOG_LOADER, 1, "%s: unable to create %s\n", __FUNCTION__, tmp);
+        return;
+    }
+    ok = (os_write(f, &hdr, sizeof(hdr)) == sizeof(hdr));
+    for (i = 0; ok && i < hdr.num_segments; i++) {
+        ok = os_seek(f, hdr.segments[i].offset, OS_SEEK_SET) &&
+            os_write(f, hdr.segments[i].start, hdr.segments[i].size) ==
+            (ssize_t) hdr.segments[i].size;
+    }
+    os_close(f);
+    if (ok)
+        ok = os_rename_file(tmp, path, true/*replace*/);
+    if (!ok) {
+        LOG(GLOBAL, LOG_LOADER, 1, "%s: failed to write %s\n", __FUNCTION__, path);
+        os_delete_file(tmp);
+        return;
+    }
+    STATS_INC(num_privload_cache_stores);
+    LOG(GLOBAL, LOG_LOADER, 1, "%s: cached relocated image for %s @"PFX" in %s\n",
+        __FUNCTION__, mod->name, mod->base, path);
+}
+
 /****************************************************************************
  *                  Thread Local Storage Handling Code                      *
  ****************************************************************************/
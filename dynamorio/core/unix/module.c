@@ -2207,7 +2207,9 @@ elf_loader_map_phdrs(elf_loader_t *elf, bool fixed, map_fn_t map_func,
         /* place an extra no-access page after .bss */
         initial_map_size += PAGE_SIZE;
     }
-    lib_base = (*map_func)(-1, &initial_map_size, 0, map_base,
+    lib_base = (*map_func)(-1, &initial_map_size, 0,
+                           (map_base == NULL && elf->map_hint != NULL) ?
+                           elf->map_hint : map_base,
                            MEMPROT_NONE, /* so the separating page is no-access */
                            MAP_FILE_COPY_ON_WRITE |
                            MAP_FILE_IMAGE |
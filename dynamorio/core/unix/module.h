@@ -228,6 +228,8 @@ typedef struct _os_privmod_data_t {
     uint           tls_image_size; /* tls variables size in the file */
     uint           tls_first_byte; /* aligned addr of the first tls variable */
     app_pc         tls_image;      /* tls block address in memory */
+    /* os_get_file_identity() of the file, set with -privload_cache_dir */
+    uint64         file_id;
 } os_privmod_data_t;
 
 ELF_ADDR 
@@ -316,6 +318,10 @@ typedef struct elf_loader_t {
     size_t image_size;                  /* Size of the mapped image. */
     void *file_map;                     /* Whole file map, if needed. */
     size_t file_size;                   /* Size of the file map. */
+    /* Requested base for a module with no preferred base.  Only a hint: the
+     * module is mapped elsewhere if the range is not free.
+     */
+    app_pc map_hint;
 
     /* Static buffer sized to hold most headers in a single read.  A typical ELF
      * file has an ELF header followed by program headers.  On my workstation,
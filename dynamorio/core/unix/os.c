@@ -74,6 +74,7 @@
 /* for getrlimit */
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>   /* __WCLONE, WNOHANG */
 
 #include <linux/futex.h> /* for futex op code */
 
@@ -144,6 +145,9 @@ char **our_environ;
 #include "../module_shared.h"
 #include "os_private.h"
 #include "../synch.h"
+#include "../fragment.h" /* get_at_syscall */
+#include "../fcache.h" /* in_fcache */
+#include "../monitor.h" /* is_building_trace */
 
 #ifdef CLIENT_INTERFACE
 # include "instrument.h"
@@ -381,6 +385,7 @@ typedef struct _maps_iter_t {
     char *newline;
     int bufread;
     int bufwant;
+    int bufsize;
     char *buf;
     char *comment_buffer;
 } maps_iter_t;
@@ -3258,8 +3263,14 @@ thread_sleep(uint64 milliseconds)
     }
 }
 
+/* Sends the suspend signal to tr, if not already sent, without waiting for
+ * the target to reach its suspend point.  If this call is the one that sends
+ * the signal and acks is non-NULL, the target atomically increments *acks and
+ * wakes any futex waiters on it once it is suspended.  A successful request
+ * must be paired with a thread_resume().
+ */
 bool
-thread_suspend(thread_record_t *tr)
+thread_suspend_request(thread_record_t *tr, volatile int *acks)
 {
     os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
     ASSERT(ostd != NULL);
@@ -3270,28 +3281,69 @@ thread_suspend(thread_record_t *tr)
     ostd->suspend_count++;
     ASSERT(ostd->suspend_count > 0);
     /* If already suspended, do not send another signal.  However, we do
-     * need to ensure the target is suspended in case of a race, so we can't
-     * just return.
+     * need to ensure the target is suspended in case of a race, so the
+     * caller can't assume it has arrived.
      */
     if (ostd->suspend_count == 1) {
-        /* PR 212090: we use a custom signal handler to suspend.  We wait
-         * here until the target reaches the suspend point, and leave it
-         * up to the caller to check whether it is a safe suspend point,
-         * to match Windows behavior.
+        /* PR 212090: we use a custom signal handler to suspend.  It is up
+         * to the caller to wait for the target to reach the suspend point
+         * and to check whether it is a safe suspend point, to match Windows
+         * behavior.
          */
         ASSERT(ostd->suspended == 0);
+        /* Set prior to the signal: the handler only looks at it once
+         * suspend_count is non-zero.
+         */
+        ostd->suspend_acks = acks;
         if (!thread_signal(tr->pid, tr->id, SUSPEND_SIGNAL)) {
+            ostd->suspend_acks = NULL;
             ostd->suspend_count--;
             mutex_unlock(&ostd->suspend_lock);
             return false;
         }
     }
-    /* we can unlock before the wait loop b/c we're using a separate "resumed"
+    mutex_unlock(&ostd->suspend_lock);
+    return true;
+}
+
+/* Returns whether a thread we requested to suspend has reached its suspend point */
+bool
+thread_suspend_arrived(thread_record_t *tr)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
+    ASSERT(ostd != NULL);
+    return (ostd->suspended == 1);
+}
+
+/* Waits until *acks differs from seen or until timeout_ms elapses, whichever
+ * comes first.  Used to collect thread_suspend_request() acknowledgements.
+ */
+void
+thread_suspend_wait_acks(volatile int *acks, int seen, int timeout_ms)
+{
+    ASSERT(ALIGNED(acks, sizeof(int)));
+    if (kernel_futex_support) {
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+        /* Return value doesn't matter: the caller re-checks its threads. */
+        dynamorio_syscall(SYS_futex, 6, acks, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    } else if (*acks == seen)
+        thread_yield();
+}
+
+bool
+thread_suspend(thread_record_t *tr)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
+    ASSERT(ostd != NULL);
+    if (!thread_suspend_request(tr, NULL))
+        return false;
+    /* the request unlocks before this wait loop b/c we're using a separate "resumed"
      * int and thread_resume holds the lock across its wait.  this way a resume
      * can proceed as soon as the suspended thread is suspended, before the
      * suspending thread gets scheduled again.
      */
-    mutex_unlock(&ostd->suspend_lock);
     /* i#96/PR 295561: use futex(2) if available */
     while (ostd->suspended == 0) {
         /* Waits only if the suspended flag is not set as 1. Return value
@@ -3715,6 +3767,36 @@ os_files_same(const char *path1, const char *path2)
     return st1.st_ino == st2.st_ino;
 }
 
+/* Returns in id a value that changes whenever the file at path is replaced or
+ * modified: a hash of its device, inode, size, and modification time.
+ */
+bool
+os_get_file_identity(const char *path, OUT uint64 *id)
+{
+    /* _LARGEFILE64_SOURCE should make libc struct match kernel (see top of file) */
+    struct stat64 st;
+    uint64 vals[5];
+    uint i;
+    ptr_int_t res = dynamorio_syscall(SYSNUM_STAT, 2, path, &st);
+    if (res != 0) {
+        LOG(THREAD_GET, LOG_SYSCALLS, 2, "%s failed: "PIFX"\n", __func__, res);
+        return false;
+    }
+    vals[0] = st.st_dev;
+    vals[1] = st.st_ino;
+    vals[2] = st.st_size;
+    vals[3] = st.st_mtime;
+    vals[4] = st.st_mtim.tv_nsec;
+    ASSERT(id != NULL);
+    /* FNV-1a over the fields */
+    *id = 0xcbf29ce484222325ULL;
+    for (i = 0; i < sizeof(vals); i++) {
+        *id ^= ((byte *)vals)[i];
+        *id *= 0x100000001b3ULL;
+    }
+    return true;
+}
+
 bool
 os_get_file_size(const char *file, uint64 *size)
 {
@@ -3981,6 +4063,32 @@ os_close_protected(file_t f)
     }
     os_close(f);
 }
+
+#ifdef LINUX
+/* Opens a perf event counting on the calling thread on any cpu, as a member
+ * of group_fd's group unless group_fd is INVALID_FILE.  The fd is kept out of
+ * the app's way like os_open_protected() fds; close it with
+ * os_close_protected().  Returns INVALID_FILE on failure.
+ */
+file_t
+os_perf_event_open(void *attr, file_t group_fd)
+{
+    file_t dup;
+    file_t res = (file_t)
+        dynamorio_syscall(SYS_perf_event_open, 5, attr, 0/*this thread*/,
+                          -1/*any cpu*/, group_fd, 0/*flags*/);
+    if (res < 0)
+        return INVALID_FILE;
+    dup = fd_priv_dup(res);
+    if (dup >= 0) {
+        close_syscall(res);
+        res = dup;
+        fd_mark_close_on_exec(res);
+    }
+    fd_table_add(res, 0);
+    return res;
+}
+#endif
 #endif /* !NOT_DYNAMORIO_CORE_PROPER */
 
 #ifndef NOT_DYNAMORIO_CORE_PROPER /* so drinject can use drdecode's copy */
@@ -4203,6 +4311,46 @@ exit_thread_syscall(long status)
     dynamorio_syscall(SYS_exit, 1, status);
 }
 
+/* Forks a copy of the process containing only the calling thread, for
+ * dr_create_snapshot().  This bypasses the app's and DR's own fork handling,
+ * and the child has no exit signal, so the app is never sent SIGCHLD for it
+ * and does not see it from wait() calls without __WCLONE.  Returns the
+ * child's id in the parent, 0 in the child, and INVALID_PROCESS_ID on
+ * failure.
+ */
+process_id_t
+os_fork_snapshot(void)
+{
+    /* A fork is a clone with no sharing: flags holds the exit signal */
+    ptr_int_t res = dynamorio_syscall(SYS_clone, 5, 0/*no exit signal*/,
+                                      NULL/*same stack*/, NULL, NULL, NULL);
+    if (res < 0) {
+        LOG(GLOBAL, LOG_SYSCALLS, 1, "%s failed: "PIFX"\n", __FUNCTION__, res);
+        return (process_id_t) INVALID_PROCESS_ID;
+    }
+    return (process_id_t) res;
+}
+
+/* Reaps a child from os_fork_snapshot().  Returns true if it has exited, in
+ * which case its exit status is returned in status.  If block is false,
+ * returns false rather than waiting if it is still running.
+ */
+bool
+os_wait_snapshot(process_id_t pid, bool block, OUT int *status)
+{
+    int wstatus;
+    ptr_int_t res;
+    do {
+        res = dynamorio_syscall(SYS_wait4, 4, pid, &wstatus,
+                                __WCLONE | (block ? 0 : WNOHANG), NULL);
+    } while (res == -EINTR);
+    if (res != pid)
+        return false;
+    if (status != NULL)
+        *status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+    return true;
+}
+
 /* FIXME: this one will not be easily internationalizable 
    yet it is easier to have a syslog based Unix implementation with real strings.
  */
@@ -7514,13 +7662,18 @@ post_system_call(dcontext_t *dcontext)
 #define BUFSIZE (MAPS_LINE_LENGTH+8)
 static char buf_scratch[BUFSIZE];
 static char comment_buf_scratch[BUFSIZE];
+/* The outer iterator walks the whole file at init, where processes we
+ * attach to can have tens of thousands of entries, so it reads in larger
+ * chunks to cut down on read syscalls.
+ */
+#define ITER_BUFSIZE (16*MAPS_LINE_LENGTH+8)
 /* To satisfy our two uses (inner use with memory_info_buf_lock versus
  * outer use with maps_iter_buf_lock), we have two different locks and
  * two different sets of static buffers.  This is to avoid lock
  * ordering issues: we need an inner lock for use in places like signal
  * handlers, but an outer lock when the iterator user allocates memory.
  */
-static char buf_iter[BUFSIZE];
+static char buf_iter[ITER_BUFSIZE];
 static char comment_buf_iter[BUFSIZE];
 #endif /* HAVE_PROC_MAPS */
 
@@ -7535,10 +7688,12 @@ maps_iterator_start(maps_iter_t *iter, bool may_alloc)
     if (may_alloc) {
         mutex_lock(&maps_iter_buf_lock);
         iter->buf = (char *) &buf_iter;
+        iter->bufsize = BUFFER_SIZE_ELEMENTS(buf_iter);
         iter->comment_buffer = (char *) &comment_buf_iter;
     } else {
         mutex_lock(&memory_info_buf_lock);
         iter->buf = (char *) &buf_scratch;
+        iter->bufsize = BUFFER_SIZE_ELEMENTS(buf_scratch);
         iter->comment_buffer = (char *) &comment_buf_scratch;
     }
 
@@ -7550,7 +7705,7 @@ maps_iterator_start(maps_iter_t *iter, bool may_alloc)
              "/proc/%d/maps", get_thread_id());
     iter->maps = os_open(maps_name, OS_OPEN_READ);
     ASSERT(iter->maps != INVALID_FILE);
-    iter->buf[BUFSIZE-1] = '\0'; /* permanently */
+    iter->buf[iter->bufsize-1] = '\0'; /* permanently */
 
     iter->may_alloc = may_alloc;
     iter->newline = NULL;
@@ -7578,6 +7733,85 @@ maps_iterator_stop(maps_iter_t *iter)
 #endif /* HAVE_PROC_MAPS */
 }
 
+#ifdef HAVE_PROC_MAPS
+/* Parses a hex number, advancing *str past it */
+static ptr_uint_t
+maps_parse_hex(char **str)
+{
+    ptr_uint_t val = 0;
+    char *s = *str;
+    for (;; s++) {
+        if (*s >= '0' && *s <= '9')
+            val = (val << 4) | (*s - '0');
+        else if (*s >= 'a' && *s <= 'f')
+            val = (val << 4) | (*s - 'a' + 10);
+        else if (*s >= 'A' && *s <= 'F')
+            val = (val << 4) | (*s - 'A' + 10);
+        else
+            break;
+    }
+    *str = s;
+    return val;
+}
+
+/* Copies the next whitespace-delimited token into dst (truncating to
+ * dst_sz-1 chars) and advances *str past it.  Returns false if there was
+ * no token.
+ */
+static bool
+maps_parse_token(char **str, char *dst, size_t dst_sz)
+{
+    char *s = *str;
+    size_t len = 0;
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (*s == '\0')
+        return false;
+    while (*s != '\0' && *s != ' ' && *s != '\t') {
+        if (dst != NULL && len < dst_sz - 1)
+            dst[len++] = *s;
+        s++;
+    }
+    if (dst != NULL)
+        dst[len] = '\0';
+    *str = s;
+    return true;
+}
+
+/* Parses one maps line, equivalent to sscanf with MAPS_LINE_FORMAT{4,8}
+ * but several times faster, which matters for processes with many
+ * mappings.  Returns the number of fields filled in.
+ */
+static int
+maps_parse_line(maps_iter_t *iter, char *line, char *perm, size_t perm_sz)
+{
+    char *s = line;
+    uint64 inode = 0;
+    iter->vm_start = (app_pc) maps_parse_hex(&s);
+    if (s == line || *s != '-')
+        return 0;
+    s++;
+    iter->vm_end = (app_pc) maps_parse_hex(&s);
+    if (!maps_parse_token(&s, perm, perm_sz))
+        return 2;
+    while (*s == ' ')
+        s++;
+    iter->offset = (size_t) maps_parse_hex(&s);
+    if (!maps_parse_token(&s, NULL, 0)) /* device */
+        return 4;
+    while (*s == ' ')
+        s++;
+    if (*s < '0' || *s > '9')
+        return 4;
+    for (; *s >= '0' && *s <= '9'; s++)
+        inode = inode * 10 + (*s - '0');
+    iter->inode = inode;
+    if (!maps_parse_token(&s, iter->comment_buffer, MAPS_LINE_LENGTH + 1))
+        return 5;
+    return 6;
+}
+#endif /* HAVE_PROC_MAPS */
+
 static bool
 maps_iterator_next(maps_iter_t *iter)
 {
@@ -7589,7 +7823,7 @@ maps_iterator_next(maps_iter_t *iter)
     ASSERT((iter->may_alloc && OWN_MUTEX(&maps_iter_buf_lock)) ||
            (!iter->may_alloc && OWN_MUTEX(&memory_info_buf_lock)));
     if (iter->newline == NULL) {
-        iter->bufwant = BUFSIZE-1;
+        iter->bufwant = iter->bufsize-1;
         iter->bufread = os_read(iter->maps, iter->buf, iter->bufwant);
         ASSERT(iter->bufread <= iter->bufwant);
         LOG(GLOBAL, LOG_VMAREAS, 6,
@@ -7633,15 +7867,7 @@ maps_iterator_next(maps_iter_t *iter)
     LOG(GLOBAL, LOG_VMAREAS, 6, 
         "\nget_memory_info_from_os: line=[%s]\n", line);
     iter->comment_buffer[0]='\0';
-    len = sscanf(line,
-#ifdef IA32_ON_IA64
-                 MAPS_LINE_FORMAT8, /* cross-compiling! */
-#else              
-                 sizeof(void*) == 4 ? MAPS_LINE_FORMAT4 : MAPS_LINE_FORMAT8,
-#endif
-                 (unsigned long*)&iter->vm_start, (unsigned long*)&iter->vm_end,
-                 perm, (unsigned long*)&iter->offset, &iter->inode,
-                 iter->comment_buffer);
+    len = maps_parse_line(iter, line, perm, BUFFER_SIZE_ELEMENTS(perm));
     if (iter->vm_start == iter->vm_end) {
         /* i#366 & i#599: Merge an empty regions caused by stack guard pages
          * into the stack region if the stack region is less than one page away.
@@ -8434,6 +8660,82 @@ find_vm_areas_via_probe(void)
 /***************************************************************************/
 
 
+#ifdef HAVE_PROC_MAPS
+/* A region found by the initial memory walk.  We stage them so that
+ * all_memory_areas can be built in one pass: inserting each region on its
+ * own costs O(n) apiece, which takes seconds for processes with tens of
+ * thousands of mappings.
+ */
+typedef struct _initial_region_t {
+    app_pc start;
+    app_pc end;
+    uint prot;
+    bool image;
+    bool skip;
+# ifdef DEBUG
+    const char *map_type;
+# endif
+} initial_region_t;
+
+#define INITIAL_REGIONS_INIT_SIZE 256
+
+/* Adds the staged regions to all_memory_areas and the vmareas lists.
+ * Returns the number of regions added to the executable list.
+ */
+static int
+add_initial_regions(initial_region_t *regions, uint num)
+{
+    vmvector_region_t *bulk;
+    uint i, num_bulk = 0;
+    int count = 0;
+    if (num == 0)
+        return 0;
+    bulk = (vmvector_region_t *)
+        global_heap_alloc(num*sizeof(vmvector_region_t) HEAPACCT(ACCT_MEM_MGT));
+    all_memory_areas_lock();
+    sync_all_memory_areas();
+    for (i = 0; i < num; i++) {
+        app_pc end = (app_pc) ALIGN_FORWARD(regions[i].end, PAGE_SIZE);
+        int type = regions[i].image ? DR_MEMTYPE_IMAGE : DR_MEMTYPE_DATA;
+        LOG(GLOBAL, LOG_VMAREAS, 4,
+            "find_executable_vm_areas: adding: "PFX"-"PFX" prot=%d\n",
+            regions[i].start, regions[i].end, regions[i].prot);
+        if (vmvector_overlap(all_memory_areas, regions[i].start, end)) {
+            /* e.g., our own vmheap: split what's there the slow way */
+            update_all_memory_areas(regions[i].start, end, regions[i].prot, type);
+        } else {
+            allmem_info_t *info =
+                HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, allmem_info_t, ACCT_MEM_MGT, PROTECTED);
+            info->prot = regions[i].prot;
+            info->type = type;
+            info->shareable = (type == DR_MEMTYPE_IMAGE);
+            bulk[num_bulk].start = regions[i].start;
+            bulk[num_bulk].end = end;
+            bulk[num_bulk].data = (void *) info;
+            num_bulk++;
+        }
+    }
+    vmvector_add_bulk(all_memory_areas, bulk, num_bulk);
+    all_memory_areas_unlock();
+    global_heap_free(bulk, num*sizeof(vmvector_region_t) HEAPACCT(ACCT_MEM_MGT));
+
+    /* FIXME: best if we could pass every region to vmareas, but
+     * it has no way of determining if this is a stack b/c we don't have
+     * a dcontext at this point -- so we just don't pass the stack
+     */
+    for (i = 0; i < num; i++) {
+        if (!regions[i].skip /* i#479, hide private module */ &&
+            app_memory_allocation(NULL, regions[i].start,
+                                  (regions[i].end - regions[i].start),
+                                  regions[i].prot, regions[i].image
+                                  _IF_DEBUG(regions[i].map_type))) {
+            count++;
+        }
+    }
+    return count;
+}
+#endif /* HAVE_PROC_MAPS */
+
 /* assumed to be called after find_dynamo_library_vm_areas() */
 int
 find_executable_vm_areas(void)
@@ -8464,6 +8766,10 @@ find_executable_vm_areas(void)
     count = find_vm_areas_via_probe();
 #else
     maps_iter_t iter;
+    initial_region_t *regions;
+    uint num_regions = 0, regions_size = INITIAL_REGIONS_INIT_SIZE;
+    regions = (initial_region_t *)
+        global_heap_alloc(regions_size*sizeof(initial_region_t) HEAPACCT(ACCT_MEM_MGT));
     maps_iterator_start(&iter, true/*may alloc*/);
     while (maps_iterator_next(&iter)) {
         bool image = false;
@@ -8586,27 +8892,27 @@ find_executable_vm_areas(void)
             DODEBUG({ map_type = "Mapped File"; });
         }
 
-        /* add all regions (incl. dynamo_areas and stack) to all_memory_areas */
-        LOG(GLOBAL, LOG_VMAREAS, 4,
-            "find_executable_vm_areas: adding: "PFX"-"PFX" prot=%d\n",
-            iter.vm_start, iter.vm_end, iter.prot);
-        all_memory_areas_lock();
-        update_all_memory_areas(iter.vm_start, iter.vm_end, iter.prot,
-                                image ? DR_MEMTYPE_IMAGE : DR_MEMTYPE_DATA);
-        all_memory_areas_unlock();
-    
-        /* FIXME: best if we could pass every region to vmareas, but
-         * it has no way of determining if this is a stack b/c we don't have
-         * a dcontext at this point -- so we just don't pass the stack
+        /* all regions (incl. dynamo_areas and stack) go to all_memory_areas,
+         * which we build in bulk once the walk is done
          */
-        if (!skip /* i#479, hide private module and match Windows's behavior */ &&
-            app_memory_allocation(NULL, iter.vm_start, (iter.vm_end - iter.vm_start),
-                                  iter.prot, image _IF_DEBUG(map_type))) {
-            count++;
-        }
-
+        if (num_regions == regions_size) {
+            regions = (initial_region_t *)
+                global_heap_realloc(regions, regions_size, regions_size*2,
+                                    sizeof(initial_region_t) HEAPACCT(ACCT_MEM_MGT));
+            regions_size *= 2;
+        }
+        regions[num_regions].start = iter.vm_start;
+        regions[num_regions].end = iter.vm_end;
+        regions[num_regions].prot = iter.prot;
+        regions[num_regions].image = image;
+        regions[num_regions].skip = skip;
+        DODEBUG({ regions[num_regions].map_type = map_type; });
+        num_regions++;
     }
     maps_iterator_stop(&iter);
+    count = add_initial_regions(regions, num_regions);
+    global_heap_free(regions, regions_size*sizeof(initial_region_t)
+                     HEAPACCT(ACCT_MEM_MGT));
 #endif /* HAVE_PROC_MAPS */
 
     LOG(GLOBAL, LOG_VMAREAS, 4, "init: all memory areas:\n");
@@ -9485,6 +9791,32 @@ os_thread_take_over(priv_mcontext_t *mc)
     LOG(GLOBAL, LOG_THREADS, 1,
         "TAKEOVER: received signal in thread %d\n", get_sys_thread_id());
 
+    dcontext = get_thread_private_dcontext();
+    if (dcontext != NULL && dcontext->thread_record != NULL &&
+        /* a thread cloned while native inherits its parent's tls */
+        dcontext->owning_thread == get_sys_thread_id() &&
+        is_thread_currently_native(dcontext->thread_record)) {
+        /* A re-takeover of a thread we already know about (from
+         * os_thread_take_over_suspended_native()): its state was kept while
+         * it was native, so there is nothing to initialize and nobody is
+         * waiting on a takeover record.  Its sigaction calls did bypass us,
+         * though.  Process-wide changes are handled separately by
+         * os_rescan_after_native().
+         */
+        LOG(THREAD, LOG_THREADS, 1, "TAKEOVER: re-taking over at "PFX"\n", mc->pc);
+        signal_reinstate_handlers(dcontext);
+        dcontext->thread_record->under_dynamo_control = true;
+        dynamo_thread_under_dynamo(dcontext);
+        dc_mc = get_mcontext(dcontext);
+        *dc_mc = *mc;
+        dcontext->whereami = WHERE_APP;
+        dcontext->next_tag = mc->pc;
+        set_last_exit(dcontext, (linkstub_t *) get_starting_linkstub());
+        call_switch_stack(dcontext, dcontext->dstack, dispatch,
+                          false/*not on initstack*/, false/*shouldn't return*/);
+        ASSERT_NOT_REACHED();
+    }
+
     /* Do standard DR thread initialization.  Mirrors code in
      * create_clone_record and new_thread_setup, except we're not putting a
      * clone record on the dstack.
@@ -9529,14 +9861,332 @@ os_thread_take_over_suspended_native(dcontext_t *dcontext)
     /* Thread is sitting in suspend signal loop so we just set a flag
      * for when it resumes:
      */
-    /* XXX: there's no event for a client to trigger this on so not yet
-     * tested.  i#721 may help.
-     */
-    ASSERT_NOT_TESTED();
+    ostd->go_native = false;
     ostd->retakeover = true;
     return true;
 }
 
+/* Sends a thread that is suspended in the code cache back to native execution
+ * once it is resumed, without tearing down any of its state so that it can
+ * later be taken over again via os_thread_take_over_suspended_native().
+ * Caller must hold thread_initexit_lock.
+ */
+bool
+os_thread_send_suspended_native(dcontext_t *dcontext)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) dcontext->os_field;
+    thread_record_t *tr = dcontext->thread_record;
+    priv_mcontext_t mc;
+    if (is_thread_currently_native(tr) || ostd->suspended_sigcxt == NULL)
+        return false;
+    /* We only handle a thread interrupted in the cache, where we can restore
+     * the app state exactly.  A thread inside DR itself or at a syscall
+     * (where the kernel may still clobber registers on resumption) is left
+     * alone and the caller can try again later.
+     */
+    if (dcontext->whereami != WHERE_FCACHE || get_at_syscall(dcontext) ||
+        is_building_trace(dcontext))
+        return false;
+    /* Signals we have queued would not be delivered until the thread came
+     * back under DR, so we keep it until they have been.
+     */
+    if (signal_thread_has_pending(dcontext))
+        return false;
+    if (!thread_get_mcontext(tr, &mc))
+        return false;
+    if (!translate_mcontext(tr, &mc, true/*restore memory*/, NULL) ||
+        mc.pc == NULL || is_dynamo_address(mc.pc) || in_fcache(mc.pc))
+        return false;
+    LOG(THREAD_GET, LOG_THREADS, 1,
+        "thread %d going native at "PFX"\n", tr->id, mc.pc);
+    if (!thread_set_mcontext(tr, &mc))
+        return false;
+    /* The thread completes the transition itself once it wakes up, as
+     * dynamo_thread_not_under_dynamo() must be called by the owner.
+     */
+    ostd->go_native = true;
+    return true;
+}
+
+/* A region of /proc/self/maps, or of all_memory_areas, staged by
+ * os_rescan_after_native() so that neither is walked while we update the other.
+ */
+typedef struct _native_region_t {
+    app_pc start;
+    app_pc end;
+    uint prot;
+    uint64 inode;
+    char *path;   /* only for a region that could be the start of a module */
+    bool skip;    /* our own or the vsyscall region: left as is */
+    bool unprotected; /* we had made it read-only but the app made it writable */
+} native_region_t;
+
+#define NATIVE_REGIONS_INIT_SIZE 64
+
+static native_region_t *
+native_region_append(native_region_t *regions, uint *num, uint *capacity)
+{
+    if (*num == *capacity) {
+        regions = (native_region_t *)
+            global_heap_realloc(regions, *capacity, *capacity*2,
+                                sizeof(native_region_t) HEAPACCT(ACCT_MEM_MGT));
+        *capacity *= 2;
+    }
+    memset(&regions[*num], 0, sizeof(regions[*num]));
+    (*num)++;
+    return regions;
+}
+
+/* Returns whether the sorted regions cover all of [start, end) with no gap and
+ * with protection prot throughout.
+ */
+static bool
+native_regions_match(native_region_t *regions, uint num, app_pc start, app_pc end,
+                     uint prot)
+{
+    uint lo = 0, hi = num;
+    app_pc pc = start;
+    while (lo < hi) {
+        uint mid = (lo + hi) / 2;
+        if (regions[mid].end <= start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < num && pc < end; lo++) {
+        if (regions[lo].start > pc || regions[lo].prot != prot ||
+            regions[lo].unprotected)
+            return false;
+        pc = regions[lo].end;
+    }
+    return pc >= end;
+}
+
+/* Returns whether all_memory_areas covers all of [start, end) with prot.
+ * Caller must hold the all_memory_areas lock.
+ */
+static bool
+all_memory_areas_match(app_pc start, app_pc end, uint prot)
+{
+    app_pc pc = start, area_start, area_end;
+    allmem_info_t *info;
+    while (pc < end) {
+        if (!vmvector_lookup_data(all_memory_areas, pc, &area_start, &area_end,
+                                  (void **) &info) ||
+            info->prot != prot)
+            return false;
+        pc = area_end;
+    }
+    return true;
+}
+
+/* Brings our view of the process up to date after app threads have run
+ * natively following os_thread_send_suspended_native(), during which their
+ * mmap, munmap, mprotect, and clone system calls went straight to the kernel.
+ * As at attach, we re-walk /proc/self/maps: modules that went away are
+ * unloaded, fragments from code that was unmapped or changed protection are
+ * flushed, and new mappings and modules are processed as though just mapped.
+ * Threads that exited while native are cleaned up and threads created while
+ * native are taken over.  Must be called by a thread that is not itself
+ * native, with no other thread suspended: any changes made after the walk and
+ * before the threads are taken back over are missed.
+ */
+void
+os_rescan_after_native(dcontext_t *dcontext)
+{
+    maps_iter_t iter;
+    module_iterator_t *mi;
+    vmvector_iterator_t vmvi;
+    native_region_t *maps, *gone;
+    uint num_maps = 0, maps_cap = NATIVE_REGIONS_INIT_SIZE;
+    uint num_gone = 0, gone_cap = NATIVE_REGIONS_INIT_SIZE;
+    thread_record_t **threads;
+    thread_id_t *tids;
+    int num_threads;
+    uint num_tids, i, j;
+
+    /* Stage the current maps */
+    maps = (native_region_t *)
+        global_heap_alloc(maps_cap*sizeof(native_region_t) HEAPACCT(ACCT_MEM_MGT));
+    maps_iterator_start(&iter, true/*may alloc*/);
+    while (maps_iterator_next(&iter)) {
+        native_region_t *r;
+        maps = native_region_append(maps, &num_maps, &maps_cap);
+        r = &maps[num_maps-1];
+        r->start = iter.vm_start;
+        r->end = iter.vm_end;
+        r->prot = iter.prot;
+        r->inode = iter.inode;
+        r->skip = (dynamo_vm_area_overlap(iter.vm_start, iter.vm_end) &&
+                   !is_in_dynamo_dll(iter.vm_start)
+                   IF_CLIENT_INTERFACE(&& !is_in_client_lib(iter.vm_start))) ||
+            strncmp(iter.comment, VSYSCALL_PAGE_MAPS_NAME,
+                    strlen(VSYSCALL_PAGE_MAPS_NAME)) == 0
+            IF_X64(|| strncmp(iter.comment, VSYSCALL_REGION_MAPS_NAME,
+                              strlen(VSYSCALL_REGION_MAPS_NAME)) == 0);
+        if (!r->skip && iter.inode != 0 && iter.offset == 0)
+            r->path = dr_strdup(iter.comment HEAPACCT(ACCT_MEM_MGT));
+    }
+    maps_iterator_stop(&iter);
+    /* all_memory_areas holds the app's view of code we made read-only to
+     * catch writes, so we compare against that.  If the app itself made such
+     * code writable our write protection is gone and it must be flushed.
+     */
+    for (i = 0; i < num_maps; i++) {
+        if (!maps[i].skip && TEST(MEMPROT_EXEC, maps[i].prot) &&
+            is_executable_area_writable(maps[i].start)) {
+            if (TEST(MEMPROT_WRITE, maps[i].prot))
+                maps[i].unprotected = true;
+            else
+                maps[i].prot |= MEMPROT_WRITE;
+        }
+    }
+
+    /* Unload modules whose first segment is no longer the same file */
+    gone = (native_region_t *)
+        global_heap_alloc(gone_cap*sizeof(native_region_t) HEAPACCT(ACCT_MEM_MGT));
+    mi = module_iterator_start();
+    while (module_iterator_hasnext(mi)) {
+        module_area_t *ma = module_iterator_next(mi);
+        bool found = false;
+        for (i = 0; i < num_maps && maps[i].start <= ma->start; i++) {
+            if (maps[i].start == ma->start && maps[i].inode == ma->names.inode)
+                found = true;
+        }
+        if (!found) {
+            gone = native_region_append(gone, &num_gone, &gone_cap);
+            gone[num_gone-1].start = ma->start;
+            gone[num_gone-1].end = ma->end;
+        }
+    }
+    module_iterator_stop(mi);
+    for (i = 0; i < num_gone; i++) {
+        LOG(THREAD, LOG_VMAREAS, 1, "module "PFX"-"PFX" unloaded while native\n",
+            gone[i].start, gone[i].end);
+        module_list_remove(gone[i].start, gone[i].end - gone[i].start);
+        app_memory_deallocation(dcontext, gone[i].start, gone[i].end - gone[i].start,
+                                false /* don't own thread_initexit_lock */,
+                                true /* image */);
+    }
+
+    /* Drop all_memory_areas entries that no longer match the maps, flushing
+     * any code from them.  They are re-added from the maps below.
+     */
+    num_gone = 0;
+    /* We cannot allocate while iterating, as heap growth updates
+     * all_memory_areas, so we size gone first.  The iterator holds the read
+     * lock, so we do not use all_memory_areas_lock() here.
+     */
+    vmvector_iterator_start(all_memory_areas, &vmvi);
+    for (i = 0; vmvector_iterator_hasnext(&vmvi); i++)
+        vmvector_iterator_next(&vmvi, NULL, NULL);
+    vmvector_iterator_stop(&vmvi);
+    if (i > gone_cap) {
+        gone = (native_region_t *)
+            global_heap_realloc(gone, gone_cap, i, sizeof(native_region_t)
+                                HEAPACCT(ACCT_MEM_MGT));
+        gone_cap = i;
+    }
+    vmvector_iterator_start(all_memory_areas, &vmvi);
+    while (vmvector_iterator_hasnext(&vmvi) && num_gone < gone_cap) {
+        app_pc start, end;
+        allmem_info_t *info = (allmem_info_t *)
+            vmvector_iterator_next(&vmvi, &start, &end);
+        if (native_regions_match(maps, num_maps, start, end, info->prot))
+            continue;
+        gone[num_gone].start = start;
+        gone[num_gone].end = end;
+        gone[num_gone].prot = info->prot;
+        num_gone++;
+    }
+    vmvector_iterator_stop(&vmvi);
+    for (i = 0; i < num_gone; i++) {
+        if (dynamo_vm_area_overlap(gone[i].start, gone[i].end))
+            continue;
+        LOG(THREAD, LOG_VMAREAS, 2, "region "PFX"-"PFX" changed while native\n",
+            gone[i].start, gone[i].end);
+        if (TEST(MEMPROT_EXEC, gone[i].prot)) {
+            app_memory_deallocation(dcontext, gone[i].start,
+                                    gone[i].end - gone[i].start,
+                                    false /* don't own thread_initexit_lock */,
+                                    false /* FIXME: could be an image */);
+        }
+        all_memory_areas_lock();
+        remove_from_all_memory_areas(gone[i].start, gone[i].end);
+        all_memory_areas_unlock();
+    }
+    global_heap_free(gone, gone_cap*sizeof(native_region_t) HEAPACCT(ACCT_MEM_MGT));
+
+    /* Process new or changed mappings as process_mmap() would have */
+    for (i = 0; i < num_maps; i++) {
+        native_region_t *r = &maps[i];
+        size_t size = r->end - r->start;
+        bool image, new_module = false, match;
+        if (r->skip)
+            continue;
+        all_memory_areas_lock();
+        match = !r->unprotected && all_memory_areas_match(r->start, r->end, r->prot);
+        all_memory_areas_unlock();
+        if (match)
+            continue;
+        if (r->path != NULL && TEST(MEMPROT_READ, r->prot) &&
+            !module_overlaps(r->start, size) && is_elf_so_header(r->start, size)) {
+            app_pc mod_base, mod_end;
+            size_t image_size = size;
+            if (module_walk_program_headers(r->start, size, false,
+                                            &mod_base, &mod_end, NULL, NULL))
+                image_size = mod_end - mod_base;
+            LOG(THREAD, LOG_VMAREAS, 1, "module %s "PFX"-"PFX" loaded while native\n",
+                r->path, r->start, r->start + image_size);
+            module_list_add(r->start, image_size, false, r->path, r->inode);
+            new_module = true;
+        }
+        os_get_module_info_lock();
+        image = module_overlaps(r->start, size);
+        os_get_module_info_unlock();
+        all_memory_areas_lock();
+        update_all_memory_areas(r->start, r->end, r->prot,
+                                image ? DR_MEMTYPE_IMAGE : DR_MEMTYPE_DATA);
+        all_memory_areas_unlock();
+        app_memory_allocation(dcontext, r->start, size, r->prot, image
+                              _IF_DEBUG("native mapping"));
+#ifdef CLIENT_INTERFACE
+        if (new_module)
+            instrument_module_load_trigger(r->start);
+#endif
+    }
+    for (i = 0; i < num_maps; i++) {
+        if (maps[i].path != NULL)
+            dr_strfree(maps[i].path HEAPACCT(ACCT_MEM_MGT));
+    }
+    global_heap_free(maps, maps_cap*sizeof(native_region_t) HEAPACCT(ACCT_MEM_MGT));
+
+    /* Clean up threads that exited while native.  Their exit was never seen,
+     * so their records would otherwise linger and fail every suspension.
+     */
+    tids = os_list_threads(dcontext, &num_tids);
+    mutex_lock(&thread_initexit_lock);
+    get_list_of_threads(&threads, &num_threads);
+    for (j = 0; j < (uint) num_threads; j++) {
+        if (!is_thread_currently_native(threads[j]))
+            continue;
+        for (i = 0; i < num_tids && tids[i] != threads[j]->id; i++)
+            ; /* nothing */
+        if (i == num_tids) {
+            LOG(THREAD, LOG_THREADS, 1, "thread %d exited while native\n",
+                threads[j]->id);
+            dynamo_other_thread_exit(threads[j]);
+        }
+    }
+    mutex_unlock(&thread_initexit_lock);
+    global_heap_free(threads, num_threads*sizeof(thread_record_t*)
+                     HEAPACCT(ACCT_THREAD_MGT));
+    HEAP_ARRAY_FREE(dcontext, tids, thread_id_t, num_tids, ACCT_THREAD_MGT, PROTECTED);
+
+    /* Take over threads created while native, as attach does */
+    os_take_over_all_unknown_threads(dcontext);
+}
+
 /***************************************************************************/
 
 uint
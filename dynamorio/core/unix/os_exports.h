@@ -92,6 +92,10 @@ thread_id_t get_tls_thread_id(void);
 thread_id_t get_sys_thread_id(void);
 bool is_thread_terminated(dcontext_t *dcontext);
 void os_wait_thread_terminated(dcontext_t *dcontext);
+/* batched suspension for synch_with_all_threads */
+bool thread_suspend_request(thread_record_t *tr, volatile int *acks);
+bool thread_suspend_arrived(thread_record_t *tr);
+void thread_suspend_wait_acks(volatile int *acks, int seen, int timeout_ms);
 void os_tls_pre_init(int gdt_index);
 /* XXX: reg_id_t is not defined here, use unsigned char instead */
 ushort os_get_app_seg_base_offset(unsigned char seg);
@@ -110,6 +114,11 @@ ssize_t read_syscall(int fd, void *buf, size_t nbytes);
 ssize_t write_syscall(int fd, const void *buf, size_t nbytes);
 void exit_process_syscall(long status);
 void exit_thread_syscall(long status);
+process_id_t os_fork_snapshot(void);
+bool os_wait_snapshot(process_id_t pid, bool block, OUT int *status);
+#ifdef LINUX
+file_t os_perf_event_open(void *attr, file_t group_fd);
+#endif
 process_id_t get_parent_id(void);
 
 /* i#238/PR 499179: our __errno_location isn't affecting libc so until
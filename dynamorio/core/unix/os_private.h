@@ -108,6 +108,10 @@ typedef struct _os_thread_data_t {
     volatile int wakeup;
     volatile int resumed;
     struct sigcontext *suspended_sigcxt;
+    /* Set by thread_suspend_request() for batched suspends: incremented
+     * atomically once suspended.  Only read by the signal handler.
+     */
+    volatile int *suspend_acks;
 
     /* PR 297902: for thread termination */
     bool terminate;
@@ -119,6 +123,7 @@ typedef struct _os_thread_data_t {
     volatile int terminated;
 
     volatile bool retakeover; /* for re-attach */
+    volatile bool go_native; /* for dr_send_suspended_thread_native() */
 
     /* PR 450670: for re-entrant suspend signals */
     int processing_signal;
@@ -157,6 +162,9 @@ mmap_syscall_succeeded(byte *retval);
 bool
 os_files_same(const char *path1, const char *path2);
 
+bool
+os_get_file_identity(const char *path, OUT uint64 *id);
+
 extern const reg_id_t syscall_regparms[MAX_SYSCALL_ARGS];
 
 file_t
@@ -192,6 +200,8 @@ void handle_post_sigprocmask(dcontext_t *dcontext, int how, kernel_sigset_t *set
                              kernel_sigset_t *oset, size_t sigsetsize);
 void handle_sigsuspend(dcontext_t *dcontext, kernel_sigset_t *set,
                        size_t sigsetsize);
+bool signal_thread_has_pending(dcontext_t *dcontext);
+void signal_reinstate_handlers(dcontext_t *dcontext);
 
 ptr_int_t
 handle_pre_signalfd(dcontext_t *dcontext, int fd, kernel_sigset_t *mask,
@@ -59,7 +59,6 @@
 #include "os_private.h"
 #include "../fragment.h"
 #include "../fcache.h"
-#include "../perfctr.h"
 #include "arch.h"
 #include "../monitor.h" /* for trace_abort */
 #include "../link.h" /* for linking interrupted fragment_t */
@@ -519,7 +518,7 @@ typedef struct _thread_itimer_info_t {
 } thread_itimer_info_t;
 
 /* We use all 3: ITIMER_REAL for clients (i#283/PR 368737), ITIMER_VIRTUAL
- * for -prof_pcs, and ITIMER_PROF for PAPI
+ * for -prof_pcs, and ITIMER_PROF is currently unused
  */
 #define NUM_ITIMERS 3
 
@@ -597,6 +596,11 @@ typedef struct _thread_sig_info_t {
     bool in_sigsuspend;
     kernel_sigset_t app_sigblocked_save;
 
+    /* released by os_thread_send_suspended_native(): the kernel holds the
+     * app's signal mask and we deliver straight to the app's handlers
+     */
+    bool native;
+
     /* to inherit in children must not modify until they're scheduled */
     volatile int num_unstarted_children;
     mutex_t child_lock;
@@ -638,6 +642,11 @@ static kernel_sigset_t init_sigmask;
 static bool removed_sig_handler;
 #endif
 
+/* Set once any thread has been released to native execution.  A thread it
+ * then creates inherits its tls, and so its dcontext, until taken over.
+ */
+static bool threads_released_native;
+
 /**** function prototypes ***********************************************/
 
 /* in x86.asm */
@@ -673,6 +682,9 @@ execute_default_from_cache(dcontext_t *dcontext, int sig, sigframe_rt_t *frame,
 static void
 execute_default_from_dispatch(dcontext_t *dcontext, int sig, sigframe_rt_t *frame);
 
+static void
+execute_native_handler(dcontext_t *dcontext, int sig, sigframe_rt_t *our_frame);
+
 static bool
 handle_alarm(dcontext_t *dcontext, int sig, kernel_ucontext_t *ucxt);
 
@@ -1473,13 +1485,7 @@ signal_thread_inherit(dcontext_t *dcontext, void *clone_record)
             intercept_signal(dcontext, info, SIGBUS);
             /* PR 212090: the signal we use to suspend threads */
             intercept_signal(dcontext, info, SUSPEND_SIGNAL);
-#ifdef PAPI
-            /* use SIGPROF for updating gui so it can be distinguished from SIGVTALRM */
-            intercept_signal(dcontext, info, SIGPROF);
-#endif
-            /* vtalarm only used with pc profiling.  it interferes w/ PAPI
-             * so arm this signal only if necessary
-             */
+            /* vtalarm is only used with pc profiling so arm it only if necessary */
             if (INTERNAL_OPTION(profile_pcs)) {
                 intercept_signal(dcontext, info, SIGVTALRM);
             }
@@ -1756,12 +1762,6 @@ signal_thread_exit(dcontext_t *dcontext, bool other_thread)
 # endif
     HEAP_TYPE_FREE(dcontext, info, thread_sig_info_t, ACCT_OTHER, PROTECTED);
 #endif
-#ifdef PAPI
-    /* use SIGPROF for updating gui so it can be distinguished from SIGVTALRM */
-    set_itimer_callback(dcontext, ITIMER_PROF, 500,
-                        (void (*func)(dcontext_t *, priv_mcontext_t *))
-                        perfctr_update_gui());
-#endif
 }
 
 static void
@@ -2138,6 +2138,58 @@ check_signals_pending(dcontext_t *dcontext, thread_sig_info_t *info)
     }
 }
 
+/* Returns whether dcontext has any signal queued by us that has not yet
+ * been delivered to the app, blocked or not.
+ */
+bool
+signal_thread_has_pending(dcontext_t *dcontext)
+{
+    thread_sig_info_t *info = (thread_sig_info_t *) dcontext->signal_field;
+    int i;
+    for (i = 1; i <= MAX_SIGNUM; i++) {
+        if (info->sigpending[i] != NULL)
+            return true;
+    }
+    return false;
+}
+
+/* Called on re-takeover of a thread that ran natively after
+ * os_thread_send_suspended_native(): the app's sigaction calls went straight
+ * to the kernel meanwhile, so we record whatever it installed as its action
+ * and put master_signal_handler back in place.
+ */
+void
+signal_reinstate_handlers(dcontext_t *dcontext)
+{
+    thread_sig_info_t *info = (thread_sig_info_t *) dcontext->signal_field;
+    kernel_sigaction_t cur;
+    int sig;
+    for (sig = 1; sig <= MAX_SIGNUM; sig++) {
+        if (sigaction_syscall(sig, NULL, &cur) != 0 ||
+            cur.handler == (handler_t) master_signal_handler)
+            continue;
+        if (cur.handler == (handler_t) SIG_DFL) {
+            if (!info->we_intercept[sig])
+                continue;
+            /* intercept_signal() does not record SIG_DFL */
+            if (info->shared_app_sigaction)
+                mutex_lock(info->shared_lock);
+            if (info->app_sigaction[sig] != NULL) {
+                handler_free(dcontext, info->app_sigaction[sig],
+                             sizeof(kernel_sigaction_t));
+                info->app_sigaction[sig] = NULL;
+            }
+            info->restorer_valid[sig] = -1;
+            if (info->shared_app_sigaction)
+                mutex_unlock(info->shared_lock);
+        } else if (cur.handler == (handler_t) SIG_IGN && !info->we_intercept[sig])
+            continue;
+        LOG(THREAD, LOG_ASYNCH, 2,
+            "app replaced our handler for signal %d while native\n", sig);
+        intercept_signal(dcontext, info, sig);
+    }
+}
+
 /* Returns whether to execute the syscall */
 bool
 handle_sigprocmask(dcontext_t *dcontext, int how, kernel_sigset_t *app_set,
@@ -3842,6 +3894,14 @@ record_pending_signal(dcontext_t *dcontext, int sig, kernel_ucontext_t *ucxt,
     fragment_t *f = NULL;
     fragment_t wrapper;
 
+    if (info->native) {
+        /* A thread released to native execution has no cache state to
+         * preserve, so there is nothing to delay: the app's handler runs now.
+         */
+        execute_native_handler(dcontext, sig, frame);
+        return;
+    }
+
     /* We no longer block SUSPEND_SIGNAL (i#184/PR 450670) or SIGSEGV (i#193/PR 287309).
      * But we can have re-entrancy issues in this routine if the app uses the same
      * SUSPEND_SIGNAL, or the nested SIGSEGV needs to be sent to the app.  The
@@ -4514,6 +4574,13 @@ master_signal_handler_C(byte *xsp)
     bool local;
     dcontext_t *dcontext = get_thread_private_dcontext();
 
+    /* A thread created natively is not ours yet, whatever its tls says: this
+     * sends our SUSPEND_SIGNAL to sig_take_over() below.
+     */
+    if (threads_released_native && dcontext != NULL && dcontext != GLOBAL_DCONTEXT &&
+        dcontext->owning_thread != get_sys_thread_id())
+        dcontext = NULL;
+
     /* i#350: To support safe_read or TRY_EXCEPT without a dcontext, use the
      * global dcontext
      * when handling safe_read faults.  This lets us pass the check for a
@@ -4807,6 +4874,25 @@ master_signal_handler_C(byte *xsp)
         /* if get here, pass the signal to the app */
 
         ASSERT(pc != 0); /* shouldn't get here */
+        if (((thread_sig_info_t *)dcontext->signal_field)->native) {
+            if (sig == SIGSEGV && is_write && was_executable_area_writable(target)) {
+                /* A native write to code we made read-only: we give the page
+                 * back its write permission and let the write re-execute.
+                 * os_rescan_after_native() sees the page is writable again
+                 * and flushes its code before the next window.
+                 */
+                uint prot;
+                DEBUG_DECLARE(bool ok =)
+                    get_memory_info(target, NULL, NULL, &prot);
+                ASSERT(ok && TEST(MEMPROT_WRITE, prot));
+                LOG(THREAD, LOG_ASYNCH, 2,
+                    "native write to read-only code "PFX" at pc "PFX"\n", target, pc);
+                os_set_protection((byte *) PAGE_START(target), PAGE_SIZE, prot);
+                break;
+            }
+            execute_native_handler(dcontext, sig, frame);
+            break;
+        }
         if (sig == SIGSEGV && !syscall_signal/*only for in-cache signals*/) {
             /* special case: we expect a seg fault for executable regions
              * that were writable and marked read-only by us.
@@ -4926,6 +5012,7 @@ execute_handler_from_cache(dcontext_t *dcontext, int sig, sigframe_rt_t *our_fra
 #endif
 
     LOG(THREAD, LOG_ASYNCH, 2, "execute_handler_from_cache for signal %d\n", sig);
+    EVTRACE_INSTANT(signal, sig);
     RSTATS_INC(num_signals);
 
     /* now that we know it's not a client-involved fault, dump as app fault */
@@ -5021,6 +5108,7 @@ execute_handler_from_dispatch(dcontext_t *dcontext, int sig)
 #endif
 
     LOG(THREAD, LOG_ASYNCH, 2, "execute_handler_from_dispatch for signal %d\n", sig);
+    EVTRACE_INSTANT(signal, sig);
     RSTATS_INC(num_signals);
 
     /* modify the rtframe before copying to stack so we can pass final
@@ -5409,6 +5497,64 @@ execute_default_from_dispatch(dcontext_t *dcontext, int sig, sigframe_rt_t *fram
     execute_default_action(dcontext, sig, frame, NULL, true);
 }
 
+/* Delivers sig to a thread released by os_thread_send_suspended_native() as
+ * the kernel would have without our handler in place: the interrupted context
+ * is the app's own, so there is nothing to translate, and the kernel holds
+ * the app's signal mask, so we block the handler's signals there.
+ */
+static void
+execute_native_handler(dcontext_t *dcontext, int sig, sigframe_rt_t *our_frame)
+{
+    thread_sig_info_t *info = (thread_sig_info_t *) dcontext->signal_field;
+    struct sigcontext *sc = get_sigcontext_from_rt_frame(our_frame);
+    kernel_sigaction_t *act = info->app_sigaction[sig];
+    byte *xsp;
+    int i;
+
+    LOG(THREAD, LOG_ASYNCH, 2, "execute_native_handler for signal %d at "PFX"\n",
+        sig, sc->SC_XIP);
+    if (act == NULL || act->handler == (handler_t)SIG_DFL) {
+        LOG(THREAD, LOG_ASYNCH, 3, "\taction is SIG_DFL\n");
+        /* a fault re-executes natively to raise it again */
+        if (default_action[sig] != DEFAULT_IGNORE)
+            execute_default_action(dcontext, sig, our_frame, sc, false);
+        return;
+    }
+    if (act->handler == (handler_t)SIG_IGN)
+        return;
+    RSTATS_INC(num_signals);
+
+    xsp = get_sigstack_frame_ptr(dcontext, sig, our_frame);
+    copy_frame_to_stack(dcontext, sig, our_frame, (void *)xsp);
+    LOG(THREAD, LOG_ASYNCH, 3, "\tcopied frame from "PFX" to "PFX"\n", our_frame, xsp);
+
+    /* Our sigreturn goes to the handler, with its signals blocked.  The
+     * app's frame restores the interrupted mask when the handler returns.
+     */
+    for (i = 1; i <= MAX_SIGNUM; i++) {
+        if (kernel_sigismember(&act->mask, i))
+            kernel_sigaddset(&our_frame->uc.uc_sigmask, i);
+    }
+    if ((act->flags & SA_NOMASK) == 0)
+        kernel_sigaddset(&our_frame->uc.uc_sigmask, sig);
+    /* we still need to be able to take the thread back over */
+    kernel_sigdelset(&our_frame->uc.uc_sigmask, SUSPEND_SIGNAL);
+    sc->SC_XIP = (ptr_uint_t) act->handler;
+    sc->SC_XSP = (ptr_uint_t) xsp;
+#ifdef X64
+    /* Set up args to handler: int sig, siginfo_t *siginfo, kernel_ucontext_t *ucxt */
+    sc->SC_XDI = sig;
+    sc->SC_XSI = (reg_t) &((sigframe_rt_t *)xsp)->info;
+    sc->SC_XDX = (reg_t) &((sigframe_rt_t *)xsp)->uc;
+#endif
+    /* the kernel clears DF for a handler */
+    sc->SC_XFLAGS &= ~EFLAGS_DF;
+    if ((act->flags & SA_ONESHOT) != 0)
+        act->handler = (handler_t) SIG_DFL;
+    LOG(THREAD, LOG_ASYNCH, 3, "\tnative handler "PFX", xsp "PFX"\n",
+        sc->SC_XIP, xsp);
+}
+
 void
 receive_pending_signal(dcontext_t *dcontext)
 {
@@ -6384,8 +6530,11 @@ static bool
 handle_suspend_signal(dcontext_t *dcontext, kernel_ucontext_t *ucxt)
 {
     os_thread_data_t *ostd = (os_thread_data_t *) dcontext->os_field;
+    thread_sig_info_t *info = (thread_sig_info_t *) dcontext->signal_field;
     struct sigcontext *sc = (struct sigcontext *) &(ucxt->uc_mcontext);
     kernel_sigset_t prevmask;
+    volatile int *acks;
+    int i;
     ASSERT(ostd != NULL);
 
     if (ostd->terminate) {
@@ -6446,8 +6595,18 @@ handle_suspend_signal(dcontext_t *dcontext, kernel_ucontext_t *ucxt)
      * officially suspended now and is ready for thread_{get,set}_mcontext.
      */
     ASSERT(ostd->suspended == 0);
+    /* Read before we're visibly suspended: a resume and re-suspend request
+     * can set a new one after that.
+     */
+    acks = ostd->suspend_acks;
+    ostd->suspend_acks = NULL;
     ostd->suspended = 1;
     futex_wake_all(&ostd->suspended);
+    if (acks != NULL) {
+        /* Batched suspend from synch_with_all_threads */
+        ATOMIC_INC(int, *acks);
+        futex_wake_all(acks);
+    }
     /* i#96/PR 295561: use futex(2) if available */
     while (ostd->wakeup == 0) {
         /* Waits only if the wakeup flag is not set as 1. Return value
@@ -6474,9 +6633,49 @@ handle_suspend_signal(dcontext_t *dcontext, kernel_ucontext_t *ucxt)
 
     if (ostd->retakeover) {
         ostd->retakeover = false;
+        if (info->native) {
+            /* Take the app's mask back from the kernel, which it was free to
+             * change while native, and emulate it again.
+             */
+            kernel_sigset_t mask = ucxt->uc_sigmask;
+            info->native = false;
+            if (kernel_sigismember(&info->app_sigblocked, SUSPEND_SIGNAL))
+                kernel_sigaddset(&mask, SUSPEND_SIGNAL);
+            set_blocked(dcontext, &mask, true/*absolute*/);
+            for (i = 1; i <= MAX_SIGNUM; i++) {
+                if (EMULATE_SIGMASK(info, i))
+                    kernel_sigdelset(&mask, i);
+            }
+            sigprocmask_syscall(SIG_SETMASK, &mask, NULL, sizeof(mask));
+        }
         sig_take_over(sc);  /* no return */
         ASSERT_NOT_REACHED();
     }
+    if (ostd->go_native) {
+        /* os_thread_send_suspended_native() already translated sc to the app
+         * state: we finish the transition here and return straight to it.
+         * We mirror entering_native() so that a later re-takeover sees
+         * the same state as for native_exec.  The app's emulated mask
+         * goes into the kernel, but never our SUSPEND_SIGNAL.
+         */
+        for (i = 1; i <= MAX_SIGNUM; i++) {
+            if (!EMULATE_SIGMASK(info, i) || i == SUSPEND_SIGNAL)
+                continue;
+            if (kernel_sigismember(&info->app_sigblocked, i))
+                kernel_sigaddset(&ucxt->uc_sigmask, i);
+            else
+                kernel_sigdelset(&ucxt->uc_sigmask, i);
+        }
+        info->native = true;
+        threads_released_native = true;
+        ostd->go_native = false;
+        dcontext->thread_record->under_dynamo_control = false;
+        set_last_exit(dcontext, (linkstub_t *) get_native_exec_linkstub());
+        dcontext->whereami = WHERE_APP;
+        dynamo_thread_not_under_dynamo(dcontext);
+        LOG(THREAD, LOG_ASYNCH, 2, "handle_suspend_signal: now native at "PFX"\n",
+            sc->SC_XIP);
+    }
 
     return false; /* do not pass to app */
 }
@@ -466,6 +466,8 @@ enum {
 #ifdef CALL_PROFILE
     LOCK_RANK(profile_callers_lock), /* < global_alloc_lock */
 #endif
+    LOCK_RANK(evtrace_lock), /* > thread_initexit_lock, < global_alloc_lock */
+    LOCK_RANK(perfctr_lock), /* > thread_initexit_lock, < global_alloc_lock */
     LOCK_RANK(coarse_stub_areas), /* < global_alloc_lock */
     LOCK_RANK(moduledb_lock), /* < global heap allocation */
     LOCK_RANK(pcache_dir_check_lock),
@@ -1664,55 +1666,90 @@ enum {LONGJMP_EXCEPTION = 1};
  * occasionally KSTART(name)/KSWITCH(better_name)/KSTOP(name), and in
  * ignorable cases KSTART(name)/KSTOP_NOT_PROPAGATED(name)
  */
+/* Every kstat path is also an -evtrace event (see evtrace.h).  The event
+ * begins before the timer starts and ends after it stops so that the
+ * recording cost is not counted against the path.
+ */
 /* starts a timer */
-# define KSTART(name) KSTAT_THREAD(name, kstat_start_var(ks, pv))
+# define KSTART(name) do {                                      \
+    EVTRACE_BEGIN(name);                                        \
+    KSTAT_THREAD(name, kstat_start_var(ks, pv));                \
+} while (0)
 
 /* makes sure we're matching start/stop */
-# define KSTOP(name) KSTAT_THREAD(name, kstat_stop_matching_var(ks, pv))
+# define KSTOP(name) do {                                       \
+    KSTAT_THREAD(name, kstat_stop_matching_var(ks, pv));        \
+    EVTRACE_END();                                              \
+} while (0)
 
 /* modifies the variable against which this path should be counted */
-# define KSWITCH(name) KSTAT_THREAD(name, kstat_switch_var(ks, pv))
+# define KSWITCH(name) do {                                     \
+    KSTAT_THREAD(name, kstat_switch_var(ks, pv));               \
+    EVTRACE_SWITCH(name);                                       \
+} while (0)
 
 /* allow mismatched start/stop - for use with KSWITCH */
-# define KSTOP_NOT_MATCHING(name)                               \
+# define KSTOP_NOT_MATCHING(name) do {                          \
     KSTAT_THREAD_NO_PV_START(get_thread_private_dcontext())     \
         ASSERT(ks->depth > 2 && "stop_not_matching not allowed to clear kstack"); \
         kstat_stop_not_matching_var(ks, ignored);               \
-    KSTAT_THREAD_NO_PV_END()
+    KSTAT_THREAD_NO_PV_END();                                   \
+    EVTRACE_END();                                              \
+} while (0)
 
 /* rewind the callstack exiting multiple entries - for exception cases */
-# define KSTOP_REWIND(name) KSTAT_THREAD(name, kstat_stop_rewind_var(ks, pv))
-# define KSTOP_REWIND_UNTIL(name) KSTAT_THREAD(name, kstat_stop_longjmp_var(ks, pv))
+# define KSTOP_REWIND(name) do {                                \
+    KSTAT_THREAD(name, kstat_stop_rewind_var(ks, pv));          \
+    EVTRACE_REWIND(name);                                       \
+} while (0)
+# define KSTOP_REWIND_UNTIL(name) do {                          \
+    KSTAT_THREAD(name, kstat_stop_longjmp_var(ks, pv));         \
+    EVTRACE_REWIND_UNTIL(name);                                 \
+} while (0)
 
 /* simultanously switch to a path and stop timer */
-# define KSWITCH_STOP(name) KSTAT_THREAD(name, {        \
-    kstat_switch_var(ks, pv);                           \
-    kstat_stop_not_matching_var(ks, ignored);           \
-})
+# define KSWITCH_STOP(name) do {                                \
+    KSTAT_THREAD(name, {                                        \
+        kstat_switch_var(ks, pv);                               \
+        kstat_stop_not_matching_var(ks, ignored);               \
+    });                                                         \
+    EVTRACE_SWITCH(name);                                       \
+    EVTRACE_END();                                              \
+} while (0)
 
 /* simultanously switch to a path and stop timer w/o propagating to parent */
-# define KSWITCH_STOP_NOT_PROPAGATED(name) KSTAT_THREAD(name, { \
-    timestamp_t ignore_cum;                                       \
-    kstat_switch_var(ks, pv);                                   \
-    kstat_stop_not_propagated_var(ks, ignored, &ignore_cum);    \
-})
+# define KSWITCH_STOP_NOT_PROPAGATED(name) do {                 \
+    KSTAT_THREAD(name, {                                        \
+        timestamp_t ignore_cum;                                 \
+        kstat_switch_var(ks, pv);                               \
+        kstat_stop_not_propagated_var(ks, ignored, &ignore_cum); \
+    });                                                         \
+    EVTRACE_SWITCH(name);                                       \
+    EVTRACE_END();                                              \
+} while (0)
 
 /* do not propagate subpath time to parent */
-# define KSTOP_NOT_MATCHING_NOT_PROPAGATED(name) KSTAT_THREAD(name,  { \
-    timestamp_t ignore_cum;                                              \
-    ASSERT(ks->depth > 2 && "stop_not_matching_np not allowed to clear kstack"); \
-    kstat_stop_not_propagated_var(ks, pv, &ignore_cum);                \
-})
+# define KSTOP_NOT_MATCHING_NOT_PROPAGATED(name) do {           \
+    KSTAT_THREAD(name,  {                                       \
+        timestamp_t ignore_cum;                                 \
+        ASSERT(ks->depth > 2 && "stop_not_matching_np not allowed to clear kstack"); \
+        kstat_stop_not_propagated_var(ks, pv, &ignore_cum);     \
+    });                                                         \
+    EVTRACE_END();                                              \
+} while (0)
 
 /* do not propagate subpath time to parent */
-# define KSTOP_NOT_PROPAGATED(name) KSTAT_THREAD(name,  {       \
-    timestamp_t ignore_cum;                                       \
-    DODEBUG({if (ks->node[ks->depth - 1].var != pv)             \
-        kstats_dump_stack(cur_dcontext);});                     \
-    ASSERT(ks->node[ks->depth - 1].var == pv                    \
-          && "stop not matching TOS");                          \
-    kstat_stop_not_propagated_var(ks, pv, &ignore_cum);         \
-})
+# define KSTOP_NOT_PROPAGATED(name) do {                        \
+    KSTAT_THREAD(name,  {                                       \
+        timestamp_t ignore_cum;                                 \
+        DODEBUG({if (ks->node[ks->depth - 1].var != pv)         \
+            kstats_dump_stack(cur_dcontext);});                 \
+        ASSERT(ks->node[ks->depth - 1].var == pv                \
+               && "stop not matching TOS");                     \
+        kstat_stop_not_propagated_var(ks, pv, &ignore_cum);     \
+    });                                                         \
+    EVTRACE_END();                                              \
+} while (0)
 
 
 /* in some cases we do need to pass a dcontext for another thread */
@@ -1720,32 +1757,42 @@ enum {LONGJMP_EXCEPTION = 1};
  * to this version of the macro, however we should then use this everywhere
  * to have comparable overheads
  */
-# define KSTART_DC(dc, name)                                    \
-        KSTAT_OTHER_THREAD(dc, name, kstat_start_var(ks, pv))
-# define KSTOP_DC(dc, name)                                     \
-        KSTAT_OTHER_THREAD(dc, name, kstat_stop_matching_var(ks, pv))
-# define KSTOP_NOT_MATCHING_DC(dc, name)                        \
+# define KSTART_DC(dc, name) do {                               \
+    EVTRACE_BEGIN_DC(dc, name);                                 \
+    KSTAT_OTHER_THREAD(dc, name, kstat_start_var(ks, pv));      \
+} while (0)
+# define KSTOP_DC(dc, name) do {                                \
+    KSTAT_OTHER_THREAD(dc, name, kstat_stop_matching_var(ks, pv)); \
+    EVTRACE_END_DC(dc);                                         \
+} while (0)
+# define KSTOP_NOT_MATCHING_DC(dc, name) do {                   \
     KSTAT_THREAD_NO_PV_START(dc)                                \
         kstat_stop_not_matching_var(ks, ignored);               \
-    KSTAT_THREAD_NO_PV_END()
-# define KSTOP_REWIND_DC(dc, name) KSTAT_OTHER_THREAD(dc, name, kstat_stop_rewind_var(ks, pv))
+    KSTAT_THREAD_NO_PV_END();                                   \
+    EVTRACE_END_DC(dc);                                         \
+} while (0)
+# define KSTOP_REWIND_DC(dc, name) do {                         \
+    KSTAT_OTHER_THREAD(dc, name, kstat_stop_rewind_var(ks, pv)); \
+    EVTRACE_REWIND_DC(dc, name);                                \
+} while (0)
 #else  /* !KSTATS */
 # define DOKSTATS(statement)    /* nothing */
-# define KSTART(name)           /* nothing */
-# define KSWITCH(name)          /* nothing */
-# define KSWITCH_STOP(name)     /* nothing */
-# define KSWITCH_STOP_NOT_PROPAGATED(name) /* nothing */
-# define KSTOP_NOT_MATCHING_NOT_PROPAGATED(name) /* nothing */
-# define KSTOP_NOT_PROPAGATED(name) /* nothing */
-# define KSTOP_NOT_MATCHING(name)   /* nothing */
-# define KSTOP(name)            /* nothing */
-# define KSTOP_REWIND(name)     /* nothing */
-# define KSTOP_REWIND_UNTIL(name) /* nothing */
-
-# define KSTART_DC(dc, name)    /* nothing */
-# define KSTOP_DC(dc, name)     /* nothing */
-# define KSTOP_NOT_MATCHING_DC(dc, name) /* nothing */
-# define KSTOP_REWIND_DC(dc, name) /* nothing */
+/* without kstats the paths are still -evtrace events */
+# define KSTART(name)           EVTRACE_BEGIN(name)
+# define KSWITCH(name)          EVTRACE_SWITCH(name)
+# define KSWITCH_STOP(name)     do { EVTRACE_SWITCH(name); EVTRACE_END(); } while (0)
+# define KSWITCH_STOP_NOT_PROPAGATED(name) KSWITCH_STOP(name)
+# define KSTOP_NOT_MATCHING_NOT_PROPAGATED(name) EVTRACE_END()
+# define KSTOP_NOT_PROPAGATED(name) EVTRACE_END()
+# define KSTOP_NOT_MATCHING(name)   EVTRACE_END()
+# define KSTOP(name)            EVTRACE_END()
+# define KSTOP_REWIND(name)     EVTRACE_REWIND(name)
+# define KSTOP_REWIND_UNTIL(name) EVTRACE_REWIND_UNTIL(name)
+
+# define KSTART_DC(dc, name)    EVTRACE_BEGIN_DC(dc, name)
+# define KSTOP_DC(dc, name)     EVTRACE_END_DC(dc)
+# define KSTOP_NOT_MATCHING_DC(dc, name) EVTRACE_END_DC(dc)
+# define KSTOP_REWIND_DC(dc, name) EVTRACE_REWIND_DC(dc, name)
 #endif /* KSTATS */
 
 #ifdef INTERNAL
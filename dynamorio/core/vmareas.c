@@ -1874,6 +1874,185 @@ vmvector_add_replace(vm_area_vector_t *v, app_pc start, app_pc end, void *data)
     return old_data;
 }
 
+/* In-place heapsort of regions by start: we have no qsort in core. */
+static void
+vmvector_region_sift_down(vmvector_region_t *regions, uint root, uint num)
+{
+    vmvector_region_t tmp;
+    uint child;
+    while ((child = 2 * root + 1) < num) {
+        if (child + 1 < num && regions[child].start < regions[child + 1].start)
+            child++;
+        if (regions[root].start >= regions[child].start)
+            return;
+        tmp = regions[root];
+        regions[root] = regions[child];
+        regions[child] = tmp;
+        root = child;
+    }
+}
+
+static void
+vmvector_region_sort(vmvector_region_t *regions, uint num)
+{
+    vmvector_region_t tmp;
+    uint i;
+    /* regions from /proc/self/maps and similar sources are usually already
+     * in order
+     */
+    for (i = 1; i < num && regions[i - 1].start <= regions[i].start; i++)
+        ; /* nothing */
+    if (i >= num)
+        return;
+    for (i = num / 2; i > 0; i--)
+        vmvector_region_sift_down(regions, i - 1, num);
+    for (i = num - 1; i > 0; i--) {
+        tmp = regions[0];
+        regions[0] = regions[i];
+        regions[i] = tmp;
+        vmvector_region_sift_down(regions, 0, i);
+    }
+}
+
+/* Returns whether an area ending at prev_end with payload prev_data should
+ * absorb the adjacent region new_start with payload new_data, per the
+ * same rules add_vm_area uses for vmvector areas (all flags 0).
+ */
+static bool
+vmvector_bulk_should_merge(vm_area_vector_t *v, app_pc prev_end, void *prev_data,
+                           app_pc new_start, void *new_data)
+{
+    return (prev_end == new_start &&
+            !TEST(VECTOR_NEVER_MERGE_ADJACENT, v->flags) &&
+            (v->should_merge_func == NULL ||
+             v->should_merge_func(true/*adjacent*/, new_data, prev_data)));
+}
+
+void
+vmvector_add_bulk(vm_area_vector_t *v, vmvector_region_t *regions, uint num)
+{
+    bool release_lock; /* 'true' means this routine needs to unlock */
+    struct vm_area_t *new_buf, *old_buf, *area;
+    int new_size, old_size, new_length = 0, i = 0;
+    uint j = 0;
+#ifdef DEBUG
+    char **comments;
+#endif
+
+    if (num == 0)
+        return;
+    /* fragment lists need add_vm_area's merging */
+    ASSERT(!TEST(VECTOR_FRAGMENT_LIST, v->flags));
+    vmvector_region_sort(regions, num);
+
+    /* We must not allocate once we start merging: for all_memory_areas and
+     * dynamo_areas a new heap unit adds an area to v itself.  So we allocate
+     * up front and retry if that grew v past what we allocated for.
+     * (Small frees, as for comments below, never release units.)
+     */
+#ifdef DEBUG
+    comments = (char **) global_heap_alloc(num*sizeof(char *) HEAPACCT(ACCT_VMAREAS));
+    for (j = 0; j < num; j++) {
+        comments[j] = (char *) global_heap_alloc(1 HEAPACCT(ACCT_VMAREAS));
+        comments[j][0] = '\0';
+    }
+    j = 0;
+#endif
+    while (true) {
+        new_size = v->length + num;
+        new_buf = (vm_area_t *) global_heap_alloc(new_size*sizeof(struct vm_area_t)
+                                                  HEAPACCT(ACCT_VMAREAS));
+        LOCK_VECTOR(v, release_lock, write);
+        ASSERT_OWN_WRITE_LOCK(SHOULD_LOCK_VECTOR(v), &v->lock);
+        if (v->length + (int)num <= new_size)
+            break;
+        UNLOCK_VECTOR(v, release_lock, write);
+        global_heap_free(new_buf, new_size*sizeof(struct vm_area_t)
+                         HEAPACCT(ACCT_VMAREAS));
+    }
+    LOG(GLOBAL, LOG_VMAREAS, 2, "vmvector_add_bulk: adding %d to %d areas\n",
+        num, v->length);
+
+    /* merge the two sorted sequences */
+    while (i < v->length || j < num) {
+        if (j >= num || (i < v->length && v->buf[i].start < regions[j].start)) {
+            ASSERT(j >= num || v->buf[i].end <= regions[j].start);
+            area = &v->buf[i++];
+            if (new_length > 0 &&
+                new_buf[new_length-1].vm_flags == area->vm_flags &&
+                new_buf[new_length-1].frag_flags == area->frag_flags &&
+                !TEST(FRAG_COARSE_GRAIN, area->frag_flags) &&
+                vmvector_bulk_should_merge(v, new_buf[new_length-1].end,
+                                           new_buf[new_length-1].custom.client,
+                                           area->start, area->custom.client)) {
+                /* a just-added region is adjacent to this existing area */
+                new_buf[new_length-1].end = area->end;
+                if (v->merge_payload_func != NULL) {
+                    new_buf[new_length-1].custom.client =
+                        v->merge_payload_func(new_buf[new_length-1].custom.client,
+                                              area->custom.client);
+                } else if (v->free_payload_func != NULL)
+                    v->free_payload_func(area->custom.client);
+#ifdef DEBUG
+                global_heap_free(area->comment, strlen(area->comment)+1
+                                 HEAPACCT(ACCT_VMAREAS));
+#endif
+            } else
+                new_buf[new_length++] = *area;
+        } else {
+            vmvector_region_t *r = &regions[j];
+            ASSERT(r->start < r->end);
+            ASSERT(i >= v->length || r->end <= v->buf[i].start);
+            ASSERT(j + 1 >= num || r->end <= regions[j+1].start);
+            if (new_length > 0 &&
+                new_buf[new_length-1].vm_flags == 0 &&
+                new_buf[new_length-1].frag_flags == 0 &&
+                vmvector_bulk_should_merge(v, new_buf[new_length-1].end,
+                                           new_buf[new_length-1].custom.client,
+                                           r->start, r->data)) {
+                new_buf[new_length-1].end = r->end;
+                if (v->merge_payload_func != NULL) {
+                    new_buf[new_length-1].custom.client =
+                        v->merge_payload_func(new_buf[new_length-1].custom.client,
+                                              r->data);
+                } else if (v->free_payload_func != NULL)
+                    v->free_payload_func(r->data);
+            } else {
+                area = &new_buf[new_length++];
+                memset(area, 0, sizeof(*area));
+                area->start = r->start;
+                area->end = r->end;
+                area->custom.client = r->data;
+#ifdef DEBUG
+                area->comment = comments[j];
+                comments[j] = NULL;
+#endif
+            }
+            j++;
+        }
+    }
+    old_buf = v->buf;
+    old_size = v->size;
+    v->buf = new_buf;
+    v->size = new_size;
+    v->length = new_length;
+    STATS_TRACK_MAX(max_vmareas_length, v->length);
+    UNLOCK_VECTOR(v, release_lock, write);
+
+    if (old_buf != NULL) {
+        global_heap_free(old_buf, old_size*sizeof(struct vm_area_t)
+                         HEAPACCT(ACCT_VMAREAS));
+    }
+#ifdef DEBUG
+    /* free the comments of merged-away regions */
+    for (j = 0; j < num; j++) {
+        if (comments[j] != NULL)
+            global_heap_free(comments[j], 1 HEAPACCT(ACCT_VMAREAS));
+    }
+    global_heap_free(comments, num*sizeof(char *) HEAPACCT(ACCT_VMAREAS));
+#endif
+}
+
 bool
 vmvector_remove(vm_area_vector_t *v, app_pc start, app_pc end)
 {
@@ -11391,6 +11570,27 @@ vmvector_tests()
     res = vmvector_remove(&v, INT_TO_PC(0x20), INT_TO_PC(0x210)); /* truncation allowed? */
     EXPECT(res, true);
     vmvector_print(&v, STDERR);
+
+    /* bulk add out of order, merging with each other and with existing areas */
+    {
+        vm_area_vector_t bv = {0, 0, 0, VECTOR_SHARED,
+                               INIT_READWRITE_LOCK(thread_vm_areas)};
+        vmvector_region_t regions[] = {
+            {INT_TO_PC(0x400), INT_TO_PC(0x500), NULL},
+            {INT_TO_PC(0x100), INT_TO_PC(0x200), NULL},
+            {INT_TO_PC(0x200), INT_TO_PC(0x280), NULL},
+            {INT_TO_PC(0x600), INT_TO_PC(0x700), NULL},
+        };
+        vmvector_add(&bv, INT_TO_PC(0x500), INT_TO_PC(0x580), NULL);
+        vmvector_add(&bv, INT_TO_PC(0x800), INT_TO_PC(0x900), NULL);
+        vmvector_add_bulk(&bv, regions, BUFFER_SIZE_ELEMENTS(regions));
+        vmvector_print(&bv, STDERR);
+        EXPECT(bv.length, 4);
+        check_vec(&bv, 0, INT_TO_PC(0x100), INT_TO_PC(0x280), 0, 0, NULL);
+        check_vec(&bv, 1, INT_TO_PC(0x400), INT_TO_PC(0x580), 0, 0, NULL);
+        check_vec(&bv, 2, INT_TO_PC(0x600), INT_TO_PC(0x700), 0, 0, NULL);
+        check_vec(&bv, 3, INT_TO_PC(0x800), INT_TO_PC(0x900), 0, 0, NULL);
+    }
 }
 
 /* initial vector tests
@@ -127,6 +127,13 @@ typedef struct vmvector_iterator_t {
     int index;
 } vmvector_iterator_t;
 
+/* one region passed to vmvector_add_bulk() */
+typedef struct vmvector_region_t {
+    app_pc start;
+    app_pc end;
+    void *data;
+} vmvector_region_t;
+
 /* rather than exporting specialized routines for just these vectors we
  * export the vectors and general routines
  */
@@ -158,6 +165,14 @@ vmvector_add(vm_area_vector_t *v, app_pc start, app_pc end, void *data);
 void *
 vmvector_add_replace(vm_area_vector_t *v, app_pc start, app_pc end, void *data);
 
+/* Adds num regions at once in O((n+num) log num) time, rather than the
+ * O(n) per region of vmvector_add.  The regions may be passed in any order
+ * (regions is sorted in place) but must not overlap each other or any
+ * existing area of v.  Adjacent regions are merged as vmvector_add would.
+ */
+void
+vmvector_add_bulk(vm_area_vector_t *v, vmvector_region_t *regions, uint num);
+
 bool
 vmvector_remove(vm_area_vector_t *v, app_pc start, app_pc end);
 
@@ -2137,6 +2137,22 @@ os_thread_take_over_suspended_native(dcontext_t *dcontext)
     return os_take_over_thread(dcontext, tr->handle, tr->id, true/*suspended*/);
 }
 
+bool
+os_thread_send_suspended_native(dcontext_t *dcontext)
+{
+    /* XXX: we could translate and set the CONTEXT here, but we would also
+     * need to undo our asynch interception for the thread, so this is
+     * not yet supported.
+     */
+    return false;
+}
+
+void
+os_rescan_after_native(dcontext_t *dcontext)
+{
+    /* no thread can be sent native by os_thread_send_suspended_native() */
+}
+
 bool
 os_take_over_all_unknown_threads(dcontext_t *dcontext)
 {
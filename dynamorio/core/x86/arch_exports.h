@@ -1375,6 +1375,11 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
                         /*IN/OUT*/fragment_t **f_res, /*OUT*/bool *alloc,
                         bool mangle _IF_CLIENT(bool call_client));
 
+void recreate_cache_thread_reset_init(dcontext_t *dcontext);
+void recreate_cache_thread_reset_free(dcontext_t *dcontext);
+void recreate_cache_invalidate(dcontext_t *dcontext, app_pc start, app_pc end);
+void recreate_cache_mark_stale(dcontext_t *dcontext);
+
 app_pc find_app_bb_end(dcontext_t *dcontext, byte *start_pc, uint flags);
 bool app_bb_overlaps(dcontext_t *dcontext, byte *start_pc, uint flags,
                        byte *region_start, byte *region_end, overlap_info_t *info_res);
@@ -1356,3 +1356,184 @@ decode_raw(dcontext_t *dcontext, byte *pc, instr_t *instr)
     return (pc + sz);
 }
 
+
+/* Initial number of entries decode_range() allocates per byte of input:
+ * x86 instructions average 3-4 bytes, so this rarely needs to grow.
+ */
+#define DECODE_RANGE_BYTES_PER_INSTR 3
+
+/* We use heap_alloc rather than global_heap_realloc so that this works
+ * in drdecode as well.
+ */
+static void *
+decode_range_realloc(void *old, size_t old_size, size_t new_size)
+{
+    void *new_area = heap_alloc(GLOBAL_DCONTEXT, new_size HEAPACCT(ACCT_IR));
+    if (old != NULL) {
+        memcpy(new_area, old, old_size);
+        heap_free(GLOBAL_DCONTEXT, old, old_size HEAPACCT(ACCT_IR));
+    }
+    return new_area;
+}
+
+static void
+decode_range_resize(decode_range_t *range, uint new_cap)
+{
+#define RESIZE_ARRAY(field)                                                   \
+    range->field = decode_range_realloc(range->field,                         \
+                                        range->capacity * sizeof(*range->field), \
+                                        new_cap * sizeof(*range->field))
+    RESIZE_ARRAY(offset);
+    RESIZE_ARRAY(length);
+    RESIZE_ARRAY(opcode);
+    RESIZE_ARRAY(cti_kind);
+    RESIZE_ARRAY(target);
+    RESIZE_ARRAY(eflags);
+#undef RESIZE_ARRAY
+    range->capacity = new_cap;
+}
+
+/* Classifies a control transfer decoded by decode_cti() */
+static dr_cti_kind_t
+decode_range_cti_kind(instr_t *instr)
+{
+    int opc;
+    /* non-ctis are left at Level 1 and we don't want to up-decode them */
+    if (!instr_opcode_valid(instr))
+        return DR_CTI_NONE;
+    opc = instr_get_opcode(instr);
+    switch (opc) {
+    case OP_jmp:
+    case OP_jmp_short:
+        return DR_CTI_JUMP;
+    case OP_call:
+        return DR_CTI_CALL;
+    case OP_jmp_ind:
+        return DR_CTI_INDIRECT_JUMP;
+    case OP_call_ind:
+        return DR_CTI_INDIRECT_CALL;
+    case OP_ret:
+        return DR_CTI_RETURN;
+    case OP_jmp_far:
+    case OP_jmp_far_ind:
+    case OP_call_far:
+    case OP_call_far_ind:
+    case OP_ret_far:
+    case OP_iret:
+        return DR_CTI_FAR;
+    case OP_int:
+    case OP_int3:
+    case OP_into:
+    case OP_syscall:
+    case OP_sysenter:
+    case OP_sysexit:
+    case OP_sysret:
+        return DR_CTI_SYSCALL;
+    default:
+        return instr_is_cbr(instr) ? DR_CTI_COND_JUMP : DR_CTI_NONE;
+    }
+}
+
+decode_range_t *
+decode_range(dcontext_t *dcontext, byte *start, size_t size, app_pc orig_start,
+             uint flags)
+{
+    decode_range_t *range = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, decode_range_t,
+                                            ACCT_IR, PROTECTED);
+    /* the final instructions are decoded from a padded copy so that we never
+     * read past the end of the range
+     */
+    byte tail[MAX_INSTR_LENGTH];
+    size_t off = 0;
+    instr_t instr;
+    CLIENT_ASSERT(size < UINT_MAX, "decode_range: range too large");
+    memset(range, 0, sizeof(*range));
+    range->start = start;
+    range->orig_start = (orig_start == NULL) ? start : orig_start;
+    range->size = size;
+    decode_range_resize(range, (uint)(size / DECODE_RANGE_BYTES_PER_INSTR) + 16);
+    instr_init(dcontext, &instr);
+    while (off < size) {
+        uint idx = range->num_instrs;
+        size_t left = size - off;
+        byte *pc = start + off, *next_pc;
+        app_pc orig_pc = range->orig_start + off;
+        dr_cti_kind_t kind;
+        if (left < MAX_INSTR_LENGTH) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, pc, left);
+            pc = tail;
+        }
+        if (idx == range->capacity)
+            decode_range_resize(range, range->capacity * 2);
+        instr_reset(dcontext, &instr);
+        next_pc = decode_cti(dcontext, pc, &instr);
+        range->offset[idx] = (uint) off;
+        if (next_pc == NULL || (size_t)(next_pc - pc) > left) {
+            range->length[idx] = 1;
+            range->opcode[idx] = OP_INVALID;
+            range->cti_kind[idx] = DR_CTI_NONE;
+            range->target[idx] = NULL;
+            range->eflags[idx] = 0;
+            range->num_invalid++;
+            range->num_instrs++;
+            off++;
+            continue;
+        }
+        range->length[idx] = (byte)(next_pc - pc);
+        kind = decode_range_cti_kind(&instr);
+        range->cti_kind[idx] = (byte) kind;
+        if (kind == DR_CTI_JUMP || kind == DR_CTI_COND_JUMP || kind == DR_CTI_CALL) {
+            /* make the target relative to where the bytes are meant to be */
+            range->target[idx] = orig_pc +
+                (opnd_get_pc(instr_get_target(&instr)) - pc);
+        } else
+            range->target[idx] = NULL;
+        if (kind == DR_CTI_NONE && TEST(DECODE_RANGE_OPCODES, flags)) {
+            instr_reset(dcontext, &instr);
+            decode_opcode(dcontext, pc, &instr);
+            range->opcode[idx] = (ushort) instr_get_opcode(&instr);
+            range->eflags[idx] = instr_get_eflags(&instr);
+        } else {
+            /* ctis are fully decoded by decode_cti() */
+            range->opcode[idx] = (ushort) instr.opcode;
+            range->eflags[idx] = (kind != DR_CTI_NONE) ? instr_get_eflags(&instr) :
+                instr_get_arith_flags(&instr);
+        }
+        range->num_instrs++;
+        off += range->length[idx];
+    }
+    instr_free(dcontext, &instr);
+    return range;
+}
+
+void
+decode_range_free(dcontext_t *dcontext, decode_range_t *range)
+{
+#define FREE_ARRAY(field)                                                    \
+    heap_free(GLOBAL_DCONTEXT, range->field, range->capacity * sizeof(*range->field) \
+              HEAPACCT(ACCT_IR))
+    FREE_ARRAY(offset);
+    FREE_ARRAY(length);
+    FREE_ARRAY(opcode);
+    FREE_ARRAY(cti_kind);
+    FREE_ARRAY(target);
+    FREE_ARRAY(eflags);
+#undef FREE_ARRAY
+    HEAP_TYPE_FREE(GLOBAL_DCONTEXT, range, decode_range_t, ACCT_IR, PROTECTED);
+}
+
+byte *
+decode_range_instr(dcontext_t *dcontext, decode_range_t *range, uint index,
+                   instr_t *instr)
+{
+    uint off;
+    CLIENT_ASSERT(index < range->num_instrs, "decode_range_instr: invalid index");
+    off = range->offset[index];
+    if (range->opcode[index] == OP_INVALID) {
+        instr_set_opcode(instr, OP_INVALID);
+        return NULL;
+    }
+    return decode_from_copy(dcontext, range->start + off, range->orig_start + off,
+                            instr);
+}
@@ -119,5 +119,98 @@ DR_UNS_API
 byte *
 decode_cti(dcontext_t *dcontext, byte *pc, instr_t *instr);
 
+/* DR_API EXPORT BEGIN */
+
+/** Control-transfer kinds recorded by decode_range() in decode_range_t.cti_kind. */
+typedef enum {
+    DR_CTI_NONE,          /**< Not a control-transfer instruction. */
+    DR_CTI_JUMP,          /**< Direct unconditional jump. */
+    DR_CTI_COND_JUMP,     /**< Direct conditional branch, including loop and jecxz. */
+    DR_CTI_CALL,          /**< Direct call. */
+    DR_CTI_INDIRECT_JUMP, /**< Near indirect jump. */
+    DR_CTI_INDIRECT_CALL, /**< Near indirect call. */
+    DR_CTI_RETURN,        /**< Near return. */
+    DR_CTI_FAR,           /**< Far jump, call, or return, or iret. */
+    DR_CTI_SYSCALL        /**< System call or interrupt. */
+} dr_cti_kind_t;
+
+/**
+ * Flag for decode_range(): also decode the opcode and full eflags usage of
+ * instructions that are not control transfers.  Without it, their opcode is
+ * OP_UNDECODED and only their arithmetic eflags usage is recorded.
+ */
+#define DECODE_RANGE_OPCODES 0x1
+
+/**
+ * Result of decode_range(): one entry per instruction in each of a set of
+ * parallel arrays, indexed from 0 to \p num_instrs - 1 in address order.
+ * The fields should be treated as read-only.
+ */
+typedef struct _decode_range_t {
+    byte *start;       /**< The start of the decoded bytes. */
+    app_pc orig_start; /**< The address the bytes were decoded as if located at. */
+    size_t size;       /**< The number of bytes decoded. */
+    uint num_instrs;   /**< The number of entries in each array. */
+    /**
+     * The number of invalid instructions.  Each is recorded as a 1-byte
+     * entry with opcode OP_INVALID, after which decoding resumes at the
+     * next byte.
+     */
+    uint num_invalid;
+    uint *offset;      /**< Offset of each instruction from \p start. */
+    byte *length;      /**< Length in bytes of each instruction. */
+    /** OP_ opcode of each instruction: see #DECODE_RANGE_OPCODES. */
+    ushort *opcode;
+    byte *cti_kind;    /**< A #dr_cti_kind_t value for each instruction. */
+    /**
+     * The target of each direct branch or call, relative to \p orig_start;
+     * NULL for all other instructions.
+     */
+    app_pc *target;
+    /**
+     * The EFLAGS_READ_ and EFLAGS_WRITE_ flags of each instruction: see
+     * #DECODE_RANGE_OPCODES.
+     */
+    uint *eflags;
+    uint capacity;     /**< For internal use only. */
+} decode_range_t;
+
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Decodes every instruction in the \p size bytes starting at \p start into
+ * a set of parallel arrays, without allocating an instr_t per instruction.
+ * Only enough of each instruction is decoded to determine its length, its
+ * arithmetic eflags usage, and, for control transfers, its opcode and direct
+ * target; use #DECODE_RANGE_OPCODES in \p flags to also decode the opcodes
+ * of the rest, and decode_range_instr() to fully decode a single entry.
+ *
+ * If \p orig_start is non-NULL, the bytes are decoded as though they were
+ * located at \p orig_start, as with decode_from_copy().  Bytes past the end
+ * of the range are never read: an instruction that would extend past it is
+ * recorded as invalid.  Intended for standalone tools decoding whole code
+ * sections.  The result must be freed with decode_range_free().
+ */
+decode_range_t *
+decode_range(dcontext_t *dcontext, byte *start, size_t size, app_pc orig_start,
+             uint flags);
+
+DR_API
+/** Frees a decode_range_t returned by decode_range(). */
+void
+decode_range_free(dcontext_t *dcontext, decode_range_t *range);
+
+DR_API
+/**
+ * Fully decodes the instruction with index \p index in \p range into \p
+ * instr, which must already be initialized, as decode_from_copy() does.
+ * Returns the address of the byte following the instruction in \p range's
+ * bytes, or NULL for an invalid instruction.
+ */
+byte *
+decode_range_instr(dcontext_t *dcontext, decode_range_t *range, uint index,
+                   instr_t *instr);
+
 
 #endif /* DECODE_FAST_H */
@@ -58,6 +58,8 @@
 #include <stdarg.h> /* for varargs */
 #include "../nudge.h" /* for nudge_internal() */
 #include "../synch.h"
+#include "../perfctr.h"
+#include "../native_exec.h"
 #ifdef UNIX
 # include <sys/time.h> /* ITIMER_* */
 # include "../unix/module.h" /* redirect_* functions */
@@ -284,6 +286,21 @@ DECLARE_CXTSWPROT_VAR(static mutex_t client_thread_count_lock,
 
 static vm_area_vector_t *client_aux_libs;
 
+#ifdef CUSTOM_TRACES
+/* A client-requested trace region: the sorted, duplicate-free tags of the
+ * blocks a trace starting at the region's head may contain.
+ */
+typedef struct _trace_region_t {
+    app_pc *tags;
+    uint num_tags;
+    uint capacity; /* allocated length of tags */
+    uint max_bbs;
+} trace_region_t;
+
+/* trace head tag => trace_region_t, for dr_register_trace_region() */
+static generic_table_t *trace_regions;
+#endif
+
 #ifdef WINDOWS
 DECLARE_CXTSWPROT_VAR(static mutex_t client_aux_lib64_lock,
                       INIT_LOCK_FREE(client_aux_lib64_lock));
@@ -543,13 +560,51 @@ init_client_aux_libs(void)
     }
 }
 
+#ifdef CUSTOM_TRACES
+static void
+trace_region_free(void *p)
+{
+    trace_region_t *region = (trace_region_t *) p;
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, region->tags, app_pc, region->capacity,
+                    ACCT_CLIENT, UNPROTECTED);
+    HEAP_TYPE_FREE(GLOBAL_DCONTEXT, region, trace_region_t, ACCT_CLIENT, UNPROTECTED);
+}
+
+static bool
+trace_region_contains(trace_region_t *region, app_pc tag)
+{
+    uint lo = 0, hi = region->num_tags;
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+        if (region->tags[mid] == tag)
+            return true;
+        if (region->tags[mid] < tag)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+#endif
+
 void
 instrument_init(void)
 {
     size_t i;
 
+    /* dr_where_am_i() casts between the two */
+    ASSERT((int)DR_WHERE_FCACHE == (int)WHERE_FCACHE &&
+           (int)DR_WHERE_UNKNOWN == (int)WHERE_UNKNOWN);
+
     init_client_aux_libs();
 
+#ifdef CUSTOM_TRACES
+    trace_regions = generic_hash_create(GLOBAL_DCONTEXT, 6,
+                                        80 /* load factor: not perf-critical */,
+                                        HASHTABLE_SHARED | HASHTABLE_PERSISTENT,
+                                        trace_region_free _IF_DEBUG("trace regions"));
+#endif
+
     /* Iterate over the client libs and call each dr_init */
     for (i=0; i<num_client_libs; i++) {
         void (*init)(client_id_t) = (void (*)(client_id_t))
@@ -687,6 +742,10 @@ instrument_exit(void)
 
     vmvector_delete_vector(GLOBAL_DCONTEXT, client_aux_libs);
     client_aux_libs = NULL;
+#ifdef CUSTOM_TRACES
+    generic_hash_destroy(GLOBAL_DCONTEXT, trace_regions);
+    trace_regions = NULL;
+#endif
 #ifdef WINDOWS
     DELETE_LOCK(client_aux_lib64_lock);
 #endif
@@ -1282,6 +1341,17 @@ dr_end_trace_hook_exists(void)
     return (end_trace_callbacks.num > 0);
 }
 
+#ifdef CUSTOM_TRACES
+bool
+dr_trace_regions_exist(void)
+{
+    /* racy read of the count: a region registered concurrently only affects
+     * traces whose selection starts afterward anyway
+     */
+    return (trace_regions != NULL && trace_regions->entries > 0);
+}
+#endif
+
 bool
 dr_thread_exit_hook_exists(void)
 {
@@ -1592,6 +1662,57 @@ instrument_end_trace(dcontext_t *dcontext, app_pc trace_tag, app_pc next_tag)
 
     return ret;
 }
+
+/* Applies any region registered via dr_register_trace_region() for the trace
+ * starting at trace_tag, which holds num_bbs blocks so far, to the decision
+ * whether to add next_tag.  Returns CUSTOM_TRACE_DR_DECIDES if there is no
+ * region for trace_tag.
+ */
+dr_custom_trace_action_t
+instrument_trace_region(dcontext_t *dcontext, app_pc trace_tag, app_pc next_tag,
+                        uint num_bbs)
+{
+    dr_custom_trace_action_t ret = CUSTOM_TRACE_DR_DECIDES;
+    trace_region_t *region;
+
+    TABLE_RWLOCK(trace_regions, read, lock);
+    region = (trace_region_t *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, trace_regions, (ptr_uint_t) trace_tag);
+    if (region != NULL) {
+        if (next_tag == trace_tag || num_bbs >= region->max_bbs ||
+            !trace_region_contains(region, next_tag))
+            ret = CUSTOM_TRACE_END_NOW;
+        else
+            ret = CUSTOM_TRACE_CONTINUE;
+    }
+    TABLE_RWLOCK(trace_regions, read, unlock);
+    return ret;
+}
+
+/* Returns whether tag is the head of, or a block in, any region registered
+ * via dr_register_trace_region().
+ */
+bool
+instrument_trace_region_has_tag(app_pc tag)
+{
+    bool found = false;
+    ptr_uint_t head;
+    trace_region_t *region;
+    int iter = 0;
+
+    if (!dr_trace_regions_exist())
+        return false;
+    TABLE_RWLOCK(trace_regions, read, lock);
+    do {
+        iter = generic_hash_iterate_next(GLOBAL_DCONTEXT, trace_regions, iter,
+                                         &head, (void **)&region);
+        if (iter < 0)
+            break;
+        found = ((app_pc)head == tag || trace_region_contains(region, tag));
+    } while (!found);
+    TABLE_RWLOCK(trace_regions, read, unlock);
+    return found;
+}
 #endif
 
 
@@ -2396,6 +2517,25 @@ dr_get_random_seed(void)
     return get_random_seed();
 }
 
+DR_API
+bool
+dr_get_perfctr_values(void *drcontext, dr_perfctr_values_t *values)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(dcontext != NULL && dcontext != GLOBAL_DCONTEXT,
+                  "dr_get_perfctr_values: invalid drcontext");
+    CLIENT_ASSERT(values != NULL && values->size == sizeof(*values),
+                  "dr_get_perfctr_values: invalid values");
+    /* our internal ids are in the same order */
+    ASSERT((int)DR_PERFCTR_NUM == (int)PERFCTR_NUM &&
+           (int)DR_PERFCTR_PAGE_FAULTS == (int)PERFCTR_page_faults);
+    memset(values->in_dr, 0, sizeof(values->in_dr));
+    memset(values->in_cache, 0, sizeof(values->in_cache));
+    values->available = 0;
+    return perfctr_get_values(dcontext, &values->available,
+                              values->in_dr, values->in_cache);
+}
+
 /***************************************************************************
  * MEMORY ALLOCATION
  *
@@ -3531,6 +3671,40 @@ dr_module_should_instrument(module_handle_t handle)
     return should_instrument;
 }
 
+DR_API
+bool
+dr_module_set_native(module_handle_t handle, bool native)
+{
+    module_area_t *ma;
+    app_pc start = NULL, end = NULL;
+    bool ok = false;
+    os_get_module_info_write_lock();
+    /* The module may have been unloaded since the client obtained the handle,
+     * which we report by failing rather than asserting.
+     */
+    ma = module_pc_lookup((byte*)handle);
+    if (ma != NULL && ma->start == (app_pc)handle) {
+        ok = native_exec_module_set_native(ma, native);
+        start = ma->start;
+        end = ma->end;
+    }
+    os_get_module_info_write_unlock();
+    /* Fragments already built from the module would keep running under DR
+     * (or, after a move back, native entrances would keep being taken), so we
+     * flush them.  The delayed flush is safe from any client context.
+     */
+    if (ok)
+        ok = dr_delay_flush_region(start, end - start, 0, NULL);
+    return ok;
+}
+
+DR_API
+bool
+dr_module_is_native(module_handle_t handle)
+{
+    return (native_exec_areas != NULL && is_native_pc((app_pc)handle));
+}
+
 
 DR_API
 /* Returns the entry point of the function with the given name in the module
@@ -4395,6 +4569,8 @@ dr_retakeover_suspended_native_thread(void *drcontext)
     bool res;
     dcontext_t *dcontext = (dcontext_t *) drcontext;
     CLIENT_ASSERT(drcontext != NULL, "invalid param");
+    if (IS_CLIENT_THREAD(dcontext))
+        return false;
     /* XXX: I don't quite see why I need to pop these 2 when I'm doing
      * what a regular retakeover would do
      */
@@ -4404,6 +4580,86 @@ dr_retakeover_suspended_native_thread(void *drcontext)
     return res;
 }
 
+DR_API
+bool
+dr_send_suspended_thread_native(void *drcontext)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL, "invalid param");
+    CLIENT_ASSERT(dcontext != get_thread_private_dcontext(),
+                  "cannot send the calling thread native");
+    if (IS_CLIENT_THREAD(dcontext))
+        return false;
+    if (!os_thread_send_suspended_native(dcontext))
+        return false;
+    STATS_INC(num_threads_sent_native);
+    return true;
+}
+
+DR_API
+void
+dr_rescan_after_native(void)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    CLIENT_ASSERT(!standalone_library, "API not supported in standalone mode");
+    os_rescan_after_native(dcontext);
+}
+
+# ifdef UNIX
+DR_API
+process_id_t
+dr_create_snapshot(void (*func)(void *drcontext, void *arg), void *arg)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    thread_record_t **threads;
+    int num_threads;
+    process_id_t pid;
+    CLIENT_ASSERT(!standalone_library, "API not supported in standalone mode");
+    CLIENT_ASSERT(func != NULL, "dr_create_snapshot: invalid params");
+    CLIENT_ASSERT(OWN_NO_LOCKS(dcontext),
+                  "dr_create_snapshot cannot be called while holding a lock");
+    /* The child has a copy of only this thread, so we first stop every other
+     * thread at a safe spot where it holds no DR locks.  The parent only
+     * pauses for as long as this and the fork itself take.
+     */
+    if (!synch_with_all_threads(THREAD_SYNCH_SUSPENDED_VALID_MCONTEXT_OR_NO_XFER,
+                                &threads, &num_threads, THREAD_SYNCH_NO_LOCKS_NO_XFER,
+                                THREAD_SYNCH_SUSPEND_FAILURE_IGNORE)) {
+        /* A thread we could not stop might hold a lock the snapshot needs.
+         * Some threads may have been suspended, so we still resume them.
+         */
+        LOG(GLOBAL, LOG_ALL, 1,
+            "dr_create_snapshot: failed to suspend every thread\n");
+        end_synch_with_all_threads(threads, num_threads, true/*resume*/);
+        return (process_id_t) INVALID_PROCESS_ID;
+    }
+    pid = os_fork_snapshot();
+    if (pid == 0) {
+        /* We are the snapshot.  We exit directly, skipping DR's and the
+         * client's exit processing, which would clean up the parent's state.
+         */
+        (*func)((void *)dcontext, arg);
+        exit_process_syscall(0);
+    }
+    end_synch_with_all_threads(threads, num_threads, true/*resume*/);
+    LOG(GLOBAL, LOG_ALL, 1, "dr_create_snapshot: created snapshot process %d\n", pid);
+    return pid;
+}
+
+DR_API
+bool
+dr_snapshot_wait(process_id_t pid, bool block, OUT bool *completed)
+{
+    int status;
+    CLIENT_ASSERT(!standalone_library, "API not supported in standalone mode");
+    if (!os_wait_snapshot(pid, block, &status))
+        return false;
+    if (completed != NULL)
+        *completed = (status == 0);
+    return true;
+}
+# endif /* UNIX */
+
 # ifdef UNIX
 DR_API
 bool
@@ -4774,6 +5030,66 @@ dr_insert_clean_call(void *drcontext, instrlist_t *ilist, instr_t *where,
     va_end(ap);
 }
 
+/* A one-shot call sequence is:
+ *     site:   jmp call           (e9 05 00 00 00 while armed)
+ *             jmp resume
+ *     call:   <clean call to oneshot_call_fire(site, callee, user_data)>
+ *     resume:
+ * To disarm we zero the low byte of site's displacement so that it lands on
+ * "jmp resume".  A single byte write is atomic wherever it falls, so no
+ * alignment of the site is needed, and the instruction lengths stay the same
+ * for state translation.
+ */
+#define ONESHOT_ARMED_DISP    5 /* length of "jmp resume" */
+#define ONESHOT_DISARMED_DISP 0
+
+static void
+oneshot_call_fire(byte *site, void (*callee)(void *), void *user_data)
+{
+    byte *disp = site + 1;
+    /* The aligned word holding the displacement's low byte never crosses a
+     * cache line, so a locked cmpxchg on it both disarms the site and elects
+     * a single thread to make the call.
+     */
+    volatile int *word = (volatile int *) ALIGN_BACKWARD(disp, sizeof(int));
+    uint shift = (uint)(disp - (byte *)word) * 8;
+    uint old_val, new_val;
+    ASSERT(*site == JMP_OPCODE);
+    do {
+        old_val = (uint) *word;
+        if (((old_val >> shift) & 0xff) != ONESHOT_ARMED_DISP)
+            return; /* another thread got here first */
+        new_val = (old_val & ~(0xffU << shift)) | (ONESHOT_DISARMED_DISP << shift);
+    } while (!atomic_compare_exchange_int(word, (int)old_val, (int)new_val));
+    STATS_INC(oneshot_calls_fired);
+    (*callee)(user_data);
+}
+
+DR_API
+bool
+dr_insert_oneshot_call(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       void *callee, bool save_fpstate, void *user_data)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    instr_t *site, *call, *resume;
+    CLIENT_ASSERT(drcontext != NULL, "dr_insert_oneshot_call: drcontext cannot be NULL");
+    if (TEST(SELFPROT_CACHE, DYNAMO_OPTION(protect_mask)))
+        return false;
+    call = INSTR_CREATE_label(dcontext);
+    resume = INSTR_CREATE_label(dcontext);
+    site = INSTR_CREATE_jmp(dcontext, opnd_create_instr(call));
+    instrlist_meta_preinsert(ilist, where, site);
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_jmp(dcontext, opnd_create_instr(resume)));
+    instrlist_meta_preinsert(ilist, where, call);
+    dr_insert_clean_call(drcontext, ilist, where, (void *)oneshot_call_fire,
+                         save_fpstate, 3, opnd_create_instr(site),
+                         OPND_CREATE_INTPTR(callee), OPND_CREATE_INTPTR(user_data));
+    instrlist_meta_preinsert(ilist, where, resume);
+    STATS_INC(oneshot_calls_inserted);
+    return true;
+}
+
 /* Utility routine for inserting a clean call to an instrumentation routine
  * Returns the size of the data stored on the DR stack (in case the caller
  * needs to align the stack pointer).  XSP and XAX are modified by this call.
@@ -6134,6 +6450,45 @@ dr_bb_exists_at(void *drcontext, void *tag)
     return false;
 }
 
+DR_API
+bool
+dr_prepopulate_cache(app_pc *tags, size_t tags_count, size_t *num_built OUT)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    size_t i, built = 0;
+    CLIENT_ASSERT(tags != NULL || tags_count == 0,
+                  "dr_prepopulate_cache: invalid tags");
+    if (dcontext == NULL)
+        return false;
+    LOG(THREAD, LOG_ALL, 2, "dr_prepopulate_cache: building "SZFMT" tags\n", tags_count);
+    for (i = 0; i < tags_count; i++) {
+        fragment_t coarse_f;
+        fragment_t *f;
+        /* same sequence as dispatch: re-lookup under the bb building lock so a
+         * racing thread cannot add the same block
+         */
+        SHARED_BB_LOCK();
+        f = fragment_lookup_fine_and_coarse(dcontext, tags[i], &coarse_f, NULL);
+        if (f == NULL) {
+            SELF_PROTECT_LOCAL(dcontext, WRITABLE);
+            f = build_basic_block_fragment(dcontext, tags[i], 0, true/*link*/,
+                                           true/*visible*/, false/*!for_trace*/,
+                                           NULL);
+            SELF_PROTECT_LOCAL(dcontext, READONLY);
+            if (f != NULL)
+                built++;
+            DOLOG(3, LOG_ALL, {
+                if (f == NULL)
+                    LOG(THREAD, LOG_ALL, 3, "\tfailed to build "PFX"\n", tags[i]);
+            });
+        }
+        SHARED_BB_UNLOCK();
+    }
+    if (num_built != NULL)
+        *num_built = built;
+    return true;
+}
+
 DR_API 
 /* Looks up the fragment associated with the application pc tag.
  * If not found, returns 0.
@@ -6223,6 +6578,39 @@ dr_app_pc_from_cache_pc(byte *cache_pc)
     return res;
 }
 
+DR_API
+dr_where_am_i_t
+dr_where_am_i(void *drcontext, app_pc pc, OUT void **tag)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    where_am_i_t whereami;
+    CLIENT_ASSERT(drcontext != NULL, "invalid param");
+    if (tag != NULL)
+        *tag = NULL;
+    whereami = dcontext->whereami;
+    /* Like pcprofile_alarm(), we rely on whereami to know that no DR locks
+     * are held before looking up the fragment.
+     */
+    if (whereami == WHERE_FCACHE) {
+        fragment_t wrapper;
+        fragment_t *f = fragment_pclookup(dcontext, pc, &wrapper);
+        if (f != NULL) {
+            if (tag != NULL)
+                *tag = f->tag;
+        } else if (in_context_switch_code(dcontext, pc))
+            whereami = WHERE_CONTEXT_SWITCH;
+        else if (in_indirect_branch_lookup_code(dcontext, pc))
+            whereami = WHERE_IBL;
+        else {
+            /* a clean call, or a stub or other gencode */
+            whereami = WHERE_UNKNOWN;
+        }
+    }
+    if (whereami > WHERE_UNKNOWN) /* e.g., WHERE_HOTPATCH */
+        whereami = WHERE_UNKNOWN;
+    return (dr_where_am_i_t) whereami;
+}
+
 DR_API
 bool
 dr_using_app_state(void *drcontext)
@@ -6421,6 +6809,92 @@ dr_trace_exists_at(void *drcontext, void *tag)
     return trace;
 }
 
+/* In-place heapsort of region tags: we have no qsort in core. */
+static void
+trace_region_sift_down(app_pc *tags, uint root, uint num)
+{
+    app_pc tmp;
+    uint child;
+    while ((child = 2 * root + 1) < num) {
+        if (child + 1 < num && tags[child] < tags[child + 1])
+            child++;
+        if (tags[root] >= tags[child])
+            return;
+        tmp = tags[root];
+        tags[root] = tags[child];
+        tags[child] = tmp;
+        root = child;
+    }
+}
+
+static void
+trace_region_sort(app_pc *tags, uint num)
+{
+    app_pc tmp;
+    uint i;
+    for (i = num / 2; i > 0; i--)
+        trace_region_sift_down(tags, i - 1, num);
+    for (i = num - 1; i > 0; i--) {
+        tmp = tags[0];
+        tags[0] = tags[i];
+        tags[i] = tmp;
+        trace_region_sift_down(tags, 0, i);
+    }
+}
+
+DR_API
+bool
+dr_register_trace_region(void *drcontext, void *head, void **tags, uint num_tags,
+                         uint max_bbs)
+{
+    DEBUG_DECLARE(dcontext_t *dcontext = (dcontext_t *) drcontext;)
+    trace_region_t *region;
+    app_pc *sorted;
+    uint i, num;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_register_trace_region: drcontext is invalid");
+    CLIENT_ASSERT(tags != NULL || num_tags == 0,
+                  "dr_register_trace_region: tags cannot be NULL");
+    if (num_tags == 0 || !dr_mark_trace_head(drcontext, head))
+        return false;
+
+    sorted = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, app_pc, num_tags,
+                              ACCT_CLIENT, UNPROTECTED);
+    for (i = 0; i < num_tags; i++)
+        sorted[i] = (app_pc) tags[i];
+    trace_region_sort(sorted, num_tags);
+    for (i = 1, num = 1; i < num_tags; i++) {
+        if (sorted[i] != sorted[num - 1])
+            sorted[num++] = sorted[i];
+    }
+
+    region = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, trace_region_t, ACCT_CLIENT, UNPROTECTED);
+    region->tags = sorted;
+    region->num_tags = num;
+    region->capacity = num_tags;
+    region->max_bbs = (max_bbs == 0) ? num + 1 : max_bbs;
+    LOG(THREAD, LOG_MONITOR, 2,
+        "Client trace region @"PFX": %d blocks, max %d\n", head, num, region->max_bbs);
+
+    TABLE_RWLOCK(trace_regions, write, lock);
+    /* removing frees any prior region's payload */
+    generic_hash_remove(GLOBAL_DCONTEXT, trace_regions, (ptr_uint_t) head);
+    generic_hash_add(GLOBAL_DCONTEXT, trace_regions, (ptr_uint_t) head, region);
+    TABLE_RWLOCK(trace_regions, write, unlock);
+    return true;
+}
+
+DR_API
+bool
+dr_unregister_trace_region(void *head)
+{
+    bool found;
+    TABLE_RWLOCK(trace_regions, write, lock);
+    found = generic_hash_remove(GLOBAL_DCONTEXT, trace_regions, (ptr_uint_t) head);
+    TABLE_RWLOCK(trace_regions, write, unlock);
+    return found;
+}
+
 #ifdef UNSUPPORTED_API
 DR_API 
 /* All basic blocks created after this routine is called will have a prefix
@@ -6512,6 +6986,22 @@ dr_insert_get_seg_base(void *drcontext, instrlist_t *ilist, instr_t *instr,
  * PERSISTENCE
  */
 
+/* Returns how many of the clients are recorded in a pcache.  Clients that
+ * can neither change the code we persist nor add their own data to it
+ * (e.g., a tool that only populates the cache) produce the same pcaches as
+ * running with no client at all, so we leave them out to let pcaches
+ * generated under such a tool be used without it and vice versa.
+ */
+static size_t
+num_persisted_clients(void)
+{
+    if (bb_callbacks.num == 0 && trace_callbacks.num == 0 &&
+        persist_ro_size_callbacks.num == 0 && persist_rx_size_callbacks.num == 0 &&
+        persist_rw_size_callbacks.num == 0 && persist_patch_callbacks.num == 0)
+        return 0;
+    return num_client_libs;
+}
+
 /* Up to caller to synchronize. */
 uint
 instrument_persist_ro_size(dcontext_t *dcontext, void *perscxt, size_t file_offs)
@@ -6534,7 +7024,7 @@ instrument_persist_ro_size(dcontext_t *dcontext, void *perscxt, size_t file_offs
      * vs under tool, in particular): but doesn't really seem useful enough
      * for the trouble
      */
-    for (i=0; i<num_client_libs; i++) {
+    for (i=0; i<num_persisted_clients(); i++) {
         sz += strlen(client_libs[i].path) + 1/*NULL*/;
     }
     sz++; /* double NULL ends it */
@@ -6566,7 +7056,7 @@ instrument_persist_ro(dcontext_t *dcontext, void *perscxt, file_t fd)
     char nul = '\0';
     ASSERT(fd != INVALID_FILE);
 
-    for (i=0; i<num_client_libs; i++) {
+    for (i=0; i<num_persisted_clients(); i++) {
         size_t sz = strlen(client_libs[i].path) + 1/*NULL*/;
         if (os_write(fd, client_libs[i].path, sz) != (ssize_t)sz)
             return false;
@@ -6597,14 +7087,14 @@ instrument_resurrect_ro(dcontext_t *dcontext, void *perscxt, byte *map)
     i = 0;
     c = (const char *) map;
     while (*c != '\0') {
-        if (i >= num_client_libs)
+        if (i >= num_persisted_clients())
             return false; /* too many clients */
         if (strcmp(client_libs[i].path, c) != 0)
             return false; /* client path mismatch */
         c += strlen(c) + 1;
         i++;
     }
-    if (i < num_client_libs)
+    if (i < num_persisted_clients())
         return false; /* too few clients */
     c++;
 
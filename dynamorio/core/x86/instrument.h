@@ -1484,6 +1484,10 @@ dr_emit_flags_t instrument_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *
 #ifdef CUSTOM_TRACES
 dr_custom_trace_action_t instrument_end_trace(dcontext_t *dcontext, app_pc trace_tag,
                                            app_pc next_tag);
+dr_custom_trace_action_t instrument_trace_region(dcontext_t *dcontext, app_pc trace_tag,
+                                                 app_pc next_tag, uint num_bbs);
+bool instrument_trace_region_has_tag(app_pc tag);
+bool dr_trace_regions_exist(void);
 #endif
 void instrument_fragment_deleted(dcontext_t *dcontext, app_pc tag, uint flags);
 bool instrument_restore_state(dcontext_t *dcontext, bool restore_memory,
@@ -1792,6 +1796,54 @@ DR_API
 uint
 dr_get_random_seed(void);
 
+/* DR_API EXPORT BEGIN */
+/**
+ * The per-thread event counters kept with the -perfctr runtime option
+ * and returned by dr_get_perfctr_values().
+ */
+typedef enum {
+    DR_PERFCTR_CYCLES,          /**< CPU cycles. */
+    DR_PERFCTR_INSTRUCTIONS,    /**< Retired instructions. */
+    DR_PERFCTR_L1I_MISSES,      /**< L1 instruction cache read misses. */
+    DR_PERFCTR_ITLB_MISSES,     /**< Instruction TLB read misses. */
+    DR_PERFCTR_TASK_CLOCK,      /**< Nanoseconds the thread was running. */
+    DR_PERFCTR_PAGE_FAULTS,     /**< Page faults. */
+    DR_PERFCTR_NUM,             /**< Number of counters. */
+} dr_perfctr_t;
+
+/** Counter values returned by dr_get_perfctr_values(). */
+typedef struct _dr_perfctr_values_t {
+    /** The size of this structure: set by the caller. */
+    size_t size;
+    /**
+     * A bitmask with (1 << #dr_perfctr_t) set for each counter that is
+     * supported on this machine.  The values of the others are 0.
+     */
+    uint available;
+    /** Counts while the thread was in DR or in the client. */
+    uint64 in_dr[DR_PERFCTR_NUM];
+    /** Counts while the thread was in the code cache. */
+    uint64 in_cache[DR_PERFCTR_NUM];
+} dr_perfctr_values_t;
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Returns in \p values the event counts for the thread \p drcontext so
+ * far, split between DR and the code cache.  Another thread's \p drcontext
+ * may only be passed while that thread is suspended, as in a thread exit
+ * event at process exit.  Only user-mode events are counted.  Time in
+ * clean calls counts as code cache time.  The caller must set the size
+ * field of \p values.
+ *
+ * \return false if the -perfctr runtime option is off or no counter is
+ * supported.
+ *
+ * \note Linux only.
+ */
+bool
+dr_get_perfctr_values(void *drcontext, dr_perfctr_values_t *values);
+
 DR_API
 /** 
  * Aborts the process immediately without any cleanup (i.e., the exit event
@@ -2963,6 +3015,39 @@ DR_API
 bool
 dr_module_should_instrument(module_handle_t handle);
 
+DR_API
+/**
+ * Moves the module referred to by \p handle into (\p native is true) or out
+ * of (\p native is false) native execution, just as though it were or were
+ * not on the -native_exec_list runtime option.  Unlike
+ * dr_module_set_should_instrument(), this may be called at any time after the
+ * module's load event, e.g., once a module's code no longer needs to be
+ * observed.  The module's code is flushed from the code cache, so the change
+ * takes effect once the flush completes, which happens before any new code is
+ * executed (see dr_delay_flush_region()).  Native execution is then entered
+ * at the next call into or return to the module from non-native code, and a
+ * thread already running natively in the module is only taken back over at
+ * its next call out of or return from the module.  While native, code from
+ * the module does not reach the basic block event.
+ * \return false if native execution is disabled via -no_native_exec, if the
+ * module is no longer loaded, or if the flush could not be scheduled.
+ *
+ * \warning Native execution can lose control of the application in ways that
+ * regular execution does not, e.g., on callbacks from the module to code
+ * that was not reached via a call.
+ */
+bool
+dr_module_set_native(module_handle_t handle, bool native);
+
+DR_API
+/**
+ * Returns whether the module referred to by \p handle is executed natively,
+ * either because it was listed in -native_exec_list or because of a prior
+ * call to dr_module_set_native().
+ */
+bool
+dr_module_is_native(module_handle_t handle);
+
 DR_API
 /**
  * Returns the entry point of the exported function with the given
@@ -4029,6 +4114,103 @@ DR_API
 bool
 dr_retakeover_suspended_native_thread(void *drcontext);
 
+DR_API
+/**
+ * Causes the thread owning \p drcontext to execute natively, outside of
+ * DR's control, once it is resumed.  The thread must currently be
+ * suspended by dr_suspend_all_other_threads_ex() with #DR_SUSPEND_NATIVE.
+ * Only a thread interrupted while executing in the code cache can be
+ * sent native: for a thread inside DR, at a system call, or in the middle
+ * of building a trace, this routine returns false and the thread stays
+ * under DR control, so the caller can simply try again at a later
+ * suspension.  No state is discarded: the code cache, the thread's
+ * drcontext, and all client state are kept, and the thread can later be
+ * returned to the code cache with dr_retakeover_suspended_native_thread().
+ * A thread with signals that DR has queued for it but not yet delivered
+ * is not sent native either.  While native, the thread's system calls
+ * bypass DR: call dr_rescan_after_native() before taking threads back
+ * over, and see there for what is and is not caught up with.  Signals
+ * arriving while the thread is native are delivered straight to the
+ * application's handlers, without a signal event, and a native write to
+ * code DR had made read-only is let through.
+ * Not yet supported on Windows.  \return whether successful.
+ */
+bool
+dr_send_suspended_thread_native(void *drcontext);
+
+DR_API
+/**
+ * Brings DR up to date with changes that threads sent native by
+ * dr_send_suspended_thread_native() made without DR seeing them.  As at
+ * attach time, the memory map is re-read: modules that were unloaded are
+ * removed (invoking the module unload event), code that was unmapped or
+ * changed protection is flushed, and new mappings and modules are processed
+ * (invoking the module load event).  Threads that exited while native are
+ * cleaned up (invoking the thread exit event) and threads created while
+ * native are taken over.  When each thread is taken back over by
+ * dr_retakeover_suspended_native_thread(), any signal handlers it installed
+ * while native are recorded as the application's and DR's own handlers are
+ * put back.
+ *
+ * Must be called with no other threads suspended, and ideally just before
+ * suspending them to take them back over: changes made in between are
+ * missed.  A thread's signal mask is taken back from the kernel as it is
+ * taken back over, but changes to its alternate signal stack made while
+ * native are not caught up with, and a handler installed while native
+ * receives its signals directly until then.  A thread created while native
+ * is not known to DR until it is taken over: a fault in it before then is
+ * fatal.
+ * No-op on Windows.
+ */
+void
+dr_rescan_after_native(void);
+
+#ifdef UNIX
+DR_API
+/**
+ * Creates a snapshot of the process: a forked copy in which \p func is
+ * called with \p arg and the current thread's \p drcontext, after which the
+ * copy exits.  This is intended for writing out large client data
+ * structures without pausing the application for the I/O: the snapshot sees
+ * all memory as it was at the time of the call, with copy-on-write isolation
+ * from the still-running process.
+ *
+ * All other threads are suspended at safe points, as with
+ * dr_suspend_all_other_threads(), only for as long as the fork takes.  The
+ * snapshot contains only the calling thread, so \p func must not wait on
+ * locks that another thread could have held at the time of the call; DR's
+ * own locks are never held.  \p func should restrict itself to reading
+ * memory, allocating memory, and file I/O.  Neither DR's nor the client's
+ * exit events run in the snapshot, and file handles not closed by \p func
+ * are simply closed when it exits.
+ *
+ * The application is never notified of the snapshot process: it is not
+ * sent SIGCHLD and is not seen by wait() calls.  The caller must
+ * reap it with dr_snapshot_wait().
+ *
+ * Must not be called while holding a lock.  \return the process id of the
+ * snapshot in the calling process, or INVALID_PROCESS_ID on failure,
+ * including when some other thread could not be suspended.
+ *
+ * \note Linux only.
+ */
+process_id_t
+dr_create_snapshot(void (*func)(void *drcontext, void *arg), void *arg);
+
+DR_API
+/**
+ * Reaps the snapshot process \p pid created by dr_create_snapshot().  If \p
+ * block is true, waits for it to exit; otherwise, returns false immediately
+ * if it is still running.  \return whether it has exited.  If \p completed
+ * is non-NULL, it is set to whether the snapshot's callback returned
+ * normally.
+ *
+ * \note Linux only.
+ */
+bool
+dr_snapshot_wait(process_id_t pid, bool block, OUT bool *completed);
+#endif
+
 /* We do not translate the context to avoid lock issues (PR 205795).
  * We do not delay until a safe point (via regular delayable signal path)
  * since some clients may want the interrupted context: for a general
@@ -4491,6 +4673,42 @@ dr_insert_clean_call_ex(void *drcontext, instrlist_t *ilist, instr_t *where,
                         void *callee, dr_cleancall_save_t save_flags,
                         uint num_args, ...);
 
+DR_API
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) forming a
+ * one-shot clean call to \p callee, which is passed \p user_data as its
+ * sole argument.  The first time the sequence executes it patches itself
+ * in the code cache so that all later executions skip the clean call with
+ * a pair of direct jumps, and only then invokes \p callee.  This avoids
+ * the flush and rebuild that removing instrumentation with
+ * dr_flush_region() requires, making it suitable for discovering edges or
+ * other one-time events across large amounts of code.  \p save_fpstate
+ * has the same meaning as for dr_insert_clean_call().
+ *
+ * The patch is a single atomic write, so other threads executing the same
+ * code (whether in a shared cache or concurrently with the patch) run
+ * either the whole clean call or none of it, and \p callee is invoked
+ * exactly once per copy of the sequence even if several threads reach it
+ * at once.  Each copy of the containing fragment is a separate copy of
+ * the sequence: a thread-private block, a trace built from a block, and a
+ * block rebuilt after a flush each fire independently, so \p callee must
+ * tolerate being called more than once for the same \p user_data.  The
+ * patch does not change the length of any instruction, so state
+ * translation is unaffected, but a client whose basic block event
+ * inserts a one-shot call only while it has not yet fired must return
+ * #DR_EMIT_STORE_TRANSLATIONS.
+ *
+ * \p callee may use dr_get_mcontext(), dr_set_mcontext(), and
+ * dr_redirect_execution() as for any clean call.
+ *
+ * \return false if the code cache is not writable (the
+ * -protect_mask option includes the code cache), in which case nothing
+ * is inserted.
+ */
+bool
+dr_insert_oneshot_call(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       void *callee, bool save_fpstate, void *user_data);
+
 DR_API
 /**
  * Inserts into \p ilist prior to \p where meta-instruction(s) to set
@@ -5059,6 +5277,29 @@ DR_API
 bool
 dr_bb_exists_at(void *drcontext, void *tag);
 
+DR_API
+/**
+ * Builds basic blocks for each of the \p tags_count application addresses in
+ * \p tags and adds them to the code cache, without executing them.  Tags that
+ * already have a fragment are skipped.  Blocks are built by the regular block
+ * builder, so blocks in modules are placed into coarse-grain units when
+ * -coarse_units is enabled and will be persisted along with the rest of the
+ * unit (e.g., when running with -persist).  This allows a tool to warm a cache
+ * ahead of time from statically discovered block starts.
+ *
+ * Each tag must point to readable, executable application code: the caller is
+ * responsible for filtering out addresses that might fault on decode.
+ * Must be called from a client event callback on a thread with a valid
+ * drcontext.  Returns false if no thread context is available.  If \p
+ * num_built is non-NULL, it is set to the number of blocks that were newly
+ * built, as opposed to already present (e.g., loaded from a persisted cache).
+ *
+ * \note Bb events are delivered for each newly built block just as for
+ * blocks built on execution.
+ */
+bool
+dr_prepopulate_cache(app_pc *tags, size_t tags_count, size_t *num_built OUT);
+
 DR_API 
 /**
  * Looks up the fragment with tag \p tag.
@@ -5102,6 +5343,43 @@ DR_API
 app_pc
 dr_app_pc_from_cache_pc(byte *cache_pc);
 
+/* DR_API EXPORT BEGIN */
+/**
+ * Where a thread's control is, as returned by dr_where_am_i().
+ */
+typedef enum {
+    DR_WHERE_APP = 0,           /**< Executing the application natively. */
+    DR_WHERE_INTERP,            /**< Building a basic block. */
+    DR_WHERE_DISPATCH,          /**< In DR's dispatcher. */
+    DR_WHERE_MONITOR,           /**< In DR's trace building code. */
+    DR_WHERE_SYSCALL_HANDLER,   /**< Handling a system call. */
+    DR_WHERE_SIGNAL_HANDLER,    /**< Handling a signal or exception. */
+    DR_WHERE_TRAMPOLINE,        /**< In an interception trampoline. */
+    DR_WHERE_CONTEXT_SWITCH,    /**< Entering or exiting the code cache. */
+    DR_WHERE_IBL,               /**< In indirect branch lookup code. */
+    DR_WHERE_FCACHE,            /**< Executing a fragment in the code cache. */
+    DR_WHERE_UNKNOWN,           /**< Elsewhere, e.g., in a clean call. */
+} dr_where_am_i_t;
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Returns where the thread \p drcontext is executing, given the pc \p pc it
+ * was interrupted at, as passed to an itimer callback (see dr_set_itimer()).
+ * If the pc is in a code cache fragment, returns #DR_WHERE_FCACHE and, if \p
+ * tag is not NULL, writes the tag of the fragment to \p tag, from which
+ * dr_fragment_app_pc() obtains the application pc of the start of the block
+ * or trace.  Otherwise, sets \p tag to NULL.
+ *
+ * Unlike dr_app_pc_from_cache_pc(), this routine does not translate or
+ * decode anything and acquires no locks in the common case, so it is meant
+ * to be cheap and safe enough to call from an itimer callback for sampling.
+ * The result is only meaningful for the current thread or for a thread that
+ * is suspended.
+ */
+dr_where_am_i_t
+dr_where_am_i(void *drcontext, app_pc pc, OUT void **tag);
+
 DR_API
 /**
  * Returns whether the given thread indicated by \p drcontext
@@ -5227,6 +5505,49 @@ DR_API
 /** Checks to see that if there is a trace in the code cache at tag \p tag. */
 bool
 dr_trace_exists_at(void *drcontext, void *tag);
+
+DR_API
+/**
+ * Requests that traces starting at \p head be formed from the region
+ * consisting of the \p num_tags basic block tags in \p tags, such as
+ * the blocks of a loop body or of a function and its callees.  \p head
+ * is marked as a trace head (see dr_mark_trace_head()).  Once it
+ * becomes hot, DR builds the trace along the executed path, adding
+ * each next block whose tag is in the region, even if that block is
+ * itself a trace head or already part of another trace.  The trace
+ * ends before the first block that is not in the region, before
+ * returning to \p head, or once it holds \p max_bbs blocks; passing
+ * 0 for \p max_bbs uses \p num_tags + 1.  The -max_trace_bbs option
+ * does not apply to region traces, but DR's limits on trace size and
+ * on blocks that cannot be part of a trace still do.
+ *
+ * Like all DR traces, a region trace is a single path through the
+ * region: execution that leaves that path does so through an
+ * ordinary trace exit, which DR links to the target block or trace as
+ * usual.  To give another frequently executed path through the same
+ * region a trace of its own, register a region at the block where
+ * that path enters.
+ *
+ * A region takes precedence over the end-trace event for traces
+ * starting at \p head.  Registering a region at a head that already
+ * has one replaces it.  Regions only affect traces built after
+ * registration.
+ *
+ * \return false if \p head cannot be marked as a trace head or if
+ * \p tags is empty; else true.
+ */
+bool
+dr_register_trace_region(void *drcontext, void *head, void **tags, uint num_tags,
+                         uint max_bbs);
+
+DR_API
+/**
+ * Removes the region registered at \p head by dr_register_trace_region().
+ * Traces already built from the region are not affected.
+ * \return false if no region was registered at \p head.
+ */
+bool
+dr_unregister_trace_region(void *head);
 #endif /* CUSTOM_TRACES */
 
 #ifdef UNSUPPORTED_API
@@ -4691,6 +4691,317 @@ recreate_bb_ilist(dcontext_t *dcontext, byte *pc, byte *pretend_pc,
     return bb.ilist;
 }
 
+/* Cache of decoded application blocks for state translation.
+ * Translating a fault or a suspended thread normally re-decodes the
+ * application code of the containing fragment and re-runs mangling and
+ * client instrumentation, which signal-heavy applications hit constantly.
+ * We keep a small per-thread direct-mapped table of the resulting
+ * instrlist_t, keyed by tag and by the parameters it was built with, and
+ * hand out clones of it.  An entry is validated against a digest of the
+ * application bytes it was decoded from, and is removed whenever a flush
+ * covers any of those bytes (which is how the vmareas write tracking
+ * reports code modification), since a flush is also how a client asks for
+ * new instrumentation.
+ * The table is only touched by the thread owning it, or by a thread that
+ * has it suspended while holding thread_initexit_lock (see the
+ * synchronization notes at recreate_fragment_ilist()), so it needs no lock.
+ * A flush from another thread that cannot be sure the owner is suspended
+ * only sets recreate_cache_stale, and the table is emptied on its next use.
+ */
+#define RECREATE_CACHE_MAX_RANGES 4
+
+/* key bits describing how an ilist was built */
+enum {
+    RECREATE_CACHE_MANGLE      = 0x01,
+    RECREATE_CACHE_CALL_CLIENT = 0x02,
+    RECREATE_CACHE_FOR_TRACE   = 0x04,
+    RECREATE_CACHE_X86_MODE    = 0x08,
+};
+
+typedef struct _recreate_cache_entry_t {
+    app_pc tag;           /* NULL if this slot is empty */
+    uint key;             /* RECREATE_CACHE_* bits */
+    uint res_flags;       /* bb.flags from the original recreation */
+    uint res_exit_type;   /* bb.exit_type from the original recreation */
+    uint digest;          /* of the app bytes in the ranges below */
+    uint num_ranges;
+    app_pc range_start[RECREATE_CACHE_MAX_RANGES];
+    uint range_size[RECREATE_CACHE_MAX_RANGES];
+    instrlist_t *ilist;
+} recreate_cache_entry_t;
+
+typedef struct _recreate_cache_t {
+    uint num_entries; /* power of 2 */
+    recreate_cache_entry_t entry[1]; /* variable-sized */
+} recreate_cache_t;
+
+static inline size_t
+recreate_cache_alloc_size(uint num_entries)
+{
+    return sizeof(recreate_cache_t) + sizeof(recreate_cache_entry_t)*(num_entries-1);
+}
+
+static recreate_cache_t *
+recreate_cache_get(dcontext_t *dcontext)
+{
+    per_thread_t *pt;
+    if (dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    pt = (per_thread_t *) dcontext->fragment_field;
+    return (pt == NULL) ? NULL : (recreate_cache_t *) pt->recreate_cache;
+}
+
+static void
+recreate_cache_entry_free(dcontext_t *dcontext, recreate_cache_entry_t *e)
+{
+    if (e->ilist != NULL)
+        instrlist_clear_and_destroy(dcontext, e->ilist);
+    e->ilist = NULL;
+    e->tag = NULL;
+}
+
+/* Computes the digest of e's ranges into *digest.  Returns false if any
+ * range is no longer readable.
+ */
+static bool
+recreate_cache_digest(recreate_cache_entry_t *e, uint *digest OUT)
+{
+    uint i, res = 0;
+    for (i = 0; i < e->num_ranges; i++) {
+        if (!is_readable_without_exception(e->range_start[i], e->range_size[i]))
+            return false;
+        res = (res << 5) + res + crc32((const char *) e->range_start[i],
+                                       e->range_size[i]);
+    }
+    *digest = res;
+    return true;
+}
+
+/* Records in e the app code ranges that ilist was decoded from.  A range
+ * is broken wherever bb building followed a ubr or call, in which case we
+ * extend it over the elided cti at its end.  Returns false if the ranges
+ * cannot be determined or there are too many of them to be worth caching.
+ */
+static bool
+recreate_cache_set_ranges(dcontext_t *dcontext, recreate_cache_entry_t *e,
+                          instrlist_t *ilist)
+{
+    instr_t *inst;
+    app_pc start = NULL, end = NULL, last = NULL, next;
+    e->num_ranges = 0;
+    for (inst = instrlist_first(ilist); inst != NULL; inst = instr_get_next(inst)) {
+        app_pc app = instr_get_translation(inst);
+        if (app == NULL || app == last)
+            continue;
+        last = app;
+        if (start != NULL && app >= start && app < end)
+            continue;
+        if (start != NULL && app != end) {
+            next = decode_next_pc(dcontext, end);
+            if (next == NULL || e->num_ranges >= RECREATE_CACHE_MAX_RANGES)
+                return false;
+            e->range_start[e->num_ranges] = start;
+            e->range_size[e->num_ranges] = (uint) (next - start);
+            e->num_ranges++;
+            start = NULL;
+        }
+        if (start == NULL) {
+            start = app;
+            end = app;
+        }
+        next = decode_next_pc(dcontext, app);
+        if (next == NULL)
+            return false;
+        if (next > end)
+            end = next;
+    }
+    if (start == NULL || e->num_ranges >= RECREATE_CACHE_MAX_RANGES)
+        return false;
+    e->range_start[e->num_ranges] = start;
+    e->range_size[e->num_ranges] = (uint) (end - start);
+    e->num_ranges++;
+    return true;
+}
+
+/* Clones a cached ilist for handing out.  instr_clone() drops the
+ * our-mangling mark, which state translation relies on, so we restore it.
+ */
+static instrlist_t *
+recreate_cache_clone_ilist(dcontext_t *dcontext, instrlist_t *ilist)
+{
+    instrlist_t *clone = instrlist_clone(dcontext, ilist);
+    instr_t *inst, *copy;
+    for (inst = instrlist_first(ilist), copy = instrlist_first(clone);
+         inst != NULL && copy != NULL;
+         inst = instr_get_next(inst), copy = instr_get_next(copy)) {
+        instr_set_our_mangling(copy, instr_is_our_mangling(inst));
+    }
+    return clone;
+}
+
+void
+recreate_cache_thread_reset_init(dcontext_t *dcontext)
+{
+    per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+    recreate_cache_t *cache;
+    uint num_entries;
+    pt->recreate_cache = NULL;
+    pt->recreate_cache_stale = false;
+    if (DYNAMO_OPTION(recreate_cache_size) == 0)
+        return;
+    /* round up to a power of 2 so we can mask */
+    for (num_entries = 1; num_entries < DYNAMO_OPTION(recreate_cache_size);
+         num_entries <<= 1)
+        ; /* nothing */
+    cache = (recreate_cache_t *)
+        heap_alloc(dcontext, recreate_cache_alloc_size(num_entries) HEAPACCT(ACCT_OTHER));
+    memset(cache, 0, recreate_cache_alloc_size(num_entries));
+    cache->num_entries = num_entries;
+    pt->recreate_cache = (void *) cache;
+}
+
+void
+recreate_cache_thread_reset_free(dcontext_t *dcontext)
+{
+    per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+    recreate_cache_t *cache = (recreate_cache_t *) pt->recreate_cache;
+    uint i;
+    if (cache == NULL)
+        return;
+    for (i = 0; i < cache->num_entries; i++)
+        recreate_cache_entry_free(dcontext, &cache->entry[i]);
+    heap_free(dcontext, cache, recreate_cache_alloc_size(cache->num_entries)
+              HEAPACCT(ACCT_OTHER));
+    pt->recreate_cache = NULL;
+}
+
+/* Removes all of dcontext's cached blocks that were decoded from any part of
+ * [start, end).  Caller must be dcontext's owner or have it suspended or
+ * synched for flushing.
+ */
+void
+recreate_cache_invalidate(dcontext_t *dcontext, app_pc start, app_pc end)
+{
+    recreate_cache_t *cache = recreate_cache_get(dcontext);
+    uint i, j;
+    if (cache == NULL)
+        return;
+    for (i = 0; i < cache->num_entries; i++) {
+        recreate_cache_entry_t *e = &cache->entry[i];
+        if (e->tag == NULL)
+            continue;
+        for (j = 0; j < e->num_ranges; j++) {
+            if (e->range_start[j] < end &&
+                e->range_start[j] + e->range_size[j] > start) {
+                LOG(THREAD, LOG_INTERP, 3,
+                    "recreate_cache_invalidate: removing "PFX"\n", e->tag);
+                recreate_cache_entry_free(dcontext, e);
+                STATS_INC(recreate_cache_invalidations);
+                break;
+            }
+        }
+    }
+}
+
+/* Marks all of dcontext's cached blocks as stale without touching them, for
+ * a flusher that may race with dcontext's owner using the table.  The
+ * entries are freed at the table's next use.
+ */
+void
+recreate_cache_mark_stale(dcontext_t *dcontext)
+{
+    per_thread_t *pt;
+    if (dcontext == GLOBAL_DCONTEXT)
+        return;
+    pt = (per_thread_t *) dcontext->fragment_field;
+    if (pt != NULL && pt->recreate_cache != NULL)
+        pt->recreate_cache_stale = true;
+}
+
+/* Wrapper around recreate_bb_ilist() for recreating the bb at tag from its
+ * own app code with vm area checks, which consults and fills in the
+ * per-thread recreate cache.
+ */
+static instrlist_t *
+recreate_bb_ilist_cached(dcontext_t *dcontext, byte *tag,
+                         uint *res_flags OUT, uint *res_exit_type OUT, bool mangle
+                         _IF_CLIENT(bool call_client) _IF_CLIENT(bool for_trace))
+{
+    recreate_cache_t *cache = recreate_cache_get(dcontext);
+    recreate_cache_entry_t *e;
+    instrlist_t *ilist;
+    uint key = 0, flags, exit_type, digest;
+
+    if (cache != NULL &&
+        ((per_thread_t *) dcontext->fragment_field)->recreate_cache_stale) {
+        per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+        uint i;
+        LOG(THREAD, LOG_INTERP, 3, "recreate_bb_ilist_cached: dropping stale table\n");
+        pt->recreate_cache_stale = false;
+        for (i = 0; i < cache->num_entries; i++) {
+            if (cache->entry[i].tag != NULL) {
+                recreate_cache_entry_free(dcontext, &cache->entry[i]);
+                STATS_INC(recreate_cache_invalidations);
+            }
+        }
+    }
+    if (cache == NULL) {
+        return recreate_bb_ilist(dcontext, tag, tag, 0/*no pre flags*/,
+                                 res_flags, res_exit_type, true/*check vm area*/,
+                                 mangle, NULL _IF_CLIENT(call_client)
+                                 _IF_CLIENT(for_trace));
+    }
+    if (mangle)
+        key |= RECREATE_CACHE_MANGLE;
+#ifdef CLIENT_INTERFACE
+    if (call_client)
+        key |= RECREATE_CACHE_CALL_CLIENT;
+    if (for_trace)
+        key |= RECREATE_CACHE_FOR_TRACE;
+#endif
+#ifdef X64
+    if (get_x86_mode(dcontext))
+        key |= RECREATE_CACHE_X86_MODE;
+#endif
+    e = &cache->entry[(((ptr_uint_t)tag >> 4) ^ (ptr_uint_t)tag ^ key) &
+                      (cache->num_entries - 1)];
+    if (e->tag == tag && e->key == key) {
+        if (recreate_cache_digest(e, &digest) && digest == e->digest) {
+            LOG(THREAD, LOG_INTERP, 3, "recreate_bb_ilist_cached: hit for "PFX"\n", tag);
+            STATS_INC(recreate_cache_hits);
+            if (res_flags != NULL)
+                *res_flags = e->res_flags;
+            if (res_exit_type != NULL)
+                *res_exit_type = e->res_exit_type;
+            return recreate_cache_clone_ilist(dcontext, e->ilist);
+        }
+        LOG(THREAD, LOG_INTERP, 3, "recreate_bb_ilist_cached: stale "PFX"\n", tag);
+        STATS_INC(recreate_cache_stale);
+    }
+    STATS_INC(recreate_cache_misses);
+    ilist = recreate_bb_ilist(dcontext, tag, tag, 0/*no pre flags*/,
+                              &flags, &exit_type, true/*check vm area*/,
+                              mangle, NULL _IF_CLIENT(call_client) _IF_CLIENT(for_trace));
+    if (ilist == NULL)
+        return NULL;
+    if (res_flags != NULL)
+        *res_flags = flags;
+    if (res_exit_type != NULL)
+        *res_exit_type = exit_type;
+    /* replace whatever was in the slot */
+    recreate_cache_entry_free(dcontext, e);
+    if (!TEST(FRAG_SELFMOD_SANDBOXED, flags) &&
+        recreate_cache_set_ranges(dcontext, e, ilist) &&
+        recreate_cache_digest(e, &e->digest)) {
+        e->tag = tag;
+        e->key = key;
+        e->res_flags = flags;
+        e->res_exit_type = exit_type;
+        e->ilist = recreate_cache_clone_ilist(dcontext, ilist);
+    }
+    return ilist;
+}
+
 /* Re-creates an ilist of the fragment that currently contains the
  * passed-in code cache pc, also returns the fragment.
  *
@@ -4767,11 +5078,9 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
 
     if ((f->flags & FRAG_IS_TRACE) == 0) {
         /* easy case: just a bb */
-        ilist = recreate_bb_ilist(dcontext, (byte *) f->tag, (byte *) f->tag,
-                                  0/*no pre flags*/, &flags, NULL,
-                                  true/*check vm area*/, mangle, NULL
-                                  _IF_CLIENT(call_client)
-                                  _IF_CLIENT(false/*not for_trace*/));
+        ilist = recreate_bb_ilist_cached(dcontext, (byte *) f->tag, &flags, NULL,
+                                         mangle _IF_CLIENT(call_client)
+                                         _IF_CLIENT(false/*not for_trace*/));
         ASSERT(ilist != NULL);
         if (ilist == NULL) /* a race */
             goto recreate_fragment_done;
@@ -4807,12 +5116,19 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
         for (i=0; i<t->num_bbs; i++) {
             void *vmlist = NULL;
             apc = (byte *) t->bbs[i].tag;
-            bb = recreate_bb_ilist(dcontext, apc, apc, 0/*no pre flags*/,
-                                   &flags, &md.final_exit_flags,
-                                   true/*check vm area*/, !mangle_at_end,
-                                   (mangle_at_end ? &vmlist : NULL)
-                                   _IF_CLIENT(call_client)
-                                   _IF_CLIENT(true/*for_trace*/));
+            if (mangle_at_end) {
+                bb = recreate_bb_ilist(dcontext, apc, apc, 0/*no pre flags*/,
+                                       &flags, &md.final_exit_flags,
+                                       true/*check vm area*/, false/*!mangle*/,
+                                       &vmlist _IF_CLIENT(call_client)
+                                       _IF_CLIENT(true/*for_trace*/));
+            } else {
+                /* no vmlist needed, so we can use the recreate cache */
+                bb = recreate_bb_ilist_cached(dcontext, apc, &flags,
+                                              &md.final_exit_flags, true/*mangle*/
+                                              _IF_CLIENT(call_client)
+                                              _IF_CLIENT(true/*for_trace*/));
+            }
             ASSERT(bb != NULL);
             if (bb == NULL) {
                 instrlist_clear_and_destroy(dcontext, ilist);
@@ -136,9 +136,10 @@ typedef struct _generic_event_entry_t {
  * GLOBALS
  */
 
-/* Using read-write locks to protect counts and lists to allow concurrent
- * bb events and only require mutual exclusion when a cb is registered
- * or unregistered, which should be rare.
+/* Registration and unregistration of bb events take bb_cb_lock, which
+ * protects the lists below.  drmgr_bb_event does not take it: each
+ * registration change publishes an immutable snapshot of the lists, which
+ * bb events read without locking.
  */
 static void *bb_cb_lock;
 
@@ -150,18 +151,34 @@ static cb_entry_t *cblist_app2app;
 static cb_entry_t *cblist_instrumentation;
 static cb_entry_t *cblist_instru2instru;
 
-/* Count of callbacks needing user_data, protected by bb_cb_lock */
-static uint pair_count;
-static uint quartet_count;
+/* A copy of the three bb lists in one array.  A bb event in flight on another
+ * thread may still be using a replaced snapshot, so replaced snapshots are
+ * only freed at exit.  Registration is rare, so few accumulate.
+ */
+typedef struct _bb_cb_snapshot_t {
+    int version;
+    uint num_app2app;
+    uint num_instrumentation;
+    uint num_instru2instru;
+    /* Count of callbacks needing user_data */
+    uint pair_count;
+    uint quartet_count;
+    /* The snapshot this one replaced */
+    struct _bb_cb_snapshot_t *prev;
+    size_t size;
+    /* The app2app, then instrumentation, then instru2instru entries follow */
+    cb_entry_t entries[1];
+} bb_cb_snapshot_t;
+
+/* Written under bb_cb_lock, read without it */
+static bb_cb_snapshot_t * volatile bb_cb_snapshot;
+static int bb_cb_version;
 
 /* Priority used for non-_ex events */
 static const drmgr_priority_t default_priority = {
     sizeof(default_priority), "__DEFAULT__", NULL, NULL, 0
 };
 
-/* We store the current bb phase in a TLS slot. */
-static int tls_idx_bb_phase;
-
 static dr_emit_flags_t
 drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                bool for_trace, bool translating);
@@ -186,6 +203,13 @@ typedef struct _tls_array_t {
     void *cls[MAX_NUM_TLS];
     struct _tls_array_t *prev;
     struct _tls_array_t *next;
+    /* For drmgr_bb_event, which accesses these directly rather than through
+     * tls[] slots.  The user_data buffer is reused across blocks.
+     */
+    drmgr_bb_phase_t bb_phase;
+    bool bb_data_in_use;
+    uint bb_data_slots;
+    void **bb_data;
 } tls_array_t;
 
 /* Whether each slot is reserved.  Protected by tls_lock. */
@@ -303,7 +327,7 @@ drmgr_init(void)
     drmgr_note = drx_reserve_note_range(NUM_DRMGR_NOTE);
     ASSERT(drmgr_note != DRX_NOTE_NONE, "fail to reserve note");
 
-    bb_cb_lock = dr_rwlock_create();
+    bb_cb_lock = dr_mutex_create();
     thread_event_lock = dr_rwlock_create();
     tls_lock = dr_mutex_create();
     cls_event_lock = dr_rwlock_create();
@@ -332,8 +356,6 @@ drmgr_init(void)
     dr_register_exception_event(drmgr_exception_event);
 #endif
 
-    tls_idx_bb_phase = drmgr_register_tls_field();
-
     return true;
 }
 
@@ -346,8 +368,6 @@ drmgr_exit(void)
     if (count != 0)
         return;
 
-    drmgr_unregister_tls_field(tls_idx_bb_phase);
-
     drmgr_bb_exit();
     drmgr_event_exit();
 
@@ -365,7 +385,7 @@ drmgr_exit(void)
     dr_rwlock_destroy(cls_event_lock);
     dr_mutex_destroy(tls_lock);
     dr_rwlock_destroy(thread_event_lock);
-    dr_rwlock_destroy(bb_cb_lock);
+    dr_mutex_destroy(bb_cb_lock);
 
     drx_exit();
 }
@@ -403,28 +423,56 @@ static dr_emit_flags_t
 drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                bool for_trace, bool translating)
 {
-    cb_entry_t *e;
+    cb_entry_t *e, *app2app, *instrumentation, *instru2instru, *end;
     dr_emit_flags_t res = DR_EMIT_DEFAULT;
     instr_t *inst, *next_inst;
     void **pair_data = NULL, **quartet_data = NULL;
-    uint pair_idx, quartet_idx;
+    uint pair_idx, quartet_idx, num_data;
+    bool own_data = false;
+    tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
+    drmgr_bb_phase_t outer_phase = DRMGR_PHASE_NONE;
+    /* Read the snapshot once: changes made by callbacks take effect for the
+     * next block.
+     */
+    bb_cb_snapshot_t *snap = bb_cb_snapshot;
 
-    dr_rwlock_read_lock(bb_cb_lock);
+    if (snap == NULL)
+        return res;
+    app2app = snap->entries;
+    instrumentation = app2app + snap->num_app2app;
+    instru2instru = instrumentation + snap->num_instrumentation;
+    end = instru2instru + snap->num_instru2instru;
 
-    /* We need per-thread user_data */
-    if (pair_count > 0)
-        pair_data = (void **) dr_thread_alloc(drcontext, sizeof(void*)*pair_count);
-    if (quartet_count > 0)
-        quartet_data = (void **) dr_thread_alloc(drcontext, sizeof(void*)*quartet_count);
+    /* We need per-thread user_data.  We reuse the thread's buffer unless
+     * there is none yet or an outer bb event on this thread is using it.
+     */
+    num_data = snap->pair_count + snap->quartet_count;
+    if (num_data > 0) {
+        if (tls != NULL && !tls->bb_data_in_use) {
+            if (tls->bb_data_slots < num_data) {
+                if (tls->bb_data != NULL) {
+                    dr_thread_free(drcontext, tls->bb_data,
+                                   sizeof(void*)*tls->bb_data_slots);
+                }
+                tls->bb_data = (void **) dr_thread_alloc(drcontext,
+                                                         sizeof(void*)*num_data);
+                tls->bb_data_slots = num_data;
+            }
+            tls->bb_data_in_use = true;
+            pair_data = tls->bb_data;
+        } else {
+            pair_data = (void **) dr_thread_alloc(drcontext, sizeof(void*)*num_data);
+            own_data = true;
+        }
+        quartet_data = pair_data + snap->pair_count;
+    }
+    if (tls != NULL)
+        outer_phase = tls->bb_phase;
 
     /* Pass 1: app2app */
-    /* XXX: better to avoid all this set_tls overhead and assume DR is globally
-     * synchronizing bb building anyway and use a global var + mutex?
-     */
-    drmgr_set_tls_field(drcontext, tls_idx_bb_phase,
-                        (void *)(ptr_int_t)DRMGR_PHASE_APP2APP);
-    for (quartet_idx = 0, e = cblist_app2app; e != NULL;
-         e = (cb_entry_t *) e->pri.next) {
+    if (tls != NULL)
+        tls->bb_phase = DRMGR_PHASE_APP2APP;
+    for (quartet_idx = 0, e = app2app; e < instrumentation; e++) {
         if (e->has_quartet) {
             res |= (*e->cb.app2app_ex_cb)
                 (drcontext, tag, bb, for_trace, translating, &quartet_data[quartet_idx]);
@@ -434,10 +482,9 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     }
 
     /* Pass 2: analysis */
-    drmgr_set_tls_field(drcontext, tls_idx_bb_phase,
-                        (void *)(ptr_int_t)DRMGR_PHASE_ANALYSIS);
-    for (quartet_idx = 0, pair_idx = 0, e = cblist_instrumentation; e != NULL;
-         e = (cb_entry_t *) e->pri.next) {
+    if (tls != NULL)
+        tls->bb_phase = DRMGR_PHASE_ANALYSIS;
+    for (quartet_idx = 0, pair_idx = 0, e = instrumentation; e < instru2instru; e++) {
         if (e->has_quartet) {
             res |= (*e->cb.pair_ex.analysis_ex_cb)
                 (drcontext, tag, bb, for_trace, translating, quartet_data[quartet_idx]);
@@ -451,12 +498,12 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     }
 
     /* Pass 3: instru, per instr */
-    drmgr_set_tls_field(drcontext, tls_idx_bb_phase,
-                        (void *)(ptr_int_t)DRMGR_PHASE_INSERTION);
+    if (tls != NULL)
+        tls->bb_phase = DRMGR_PHASE_INSERTION;
     for (inst = instrlist_first(bb); inst != NULL; inst = next_inst) {
         next_inst = instr_get_next(inst);
-        for (quartet_idx = 0, pair_idx = 0, e = cblist_instrumentation; e != NULL;
-             e = (cb_entry_t *) e->pri.next) {
+        for (quartet_idx = 0, pair_idx = 0, e = instrumentation; e < instru2instru;
+             e++) {
             if (e->has_quartet) {
                 res |= (*e->cb.pair_ex.insertion_ex_cb)
                     (drcontext, tag, bb, inst, for_trace, translating,
@@ -473,10 +520,9 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     }
 
     /* Pass 4: final */
-    drmgr_set_tls_field(drcontext, tls_idx_bb_phase,
-                        (void *)(ptr_int_t)DRMGR_PHASE_INSTRU2INSTRU);
-    for (quartet_idx = 0, e = cblist_instru2instru; e != NULL;
-         e = (cb_entry_t *) e->pri.next) {
+    if (tls != NULL)
+        tls->bb_phase = DRMGR_PHASE_INSTRU2INSTRU;
+    for (quartet_idx = 0, e = instru2instru; e < end; e++) {
         if (e->has_quartet) {
             res |= (*e->cb.instru2instru_ex_cb)
                 (drcontext, tag, bb, for_trace, translating, quartet_data[quartet_idx]);
@@ -488,19 +534,86 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     /* Pass 5: our private pass to support multiple non-meta ctis in app2app phase */
     drmgr_fix_app_ctis(drcontext, bb);
 
-    drmgr_set_tls_field(drcontext, tls_idx_bb_phase,
-                        (void *)(ptr_int_t)DRMGR_PHASE_NONE);
-
-    if (pair_count > 0)
-        dr_thread_free(drcontext, pair_data, sizeof(void*)*pair_count);
-    if (quartet_count > 0)
-        dr_thread_free(drcontext, quartet_data, sizeof(void*)*quartet_count);
+    if (tls != NULL)
+        tls->bb_phase = outer_phase;
 
-    dr_rwlock_read_unlock(bb_cb_lock);
+    if (own_data)
+        dr_thread_free(drcontext, pair_data, sizeof(void*)*num_data);
+    else if (num_data > 0)
+        tls->bb_data_in_use = false;
 
     return res;
 }
 
+static uint
+drmgr_bb_cb_count(cb_entry_t *list, uint *pairs, uint *quartets)
+{
+    uint count = 0, num_pairs = 0, num_quartets = 0;
+    cb_entry_t *e;
+    for (e = list; e != NULL; e = (cb_entry_t *) e->pri.next) {
+        count++;
+        if (e->has_quartet)
+            num_quartets++;
+        else
+            num_pairs++;
+    }
+    if (pairs != NULL)
+        *pairs = num_pairs;
+    if (quartets != NULL && num_quartets > *quartets)
+        *quartets = num_quartets;
+    return count;
+}
+
+static cb_entry_t *
+drmgr_bb_cb_copy(cb_entry_t *list, cb_entry_t *dst)
+{
+    cb_entry_t *e;
+    for (e = list; e != NULL; e = (cb_entry_t *) e->pri.next, dst++) {
+        *dst = *e;
+        dst->pri.next = NULL;
+    }
+    return dst;
+}
+
+/* Caller must hold bb_cb_lock.
+ * Publishes a snapshot of the current lists for drmgr_bb_event.
+ */
+static void
+drmgr_bb_cb_publish(void)
+{
+    bb_cb_snapshot_t *snap;
+    uint num_app2app, num_instrumentation, num_instru2instru;
+    uint pairs, quartets = 0;
+    size_t size;
+    cb_entry_t *dst;
+
+    /* Quartets are indexed separately in each pass; pairs only occur in the
+     * instrumentation list.
+     */
+    num_app2app = drmgr_bb_cb_count(cblist_app2app, NULL, &quartets);
+    num_instrumentation = drmgr_bb_cb_count(cblist_instrumentation, &pairs, &quartets);
+    num_instru2instru = drmgr_bb_cb_count(cblist_instru2instru, NULL, &quartets);
+
+    size = sizeof(*snap) +
+        sizeof(cb_entry_t) * (num_app2app + num_instrumentation + num_instru2instru);
+    snap = (bb_cb_snapshot_t *) dr_global_alloc(size);
+    snap->size = size;
+    snap->num_app2app = num_app2app;
+    snap->num_instrumentation = num_instrumentation;
+    snap->num_instru2instru = num_instru2instru;
+    snap->pair_count = pairs;
+    snap->quartet_count = quartets;
+    dst = drmgr_bb_cb_copy(cblist_app2app, snap->entries);
+    dst = drmgr_bb_cb_copy(cblist_instrumentation, dst);
+    drmgr_bb_cb_copy(cblist_instru2instru, dst);
+    snap->prev = bb_cb_snapshot;
+    /* The atomic add is a full barrier, so the contents are visible to other
+     * threads before the pointer is.
+     */
+    snap->version = dr_atomic_add32_return_sum(&bb_cb_version, 1);
+    bb_cb_snapshot = snap;
+}
+
 /* Caller must hold write lock.
  * priority can be NULL in which case default_priority is used.
  */
@@ -616,23 +729,20 @@ drmgr_bb_cb_add(cb_entry_t **list,
         }
     }
 
-    dr_rwlock_write_lock(bb_cb_lock);
+    dr_mutex_lock(bb_cb_lock);
 
     if (priority_event_add((priority_event_entry_t **)list,
                            &new_e->pri, priority)) {
+        drmgr_bb_cb_publish();
         if (bb_event_count == 0)
             dr_register_bb_event(drmgr_bb_event);
         bb_event_count++;
-        if (new_e->has_quartet)
-            quartet_count++;
-        else if (xform_func == NULL)
-            pair_count++;
     } else {
         dr_global_free(new_e, sizeof(*new_e));
         res = false;
     }
 
-    dr_rwlock_write_unlock(bb_cb_lock);
+    dr_mutex_unlock(bb_cb_lock);
     return res;
 }
 
@@ -704,7 +814,7 @@ drmgr_bb_cb_remove(cb_entry_t **list,
     ASSERT((xform_func != NULL && analysis_func == NULL) ||
            (xform_func == NULL && analysis_func != NULL), "invalid internal params");
 
-    dr_rwlock_write_lock(bb_cb_lock);
+    dr_mutex_lock(bb_cb_lock);
 
     for (prev_e = NULL, e = *list; e != NULL;
          prev_e = e, e = (cb_entry_t *) e->pri.next) {
@@ -724,18 +834,14 @@ drmgr_bb_cb_remove(cb_entry_t **list,
         else
             prev_e->pri.next = e->pri.next;
         dr_global_free(e, sizeof(*e));
-
-        if (e->has_quartet)
-            quartet_count--;
-        else if (xform_func == NULL)
-            pair_count--;
+        drmgr_bb_cb_publish();
 
         bb_event_count--;
         if (bb_event_count == 0)
             dr_unregister_bb_event(drmgr_bb_event);
     }
 
-    dr_rwlock_write_unlock(bb_cb_lock);
+    dr_mutex_unlock(bb_cb_lock);
     return res;
 }
 
@@ -743,20 +849,26 @@ static void
 drmgr_bb_cb_exit(cb_entry_t *list)
 {
     cb_entry_t *e, *next_e;
-    dr_rwlock_write_lock(bb_cb_lock);
+    dr_mutex_lock(bb_cb_lock);
     for (e = list; e != NULL; e = next_e) {
         next_e = (cb_entry_t *) e->pri.next;
         dr_global_free(e, sizeof(*e));
     }
-    dr_rwlock_write_unlock(bb_cb_lock);
+    dr_mutex_unlock(bb_cb_lock);
 }
 
 static void
 drmgr_bb_exit(void)
 {
+    bb_cb_snapshot_t *snap, *prev;
     drmgr_bb_cb_exit(cblist_app2app);
     drmgr_bb_cb_exit(cblist_instrumentation);
     drmgr_bb_cb_exit(cblist_instru2instru);
+    for (snap = bb_cb_snapshot; snap != NULL; snap = prev) {
+        prev = snap->prev;
+        dr_global_free(snap, snap->size);
+    }
+    bb_cb_snapshot = NULL;
 }
 
 DR_EXPORT
@@ -810,8 +922,10 @@ DR_EXPORT
 drmgr_bb_phase_t
 drmgr_current_bb_phase(void *drcontext)
 {
-    return (drmgr_bb_phase_t)(ptr_int_t)
-        drmgr_get_tls_field(drcontext, tls_idx_bb_phase);
+    tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
+    if (tls == NULL)
+        return DRMGR_PHASE_NONE;
+    return tls->bb_phase;
 }
 
 /***************************************************************************
@@ -1536,6 +1650,8 @@ drmgr_cls_stack_exit(void *drcontext)
         dr_set_tls_field(drcontext, (void *)tmp);
         for (e = cblist_cls_exit; e != NULL; e = (generic_event_entry_t *) e->pri.next)
             (*e->cb.cls_cb)(drcontext, true/*thread_exit*/);
+        if (tmp->bb_data != NULL)
+            dr_thread_free(drcontext, tmp->bb_data, sizeof(void*)*tmp->bb_data_slots);
         dr_thread_free(drcontext, tmp, sizeof(*tmp));
     }
     dr_rwlock_read_unlock(cls_event_lock);
@@ -25,6 +25,8 @@
 
 #include "dr_api.h"
 #include "drmgr.h"
+#include "drutil.h"
+#include <stddef.h> /* offsetof */
 
 /* currently using asserts on internal logic sanity checks (never on
  * input from user)
@@ -218,6 +220,13 @@ opc_is_stringop_loop(uint opc)
             opc == OP_repne_cmps || opc == OP_rep_scas || opc == OP_repne_scas);
 }
 
+DR_EXPORT
+bool
+drutil_instr_is_stringop_loop(instr_t *inst)
+{
+    return opc_is_stringop_loop(instr_get_opcode(inst));
+}
+
 static instr_t *
 create_nonloop_stringop(void *drcontext, instr_t *inst)
 {
@@ -399,3 +408,124 @@ drutil_expand_rep_string(void *drcontext, instrlist_t *bb)
 {
     return drutil_expand_rep_string_ex(drcontext, bb, NULL, NULL);
 }
+
+/* We store the flags via pushf, which writes below xsp: skip the red zone. */
+#ifdef X64
+# define REDZONE_SIZE 128
+#endif
+
+DR_EXPORT
+bool
+drutil_insert_rep_string_range(void *drcontext, instrlist_t *bb, instr_t *where,
+                               opnd_t memref, bool write, reg_id_t base, int disp,
+                               reg_id_t scratch)
+{
+    opnd_t xcx;
+    uint xcx_sz;
+    instr_t *first, *second;
+
+    if (!opc_is_stringop_loop(instr_get_opcode(where)) ||
+        !opnd_is_memory_reference(memref))
+        return false;
+    if (base == DR_REG_XCX || base == DR_REG_XSI || base == DR_REG_XDI ||
+        base == DR_REG_XSP || scratch == DR_REG_XSI || scratch == DR_REG_XDI ||
+        scratch == DR_REG_XSP || scratch == base) {
+        USAGE_ERROR("drutil_insert_rep_string_range: invalid register");
+        return false;
+    }
+    /* We assume xcx is last dst, as in create_nonloop_stringop() */
+    xcx = instr_get_dst(where, instr_num_dsts(where) - 1);
+    ASSERT(opnd_is_reg(xcx) && opnd_uses_reg(xcx, DR_REG_XCX),
+           "rep opnd order assumption violated");
+
+    /* Store the count first, as scratch may be xcx.  With an address size
+     * prefix the counter is narrower than the slot so we zero the rest.
+     */
+    xcx_sz = opnd_size_in_bytes(opnd_get_size(xcx));
+    PRE(bb, where, INSTR_CREATE_mov_st
+        (drcontext, opnd_create_base_disp
+         (base, DR_REG_NULL, 0, disp + offsetof(drutil_rep_string_range_t, count),
+          opnd_get_size(xcx)), xcx));
+    if (xcx_sz == 2) {
+        PRE(bb, where, INSTR_CREATE_mov_st
+            (drcontext, OPND_CREATE_MEM16
+             (base, disp + offsetof(drutil_rep_string_range_t, count) + 2),
+             OPND_CREATE_INT16(0)));
+    }
+#ifdef X64
+    if (xcx_sz <= 4) {
+        PRE(bb, where, INSTR_CREATE_mov_st
+            (drcontext, OPND_CREATE_MEM32
+             (base, disp + offsetof(drutil_rep_string_range_t, count) + 4),
+             OPND_CREATE_INT32(0)));
+    }
+#endif
+
+    /* The string memrefs are never far via a TLS segment in practice, and for
+     * a lone base register drutil_insert_get_mem_addr() handles dst == scratch.
+     */
+    if (!drutil_insert_get_mem_addr(drcontext, bb, where, memref, scratch, scratch))
+        return false;
+    PRE(bb, where, INSTR_CREATE_mov_st
+        (drcontext, OPND_CREATE_MEMPTR
+         (base, disp + offsetof(drutil_rep_string_range_t, start)),
+         opnd_create_reg(scratch)));
+
+    /* pushf;pop is the only way to read DF that does not touch the arith flags */
+#ifdef X64
+    PRE(bb, where, INSTR_CREATE_lea
+        (drcontext, opnd_create_reg(DR_REG_XSP),
+         opnd_create_base_disp(DR_REG_XSP, DR_REG_NULL, 0, -REDZONE_SIZE,
+                               OPSZ_lea)));
+#endif
+    PRE(bb, where, INSTR_CREATE_pushf(drcontext));
+    PRE(bb, where, INSTR_CREATE_pop(drcontext, opnd_create_reg(scratch)));
+#ifdef X64
+    PRE(bb, where, INSTR_CREATE_lea
+        (drcontext, opnd_create_reg(DR_REG_XSP),
+         opnd_create_base_disp(DR_REG_XSP, DR_REG_NULL, 0, REDZONE_SIZE,
+                               OPSZ_lea)));
+#endif
+    PRE(bb, where, INSTR_CREATE_mov_st
+        (drcontext, OPND_CREATE_MEM16
+         (base, disp + offsetof(drutil_rep_string_range_t, eflags)),
+         opnd_create_reg(reg_resize_to_opsz(scratch, OPSZ_2))));
+
+    /* elem_size and write are adjacent bytes */
+    PRE(bb, where, INSTR_CREATE_mov_st
+        (drcontext, OPND_CREATE_MEM8
+         (base, disp + offsetof(drutil_rep_string_range_t, elem_size)),
+         OPND_CREATE_INT8(drutil_opnd_mem_size_in_bytes(memref, where))));
+    PRE(bb, where, INSTR_CREATE_mov_st
+        (drcontext, OPND_CREATE_MEM8
+         (base, disp + offsetof(drutil_rep_string_range_t, write)),
+         OPND_CREATE_INT8(write ? 1 : 0)));
+
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t) instr_get_app_pc(where),
+                                     OPND_CREATE_MEMPTR
+                                     (base, disp +
+                                      offsetof(drutil_rep_string_range_t, pc)),
+                                     bb, where, &first, &second);
+    instr_set_ok_to_mangle(first, false/*meta*/);
+    if (second != NULL)
+        instr_set_ok_to_mangle(second, false/*meta*/);
+    return true;
+}
+
+DR_EXPORT
+void
+drutil_rep_string_range_bounds(const drutil_rep_string_range_t *range,
+                               app_pc *start OUT, app_pc *end OUT)
+{
+    ptr_uint_t bytes = range->count * range->elem_size;
+    if (range->count == 0) {
+        *start = range->start;
+        *end = range->start;
+    } else if ((range->eflags & EFLAGS_DF) != 0) {
+        *start = range->start + range->elem_size - bytes;
+        *end = range->start + range->elem_size;
+    } else {
+        *start = range->start;
+        *end = range->start + bytes;
+    }
+}
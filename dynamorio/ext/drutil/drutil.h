@@ -143,6 +143,89 @@ bool
 drutil_expand_rep_string_ex(void *drcontext, instrlist_t *bb, OUT bool *expanded,
                             OUT instr_t **stringop);
 
+DR_EXPORT
+/**
+ * Returns whether \p inst is a single-instruction string loop: a string
+ * instruction with a \p rep or \p repne prefix.
+ */
+bool
+drutil_instr_is_stringop_loop(instr_t *inst);
+
+/**
+ * Describes one execution of a single-instruction string loop, as
+ * stored by drutil_insert_rep_string_range().  The layout is fixed so
+ * that the record can be written by inlined instrumentation: it is
+ * four pointer-sized slots.
+ */
+typedef struct _drutil_rep_string_range_t {
+    /** The address of the string loop instruction. */
+    app_pc pc;
+    /**
+     * The address of the first element accessed, i.e., the value of
+     * the \p xsi or \p xdi based memory reference prior to the loop.
+     */
+    app_pc start;
+    /**
+     * The value of the counter register (\p xcx, or its narrower form
+     * if the instruction has an address size prefix) prior to the loop.
+     * For \p repe and \p repne loops this is an upper bound, as the
+     * loop may terminate early.
+     */
+    ptr_uint_t count;
+    /**
+     * The low 16 bits of the application's eflags prior to the loop.
+     * If EFLAGS_DF is set the elements are accessed in decreasing
+     * address order starting at \p start.
+     */
+    ushort eflags;
+    /** The size in bytes of each element accessed. */
+    byte elem_size;
+    /** Whether the elements are written (true) or read (false). */
+    bool write;
+} drutil_rep_string_range_t;
+
+DR_EXPORT
+/**
+ * An alternative to drutil_expand_rep_string() for tools that can
+ * consume a memory range rather than individual references.  Leaves the
+ * single-instruction string loop \p where intact and inserts prior to it
+ * a straight-line sequence of meta instructions that stores a
+ * #drutil_rep_string_range_t describing the references made by the
+ * loop through \p memref, which must be one of the memory operands of
+ * \p where, to the memory at \p disp(\p base).  \p write indicates
+ * whether \p memref is a destination.  Both memory operands of a \p
+ * movs or \p cmps loop can be recorded by calling this routine once for
+ * each.
+ *
+ * The register \p scratch is clobbered.  \p base may not be \p xcx,
+ * \p xsi, \p xdi, or \p xsp; \p scratch may not be \p xsi, \p xdi,
+ * \p xsp, or \p base.  The application values of \p xcx, \p xsi, and \p xdi must
+ * be in place at \p where.  The application's arithmetic flags are
+ * preserved, but the sequence reads the flags via the application
+ * stack (below any 64-bit red zone).
+ *
+ * One record is stored per execution of the loop.  If the loop is
+ * interrupted and resumed partway through (e.g., by a signal), an
+ * additional record is stored covering the remaining iterations.
+ *
+ * \return whether successful.
+ */
+bool
+drutil_insert_rep_string_range(void *drcontext, instrlist_t *bb, instr_t *where,
+                               opnd_t memref, bool write, reg_id_t base, int disp,
+                               reg_id_t scratch);
+
+DR_EXPORT
+/**
+ * Computes the lowest address \p start and the address just past the
+ * highest address \p end touched by the loop described by \p range,
+ * taking the direction flag into account.  If the count is 0, both are
+ * set to the start address.
+ */
+void
+drutil_rep_string_range_bounds(const drutil_rep_string_range_t *range,
+                               OUT app_pc *start, OUT app_pc *end);
+
 
 /*@}*/ /* end doxygen group */
 
@@ -52,6 +52,15 @@
     (((ptr_uint_t)x) & (~((ptr_uint_t)(alignment)-1)))
 
 static void *note_lock;
+static void *duty_lock;
+/* protects the sharded counter lists and retired totals */
+static void *shard_lock;
+static void *modtab_lock;
+
+static void shard_thread_init(void *drcontext);
+static void shard_thread_exit(void *drcontext);
+static void shard_exit(void);
+static void modtab_exit(void);
 
 /***************************************************************************
  * INIT
@@ -67,6 +76,11 @@ drx_init(void)
     if (count > 1)
         return true;
     note_lock = dr_mutex_create();
+    duty_lock = dr_mutex_create();
+    shard_lock = dr_mutex_create();
+    modtab_lock = dr_mutex_create();
+    dr_register_thread_init_event(shard_thread_init);
+    dr_register_thread_exit_event(shard_thread_exit);
     return true;
 }
 
@@ -77,7 +91,14 @@ drx_exit()
     int count = dr_atomic_add32_return_sum(&drx_init_count, -1);
     if (count != 0)
         return;
+    dr_unregister_thread_init_event(shard_thread_init);
+    dr_unregister_thread_exit_event(shard_thread_exit);
+    shard_exit();
+    modtab_exit();
     dr_mutex_destroy(note_lock);
+    dr_mutex_destroy(duty_lock);
+    dr_mutex_destroy(shard_lock);
+    dr_mutex_destroy(modtab_lock);
 }
 
 
@@ -335,31 +356,17 @@ counter_crosses_cache_line(byte *addr, size_t size)
     return true;
 }
 
-DR_EXPORT
-bool
-drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
-                          dr_spill_slot_t slot, void *addr, int value,
-                          uint flags)
+/* Inserts an add of value to counter (and, if counter_hi is not a null
+ * operand, the carry into counter_hi), saving aflags to slot if they are
+ * live and merging with a preceding drx aflags restore if possible.
+ */
+static void
+insert_counter_add(void *drcontext, instrlist_t *ilist, instr_t *where,
+                   dr_spill_slot_t slot, opnd_t counter, opnd_t counter_hi,
+                   int value, bool lock)
 {
     instr_t *instr;
     bool save_aflags = !drx_aflags_are_dead(where);
-    bool is_64 = TEST(DRX_COUNTER_64BIT, flags);
-
-    if (drcontext == NULL) {
-        ASSERT(false, "drcontext cannot be NULL");
-        return false;
-    }
-    if (!(slot >= SPILL_SLOT_1 && slot <= SPILL_SLOT_MAX)) {
-        ASSERT(false, "wrong spill slot");
-        return false;
-    }
-
-    /* check whether we can add lock */
-    if (TEST(DRX_COUNTER_LOCK, flags)) {
-        if (IF_NOT_X64(is_64 ||) /* 64-bit counter in 32-bit mode */
-            counter_crosses_cache_line((byte *)addr, is_64 ? 8 : 4))
-            return false;
-    }
 
     /* if save_aflags, check if we can merge with the prev aflags save */
     if (save_aflags) {
@@ -377,29 +384,578 @@ drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
                              slot, DR_REG_NULL);
     }
     /* update counter */
-    instr = INSTR_CREATE_add(drcontext,
-                             OPND_CREATE_ABSMEM
-                             (addr, IF_X64_ELSE((is_64 ? OPSZ_8 : OPSZ_4), OPSZ_4)),
-                             OPND_CREATE_INT32(value));
-    if (TEST(DRX_COUNTER_LOCK, flags))
+    instr = INSTR_CREATE_add(drcontext, counter, OPND_CREATE_INT32(value));
+    if (lock)
         instr = LOCK(instr);
     MINSERT(ilist, where, instr);
-            
-#ifndef X64
-    if (is_64) {
+    if (!opnd_is_null(counter_hi)) {
         MINSERT(ilist, where,
-                INSTR_CREATE_adc(drcontext,
-                                 OPND_CREATE_ABSMEM
-                                 ((void *)((ptr_int_t)addr + 4), OPSZ_4),
-                                 OPND_CREATE_INT32(0)));
+                INSTR_CREATE_adc(drcontext, counter_hi, OPND_CREATE_INT32(0)));
     }
-#endif /* !X64 */
     /* restore aflags if necessary */
     if (save_aflags) {
         drx_restore_arith_flags(drcontext, ilist, where,
                                 true /* restore eax */, true /* restore oflag */,
                                 slot, DR_REG_NULL);
     }
+}
+
+DR_EXPORT
+bool
+drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+                          dr_spill_slot_t slot, void *addr, int value,
+                          uint flags)
+{
+    bool is_64 = TEST(DRX_COUNTER_64BIT, flags);
+    opnd_t counter_hi = opnd_create_null();
+
+    if (drcontext == NULL) {
+        ASSERT(false, "drcontext cannot be NULL");
+        return false;
+    }
+    if (!(slot >= SPILL_SLOT_1 && slot <= SPILL_SLOT_MAX)) {
+        ASSERT(false, "wrong spill slot");
+        return false;
+    }
+
+    /* check whether we can add lock */
+    if (TEST(DRX_COUNTER_LOCK, flags)) {
+        if (IF_NOT_X64(is_64 ||) /* 64-bit counter in 32-bit mode */
+            counter_crosses_cache_line((byte *)addr, is_64 ? 8 : 4))
+            return false;
+    }
+
+#ifndef X64
+    if (is_64)
+        counter_hi = OPND_CREATE_ABSMEM((void *)((ptr_int_t)addr + 4), OPSZ_4);
+#endif /* !X64 */
+    insert_counter_add(drcontext, ilist, where, slot,
+                       OPND_CREATE_ABSMEM
+                       (addr, IF_X64_ELSE((is_64 ? OPSZ_8 : OPSZ_4), OPSZ_4)),
+                       counter_hi, value, TEST(DRX_COUNTER_LOCK, flags));
     return true;
 }
 
+/***************************************************************************
+ * SHARDED COUNTERS
+ */
+
+/* Each thread's shards are raw TLS slots, so an update is a single
+ * segment-relative add to memory that no other thread writes.  We record
+ * each thread's TLS base at thread init so that the shards can be summed
+ * from any thread, and fold a thread's shards into the retired totals when
+ * it exits.  dr_raw_tls_calloc() only zeroes the slots of threads created
+ * later, and slots freed earlier can be handed out again, so we zero a
+ * group's shards ourselves in every thread.
+ */
+
+/* the segment used by dr_raw_tls_calloc() */
+#define DRX_SEG_TLS IF_X64_ELSE(DR_SEG_GS, DR_SEG_FS)
+
+struct _drx_sharded_counters_t {
+    uint offs; /* raw TLS offset of the first counter's shard */
+    uint num;
+    uint64 *retired; /* sums of the shards of exited threads */
+    drx_sharded_counters_t *next;
+};
+
+typedef struct _shard_thread_t {
+    void *drcontext;
+    byte *tls_base;
+    struct _shard_thread_t *next;
+} shard_thread_t;
+
+static drx_sharded_counters_t *shard_groups;
+static shard_thread_t *shard_threads;
+
+static ptr_uint_t
+shard_value(drx_sharded_counters_t *counters, shard_thread_t *thread, uint index)
+{
+    /* Pointer-sized and aligned, so this read is atomic even while the
+     * owning thread is updating it.
+     */
+    return *(volatile ptr_uint_t *)
+        (thread->tls_base + counters->offs + index * sizeof(void *));
+}
+
+/* Caller must hold shard_lock */
+static void
+shard_zero(drx_sharded_counters_t *counters, shard_thread_t *thread)
+{
+    uint i;
+    for (i = 0; i < counters->num; i++) {
+        *(ptr_uint_t *)(thread->tls_base + counters->offs + i * sizeof(void *)) = 0;
+    }
+}
+
+static void
+shard_thread_init(void *drcontext)
+{
+    shard_thread_t *thread = dr_global_alloc(sizeof(*thread));
+    drx_sharded_counters_t *counters;
+    thread->drcontext = drcontext;
+    thread->tls_base = dr_get_dr_segment_base(DRX_SEG_TLS);
+    dr_mutex_lock(shard_lock);
+    for (counters = shard_groups; counters != NULL; counters = counters->next)
+        shard_zero(counters, thread);
+    thread->next = shard_threads;
+    shard_threads = thread;
+    dr_mutex_unlock(shard_lock);
+}
+
+/* May be called from another thread at process exit, so we only use the
+ * TLS base recorded at init.
+ */
+static void
+shard_thread_exit(void *drcontext)
+{
+    shard_thread_t *thread, *prev = NULL;
+    drx_sharded_counters_t *counters;
+    uint i;
+    dr_mutex_lock(shard_lock);
+    for (thread = shard_threads; thread != NULL; prev = thread, thread = thread->next) {
+        if (thread->drcontext == drcontext)
+            break;
+    }
+    if (thread == NULL) {
+        /* started before drx_init() */
+        dr_mutex_unlock(shard_lock);
+        return;
+    }
+    if (prev == NULL)
+        shard_threads = thread->next;
+    else
+        prev->next = thread->next;
+    for (counters = shard_groups; counters != NULL; counters = counters->next) {
+        for (i = 0; i < counters->num; i++)
+            counters->retired[i] += shard_value(counters, thread, i);
+    }
+    dr_mutex_unlock(shard_lock);
+    dr_global_free(thread, sizeof(*thread));
+}
+
+/* Frees the records of threads that have not exited yet */
+static void
+shard_exit(void)
+{
+    while (shard_threads != NULL) {
+        shard_thread_t *thread = shard_threads;
+        shard_threads = thread->next;
+        dr_global_free(thread, sizeof(*thread));
+    }
+}
+
+DR_EXPORT
+drx_sharded_counters_t *
+drx_sharded_counters_create(uint num_counters)
+{
+    drx_sharded_counters_t *counters;
+    shard_thread_t *thread;
+    reg_id_t seg;
+    uint i;
+    if (num_counters == 0)
+        return NULL;
+    counters = dr_global_alloc(sizeof(*counters));
+    if (!dr_raw_tls_calloc(&seg, &counters->offs, num_counters, 0)) {
+        dr_global_free(counters, sizeof(*counters));
+        return NULL;
+    }
+    ASSERT(seg == DRX_SEG_TLS, "unexpected raw TLS segment");
+    counters->num = num_counters;
+    counters->retired = dr_global_alloc(num_counters * sizeof(uint64));
+    for (i = 0; i < num_counters; i++)
+        counters->retired[i] = 0;
+    dr_mutex_lock(shard_lock);
+    /* no instrumentation uses the new slots yet, so we can write them */
+    for (thread = shard_threads; thread != NULL; thread = thread->next)
+        shard_zero(counters, thread);
+    counters->next = shard_groups;
+    shard_groups = counters;
+    dr_mutex_unlock(shard_lock);
+    return counters;
+}
+
+DR_EXPORT
+bool
+drx_sharded_counters_destroy(drx_sharded_counters_t *counters)
+{
+    drx_sharded_counters_t *cur, *prev = NULL;
+    bool res;
+    dr_mutex_lock(shard_lock);
+    for (cur = shard_groups; cur != NULL; prev = cur, cur = cur->next) {
+        if (cur == counters)
+            break;
+    }
+    if (cur == NULL) {
+        dr_mutex_unlock(shard_lock);
+        return false;
+    }
+    if (prev == NULL)
+        shard_groups = cur->next;
+    else
+        prev->next = cur->next;
+    dr_mutex_unlock(shard_lock);
+    res = dr_raw_tls_cfree(counters->offs, counters->num);
+    dr_global_free(counters->retired, counters->num * sizeof(uint64));
+    dr_global_free(counters, sizeof(*counters));
+    return res;
+}
+
+DR_EXPORT
+bool
+drx_insert_sharded_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                  dr_spill_slot_t slot,
+                                  drx_sharded_counters_t *counters, uint index,
+                                  int value)
+{
+    if (drcontext == NULL) {
+        ASSERT(false, "drcontext cannot be NULL");
+        return false;
+    }
+    if (!(slot >= SPILL_SLOT_1 && slot <= SPILL_SLOT_MAX)) {
+        ASSERT(false, "wrong spill slot");
+        return false;
+    }
+    if (counters == NULL || index >= counters->num) {
+        ASSERT(false, "invalid sharded counter");
+        return false;
+    }
+    insert_counter_add(drcontext, ilist, where, slot,
+                       opnd_create_far_base_disp(DRX_SEG_TLS, DR_REG_NULL, DR_REG_NULL,
+                                                 0, counters->offs +
+                                                 index * sizeof(void *), OPSZ_PTR),
+                       opnd_create_null(), value, false/*no lock needed*/);
+    return true;
+}
+
+DR_EXPORT
+uint64
+drx_sharded_counter_read(drx_sharded_counters_t *counters, uint index)
+{
+    shard_thread_t *thread;
+    uint64 sum;
+    if (counters == NULL || index >= counters->num) {
+        ASSERT(false, "invalid sharded counter");
+        return 0;
+    }
+    dr_mutex_lock(shard_lock);
+    sum = counters->retired[index];
+    for (thread = shard_threads; thread != NULL; thread = thread->next)
+        sum += shard_value(counters, thread, index);
+    dr_mutex_unlock(shard_lock);
+    return sum;
+}
+
+/***************************************************************************
+ * MODULE TABLE
+ */
+
+/* A two-level page-indexed table mapping each page to a module id, which is
+ * 0 for pages outside of any module.  The top level is indexed by the bits
+ * of a pc above MODTAB_CHUNK_SHIFT and points at chunks holding one id per
+ * page.  Unused top-level entries point at a shared read-only chunk of
+ * zeroes, so a lookup never needs a NULL check and can be done inline
+ * without a branch.  Writers hold modtab_lock; readers, including the
+ * inlined lookups, do not lock, as pointer and id stores are atomic.
+ * On x64 we index the low 48 bits, so higher (never user) addresses alias
+ * onto unused entries.
+ */
+#define MODTAB_PAGE_SHIFT 12
+#define MODTAB_PAGE_SIZE (1 << MODTAB_PAGE_SHIFT)
+#define MODTAB_CHUNK_SHIFT IF_X64_ELSE(30, 22)
+#define MODTAB_TOP_SIZE (1 << (IF_X64_ELSE(48, 32) - MODTAB_CHUNK_SHIFT))
+#define MODTAB_CHUNK_SIZE (1 << (MODTAB_CHUNK_SHIFT - MODTAB_PAGE_SHIFT))
+#define MODTAB_TOP_IDX(pc) \
+    ((((ptr_uint_t)(pc)) >> MODTAB_CHUNK_SHIFT) & (MODTAB_TOP_SIZE - 1))
+#define MODTAB_CHUNK_IDX(pc) \
+    ((((ptr_uint_t)(pc)) >> MODTAB_PAGE_SHIFT) & (MODTAB_CHUNK_SIZE - 1))
+
+/* read from inlined lookups, so never changed once allocated */
+static ushort **modtab_top;
+static ushort *modtab_empty;
+
+/* Caller must hold modtab_lock */
+static bool
+modtab_ensure(void)
+{
+    uint i;
+    if (modtab_top != NULL)
+        return true;
+    modtab_empty = dr_raw_mem_alloc(MODTAB_CHUNK_SIZE * sizeof(ushort),
+                                    DR_MEMPROT_READ, NULL);
+    if (modtab_empty == NULL)
+        return false;
+    modtab_top = dr_raw_mem_alloc(MODTAB_TOP_SIZE * sizeof(ushort *),
+                                  DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    if (modtab_top == NULL) {
+        dr_raw_mem_free(modtab_empty, MODTAB_CHUNK_SIZE * sizeof(ushort));
+        modtab_empty = NULL;
+        return false;
+    }
+    for (i = 0; i < MODTAB_TOP_SIZE; i++)
+        modtab_top[i] = modtab_empty;
+    return true;
+}
+
+static void
+modtab_exit(void)
+{
+    uint i;
+    if (modtab_top == NULL)
+        return;
+    for (i = 0; i < MODTAB_TOP_SIZE; i++) {
+        if (modtab_top[i] != modtab_empty)
+            dr_raw_mem_free(modtab_top[i], MODTAB_CHUNK_SIZE * sizeof(ushort));
+    }
+    dr_raw_mem_free(modtab_top, MODTAB_TOP_SIZE * sizeof(ushort *));
+    dr_raw_mem_free(modtab_empty, MODTAB_CHUNK_SIZE * sizeof(ushort));
+    modtab_top = NULL;
+    modtab_empty = NULL;
+}
+
+/* Caller must hold modtab_lock */
+static bool
+modtab_set(app_pc start, app_pc end, ushort id)
+{
+    ptr_uint_t first = ALIGN_BACKWARD(start, MODTAB_PAGE_SIZE);
+    ptr_uint_t page;
+    if (!modtab_ensure())
+        return false;
+    /* comparing offsets avoids overflow at the top of the address space */
+    for (page = first; page - first < (ptr_uint_t)end - first;
+         page += MODTAB_PAGE_SIZE) {
+        ushort **top = &modtab_top[MODTAB_TOP_IDX(page)];
+        if (*top == modtab_empty) {
+            ushort *chunk;
+            if (id == 0)
+                continue;
+            /* dr_raw_mem_alloc() memory is zeroed */
+            chunk = dr_raw_mem_alloc(MODTAB_CHUNK_SIZE * sizeof(ushort),
+                                     DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+            if (chunk == NULL)
+                return false;
+            *top = chunk;
+        }
+        (*top)[MODTAB_CHUNK_IDX(page)] = id;
+    }
+    return true;
+}
+
+DR_EXPORT
+bool
+drx_module_table_add(app_pc start, app_pc end, ushort id)
+{
+    bool res;
+    if (id == DRX_MODULE_ID_NONE || start >= end)
+        return false;
+    dr_mutex_lock(modtab_lock);
+    res = modtab_set(start, end, id);
+    dr_mutex_unlock(modtab_lock);
+    return res;
+}
+
+DR_EXPORT
+bool
+drx_module_table_remove(app_pc start, app_pc end)
+{
+    bool res;
+    if (start >= end)
+        return false;
+    dr_mutex_lock(modtab_lock);
+    res = modtab_set(start, end, DRX_MODULE_ID_NONE);
+    dr_mutex_unlock(modtab_lock);
+    return res;
+}
+
+DR_EXPORT
+ushort
+drx_module_table_lookup(app_pc pc)
+{
+    if (modtab_top == NULL)
+        return DRX_MODULE_ID_NONE;
+    return modtab_top[MODTAB_TOP_IDX(pc)][MODTAB_CHUNK_IDX(pc)];
+}
+
+DR_EXPORT
+bool
+drx_insert_module_table_lookup(void *drcontext, instrlist_t *ilist, instr_t *where,
+                               reg_id_t reg_pc, reg_id_t reg_scratch)
+{
+    bool ok;
+    if (drcontext == NULL) {
+        ASSERT(false, "drcontext cannot be NULL");
+        return false;
+    }
+    if (!reg_is_gpr(reg_pc) || !reg_is_pointer_sized(reg_pc) ||
+        !reg_is_gpr(reg_scratch) || !reg_is_pointer_sized(reg_scratch) ||
+        reg_pc == reg_scratch) {
+        ASSERT(false, "invalid registers");
+        return false;
+    }
+    dr_mutex_lock(modtab_lock);
+    ok = modtab_ensure();
+    dr_mutex_unlock(modtab_lock);
+    if (!ok)
+        return false;
+
+    /* scratch = &modtab_top[MODTAB_TOP_IDX(pc)] */
+    MINSERT(ilist, where,
+            INSTR_CREATE_mov_ld(drcontext, opnd_create_reg(reg_scratch),
+                                opnd_create_reg(reg_pc)));
+    MINSERT(ilist, where,
+            INSTR_CREATE_shr(drcontext, opnd_create_reg(reg_scratch),
+                             OPND_CREATE_INT8(MODTAB_CHUNK_SHIFT)));
+#ifdef X64
+    MINSERT(ilist, where,
+            INSTR_CREATE_and(drcontext, opnd_create_reg(reg_scratch),
+                             OPND_CREATE_INT32(MODTAB_TOP_SIZE - 1)));
+#endif
+    MINSERT(ilist, where,
+            INSTR_CREATE_shl(drcontext, opnd_create_reg(reg_scratch),
+                             OPND_CREATE_INT8(IF_X64_ELSE(3, 2))));
+    MINSERT(ilist, where,
+            INSTR_CREATE_add(drcontext, opnd_create_reg(reg_scratch),
+                             OPND_CREATE_ABSMEM((void *)&modtab_top, OPSZ_PTR)));
+    /* scratch = chunk */
+    MINSERT(ilist, where,
+            INSTR_CREATE_mov_ld(drcontext, opnd_create_reg(reg_scratch),
+                                OPND_CREATE_MEMPTR(reg_scratch, 0)));
+    /* pc = chunk[MODTAB_CHUNK_IDX(pc)] */
+    MINSERT(ilist, where,
+            INSTR_CREATE_shr(drcontext, opnd_create_reg(reg_pc),
+                             OPND_CREATE_INT8(MODTAB_PAGE_SHIFT)));
+    MINSERT(ilist, where,
+            INSTR_CREATE_and(drcontext, opnd_create_reg(reg_pc),
+                             OPND_CREATE_INT32(MODTAB_CHUNK_SIZE - 1)));
+    MINSERT(ilist, where,
+            INSTR_CREATE_movzx(drcontext, opnd_create_reg(reg_pc),
+                               opnd_create_base_disp(reg_scratch, reg_pc,
+                                                     sizeof(ushort), 0, OPSZ_2)));
+    return true;
+}
+
+/***************************************************************************
+ * DUTY CYCLE
+ */
+
+/* We sleep in small slices so that drx_duty_cycle_stop() takes effect quickly */
+#define DUTY_CYCLE_SLICE_MS 10
+/* A thread inside DR or at a syscall cannot be released: we retry a few times
+ * before leaving it under DR until the next release.
+ */
+#define DUTY_CYCLE_RELEASE_ATTEMPTS 4
+
+static volatile bool duty_cycle_active;
+static volatile bool duty_cycle_exit;
+static uint duty_window_ms;
+static uint duty_period_ms;
+static drx_duty_cycle_cb_t duty_cb;
+static void *duty_cb_data;
+
+/* Returns false if asked to exit while sleeping */
+static bool
+duty_cycle_sleep(uint ms)
+{
+    while (ms > 0 && !duty_cycle_exit) {
+        uint slice = (ms < DUTY_CYCLE_SLICE_MS) ? ms : DUTY_CYCLE_SLICE_MS;
+        dr_sleep(slice);
+        ms -= slice;
+    }
+    return !duty_cycle_exit;
+}
+
+/* If release, sends every suspendable thread native; else takes every native
+ * thread back over.  Returns the number of threads still in the wrong state.
+ */
+static uint
+duty_cycle_transition(bool release)
+{
+    void **drcontexts;
+    uint num_suspended, i, remaining = 0;
+    /* Catch up with what the threads did natively before they run code from
+     * the cache again.  This must happen before we suspend them.
+     */
+    if (!release)
+        dr_rescan_after_native();
+    /* If some threads could not be suspended we still handle the rest */
+    dr_suspend_all_other_threads_ex(&drcontexts, &num_suspended, NULL,
+                                    DR_SUSPEND_NATIVE);
+    for (i = 0; i < num_suspended; i++) {
+        void *drcontext = drcontexts[i];
+        if (release) {
+            if (!dr_is_thread_native(drcontext) &&
+                !dr_send_suspended_thread_native(drcontext))
+                remaining++;
+        } else {
+            /* dr_retakeover_suspended_native_thread() fails on client threads */
+            if (dr_is_thread_native(drcontext))
+                dr_retakeover_suspended_native_thread(drcontext);
+        }
+    }
+    if (!dr_resume_all_other_threads(drcontexts, num_suspended))
+        ASSERT(false, "failed to resume threads");
+    return remaining;
+}
+
+static void
+duty_cycle_thread(void *arg)
+{
+    /* Our suspensions must not be blocked waiting on our own thread */
+    dr_client_thread_set_suspendable(false);
+    while (duty_cycle_sleep(duty_window_ms)) {
+        uint attempt;
+        for (attempt = 0; attempt < DUTY_CYCLE_RELEASE_ATTEMPTS; attempt++) {
+            if (duty_cycle_transition(true/*release*/) == 0)
+                break;
+            dr_sleep(1);
+        }
+        if (duty_cb != NULL)
+            (*duty_cb)(false, duty_cb_data);
+        if (!duty_cycle_sleep(duty_period_ms - duty_window_ms)) {
+            duty_cycle_transition(false/*retake*/);
+            break;
+        }
+        duty_cycle_transition(false/*retake*/);
+        if (duty_cb != NULL)
+            (*duty_cb)(true, duty_cb_data);
+    }
+    duty_cycle_active = false;
+}
+
+DR_EXPORT
+bool
+drx_duty_cycle_start(uint window_ms, uint period_ms, drx_duty_cycle_cb_t cb,
+                     void *user_data)
+{
+#ifdef WINDOWS
+    /* dr_send_suspended_thread_native() is not yet supported on Windows */
+    return false;
+#else
+    bool res;
+    if (window_ms == 0 || window_ms >= period_ms)
+        return false;
+    dr_mutex_lock(duty_lock);
+    if (duty_cycle_active) {
+        dr_mutex_unlock(duty_lock);
+        return false;
+    }
+    duty_window_ms = window_ms;
+    duty_period_ms = period_ms;
+    duty_cb = cb;
+    duty_cb_data = user_data;
+    duty_cycle_exit = false;
+    duty_cycle_active = true;
+    res = dr_create_client_thread(duty_cycle_thread, NULL);
+    if (!res)
+        duty_cycle_active = false;
+    dr_mutex_unlock(duty_lock);
+    return res;
+#endif
+}
+
+DR_EXPORT
+void
+drx_duty_cycle_stop(void)
+{
+    duty_cycle_exit = true;
+}
@@ -136,6 +136,189 @@ drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
                           dr_spill_slot_t slot, void *addr, int value,
                           uint flags);
 
+/***************************************************************************
+ * SHARDED COUNTERS
+ */
+
+/** Opaque handle for a group of counters created by drx_sharded_counters_create(). */
+typedef struct _drx_sharded_counters_t drx_sharded_counters_t;
+
+DR_EXPORT
+/**
+ * Creates a group of \p num_counters process-wide counters that are each
+ * sharded across threads: every thread updates its own copy, held in a
+ * raw thread-local storage slot (see dr_raw_tls_calloc()), so updates from
+ * different threads never contend for the same cache line and need no
+ * lock prefix.  The total of a counter is obtained with
+ * drx_sharded_counter_read().  The shards of a thread that exits are
+ * folded into the total at its exit.
+ *
+ * Each counter is pointer-sized, and thus wraps at 32 bits per thread in
+ * a 32-bit process.  Only threads that start after drx_init() is called
+ * are counted, so drx_init() should be called from dr_init() when using
+ * these counters.  Raw TLS slots are a limited resource, so counters
+ * should be grouped into as few groups as possible.
+ *
+ * \return NULL on failure.
+ */
+drx_sharded_counters_t *
+drx_sharded_counters_create(uint num_counters);
+
+DR_EXPORT
+/**
+ * Destroys a group of counters created by drx_sharded_counters_create().
+ * The caller must ensure that no code cache instrumentation updating them
+ * can still execute, e.g., by calling this from the exit event.
+ *
+ * \return whether successful.
+ */
+bool
+drx_sharded_counters_destroy(drx_sharded_counters_t *counters);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to add the
+ * constant \p value to the current thread's shard of counter \p index in
+ * \p counters.  The update is a single segment-relative add.  The spill
+ * slot \p slot is used for storing arithmetic flags if necessary, and the
+ * flags are shared with adjacent drx_insert_counter_update() and
+ * drx_insert_sharded_counter_update() updates at the same \p where as
+ * described for drx_insert_counter_update().
+ *
+ * \return whether successful.
+ */
+bool
+drx_insert_sharded_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                  dr_spill_slot_t slot,
+                                  drx_sharded_counters_t *counters, uint index,
+                                  int value);
+
+DR_EXPORT
+/**
+ * Returns the total of counter \p index in \p counters: the sum of the
+ * shards of all live threads plus those of all threads that have exited.
+ * Can be called at any time from any thread, including the exit event;
+ * while other threads are running the result is a snapshot that may miss
+ * their most recent updates.
+ */
+uint64
+drx_sharded_counter_read(drx_sharded_counters_t *counters, uint index);
+
+/***************************************************************************
+ * MODULE TABLE
+ */
+
+/** The module id returned for addresses that are not in any module. */
+#define DRX_MODULE_ID_NONE 0
+
+DR_EXPORT
+/**
+ * Records that the pages overlapping [\p start, \p end) belong to the
+ * module identified by \p id, which is chosen by the caller and must not
+ * be #DRX_MODULE_ID_NONE.  Typically called from the module load event,
+ * with drx_module_table_remove() called from the unload event.  The
+ * mapping is kept in a two-level page-indexed table that can be queried
+ * with drx_module_table_lookup() or with an inlined lookup inserted by
+ * drx_insert_module_table_lookup().  Granularity is a page: a page shared
+ * by two modules maps to whichever was added last.
+ *
+ * \return whether successful.
+ */
+bool
+drx_module_table_add(app_pc start, app_pc end, ushort id);
+
+DR_EXPORT
+/**
+ * Maps the pages overlapping [\p start, \p end) back to
+ * #DRX_MODULE_ID_NONE.
+ *
+ * \return whether successful.
+ */
+bool
+drx_module_table_remove(app_pc start, app_pc end);
+
+DR_EXPORT
+/**
+ * Returns the id passed to drx_module_table_add() for the module containing
+ * \p pc, or #DRX_MODULE_ID_NONE.
+ */
+ushort
+drx_module_table_lookup(app_pc pc);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) that replace
+ * the application address in \p reg_pc with the id of its module, as
+ * drx_module_table_lookup() would return it, zero-extended to the full
+ * register.  The sequence has no branches or calls and clobbers \p
+ * reg_scratch and the arithmetic flags, which the caller must save if
+ * they are live.  Both registers must be pointer-sized general-purpose
+ * registers.  The inlined lookup reads the table without locking and
+ * observes subsequent drx_module_table_add() and drx_module_table_remove()
+ * calls.
+ *
+ * \return whether successful.
+ */
+bool
+drx_insert_module_table_lookup(void *drcontext, instrlist_t *ilist, instr_t *where,
+                               reg_id_t reg_pc, reg_id_t reg_scratch);
+
+/***************************************************************************
+ * DUTY CYCLE
+ */
+
+/**
+ * Callback type for drx_duty_cycle_start().  Called on the duty-cycle
+ * client thread, with all other threads resumed, each time the
+ * application threads have been returned to DR's control (\p
+ * instrumenting is true) or released to native execution (\p
+ * instrumenting is false).
+ */
+typedef void (*drx_duty_cycle_cb_t)(bool instrumenting, void *user_data);
+
+DR_EXPORT
+/**
+ * Starts a client thread that repeatedly releases all application
+ * threads to native execution and then takes them back over: out of
+ * every \p period_ms milliseconds, the threads run under DR for \p
+ * window_ms milliseconds and natively for the rest.  The first window
+ * starts immediately.
+ *
+ * Nothing is flushed when threads are released, so the code cache,
+ * each thread's drcontext, and all client state are retained and every
+ * window after the first runs out of an already-warm cache.  Blocks
+ * executed only while the threads are native are never seen by the
+ * client.  A thread that is inside DR, at a system call, or with signals
+ * pending when a window ends stays under DR control until the next window
+ * ends (see dr_send_suspended_thread_native()).  Before each window,
+ * dr_rescan_after_native() catches DR up with the memory, module, and
+ * thread changes made natively, so module load and unload events and
+ * thread init and exit events for those arrive late, at the start of the
+ * window, and changes made just as a window starts may be missed.  If the
+ * application exits while its threads
+ * are native, DR does not regain control and the client's exit event is
+ * not called: a tool should either record its results incrementally or
+ * stop the duty cycle before the application exits.
+ *
+ * The optional callback \p cb is invoked with \p user_data at each
+ * transition.  Only one duty cycle can be active at a time.  Must be
+ * called after drx_init().  Currently supported on Linux only.
+ *
+ * \return whether successful.
+ */
+bool
+drx_duty_cycle_start(uint window_ms, uint period_ms, drx_duty_cycle_cb_t cb,
+                     void *user_data);
+
+DR_EXPORT
+/**
+ * Stops a duty cycle started by drx_duty_cycle_start().  All application
+ * threads are returned to DR's control before the duty-cycle thread
+ * exits, which happens asynchronously within a few milliseconds.
+ */
+void
+drx_duty_cycle_stop(void);
+
 /*@}*/ /* end doxygen group */
 
 #ifdef __cplusplus
@@ -0,0 +1,78 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: block-building bound.  Thousands of distinct small
+ * functions are each executed only a few times, so nearly all of the time
+ * under DR goes to decoding and emitting new blocks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NOINLINE __attribute__((noinline))
+
+/* Each function gets a distinct hex constant from its name so that the
+ * compiler can't fold identical bodies together.
+ */
+#define FUNC(n) \
+    static NOINLINE int f##n(int x) \
+    { \
+        if (x & 1) \
+            return x * 3 + 0x##n; \
+        return (x >> 1) ^ 0x##n; \
+    }
+#define CALL(n) sum = f##n(sum + i);
+
+#define D10(M, p) M(p##0) M(p##1) M(p##2) M(p##3) M(p##4) \
+                  M(p##5) M(p##6) M(p##7) M(p##8) M(p##9)
+#define D100(M, p) D10(M, p##0) D10(M, p##1) D10(M, p##2) D10(M, p##3) D10(M, p##4) \
+                   D10(M, p##5) D10(M, p##6) D10(M, p##7) D10(M, p##8) D10(M, p##9)
+#define D1000(M, p) D100(M, p##0) D100(M, p##1) D100(M, p##2) D100(M, p##3) \
+                    D100(M, p##4) D100(M, p##5) D100(M, p##6) D100(M, p##7) \
+                    D100(M, p##8) D100(M, p##9)
+/* 8000 functions */
+#define ALL(M) D1000(M, 1) D1000(M, 2) D1000(M, 3) D1000(M, 4) \
+               D1000(M, 5) D1000(M, 6) D1000(M, 7) D1000(M, 8)
+
+ALL(FUNC)
+
+int
+main(int argc, char **argv)
+{
+    int iters = (argc > 1) ? atoi(argv[1]) : 10;
+    int i, sum = 0;
+    for (i = 0; i < iters; i++) {
+        ALL(CALL)
+    }
+    printf("bigcode: %d\n", sum);
+    return 0;
+}
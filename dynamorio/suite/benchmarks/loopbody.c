@@ -0,0 +1,85 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: trace selection on loop-heavy code.  A hot loop whose
+ * body branches on data in several directions and calls small helper
+ * functions is split by DR's default trace selection across several traces,
+ * with exits to dispatch or the indirect branch lookup between them; a client
+ * that registers trace regions for loops can keep each iteration in one trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARRAY_SIZE 4096
+
+static unsigned int data[ARRAY_SIZE];
+
+static __attribute__((noinline)) unsigned int
+mix(unsigned int x)
+{
+    return (x ^ (x >> 7)) * 0x9e3779b1;
+}
+
+static __attribute__((noinline)) unsigned int
+clamp(unsigned int x, unsigned int limit)
+{
+    return (x > limit) ? limit : x;
+}
+
+int
+main(int argc, char **argv)
+{
+    int iters = (argc > 1) ? atoi(argv[1]) : 1000;
+    unsigned int sum = 0, seed = 12345;
+    int i, j;
+    for (j = 0; j < ARRAY_SIZE; j++) {
+        seed = seed * 1103515245 + 12345;
+        data[j] = seed >> 8;
+    }
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < ARRAY_SIZE; j++) {
+            unsigned int x = data[j];
+            /* paths vary from element to element */
+            if (x & 1)
+                sum += mix(x);
+            else if (x & 2)
+                sum -= x >> 3;
+            else
+                sum ^= clamp(x, 1000);
+            if ((x & 0xc) == 0xc)
+                sum = mix(sum);
+        }
+    }
+    printf("loopbody: %u\n", sum);
+    return 0;
+}
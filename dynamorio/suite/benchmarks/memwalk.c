@@ -0,0 +1,126 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: memory tracers such as drmemtrace.  Each thread
+ * repeatedly streams through a private array, which delta-encodes well, and
+ * then follows a random cycle of indices through it, which does not and
+ * which misses in the caches and TLBs.
+ *
+ * usage: memwalk <iterations> <threads>
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARRAY_ELEMS (512*1024) /* 4MB of indices per thread on 64-bit */
+#define MAX_THREADS 64
+
+static int iters;
+
+/* Links the elements into a single random cycle (Sattolo's algorithm) */
+static void
+make_cycle(size_t *next, size_t count, unsigned int seed)
+{
+    size_t i, j, tmp;
+    for (i = 0; i < count; i++)
+        next[i] = i;
+    for (i = count - 1; i > 0; i--) {
+        seed = seed * 1103515245U + 12345U;
+        j = (seed >> 8) % i;
+        tmp = next[i];
+        next[i] = next[j];
+        next[j] = tmp;
+    }
+}
+
+static size_t
+run(unsigned int seed)
+{
+    size_t *next = malloc(ARRAY_ELEMS * sizeof(*next));
+    size_t sum = 0, pos = 0;
+    int i;
+    size_t j;
+    if (next == NULL)
+        return 0;
+    make_cycle(next, ARRAY_ELEMS, seed);
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < ARRAY_ELEMS; j++)
+            sum += next[j];
+        for (j = 0; j < ARRAY_ELEMS / 8; j++)
+            pos = next[pos];
+        sum += pos;
+    }
+    free(next);
+    return sum;
+}
+
+static void *
+thread_main(void *arg)
+{
+    size_t *res = (size_t *)arg;
+    *res = run((unsigned int)*res);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t threads[MAX_THREADS];
+    size_t results[MAX_THREADS];
+    size_t sum = 0;
+    int num_threads, i;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <iterations> <threads>\n", argv[0]);
+        return 1;
+    }
+    iters = atoi(argv[1]);
+    num_threads = atoi(argv[2]);
+    if (num_threads < 1 || num_threads > MAX_THREADS) {
+        fprintf(stderr, "threads must be in [1, %d]\n", MAX_THREADS);
+        return 1;
+    }
+    for (i = 0; i < num_threads; i++) {
+        results[i] = i;
+        if (pthread_create(&threads[i], NULL, thread_main, &results[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        sum += results[i];
+    }
+    printf("checksum %zx\n", sum);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: code generation bound.  The app repeatedly maps a
+ * page, writes a tiny function into it, calls it, and unmaps it, so DR
+ * has to build blocks from new code and flush them on every unmap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+typedef int (*func_t)(void);
+
+int
+main(int argc, char **argv)
+{
+    int iters = (argc > 1) ? atoi(argv[1]) : 10000;
+    /* mov eax, imm32; ret */
+    unsigned char code[] = { 0xb8, 0, 0, 0, 0, 0xc3 };
+    int i, sum = 0;
+    for (i = 0; i < iters; i++) {
+        unsigned char *page = (unsigned char *)
+            mmap(NULL, 4096, PROT_READ|PROT_WRITE|PROT_EXEC,
+                 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (page == (unsigned char *) MAP_FAILED) {
+            fprintf(stderr, "mmap failed\n");
+            return 1;
+        }
+        memcpy(&code[1], &i, sizeof(i));
+        memcpy(page, code, sizeof(code));
+        sum += ((func_t) page)();
+        munmap(page, 4096);
+    }
+    printf("mmapexec: %d\n", sum);
+    return 0;
+}
@@ -0,0 +1,469 @@
+#!/usr/bin/perl
+
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+### runbench.pl
+###
+### Runs each overhead benchmark natively and under a series of DR
+### configurations, each included only if its client is passed in:
+###   empty              DR with an empty client
+###   bbcov              bbcov, continuously and then at each -bbcov_duty
+###                      duty cycle (bbcov_duty_<window>_<period>)
+###   drprof             the drprof sampling profiler
+###   drmemtrace         drmemtrace, after which drcachesim simulates the
+###                      fastest run's traces
+###   persist_cold       -persist with no persisted caches, with caches
+###   persist_offline    generated ahead of time by drpersist, and with
+###   persist_runtime    caches persisted by one earlier run of the app
+###   deps, deps_cached  a client with many library dependences, without
+###                      and with -privload_cache_dir
+###   region             a client registering loop trace regions
+###   <config>           any other client, with its options, given via
+###                      -client <config>=<client>[,<option>...]
+### -restrict limits a configuration, or every configuration whose name
+### starts with it plus "_", to the named benchmarks.  The results are
+### written as JSON for regression tracking: per-configuration wall-clock
+### seconds (best of -reps runs), slowdown ratios versus native, the number
+### of references and bytes traced by the fastest drmemtrace run and the
+### seconds drcachesim takes to simulate them, the process kstats of the DR
+### runs when DR was built with KSTATS, and the cache exit statistics of the
+### DR runs for a debug build.  Normally invoked via "make benchmarks".
+
+use strict;
+use File::Path;
+use File::Find;
+use File::Spec;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $usage = "Usage: $0 -drrun <path> -empty <client> [-bbcov <client>]\n" .
+    "  [-bbcov_duty <window_ms>:<period_ms>[,...]] [-drprof <client>]\n" .
+    "  [-drmemtrace <client> -drcachesim <exe>]\n" .
+    "  [-drpersist <client> -drpersist_gen <exe>]\n" .
+    "  [-deps <client>] [-region <client>] [-debug]\n" .
+    "  [-client <config>=<client>[,<option>...]] ...\n" .
+    "  [-restrict <config>=<name>[,...]] ...\n" .
+    "  [-kstats] [-reps <N>] [-ops <DR options>] [-workdir <dir>] [-out <file>]\n" .
+    "  <name>=<exe>[,<arg>...] ...\n";
+
+my $drrun = "";
+my $empty = "";
+my $bbcov = "";
+my $bbcov_duty = "";
+my $drprof = "";
+my $drmemtrace = "";
+my $drcachesim = "";
+my $drpersist = "";
+my $drpersist_gen = "";
+my %restrict;
+my @client_configs = ();
+my %client_cmd;
+my $deps = "";
+my $region = "";
+my $debug = 0;
+my $kstats = 0;
+my $reps = 3;
+my $ops = "";
+my $workdir = "benchmark-runs";
+my $outfile = "";
+my @benches = ();
+
+while ($#ARGV >= 0) {
+    my $arg = shift @ARGV;
+    if ($arg eq "-drrun") {
+        $drrun = shift @ARGV;
+    } elsif ($arg eq "-empty") {
+        $empty = shift @ARGV;
+    } elsif ($arg eq "-bbcov") {
+        $bbcov = shift @ARGV;
+    } elsif ($arg eq "-bbcov_duty") {
+        $bbcov_duty = shift @ARGV;
+    } elsif ($arg eq "-drprof") {
+        $drprof = shift @ARGV;
+    } elsif ($arg eq "-drmemtrace") {
+        $drmemtrace = shift @ARGV;
+    } elsif ($arg eq "-drcachesim") {
+        $drcachesim = shift @ARGV;
+    } elsif ($arg eq "-drpersist") {
+        $drpersist = shift @ARGV;
+    } elsif ($arg eq "-drpersist_gen") {
+        $drpersist_gen = shift @ARGV;
+    } elsif ($arg eq "-client") {
+        my $spec = shift @ARGV;
+        die $usage unless ($spec =~ /^(\w+)=([^,]+)(?:,(.*))?$/);
+        push @client_configs, $1;
+        $client_cmd{$1} = [$2, defined($3) ? split(/,/, $3) : ()];
+    } elsif ($arg eq "-restrict") {
+        my $spec = shift @ARGV;
+        die $usage unless ($spec =~ /^(\w+)=([\w,]+)$/);
+        $restrict{$1} = [split(/,/, $2)];
+    } elsif ($arg eq "-deps") {
+        $deps = shift @ARGV;
+    } elsif ($arg eq "-region") {
+        $region = shift @ARGV;
+    } elsif ($arg eq "-debug") {
+        $debug = 1;
+    } elsif ($arg eq "-kstats") {
+        $kstats = 1;
+    } elsif ($arg eq "-reps") {
+        $reps = shift @ARGV;
+    } elsif ($arg eq "-ops") {
+        $ops = shift @ARGV;
+    } elsif ($arg eq "-workdir") {
+        $workdir = shift @ARGV;
+    } elsif ($arg eq "-out") {
+        $outfile = shift @ARGV;
+    } elsif ($arg =~ /^(\w+)=(.+)$/) {
+        push @benches, $arg;
+    } else {
+        die $usage;
+    }
+}
+die $usage if ($drrun eq "" || $empty eq "" || $#benches < 0 || $reps < 1);
+die $usage if (($drmemtrace eq "") != ($drcachesim eq ""));
+die $usage if (($drpersist eq "") != ($drpersist_gen eq ""));
+
+# Configurations to compare.  Each DR run gets its own log dir so we can
+# find its kstats afterward.
+my @configs = ("native", "empty");
+push @configs, "bbcov" if ($bbcov ne "");
+# bbcov -duty_cycle configurations are named bbcov_duty_<window>_<period>
+if ($bbcov ne "") {
+    foreach my $cycle (split(/,/, $bbcov_duty)) {
+        die $usage unless ($cycle =~ /^(\d+):(\d+)$/);
+        push @configs, "bbcov_duty_$1_$2";
+    }
+}
+push @configs, "drprof" if ($drprof ne "");
+push @configs, "drmemtrace" if ($drmemtrace ne "");
+# The persist_offline and persist_runtime caches are produced once,
+# unmeasured, per benchmark.  Measured runs load caches but never write them.
+my $persistdir = File::Spec->rel2abs("$workdir/persist-cache");
+push @configs, ("persist_cold", "persist_offline", "persist_runtime")
+    if ($drpersist ne "");
+# The deps client with the relocated image cache is run once unmeasured per
+# benchmark to fill the cache, so its times are for warm starts.
+my $privcache = File::Spec->rel2abs("$workdir/privload-cache");
+push @configs, ("deps", "deps_cached") if ($deps ne "");
+push @configs, "region" if ($region ne "");
+foreach my $config (@client_configs) {
+    die "Error: duplicate configuration $config\n"
+        if (grep { $_ eq $config } @configs);
+    push @configs, $config;
+}
+
+# Statistics showing how often the code cache is left, read from the global
+# logs of debug-build runs.
+my @exit_stats = ("Fcache exits, total",
+                  "Fcache exits, from BBs",
+                  "Fcache exits, from traces",
+                  "Fcache exits, total indirect branches",
+                  "Trace fragments generated",
+                  "Custom trace region blocks added");
+
+my @results = ();
+foreach my $bench (@benches) {
+    $bench =~ /^(\w+)=(.+)$/;
+    my $name = $1;
+    my @app = split(/,/, $2);
+    my %secs;
+    my %kstats;
+    my %stats;
+    my %trace;
+    foreach my $config (@configs) {
+        next if (!is_selected($config, $name));
+        my $best = -1;
+        my $best_logdir = "";
+        if ($config eq "deps_cached") {
+            rmtree($privcache);
+            mkpath($privcache);
+            my $logdir = "$workdir/$name-$config-warmup";
+            rmtree($logdir);
+            mkpath($logdir);
+            run_quietly($logdir, dr_command($config, $logdir, @app));
+        } elsif ($config =~ /^persist_/) {
+            rmtree($persistdir);
+            mkpath($persistdir);
+            my $logdir = "$workdir/$name-$config-warmup";
+            rmtree($logdir);
+            mkpath($logdir);
+            persist_warmup($config, $logdir, @app);
+        }
+        for (my $rep = 0; $rep < $reps; $rep++) {
+            my $logdir = "$workdir/$name-$config-$rep";
+            rmtree($logdir);
+            mkpath($logdir);
+            my $elapsed = run_quietly($logdir, dr_command($config, $logdir, @app));
+            if ($best < 0 || $elapsed < $best) {
+                # only the fastest run's traces are simulated
+                unlink(glob("$best_logdir/*.trace")) if ($best_logdir ne "");
+                $best = $elapsed;
+                $best_logdir = $logdir;
+                # kstats come from the fastest run, to match the time
+                $kstats{$config} = read_kstats($logdir) if ($config ne "native");
+                $stats{$config} = read_stats($logdir) if ($config ne "native");
+            } else {
+                unlink(glob("$logdir/*.trace"));
+            }
+        }
+        $secs{$config} = $best;
+        printf STDERR "%-12s %-16s %8.3f s\n", $name, $config, $best;
+        if ($config eq "drmemtrace") {
+            %trace = simulate_traces($best_logdir);
+            printf STDERR "%-12s %-16s %8.3f s for %s references\n", $name,
+                "drcachesim", $trace{secs}, $trace{refs};
+        }
+    }
+    push @results, { name => $name, secs => \%secs, kstats => \%kstats,
+                     stats => \%stats, trace => \%trace };
+}
+
+my $json = results_json(@results);
+if ($outfile ne "") {
+    open(OUT, "> $outfile") || die "Error: Couldn't open $outfile for output\n";
+    print OUT $json;
+    close(OUT);
+    print STDERR "Results written to $outfile\n";
+} else {
+    print $json;
+}
+exit 0;
+
+# Runs the command with its stdout sent to $logdir/app.out, to keep the
+# apps' output out of the report, and returns the elapsed seconds.
+sub run_quietly {
+    my ($logdir, @cmd) = @_;
+    open(SAVED_STDOUT, ">&STDOUT") || die "Error: Couldn't dup stdout\n";
+    open(STDOUT, "> $logdir/app.out") || die "Error: Couldn't redirect stdout\n";
+    my $start = [gettimeofday];
+    my $status = system(@cmd);
+    my $elapsed = tv_interval($start);
+    open(STDOUT, ">&SAVED_STDOUT") || die "Error: Couldn't restore stdout\n";
+    close(SAVED_STDOUT);
+    die "Error: \"@cmd\" failed ($status)\n" if ($status != 0);
+    return $elapsed;
+}
+
+# Returns the command line for running the app under the given configuration.
+sub dr_command {
+    my ($config, $logdir, @app) = @_;
+    return @app if ($config eq "native");
+    my @cmd = ($drrun, "-quiet", "-logdir", $logdir);
+    push @cmd, "-debug" if ($debug);
+    my $drops = $ops;
+    $drops .= " -kstats" if ($kstats);
+    # only the statistics dump at exit
+    $drops .= " -loglevel 1 -logmask 0x1" if ($debug);
+    $drops .= " -privload_cache_dir $privcache" if ($config eq "deps_cached");
+    $drops .= " -persist -persist_dir $persistdir -no_coarse_freeze_at_exit" .
+        " -no_coarse_freeze_at_unload" if ($config =~ /^persist_/);
+    push @cmd, ("-ops", $drops) if ($drops ne "");
+    if (defined($client_cmd{$config})) {
+        push @cmd, ("-c", @{$client_cmd{$config}});
+    } elsif ($config eq "empty") {
+        push @cmd, ("-c", $empty);
+    } elsif ($config =~ /^persist_/) {
+        # no client: only the persisted caches differ
+    } elsif ($config eq "deps" || $config eq "deps_cached") {
+        push @cmd, ("-c", $deps);
+    } elsif ($config eq "region") {
+        push @cmd, ("-c", $region);
+    } elsif ($config =~ /^bbcov_duty_(\d+)_(\d+)$/) {
+        push @cmd, ("-c", $bbcov, "-logdir", $logdir, "-duty_cycle", $1, $2);
+    } elsif ($config eq "drprof") {
+        push @cmd, ("-c", $drprof, "-logdir", $logdir);
+    } elsif ($config eq "drmemtrace") {
+        push @cmd, ("-c", $drmemtrace, "-logdir", $logdir);
+    } else {
+        push @cmd, ("-c", $bbcov, "-logdir", $logdir);
+    }
+    return (@cmd, "--", @app);
+}
+
+# Returns whether the configuration is to be run for the named benchmark,
+# according to any -restrict for it or for a prefix of its name.
+sub is_selected {
+    my ($config, $name) = @_;
+    foreach my $key (keys %restrict) {
+        next unless ($config eq $key || $config =~ /^${key}_/);
+        return 0 unless (grep { $_ eq $name } @{$restrict{$key}});
+    }
+    return 1;
+}
+
+# Fills $persistdir for the persist_offline or persist_runtime
+# configuration.  The offline caches are generated by drpersist for the app
+# and the libraries ldd lists for it; the app itself may not be loadable by
+# drpersist_gen (e.g., a non-PIE executable), in which case only its
+# libraries are covered, so drpersist_gen's status is ignored.
+sub persist_warmup {
+    my ($config, $logdir, @app) = @_;
+    return if ($config eq "persist_cold");
+    my @cmd = ($drrun, "-quiet", "-logdir", $logdir);
+    push @cmd, "-debug" if ($debug);
+    push @cmd, ("-ops", "$ops -persist -persist_dir $persistdir");
+    if ($config eq "persist_offline") {
+        my @libs = (`ldd $app[0] 2>/dev/null` =~ /=> (\/\S+) /g);
+        @cmd = (@cmd, "-c", $drpersist, "--", $drpersist_gen, $app[0], @libs);
+        open(SAVED_STDOUT, ">&STDOUT") || die "Error: Couldn't dup stdout\n";
+        open(STDOUT, "> $logdir/app.out") || die "Error: Couldn't redirect stdout\n";
+        open(SAVED_STDERR, ">&STDERR") || die "Error: Couldn't dup stderr\n";
+        open(STDERR, ">&STDOUT") || die "Error: Couldn't redirect stderr\n";
+        system(@cmd);
+        open(STDERR, ">&SAVED_STDERR") || die "Error: Couldn't restore stderr\n";
+        close(SAVED_STDERR);
+        open(STDOUT, ">&SAVED_STDOUT") || die "Error: Couldn't restore stdout\n";
+        close(SAVED_STDOUT);
+    } else {
+        run_quietly($logdir, @cmd, "--", @app);
+    }
+}
+
+# Runs drcachesim on the traces drmemtrace wrote to $logdir and returns a
+# hash with the wall-clock seconds it took and the number of references and
+# trace bytes it reports.
+sub simulate_traces {
+    my ($logdir) = @_;
+    my @traces = glob("$logdir/*.trace");
+    die "Error: no traces in $logdir\n" if ($#traces < 0);
+    my $start = [gettimeofday];
+    my $out = `$drcachesim @traces`;
+    my $elapsed = tv_interval($start);
+    die "Error: \"$drcachesim\" failed ($?)\n" if ($? != 0);
+    die "Error: unrecognized drcachesim output\n"
+        unless ($out =~ /^Simulated (\d+) references from (\d+) bytes/m);
+    return (secs => $elapsed, refs => $1, bytes => $2);
+}
+
+# Returns a hash of kstat name => total milliseconds from the "Process KSTATS"
+# report of every process that logged under $logdir (e.g., fork children),
+# summed.
+sub read_kstats {
+    my ($logdir) = @_;
+    my %ms;
+    return \%ms if (!$kstats);
+    my @files = ();
+    find(sub { push @files, $File::Find::name if (-f $_ && !/\.trace$/); },
+         $logdir);
+    foreach my $file (@files) {
+        open(LOG, "< $file") || next;
+        my $in_process = 0;
+        my $cur = "";
+        while (<LOG>) {
+            if (/^Process KSTATS:/) {
+                $in_process = 1;
+            } elsif ($in_process && /^\s*(\w+):\s*\d+ totc,/) {
+                $cur = $1;
+            } elsif ($in_process && $cur ne "" && /^\s+(\d+) ms,/) {
+                $ms{$cur} += $1;
+                $cur = "";
+            } elsif ($in_process && !/^\s/) {
+                $in_process = 0;
+            }
+        }
+        close(LOG);
+    }
+    return \%ms;
+}
+
+# Returns a hash of statistic name => value for the statistics in @exit_stats
+# from the global log of every process that logged under $logdir, summed.
+sub read_stats {
+    my ($logdir) = @_;
+    my %vals;
+    return \%vals if (!$debug);
+    my @files = ();
+    find(sub { push @files, $File::Find::name if (-f $_ && !/\.trace$/); },
+         $logdir);
+    foreach my $file (@files) {
+        open(LOG, "< $file") || next;
+        while (<LOG>) {
+            # thread totals are labeled "(thread)" and so do not match
+            next unless (/^\s*(.+?) :\s*(\d+)\s*$/);
+            my ($desc, $val) = ($1, $2);
+            $vals{$desc} += $val if (grep { $_ eq $desc } @exit_stats);
+        }
+        close(LOG);
+    }
+    return \%vals;
+}
+
+sub results_json {
+    my @results = @_;
+    my $json = "{\n  \"reps\": $reps,\n  \"benchmarks\": [\n";
+    my @entries = ();
+    foreach my $res (@results) {
+        my $secs = $res->{secs};
+        my $res_kstats = $res->{kstats};
+        my $res_stats = $res->{stats};
+        my $res_trace = $res->{trace};
+        my @fields = ("      \"name\": \"$res->{name}\"");
+        # drmemtrace is only run for some benchmarks
+        my @ran = grep { defined($secs->{$_}) } @configs;
+        foreach my $config (@ran) {
+            push @fields, sprintf("      \"%s_secs\": %.4f", $config, $secs->{$config});
+        }
+        foreach my $config (@ran) {
+            next if ($config eq "native");
+            my $ratio = ($secs->{native} > 0) ?
+                $secs->{$config} / $secs->{native} : 0;
+            push @fields, sprintf("      \"%s_slowdown\": %.3f", $config, $ratio);
+        }
+        if (defined($res_trace->{refs})) {
+            push @fields, "      \"drmemtrace_refs\": $res_trace->{refs}";
+            push @fields, "      \"drmemtrace_bytes\": $res_trace->{bytes}";
+            push @fields, sprintf("      \"drcachesim_secs\": %.4f",
+                                  $res_trace->{secs});
+        }
+        if ($kstats) {
+            my @kfields = ();
+            foreach my $config (@ran) {
+                next if ($config eq "native");
+                my $ms = $res_kstats->{$config};
+                my @pairs = map { "\"$_\": $ms->{$_}" } (sort keys %$ms);
+                push @kfields, "        \"$config\": {" . join(", ", @pairs) . "}";
+            }
+            push @fields, "      \"kstats_ms\": {\n" . join(",\n", @kfields) . "\n      }";
+        }
+        if ($debug) {
+            my @sfields = ();
+            foreach my $config (@ran) {
+                next if ($config eq "native");
+                my $vals = $res_stats->{$config};
+                my @pairs = map { "\"$_\": " . ($vals->{$_} || 0) } @exit_stats;
+                push @sfields, "        \"$config\": {" . join(", ", @pairs) . "}";
+            }
+            push @fields, "      \"exit_stats\": {\n" . join(",\n", @sfields) . "\n      }";
+        }
+        push @entries, "    {\n" . join(",\n", @fields) . "\n    }";
+    }
+    $json .= join(",\n", @entries) . "\n  ]\n}\n";
+    return $json;
+}
@@ -0,0 +1,132 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: sampling profilers such as drprof.  Each thread
+ * repeatedly sorts and hashes buffers through a few levels of calls, so a
+ * profile of it has distinct, predictable stacks.
+ *
+ * usage: sortcalls <iterations> <threads>
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUF_ELEMS 4096
+#define MAX_THREADS 64
+
+static int iters;
+
+static unsigned int
+hash_block(const unsigned int *buf, int count)
+{
+    unsigned int hash = 2166136261U;
+    int i;
+    for (i = 0; i < count; i++) {
+        hash ^= buf[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static int
+compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+fill_block(unsigned int *buf, int count, unsigned int seed)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        seed = seed * 1103515245U + 12345U;
+        buf[i] = seed >> 8;
+    }
+}
+
+static unsigned int
+run(unsigned int seed)
+{
+    static __thread unsigned int buf[BUF_ELEMS];
+    unsigned int sum = 0;
+    int i;
+    for (i = 0; i < iters; i++) {
+        fill_block(buf, BUF_ELEMS, seed + i);
+        qsort(buf, BUF_ELEMS, sizeof(buf[0]), compare_uint);
+        sum += hash_block(buf, BUF_ELEMS);
+    }
+    return sum;
+}
+
+static void *
+thread_main(void *arg)
+{
+    unsigned int *res = (unsigned int *)arg;
+    *res = run(*res);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t threads[MAX_THREADS];
+    unsigned int results[MAX_THREADS];
+    unsigned int sum = 0;
+    int num_threads, i;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <iterations> <threads>\n", argv[0]);
+        return 1;
+    }
+    iters = atoi(argv[1]);
+    num_threads = atoi(argv[2]);
+    if (num_threads < 1 || num_threads > MAX_THREADS) {
+        fprintf(stderr, "threads must be in [1, %d]\n", MAX_THREADS);
+        return 1;
+    }
+    for (i = 0; i < num_threads; i++) {
+        results[i] = i;
+        if (pthread_create(&threads[i], NULL, thread_main, &results[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        sum += results[i];
+    }
+    printf("checksum %x\n", sum);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* Overhead benchmark: string loop instrumentation, such as the memtrace
+ * sample's per-execution ranges versus its per-iteration expansion.  Each
+ * iteration does the copies and fills that memcpy, memmove and memset do
+ * with rep string instructions: a few long forward copies, a backward
+ * (DF=1) overlapping move, a long fill, and many short copies.
+ *
+ * usage: strloop <iterations>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LONG_SIZE 4096
+#define SHORT_SIZE 48
+#define SHORT_COPIES 64
+
+static char src[LONG_SIZE];
+static char dst[LONG_SIZE + SHORT_COPIES];
+
+static void
+copy_forward(char *to, const char *from, size_t count)
+{
+    __asm__ __volatile__("rep movsb"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+}
+
+/* to > from and the ranges overlap, as in memmove */
+static void
+copy_backward(char *to, const char *from, size_t count)
+{
+    to += count - 1;
+    from += count - 1;
+    __asm__ __volatile__("std\n\t"
+                         "rep movsb\n\t"
+                         "cld"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+}
+
+static void
+fill_words(void *to, size_t val, size_t count)
+{
+    __asm__ __volatile__("rep stosl"
+                         : "+D" (to), "+c" (count) : "a" (val) : "memory");
+}
+
+int
+main(int argc, char **argv)
+{
+    int iters, i, j;
+    size_t sum = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <iterations>\n", argv[0]);
+        return 1;
+    }
+    iters = atoi(argv[1]);
+    for (i = 0; i < LONG_SIZE; i++)
+        src[i] = (char) i;
+    for (i = 0; i < iters; i++) {
+        copy_forward(dst, src, LONG_SIZE);
+        copy_backward(dst + SHORT_COPIES, dst, LONG_SIZE);
+        for (j = 0; j < SHORT_COPIES; j++)
+            copy_forward(dst + j, src + j * SHORT_SIZE, SHORT_SIZE);
+        sum += (unsigned char) dst[i % LONG_SIZE];
+        fill_words(dst, i, LONG_SIZE / 4);
+        sum += (unsigned char) dst[LONG_SIZE - 1];
+    }
+    printf("checksum %zx\n", sum);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: thread creation and exit bound.  Waves of short-lived
+ * threads are created and joined, so DR's per-thread setup and teardown
+ * dominate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define WAVE_SIZE 8
+
+static void *
+thread_func(void *arg)
+{
+    int i;
+    long sum = (long) arg;
+    for (i = 0; i < 1000; i++)
+        sum += i;
+    return (void *) sum;
+}
+
+int
+main(int argc, char **argv)
+{
+    int num_threads = (argc > 1) ? atoi(argv[1]) : 1000;
+    pthread_t threads[WAVE_SIZE];
+    long sum = 0;
+    void *res;
+    int i, j;
+    for (i = 0; i < num_threads; i += WAVE_SIZE) {
+        for (j = 0; j < WAVE_SIZE; j++) {
+            if (pthread_create(&threads[j], NULL, thread_func, (void *)(long) j) != 0) {
+                fprintf(stderr, "cannot create thread\n");
+                return 1;
+            }
+        }
+        for (j = 0; j < WAVE_SIZE; j++) {
+            pthread_join(threads[j], &res);
+            sum += (long) res;
+        }
+    }
+    printf("threadchurn: %ld\n", sum);
+    return 0;
+}
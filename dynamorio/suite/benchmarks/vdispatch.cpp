@@ -0,0 +1,92 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Overhead benchmark: indirect-branch bound.  Virtual calls through a base
+ * pointer spread over many receiver classes, so every call and return is an
+ * indirect branch with many targets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+class shape_t {
+ public:
+    virtual ~shape_t() {}
+    virtual int area(int scale) const = 0;
+};
+
+template <int N>
+class poly_t : public shape_t {
+ public:
+    virtual int area(int scale) const { return scale * N + (scale >> (N % 5)); }
+};
+
+#define NUM_CLASSES 16
+#define NUM_OBJECTS 1024
+
+int
+main(int argc, char **argv)
+{
+    long iters = (argc > 1) ? atol(argv[1]) : 10000000;
+    shape_t *objs[NUM_OBJECTS];
+    unsigned int seed = 1;
+    long i;
+    int sum = 0;
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        /* pseudo-random order so the targets don't form a simple pattern */
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % NUM_CLASSES) {
+        case 0:  objs[i] = new poly_t<0>();  break;
+        case 1:  objs[i] = new poly_t<1>();  break;
+        case 2:  objs[i] = new poly_t<2>();  break;
+        case 3:  objs[i] = new poly_t<3>();  break;
+        case 4:  objs[i] = new poly_t<4>();  break;
+        case 5:  objs[i] = new poly_t<5>();  break;
+        case 6:  objs[i] = new poly_t<6>();  break;
+        case 7:  objs[i] = new poly_t<7>();  break;
+        case 8:  objs[i] = new poly_t<8>();  break;
+        case 9:  objs[i] = new poly_t<9>();  break;
+        case 10: objs[i] = new poly_t<10>(); break;
+        case 11: objs[i] = new poly_t<11>(); break;
+        case 12: objs[i] = new poly_t<12>(); break;
+        case 13: objs[i] = new poly_t<13>(); break;
+        case 14: objs[i] = new poly_t<14>(); break;
+        default: objs[i] = new poly_t<15>(); break;
+        }
+    }
+    for (i = 0; i < iters; i++)
+        sum += objs[i % NUM_OBJECTS]->area((int)i);
+    for (i = 0; i < NUM_OBJECTS; i++)
+        delete objs[i];
+    printf("vdispatch: %d\n", sum);
+    return 0;
+}
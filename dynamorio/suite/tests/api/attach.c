@@ -0,0 +1,103 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Measures how long DR takes to take over a process with many memory
+ * mappings, as when attaching to a large server process.  Usage:
+ *   api.attach [num_mappings [-time]]
+ * With -time the setup+start latency is printed; it is left out by default
+ * to keep the output deterministic.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#ifdef USE_DYNAMO
+# include "configure.h"
+# include "dr_api.h"
+#endif
+#include "tools.h"
+
+#define DEFAULT_MAPPINGS 1000
+#define MAP_UNIT 4096
+
+int
+main(int argc, char *argv[])
+{
+    int num_maps = (argc > 1) ? atoi(argv[1]) : DEFAULT_MAPPINGS;
+    bool show_time = (argc > 2 && strcmp(argv[2], "-time") == 0);
+    struct timeval start, end;
+    char *base;
+    int i, sum = 0;
+
+    /* One reservation with alternating protections, so that the kernel
+     * keeps each page as its own maps entry.
+     */
+    base = mmap(NULL, num_maps * MAP_UNIT, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        print("mmap failed\n");
+        return 1;
+    }
+    for (i = 0; i < num_maps; i += 2) {
+        if (mprotect(base + i * MAP_UNIT, MAP_UNIT, PROT_READ) != 0) {
+            print("mprotect failed\n");
+            return 1;
+        }
+    }
+
+    gettimeofday(&start, NULL);
+#ifdef USE_DYNAMO
+    dr_app_setup();
+    dr_app_start();
+#endif
+    gettimeofday(&end, NULL);
+
+    /* touch the mappings under DR */
+    for (i = 0; i < num_maps; i++)
+        sum += base[i * MAP_UNIT];
+
+#ifdef USE_DYNAMO
+    dr_app_stop();
+    dr_app_cleanup();
+#endif
+    munmap(base, num_maps * MAP_UNIT);
+
+    if (show_time) {
+        print("attach with %d mappings took %d ms\n", num_maps,
+              (int)((end.tv_sec - start.tv_sec) * 1000 +
+                    (end.tv_usec - start.tv_usec) / 1000));
+    }
+    print("attached with %d mappings: %d\n", num_maps, sum);
+    return 0;
+}
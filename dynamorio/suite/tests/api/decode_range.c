@@ -0,0 +1,205 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests decode_range() against a per-instruction decode loop over the
+ * same bytes, and optionally measures the throughput of each.
+ */
+
+#include "configure.h"
+#include "dr_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ORIG_PC ((app_pc)0x10000000)
+/* the longest x86 instruction */
+#define MAX_INSTR_LEN 17
+
+#define CHECK(x, msg) do {                                              \
+    if (!(x)) {                                                         \
+        dr_fprintf(STDERR, "CHECK failed %s:%d: %s\n", __FILE__, __LINE__, msg); \
+        abort();                                                        \
+    }                                                                   \
+} while (0)
+
+/* Returns the number of instructions, mirroring decode_range()'s treatment
+ * of invalid and truncated instructions.
+ */
+static uint
+decode_each(void *drcontext, byte *buf, size_t size, decode_range_t *check)
+{
+    instr_t instr;
+    /* the final instructions are decoded from a padded copy so that we never
+     * read past the end of buf
+     */
+    byte tail[MAX_INSTR_LEN];
+    byte *pc = buf, *next;
+    uint count = 0;
+    instr_init(drcontext, &instr);
+    while (pc < buf + size) {
+        size_t left = buf + size - pc;
+        byte *decode_pc = pc;
+        if (left < sizeof(tail)) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, pc, left);
+            decode_pc = tail;
+        }
+        instr_reset(drcontext, &instr);
+        next = decode_from_copy(drcontext, decode_pc, ORIG_PC + (pc - buf), &instr);
+        if (next == NULL || (size_t)(next - decode_pc) > left)
+            next = pc + 1;
+        else
+            next = pc + (next - decode_pc);
+        if (check != NULL) {
+            CHECK(count < check->num_instrs, "too few instrs");
+            CHECK(check->offset[count] == (uint)(pc - buf), "offset mismatch");
+            CHECK(check->length[count] == (byte)(next - pc), "length mismatch");
+            if (check->opcode[count] != OP_INVALID) {
+                CHECK(check->opcode[count] == instr_get_opcode(&instr),
+                      "opcode mismatch");
+                CHECK(check->eflags[count] == instr_get_eflags(&instr),
+                      "eflags mismatch");
+                if (instr_is_cbr(&instr) || instr_is_ubr(&instr) ||
+                    instr_get_opcode(&instr) == OP_call) {
+                    CHECK(check->target[count] ==
+                          opnd_get_pc(instr_get_target(&instr)),
+                          "target mismatch");
+                } else
+                    CHECK(check->target[count] == NULL, "unexpected target");
+                CHECK((check->cti_kind[count] != DR_CTI_NONE) ==
+                      (instr_is_cti(&instr) || instr_is_syscall(&instr) ||
+                       instr_is_interrupt(&instr)), "cti kind mismatch");
+            }
+        }
+        pc = next;
+        count++;
+    }
+    instr_free(drcontext, &instr);
+    return count;
+}
+
+static void
+check_instr(void *drcontext, decode_range_t *range, uint index)
+{
+    instr_t instr;
+    byte *next;
+    instr_init(drcontext, &instr);
+    next = decode_range_instr(drcontext, range, index, &instr);
+    if (range->opcode[index] == OP_INVALID)
+        CHECK(next == NULL, "invalid entry decoded");
+    else {
+        CHECK(next == range->start + range->offset[index] + range->length[index],
+              "decode_range_instr length mismatch");
+        CHECK(instr_get_opcode(&instr) == range->opcode[index],
+              "decode_range_instr opcode mismatch");
+        CHECK(instr_get_app_pc(&instr) == range->orig_start + range->offset[index],
+              "decode_range_instr pc mismatch");
+    }
+    instr_free(drcontext, &instr);
+}
+
+static void
+test_range(void *drcontext, byte *buf, size_t size)
+{
+    uint i, count;
+    decode_range_t *range = decode_range(drcontext, buf, size, ORIG_PC,
+                                         DECODE_RANGE_OPCODES);
+    CHECK(range != NULL, "decode_range failed");
+    count = decode_each(drcontext, buf, size, range);
+    CHECK(count == range->num_instrs, "instr count mismatch");
+    for (i = 0; i < range->num_instrs; i += 17)
+        check_instr(drcontext, range, i);
+    decode_range_free(drcontext, range);
+
+    /* Without DECODE_RANGE_OPCODES, lengths and branch targets must agree. */
+    range = decode_range(drcontext, buf, size, ORIG_PC, 0);
+    CHECK(range != NULL && range->num_instrs == count, "no-opcode count mismatch");
+    for (i = 0; i < range->num_instrs; i++) {
+        CHECK(range->opcode[i] == OP_INVALID || range->cti_kind[i] != DR_CTI_NONE ||
+              range->opcode[i] == OP_UNDECODED, "unexpected opcode");
+    }
+    decode_range_free(drcontext, range);
+    dr_printf("decode_range matches per-instruction decode\n");
+}
+
+static void
+benchmark(void *drcontext, byte *buf, size_t size, uint iters)
+{
+    uint i;
+    uint64 start, each_ms, range_ms;
+    double mb = (double)size * iters / (1024 * 1024);
+    start = dr_get_milliseconds();
+    for (i = 0; i < iters; i++)
+        decode_each(drcontext, buf, size, NULL);
+    each_ms = dr_get_milliseconds() - start;
+    start = dr_get_milliseconds();
+    for (i = 0; i < iters; i++)
+        decode_range_free(drcontext, decode_range(drcontext, buf, size, ORIG_PC, 0));
+    range_ms = dr_get_milliseconds() - start;
+    printf("per-instr decode: %6u ms (%.1f MB/s)\n", (uint)each_ms,
+           each_ms == 0 ? 0. : mb * 1000 / each_ms);
+    printf("decode_range:     %6u ms (%.1f MB/s)\n", (uint)range_ms,
+           range_ms == 0 ? 0. : mb * 1000 / range_ms);
+}
+
+int
+main(int argc, char *argv[])
+{
+    file_t f;
+    uint64 size;
+    byte *buf;
+    void *drcontext = dr_standalone_init();
+    if (argc != 2 && argc != 3) {
+        dr_fprintf(STDERR, "Usage: %s <objfile> [benchmark-iters]\n", argv[0]);
+        return 1;
+    }
+    f = dr_open_file(argv[1], DR_FILE_READ | DR_FILE_ALLOW_LARGE);
+    if (f == INVALID_FILE || !dr_file_size(f, &size)) {
+        dr_fprintf(STDERR, "Error opening %s\n", argv[1]);
+        return 1;
+    }
+    buf = (byte *) malloc((size_t)size);
+    CHECK(buf != NULL, "out of memory");
+    CHECK(dr_read_file(f, buf, (size_t)size) == (ssize_t)size, "short read");
+    dr_close_file(f);
+
+    test_range(drcontext, buf, (size_t)size);
+    /* The tail must never be read past: a truncated final instruction is
+     * recorded as invalid.
+     */
+    test_range(drcontext, buf, (size_t)size - 1);
+    if (argc == 3)
+        benchmark(drcontext, buf, (size_t)size, atoi(argv[2]));
+    free(buf);
+    dr_printf("all done\n");
+    return 0;
+}
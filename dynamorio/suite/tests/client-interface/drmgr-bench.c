@@ -0,0 +1,78 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* App for client.drmgr-bench: runs a few thousand distinct basic blocks
+ * once each, so that its run time is dominated by block building.
+ */
+
+#include "tools.h"
+
+#define FUNC(n)                                 \
+    static int NOINLINE                         \
+    func_##n(int x)                             \
+    {                                           \
+        if (x & 1)                              \
+            return x * 3 + n;                   \
+        return x / 2 - n;                       \
+    }
+#define FUNC_PTR(n) func_##n,
+
+#define REP10(M, p) \
+    M(p##0) M(p##1) M(p##2) M(p##3) M(p##4) M(p##5) M(p##6) M(p##7) M(p##8) M(p##9)
+#define REP100(M, p) \
+    REP10(M, p##0) REP10(M, p##1) REP10(M, p##2) REP10(M, p##3) REP10(M, p##4) \
+    REP10(M, p##5) REP10(M, p##6) REP10(M, p##7) REP10(M, p##8) REP10(M, p##9)
+#define REP1000(M, p) \
+    REP100(M, p##0) REP100(M, p##1) REP100(M, p##2) REP100(M, p##3) REP100(M, p##4) \
+    REP100(M, p##5) REP100(M, p##6) REP100(M, p##7) REP100(M, p##8) REP100(M, p##9)
+
+REP1000(FUNC, 1)
+REP1000(FUNC, 2)
+
+typedef int (*func_t)(int);
+static volatile int sum;
+static func_t funcs[] = {
+    REP1000(FUNC_PTR, 1)
+    REP1000(FUNC_PTR, 2)
+};
+
+int
+main(int argc, char **argv)
+{
+    int i;
+    /* both paths of each function */
+    for (i = 0; i < sizeof(funcs)/sizeof(funcs[0]); i++)
+        sum += funcs[i](i) + funcs[i](i + 1);
+    print("ran %d functions\n", (int)(sizeof(funcs)/sizeof(funcs[0])));
+    return 0;
+}
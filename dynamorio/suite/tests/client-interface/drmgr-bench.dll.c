@@ -0,0 +1,223 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Registers N (the client option) no-op drmgr passes of each kind (app2app,
+ * instrumentation, instru2instru, and instrumentation_ex) and checks that
+ * each pass sees its own user_data and the right phase.  Partway through,
+ * one pass is swapped for another from within a bb event.  "make benchmarks"
+ * also runs it with 0 and with 16 passes to time drmgr's per-block dispatch.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "client_tools.h"
+
+#define DEFAULT_PASSES 4
+#define MAX_PASSES 64
+#define SWAP_AT_BLOCK 500
+
+static int num_passes = DEFAULT_PASSES;
+static int num_blocks;
+static int num_early, num_late;
+static bool swapped;
+
+/* drmgr keeps pointers to the names */
+static char names[MAX_PASSES][3][16];
+static drmgr_priority_t priorities[MAX_PASSES][3];
+
+static void
+check_phase(void *drcontext, drmgr_bb_phase_t phase)
+{
+    ASSERT_MSG(drmgr_current_bb_phase(drcontext) == phase, "wrong phase");
+}
+
+static dr_emit_flags_t
+event_count(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+            bool translating)
+{
+    if (!translating)
+        num_blocks++;
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_app2app(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+              bool translating)
+{
+    check_phase(drcontext, DRMGR_PHASE_APP2APP);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_analysis(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+               bool translating, OUT void **user_data)
+{
+    check_phase(drcontext, DRMGR_PHASE_ANALYSIS);
+    *user_data = tag;
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_insertion(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                bool for_trace, bool translating, void *user_data)
+{
+    check_phase(drcontext, DRMGR_PHASE_INSERTION);
+    ASSERT_MSG(user_data == tag, "wrong pair user_data");
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_instru2instru(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+                    bool translating)
+{
+    check_phase(drcontext, DRMGR_PHASE_INSTRU2INSTRU);
+    return DR_EMIT_DEFAULT;
+}
+
+/* The quartet's user_data is the bb's last instr, to differ from the pairs' */
+static dr_emit_flags_t
+event_app2app_ex(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+                 bool translating, OUT void **user_data)
+{
+    check_phase(drcontext, DRMGR_PHASE_APP2APP);
+    *user_data = instrlist_last(bb);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_analysis_ex(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+                  bool translating, void *user_data)
+{
+    check_phase(drcontext, DRMGR_PHASE_ANALYSIS);
+    ASSERT_MSG(user_data == instrlist_last(bb), "wrong quartet user_data");
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_insertion_ex(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                   bool for_trace, bool translating, void *user_data)
+{
+    check_phase(drcontext, DRMGR_PHASE_INSERTION);
+    /* app2app passes may add instrs after the last one it saw */
+    ASSERT_MSG(user_data != NULL, "wrong quartet user_data");
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_instru2instru_ex(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+                       bool translating, void *user_data)
+{
+    check_phase(drcontext, DRMGR_PHASE_INSTRU2INSTRU);
+    ASSERT_MSG(user_data != NULL, "wrong quartet user_data");
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_late(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+           bool translating)
+{
+    num_late++;
+    return DR_EMIT_DEFAULT;
+}
+
+/* Swaps itself for event_late from within a bb event */
+static dr_emit_flags_t
+event_early(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+            bool translating)
+{
+    static drmgr_priority_t pri_late = {sizeof(pri_late), "late", NULL, NULL, 0};
+    num_early++;
+    if (num_blocks >= SWAP_AT_BLOCK && !swapped) {
+        swapped = true;
+        ASSERT(drmgr_unregister_bb_app2app_event(event_early));
+        ASSERT(drmgr_register_bb_app2app_event(event_late, &pri_late));
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    int i;
+    ASSERT(swapped && num_late > 0 && num_early >= SWAP_AT_BLOCK);
+    for (i = 0; i < num_passes; i++) {
+        ASSERT(drmgr_unregister_bb_app2app_event(event_app2app));
+        ASSERT(drmgr_unregister_bb_instrumentation_event(event_analysis));
+        ASSERT(drmgr_unregister_bb_instru2instru_event(event_instru2instru));
+        ASSERT(drmgr_unregister_bb_instrumentation_ex_event
+               (event_app2app_ex, event_analysis_ex, event_insertion_ex,
+                event_instru2instru_ex));
+    }
+    ASSERT(drmgr_unregister_bb_app2app_event(event_late));
+    ASSERT(drmgr_unregister_bb_app2app_event(event_count));
+    drmgr_exit();
+    dr_fprintf(STDERR, "drmgr-bench test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    /* first, so the other passes see the block count */
+    static drmgr_priority_t pri_count = {sizeof(pri_count), "count", NULL, NULL, -1};
+    static drmgr_priority_t pri_early = {sizeof(pri_early), "early", NULL, NULL, 0};
+    const char *options = dr_get_options(id);
+    int i;
+
+    if (dr_sscanf(options, "%d", &num_passes) != 1)
+        num_passes = DEFAULT_PASSES;
+    ASSERT(num_passes >= 0 && num_passes <= MAX_PASSES);
+
+    drmgr_init();
+    ASSERT(drmgr_register_bb_app2app_event(event_count, &pri_count));
+    ASSERT(drmgr_register_bb_app2app_event(event_early, &pri_early));
+    for (i = 0; i < num_passes; i++) {
+        int j;
+        for (j = 0; j < 3; j++) {
+            dr_snprintf(names[i][j], BUFFER_SIZE_ELEMENTS(names[i][j]), "%s%d",
+                        j == 0 ? "plain" : (j == 1 ? "pair" : "quartet"), i);
+            NULL_TERMINATE_BUFFER(names[i][j]);
+            priorities[i][j].struct_size = sizeof(priorities[i][j]);
+            priorities[i][j].name = names[i][j];
+            priorities[i][j].priority = i;
+        }
+        ASSERT(drmgr_register_bb_app2app_event(event_app2app, &priorities[i][0]));
+        ASSERT(drmgr_register_bb_instru2instru_event(event_instru2instru,
+                                                     &priorities[i][0]));
+        ASSERT(drmgr_register_bb_instrumentation_event(event_analysis, event_insertion,
+                                                       &priorities[i][1]));
+        ASSERT(drmgr_register_bb_instrumentation_ex_event
+               (event_app2app_ex, event_analysis_ex, event_insertion_ex,
+                event_instru2instru_ex, &priorities[i][2]));
+    }
+    dr_register_exit_event(event_exit);
+}
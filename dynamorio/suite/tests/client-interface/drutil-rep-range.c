@@ -0,0 +1,113 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Runs string loops of each shape drutil_insert_rep_string_range() must
+ * describe: forward, backward (DF=1), with a zero count, and with a
+ * counter narrowed by an address size prefix.
+ */
+
+#include "tools.h"
+#include <sys/mman.h>
+
+#define BUF_SIZE 256
+
+static char src[BUF_SIZE];
+static char dst[BUF_SIZE];
+
+static void NOINLINE
+copy_forward(char *to, const char *from, size_t count)
+{
+    __asm__ __volatile__("rep movsb"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+}
+
+static void NOINLINE
+copy_backward(int *to, const int *from, size_t count)
+{
+    to += count - 1;
+    from += count - 1;
+    __asm__ __volatile__("std\n\t"
+                         "rep movsl\n\t"
+                         "cld"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+}
+
+static void NOINLINE
+fill(int *to, int val, size_t count)
+{
+    __asm__ __volatile__("rep stosl"
+                         : "+D" (to), "+c" (count) : "a" (val) : "memory");
+}
+
+static void NOINLINE
+copy_narrow(char *to, const char *from, size_t count)
+{
+#ifdef X64
+    __asm__ __volatile__("addr32 rep movsb"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+#else
+    __asm__ __volatile__("addr16 rep movsb"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+#endif
+}
+
+int
+main(void)
+{
+    int i, mismatches = 0;
+    for (i = 0; i < BUF_SIZE; i++)
+        src[i] = (char) i;
+    copy_forward(dst, src, BUF_SIZE);
+    copy_backward((int *) dst, (const int *) src, BUF_SIZE / sizeof(int));
+    fill((int *) dst, 0, 0);
+#ifdef X64
+    {
+        /* only ecx counts: copy 3 bytes within the low 4GB */
+        char *low = mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS|MAP_32BIT, -1, 0);
+        if (low == MAP_FAILED)
+            print("mmap failed\n");
+        else
+            copy_narrow(low + BUF_SIZE, low, (((size_t)1) << 32) | 3);
+    }
+#else
+    /* only cx counts, and it is 0, so no memory is touched via si or di */
+    copy_narrow(dst, src, 0x10000);
+#endif
+    /* not memcmp, which may be inlined as a string loop */
+    for (i = 0; i < BUF_SIZE; i++) {
+        if (dst[i] != src[i])
+            mismatches++;
+    }
+    print("copied with %d mismatches\n", mismatches);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests drutil_insert_rep_string_range() and drutil_rep_string_range_bounds()
+ * by comparing the records stored before each of the app's string loops
+ * with the machine state there.
+ */
+
+#include "dr_api.h"
+#include "drutil.h"
+
+#define CHECK(x, msg) do {               \
+    if (!(x)) {                          \
+        dr_fprintf(STDERR, "%s\n", msg); \
+        dr_abort();                      \
+    }                                    \
+} while (0);
+
+/* one per memory operand: movs and cmps have two */
+#define MAX_RANGES 2
+
+static drutil_rep_string_range_t ranges[MAX_RANGES];
+static module_data_t *exe;
+static int num_checked;
+
+static void
+check_ranges(app_pc pc, int num_ranges)
+{
+    void *drcontext = dr_get_current_drcontext();
+    dr_mcontext_t mc = {sizeof(mc), DR_MC_INTEGER | DR_MC_CONTROL};
+    instr_t instr;
+    ptr_uint_t count;
+    bool backward;
+    int i, j = 0;
+
+    dr_get_mcontext(drcontext, &mc);
+    backward = ((mc.xflags & EFLAGS_DF) != 0);
+    instr_init(drcontext, &instr);
+    decode(drcontext, pc, &instr);
+    /* xcx, or cx or ecx with an address size prefix, is the last dst */
+    count = reg_get_value(opnd_get_reg(instr_get_dst(&instr, instr_num_dsts(&instr) - 1)),
+                          &mc);
+    for (i = 0; i < instr_num_srcs(&instr) + instr_num_dsts(&instr); i++) {
+        bool write = (i >= instr_num_srcs(&instr));
+        opnd_t ref = write ? instr_get_dst(&instr, i - instr_num_srcs(&instr)) :
+            instr_get_src(&instr, i);
+        drutil_rep_string_range_t *range;
+        app_pc addr, start, end;
+        uint size;
+        if (!opnd_is_memory_reference(ref))
+            continue;
+        CHECK(j < num_ranges, "more memory operands than ranges");
+        range = &ranges[j++];
+        addr = opnd_compute_address(ref, &mc);
+        size = opnd_size_in_bytes(opnd_get_size(ref));
+        CHECK(range->pc == pc, "wrong pc");
+        CHECK(range->start == addr, "wrong start");
+        CHECK(range->count == count, "wrong count");
+        CHECK(((range->eflags & EFLAGS_DF) != 0) == backward, "wrong direction");
+        CHECK(range->elem_size == size, "wrong element size");
+        CHECK(range->write == write, "wrong access type");
+        drutil_rep_string_range_bounds(range, &start, &end);
+        if (count == 0) {
+            CHECK(start == addr && end == addr, "wrong empty bounds");
+        } else if (backward) {
+            CHECK(start == addr - (count - 1) * size && end == addr + size,
+                  "wrong backward bounds");
+        } else {
+            CHECK(start == addr && end == addr + count * size, "wrong forward bounds");
+        }
+        dr_fprintf(STDERR, "%s %c: %d x %d bytes%s\n",
+                   decode_opcode_name(instr_get_opcode(&instr)), write ? 'w' : 'r',
+                   (int) count, size, backward ? " backward" : "");
+        num_checked++;
+    }
+    CHECK(j == num_ranges, "fewer memory operands than ranges");
+    instr_free(drcontext, &instr);
+}
+
+static dr_emit_flags_t
+event_bb(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    instr_t *instr;
+    app_pc pc = dr_fragment_app_pc(tag);
+    if (pc < exe->start || pc >= exe->end)
+        return DR_EMIT_DEFAULT;
+    for (instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr)) {
+        int i, num_ranges = 0;
+        if (!drutil_instr_is_stringop_loop(instr))
+            continue;
+        dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+        dr_save_reg(drcontext, bb, instr, DR_REG_XDX, SPILL_SLOT_2);
+        dr_save_reg(drcontext, bb, instr, DR_REG_XCX, SPILL_SLOT_3);
+        instrlist_meta_preinsert(bb, instr, INSTR_CREATE_mov_imm
+                                 (drcontext, opnd_create_reg(DR_REG_XDX),
+                                  OPND_CREATE_INTPTR(ranges)));
+        for (i = 0; i < instr_num_srcs(instr) + instr_num_dsts(instr); i++) {
+            bool write = (i >= instr_num_srcs(instr));
+            opnd_t ref = write ? instr_get_dst(instr, i - instr_num_srcs(instr)) :
+                instr_get_src(instr, i);
+            bool ok;
+            if (!opnd_is_memory_reference(ref))
+                continue;
+            CHECK(num_ranges < MAX_RANGES, "too many memory operands");
+            /* the first range uses xcx as the scratch, which is then restored */
+            ok = drutil_insert_rep_string_range
+                (drcontext, bb, instr, ref, write, DR_REG_XDX,
+                 num_ranges * sizeof(drutil_rep_string_range_t),
+                 num_ranges == 0 ? DR_REG_XCX : DR_REG_XAX);
+            CHECK(ok, "drutil_insert_rep_string_range failed");
+            if (num_ranges == 0)
+                dr_restore_reg(drcontext, bb, instr, DR_REG_XCX, SPILL_SLOT_3);
+            num_ranges++;
+        }
+        dr_insert_clean_call(drcontext, bb, instr, (void *) check_ranges, false, 2,
+                             OPND_CREATE_INTPTR(instr_get_app_pc(instr)),
+                             OPND_CREATE_INT32(num_ranges));
+        dr_restore_reg(drcontext, bb, instr, DR_REG_XDX, SPILL_SLOT_2);
+        dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    dr_fprintf(STDERR, "checked %d ranges\n", num_checked);
+    dr_free_module_data(exe);
+    drutil_exit();
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    drutil_init();
+    exe = dr_get_main_module();
+    CHECK(exe != NULL, "failed to get main module");
+    dr_register_bb_event(event_bb);
+    dr_register_exit_event(event_exit);
+}
@@ -0,0 +1,110 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Counts basic block executions with drx counters.  By default every block
+ * updates both a locked absolute counter and a sharded counter, and the two
+ * totals must agree.  Given "absolute", "locked", or "sharded" as the client
+ * option, only that kind of counter is updated: "make benchmarks" times each
+ * of the three on a multi-threaded workload.
+ */
+
+#include "dr_api.h"
+#include "drx.h"
+#include "client_tools.h"
+#include <string.h>
+
+enum {
+    COUNT_ABSOLUTE = 0x1,
+    COUNT_LOCKED   = 0x2,
+    COUNT_SHARDED  = 0x4,
+};
+
+static uint kinds = COUNT_LOCKED | COUNT_SHARDED;
+/* separate cache lines so the kinds do not interfere */
+static struct {
+    uint64 absolute;
+    char pad[64];
+    /* drx cannot atomically update a 64-bit counter in 32-bit mode */
+    ptr_uint_t locked;
+} counts;
+static drx_sharded_counters_t *sharded;
+
+static dr_emit_flags_t
+event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating)
+{
+    instr_t *first = instrlist_first(bb);
+    if (TEST(COUNT_ABSOLUTE, kinds)) {
+        ASSERT(drx_insert_counter_update(drcontext, bb, first, SPILL_SLOT_1,
+                                         &counts.absolute, 1, DRX_COUNTER_64BIT));
+    }
+    if (TEST(COUNT_LOCKED, kinds)) {
+        ASSERT(drx_insert_counter_update(drcontext, bb, first, SPILL_SLOT_1,
+                                         &counts.locked, 1,
+                                         IF_X64(DRX_COUNTER_64BIT |)
+                                         DRX_COUNTER_LOCK));
+    }
+    if (TEST(COUNT_SHARDED, kinds)) {
+        ASSERT(drx_insert_sharded_counter_update(drcontext, bb, first, SPILL_SLOT_1,
+                                                 sharded, 0, 1));
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    uint64 sharded_count = drx_sharded_counter_read(sharded, 0);
+    if (TESTALL(COUNT_LOCKED | COUNT_SHARDED, kinds))
+        ASSERT(counts.locked == sharded_count && sharded_count > 0);
+    ASSERT(drx_sharded_counters_destroy(sharded));
+    drx_exit();
+    dr_fprintf(STDERR, "drx-counter-bench test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    const char *options = dr_get_options(id);
+    if (strstr(options, "absolute") != NULL)
+        kinds = COUNT_ABSOLUTE;
+    else if (strstr(options, "locked") != NULL)
+        kinds = COUNT_LOCKED;
+    else if (strstr(options, "sharded") != NULL)
+        kinds = COUNT_SHARDED;
+
+    drx_init();
+    sharded = drx_sharded_counters_create(1);
+    ASSERT(sharded != NULL);
+    dr_register_bb_event(event_basic_block);
+    dr_register_exit_event(event_exit);
+}
@@ -0,0 +1,184 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests the drx module table: every indirect branch target, including
+ * return addresses, is looked up both with the inlined
+ * drx_insert_module_table_lookup() sequence and from a clean call via
+ * drx_module_table_lookup(), and the per-module counts must agree.  Given
+ * "inline" or "clean" as the client option only that kind of lookup is done.
+ */
+
+#include "dr_api.h"
+#include "drx.h"
+#include "client_tools.h"
+#include <string.h>
+
+#define MAX_MODULES 256
+
+static bool do_inline = true;
+static bool do_clean = true;
+static void *mod_lock;
+static int num_mods = DRX_MODULE_ID_NONE + 1;
+static uint inline_count[MAX_MODULES];
+static uint clean_count[MAX_MODULES];
+static uint inline_ret_count[MAX_MODULES];
+static uint clean_ret_count[MAX_MODULES];
+static app_pc exe_start;
+static int exe_id = DRX_MODULE_ID_NONE;
+
+static void
+clean_lookup(app_pc instr_addr, app_pc target_addr)
+{
+    clean_count[drx_module_table_lookup(target_addr)]++;
+}
+
+static void
+clean_ret_lookup(app_pc instr_addr, app_pc target_addr)
+{
+    clean_ret_count[drx_module_table_lookup(target_addr)]++;
+}
+
+static void
+insert_inline_lookup(void *drcontext, instrlist_t *bb, instr_t *mbr, uint *counts)
+{
+    /* a return's target operand is xsp, so read the address off the stack */
+    opnd_t target = instr_is_return(mbr) ? OPND_CREATE_MEMPTR(DR_REG_XSP, 0) :
+        instr_get_target(mbr);
+    dr_save_reg(drcontext, bb, mbr, DR_REG_XCX, SPILL_SLOT_2);
+    dr_save_reg(drcontext, bb, mbr, DR_REG_XDX, SPILL_SLOT_3);
+    instrlist_meta_preinsert(bb, mbr, INSTR_CREATE_mov_ld
+                             (drcontext, opnd_create_reg(DR_REG_XCX), target));
+    dr_save_arith_flags(drcontext, bb, mbr, SPILL_SLOT_1);
+    ASSERT(drx_insert_module_table_lookup(drcontext, bb, mbr,
+                                          DR_REG_XCX, DR_REG_XDX));
+    instrlist_meta_preinsert(bb, mbr, INSTR_CREATE_mov_imm
+                             (drcontext, opnd_create_reg(DR_REG_XDX),
+                              OPND_CREATE_INTPTR(counts)));
+    instrlist_meta_preinsert(bb, mbr, INSTR_CREATE_add
+                             (drcontext,
+                              opnd_create_base_disp(DR_REG_XDX, DR_REG_XCX,
+                                                    sizeof(uint), 0, OPSZ_4),
+                              OPND_CREATE_INT8(1)));
+    dr_restore_arith_flags(drcontext, bb, mbr, SPILL_SLOT_1);
+    dr_restore_reg(drcontext, bb, mbr, DR_REG_XDX, SPILL_SLOT_3);
+    dr_restore_reg(drcontext, bb, mbr, DR_REG_XCX, SPILL_SLOT_2);
+}
+
+static dr_emit_flags_t
+event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating)
+{
+    instr_t *mbr = instrlist_last(bb);
+    bool is_ret;
+    if (mbr == NULL || !instr_is_mbr(mbr))
+        return DR_EMIT_DEFAULT;
+    is_ret = instr_is_return(mbr);
+    if (!is_ret && opnd_get_size(instr_get_target(mbr)) != OPSZ_PTR)
+        return DR_EMIT_DEFAULT;
+    if (do_inline) {
+        insert_inline_lookup(drcontext, bb, mbr,
+                             is_ret ? inline_ret_count : inline_count);
+    }
+    if (do_clean) {
+        dr_insert_mbr_instrumentation(drcontext, bb, mbr,
+                                      is_ret ? (void *)clean_ret_lookup :
+                                      (void *)clean_lookup, SPILL_SLOT_1);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    dr_mutex_lock(mod_lock);
+    ASSERT(num_mods < MAX_MODULES);
+    ASSERT(drx_module_table_add(info->start, info->end, (ushort)num_mods));
+    ASSERT(drx_module_table_lookup(info->start) == num_mods);
+    if (info->start == exe_start)
+        exe_id = num_mods;
+    num_mods++;
+    dr_mutex_unlock(mod_lock);
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    ASSERT(drx_module_table_remove(info->start, info->end));
+    ASSERT(drx_module_table_lookup(info->start) == DRX_MODULE_ID_NONE);
+}
+
+static void
+event_exit(void)
+{
+    int i, num_targets = 0;
+    if (do_inline && do_clean) {
+        for (i = 0; i < num_mods; i++) {
+            ASSERT(inline_count[i] == clean_count[i]);
+            if (i != DRX_MODULE_ID_NONE && inline_count[i] > 0)
+                num_targets++;
+        }
+        /* the executable and libc */
+        ASSERT(num_targets >= 2);
+        for (i = 0; i < num_mods; i++)
+            ASSERT(inline_ret_count[i] == clean_ret_count[i]);
+    }
+    /* both local_func and strlen return into the executable */
+    ASSERT(exe_id != DRX_MODULE_ID_NONE);
+    if ((do_inline ? inline_ret_count : clean_ret_count)[exe_id] >= 400000)
+        dr_fprintf(STDERR, "returns into the executable counted\n");
+    dr_mutex_destroy(mod_lock);
+    drx_exit();
+    dr_fprintf(STDERR, "drx-modtab test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    const char *options = dr_get_options(id);
+    module_data_t *exe;
+    if (strstr(options, "inline") != NULL)
+        do_clean = false;
+    else if (strstr(options, "clean") != NULL)
+        do_inline = false;
+
+    exe = dr_get_main_module();
+    ASSERT(exe != NULL);
+    exe_start = exe->start;
+    dr_free_module_data(exe);
+
+    drx_init();
+    mod_lock = dr_mutex_create();
+    dr_register_bb_event(event_basic_block);
+    dr_register_module_load_event(event_module_load);
+    dr_register_module_unload_event(event_module_unload);
+    dr_register_exit_event(event_exit);
+}
@@ -0,0 +1,178 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* App for client.duty_cycle: keeps executing in the code cache for long
+ * enough to see several instrumentation windows, faulting into its own
+ * handler throughout.  The client suppresses our SIGUSR1 while we are under
+ * DR, so our handler running tells us we are native: in the first two native
+ * periods we load and unload a library, start and stop threads, and rewrite
+ * generated code, and in the windows after each we check that the library and
+ * the new code are what runs.
+ */
+
+#include "tools.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_STEPS 100
+#define LIB_VALUE 42
+
+static SIGJMP_BUF mark;
+static int * volatile null_ptr;
+static int num_faults;
+static volatile bool native;
+
+/* mov $imm32, %eax; ret */
+static unsigned char *gencode;
+static int gencode_value;
+
+static void *lib;
+static int (*lib_value)(void);
+
+static pthread_t thread_a, thread_b;
+static volatile bool stop_a, stop_b;
+
+static void
+handler(int sig, siginfo_t *siginfo, ucontext_t *ucxt)
+{
+    if (sig == SIGSEGV) {
+        num_faults++;
+        SIGLONGJMP(mark, 1);
+    }
+    native = true;
+}
+
+static void *
+thread_func(void *arg)
+{
+    volatile bool *stop = (volatile bool *) arg;
+    uint i = 0, sum = 0;
+    while (!*stop)
+        sum += i++ % 7;
+    return NULL;
+}
+
+static void
+set_gencode(int value)
+{
+    *(int *)(gencode + 1) = value;
+    gencode_value = value;
+}
+
+/* Returns the number of stale results */
+static int
+check(void)
+{
+    int stale = 0;
+    if (((int (*)(void)) gencode)() != gencode_value)
+        stale++;
+    if (lib != NULL && (*lib_value)() != LIB_VALUE)
+        stale++;
+    return stale;
+}
+
+static void
+native_period(int num, const char *libpath)
+{
+    if (num == 1) {
+        /* a plain write to code we executed under DR */
+        set_gencode(2);
+        lib = dlopen(libpath, RTLD_NOW);
+        if (lib == NULL) {
+            print("dlopen %s failed: %s\n", libpath, dlerror());
+            return;
+        }
+        lib_value = (int (*)(void)) dlsym(lib, "duty_cycle_lib_value");
+        pthread_create(&thread_b, NULL, thread_func, (void *) &stop_b);
+        stop_a = true;
+        pthread_join(thread_a, NULL);
+    } else if (num == 2) {
+        mprotect(gencode, PAGE_SIZE, PROT_READ|PROT_WRITE);
+        set_gencode(3);
+        mprotect(gencode, PAGE_SIZE, PROT_READ|PROT_EXEC);
+        if (lib != NULL)
+            dlclose(lib);
+        lib = NULL;
+        stop_b = true;
+        pthread_join(thread_b, NULL);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    clock_t start = clock();
+    int i = 0, sum = 0, step = 0, num_native = 0, num_checked = 0, stale = 0;
+    bool was_native = false;
+    if (argc != 2) {
+        print("usage: %s <library>\n", argv[0]);
+        return 1;
+    }
+    intercept_signal(SIGSEGV, handler, false);
+    intercept_signal(SIGUSR1, handler, false);
+    gencode = (unsigned char *)
+        mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC,
+             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    gencode[0] = 0xb8;
+    gencode[5] = 0xc3;
+    set_gencode(1);
+    pthread_create(&thread_a, NULL, thread_func, (void *) &stop_a);
+    /* A step every 5ms of CPU time, for 500ms or ten duty-cycle periods, and
+     * until we have checked the windows after two native periods.  We give
+     * up after 5s.
+     */
+    while ((step < NUM_STEPS || num_checked < 2) && step < 10*NUM_STEPS) {
+        sum += i++ % 7;
+        if (clock() - start < step * (CLOCKS_PER_SEC / 2 / NUM_STEPS))
+            continue;
+        step++;
+        if (SIGSETJMP(mark) == 0)
+            *null_ptr = sum;
+        native = false;
+        pthread_kill(pthread_self(), SIGUSR1);
+        if (native && !was_native && num_native < 2)
+            native_period(++num_native, argv[1]);
+        else if (!native && was_native && num_checked < num_native)
+            num_checked++;
+        stale += check();
+        was_native = native;
+    }
+    print("handled %s faults\n", num_faults == step ? "all" : "not all");
+    print("checked after %d native periods\n", num_checked);
+    print("%d stale results\n", stale);
+    return 0;
+}
@@ -0,0 +1,166 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests drx_duty_cycle_start(): the app thread must be released to native
+ * execution and taken back over repeatedly.  We stop the cycle after a few
+ * periods so that the app is under DR when it exits, as an exit while
+ * native would skip our exit event.  We suppress the app's SIGUSR1 while it
+ * is under DR, so that it can tell when it is native, and check that what it
+ * does then is caught up with before the next window: its library load and
+ * unload and its thread exits are seen late, from the duty-cycle thread, and
+ * the thread it creates is taken over.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+#include "drx.h"
+#include <signal.h>
+#include <string.h>
+
+#define NUM_PERIODS 4
+
+/* only written by the duty-cycle thread */
+static int num_released;
+static int num_retaken;
+static int num_seen_native;
+static int num_late_loads;
+static int num_late_unloads;
+static int num_late_exits;
+
+static volatile int num_thread_inits;
+
+static void
+duty_cycle_cb(bool instrumenting, void *user_data)
+{
+    void **drcontexts;
+    uint num, i;
+    ASSERT(user_data == (void *) &num_released);
+    if (instrumenting) {
+        num_retaken++;
+        if (num_retaken == NUM_PERIODS)
+            drx_duty_cycle_stop();
+        return;
+    }
+    num_released++;
+    dr_suspend_all_other_threads_ex(&drcontexts, &num, NULL, DR_SUSPEND_NATIVE);
+    for (i = 0; i < num; i++) {
+        if (dr_is_thread_native(drcontexts[i]))
+            num_seen_native++;
+    }
+    dr_resume_all_other_threads(drcontexts, num);
+}
+
+static bool
+is_app_lib(const module_data_t *info)
+{
+    const char *name = dr_module_preferred_name(info);
+    return name != NULL && strstr(name, "duty_cycle.appdll") != NULL;
+}
+
+/* Events for what the app did while native come from the duty-cycle thread,
+ * which catches up with it, rather than from the app's own main thread.
+ */
+static bool
+is_late(void *drcontext)
+{
+    return dr_get_thread_id(drcontext) != dr_get_process_id();
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    if (is_app_lib(info) && is_late(drcontext))
+        num_late_loads++;
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    if (is_app_lib(info) && is_late(drcontext))
+        num_late_unloads++;
+}
+
+static dr_signal_action_t
+event_signal(void *drcontext, dr_siginfo_t *info)
+{
+    if (info->sig == SIGUSR1)
+        return DR_SIGNAL_SUPPRESS;
+    return DR_SIGNAL_DELIVER;
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    dr_atomic_add32_return_sum(&num_thread_inits, 1);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    if (drcontext != dr_get_current_drcontext()) {
+        /* cleaned up by the duty-cycle thread after exiting while native */
+        num_late_exits++;
+    } else
+        ASSERT(!dr_is_thread_native(drcontext));
+}
+
+static void
+event_exit(void)
+{
+    ASSERT(num_released >= NUM_PERIODS);
+    ASSERT(num_retaken >= NUM_PERIODS);
+    ASSERT(num_seen_native > 0);
+    ASSERT(num_late_loads > 0);
+    ASSERT(num_late_unloads > 0);
+    ASSERT(num_late_exits > 0);
+    /* the main thread, the one it starts under DR, and the one it starts
+     * while native
+     */
+    ASSERT(num_thread_inits == 3);
+    drx_exit();
+    dr_fprintf(STDERR, "duty cycle test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    drx_init();
+    /* 20ms under DR out of every 50ms */
+    if (!drx_duty_cycle_start(20, 50, duty_cycle_cb, (void *) &num_released))
+        dr_fprintf(STDERR, "unable to start duty cycle\n");
+    dr_register_module_load_event(event_module_load);
+    dr_register_module_unload_event(event_module_unload);
+    dr_register_signal_event(event_signal);
+    dr_register_thread_init_event(event_thread_init);
+    dr_register_thread_exit_event(event_thread_exit);
+    dr_register_exit_event(event_exit);
+}
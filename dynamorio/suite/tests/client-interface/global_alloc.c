@@ -0,0 +1,84 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Multi-threaded app for client.global_alloc: each thread runs a loop whose
+ * every block execution triggers global heap allocations in the client.
+ * Pass an iteration count to use it as a global heap scalability benchmark,
+ * e.g. comparing -global_heap_cache_size 0 against the default.
+ */
+
+#include "tools.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+#define NUM_THREADS 8
+#define DEFAULT_ITERS 2000
+
+static int iters = DEFAULT_ITERS;
+static volatile int sum[NUM_THREADS];
+
+static void *
+thread_func(void *arg)
+{
+    int id = (int)(ptr_int_t) arg;
+    int i;
+    for (i = 0; i < iters; i++) {
+        if (i % 3 == 0)
+            sum[id] += i;
+        else
+            sum[id] -= 1;
+    }
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t thread[NUM_THREADS];
+    int i;
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    for (i = 0; i < NUM_THREADS; i++) {
+        if (pthread_create(&thread[i], NULL, thread_func, (void *)(ptr_int_t) i) != 0) {
+            print("cannot create thread\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        if (pthread_join(thread[i], NULL) != 0) {
+            print("thread join failed\n");
+            exit(1);
+        }
+    }
+    print("all threads done\n");
+    return 0;
+}
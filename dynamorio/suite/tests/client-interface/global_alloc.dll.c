@@ -0,0 +1,193 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Stresses dr_global_alloc from many threads at once: a clean call at the top
+ * of every block allocates and frees a mix of bucket-sized and variable-sized
+ * chunks, and some chunks are handed over to other threads to free so that
+ * blocks migrate between the per-thread global heap caches.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+
+#define NUM_SIZES 8
+static const size_t sizes[NUM_SIZES] = { 8, 20, 40, 64, 100, 256, 500, 1200 };
+
+/* chunks are tagged with their size so the freer knows it */
+typedef struct _chunk_t {
+    size_t size;
+    struct _chunk_t *next;
+} chunk_t;
+
+#define HANDOFF_MAX 64
+
+static void *handoff_lock;
+static chunk_t *handoff;
+static uint handoff_count;
+
+static uint num_allocs;
+static uint num_frees;
+static void *count_lock;
+
+typedef struct _per_thread_t {
+    chunk_t *held;
+    uint iter;
+    uint allocs;
+    uint frees;
+} per_thread_t;
+
+static chunk_t *
+chunk_alloc(per_thread_t *pt, size_t size)
+{
+    chunk_t *c = (chunk_t *) dr_global_alloc(size < sizeof(*c) ? sizeof(*c) : size);
+    c->size = (size < sizeof(*c) ? sizeof(*c) : size);
+    c->next = NULL;
+    pt->allocs++;
+    return c;
+}
+
+static void
+chunk_free(per_thread_t *pt, chunk_t *c)
+{
+    dr_global_free(c, c->size);
+    pt->frees++;
+}
+
+static void
+at_bb(void)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *pt = (per_thread_t *) dr_get_tls_field(drcontext);
+    chunk_t *c;
+    int i;
+    /* transient allocs, as most DR and client allocs are */
+    for (i = 0; i < NUM_SIZES; i++) {
+        c = chunk_alloc(pt, sizes[(pt->iter + i) % NUM_SIZES]);
+        chunk_free(pt, c);
+    }
+    /* longer-lived allocs, some of which another thread frees */
+    c = chunk_alloc(pt, sizes[pt->iter % NUM_SIZES]);
+    c->next = pt->held;
+    pt->held = c;
+    if (pt->iter % 16 == 15) {
+        dr_mutex_lock(handoff_lock);
+        while (pt->held != NULL && handoff_count < HANDOFF_MAX) {
+            c = pt->held;
+            pt->held = c->next;
+            c->next = handoff;
+            handoff = c;
+            handoff_count++;
+        }
+        dr_mutex_unlock(handoff_lock);
+        while (pt->held != NULL) {
+            c = pt->held;
+            pt->held = c->next;
+            chunk_free(pt, c);
+        }
+    } else if (pt->iter % 16 == 7) {
+        dr_mutex_lock(handoff_lock);
+        while (handoff != NULL) {
+            c = handoff;
+            handoff = c->next;
+            handoff_count--;
+            chunk_free(pt, c);
+        }
+        dr_mutex_unlock(handoff_lock);
+    }
+    pt->iter++;
+}
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    dr_insert_clean_call(drcontext, bb, instrlist_first(bb), at_bb, false, 0);
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+thread_init_event(void *drcontext)
+{
+    per_thread_t *pt = (per_thread_t *) dr_thread_alloc(drcontext, sizeof(*pt));
+    pt->held = NULL;
+    pt->iter = 0;
+    pt->allocs = 0;
+    pt->frees = 0;
+    dr_set_tls_field(drcontext, pt);
+}
+
+static void
+thread_exit_event(void *drcontext)
+{
+    per_thread_t *pt = (per_thread_t *) dr_get_tls_field(drcontext);
+    chunk_t *c;
+    while (pt->held != NULL) {
+        c = pt->held;
+        pt->held = c->next;
+        chunk_free(pt, c);
+    }
+    dr_mutex_lock(count_lock);
+    num_allocs += pt->allocs;
+    num_frees += pt->frees;
+    dr_mutex_unlock(count_lock);
+    dr_thread_free(drcontext, pt, sizeof(*pt));
+}
+
+static void
+exit_event(void)
+{
+    chunk_t *c;
+    /* no other threads are left to race with us */
+    while (handoff != NULL) {
+        c = handoff;
+        handoff = c->next;
+        dr_global_free(c, c->size);
+        num_frees++;
+    }
+    if (num_allocs != num_frees)
+        dr_fprintf(STDERR, "mismatch: %d allocs vs %d frees\n", num_allocs, num_frees);
+    if (num_allocs == 0)
+        dr_fprintf(STDERR, "no allocations were made\n");
+    dr_mutex_destroy(handoff_lock);
+    dr_mutex_destroy(count_lock);
+    dr_fprintf(STDERR, "global alloc test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    handoff_lock = dr_mutex_create();
+    count_lock = dr_mutex_create();
+    dr_register_bb_event(bb_event);
+    dr_register_thread_init_event(thread_init_event);
+    dr_register_thread_exit_event(thread_exit_event);
+    dr_register_exit_event(exit_event);
+}
@@ -0,0 +1,82 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "tools.h"
+
+enum { ITERS = 1000 };
+
+extern void
+appdll_set_resume(void (*resume)(void));
+
+extern void
+appdll_switch(void);
+
+extern int
+appdll_work(int x);
+
+extern int
+appdll_late(int x);
+
+/* Not called until after appdll has gone native, so its blocks are new. */
+static NOINLINE int
+exe_work(int x)
+{
+    return (x % 3 == 0) ? x : -x;
+}
+
+/* The client moves appdll back under DR from the entry of this function. */
+static NOINLINE void
+exe_resume(void)
+{
+    print("resumed\n");
+}
+
+int
+main(void)
+{
+    int i;
+    int sum = 0, exe_sum = 0;
+    appdll_set_resume(exe_resume);
+    /* The client moves appdll to native execution from this call. */
+    appdll_switch();
+    print("switched\n");
+    for (i = 0; i < ITERS; i++) {
+        sum += appdll_work(i);
+        exe_sum += exe_work(i);
+    }
+    print("appdll_work: %d\n", sum);
+    print("exe_work: %d\n", exe_sum);
+    exe_resume();
+    print("appdll_late: %d\n", appdll_late(ITERS));
+    print("all done\n");
+    return 0;
+}
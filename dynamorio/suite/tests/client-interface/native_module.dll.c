@@ -0,0 +1,149 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_module_set_native(): the client moves appdll to native execution
+ * from a clean call at the entry of appdll_switch(), after which no new block
+ * from appdll may reach the bb event while the executable's new blocks still
+ * must.  It then moves appdll back under DR from the entry of the exe_resume()
+ * function that the app registered with appdll, after which appdll's blocks
+ * must reach the bb event again.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+
+#include <string.h>
+
+static module_handle_t appdll_handle;
+static app_pc appdll_start, appdll_end;
+static app_pc switch_pc;
+static app_pc resume_pc;
+static app_pc exe_start, exe_end;
+static bool switched;
+static bool resumed;
+static uint appdll_bbs_after;
+static uint exe_bbs_after;
+static uint appdll_bbs_resumed;
+
+static void
+at_switch(void)
+{
+    bool success;
+    ASSERT(!dr_module_is_native(appdll_handle));
+    success = dr_module_set_native(appdll_handle, true);
+    ASSERT(success);
+    ASSERT(dr_module_is_native(appdll_handle));
+    switched = true;
+}
+
+static void
+at_resume(void)
+{
+    bool success;
+    ASSERT(dr_module_is_native(appdll_handle));
+    success = dr_module_set_native(appdll_handle, false);
+    ASSERT(success);
+    ASSERT(!dr_module_is_native(appdll_handle));
+    resumed = true;
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    const char *name = dr_module_preferred_name(info);
+    if (strstr(name, "appdll") != NULL) {
+        appdll_handle = info->handle;
+        appdll_start = info->start;
+        appdll_end = info->end;
+        switch_pc = (app_pc) dr_get_proc_address(info->handle, "appdll_switch");
+        ASSERT(switch_pc != NULL);
+    }
+}
+
+static dr_emit_flags_t
+event_bb(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+         bool translating)
+{
+    app_pc pc = dr_fragment_app_pc(tag);
+    if (resumed && !for_trace && !translating) {
+        if (pc >= appdll_start && pc < appdll_end)
+            appdll_bbs_resumed++;
+    } else if (switched && !for_trace && !translating) {
+        if (pc >= appdll_start && pc < appdll_end)
+            appdll_bbs_after++;
+        else if (pc >= exe_start && pc < exe_end)
+            exe_bbs_after++;
+    }
+    if (pc == switch_pc) {
+        /* appdll_set_resume() has run by now */
+        app_pc *resume_var = (app_pc *)
+            dr_get_proc_address(appdll_handle, "appdll_resume");
+        ASSERT(resume_var != NULL);
+        resume_pc = *resume_var;
+        dr_insert_clean_call(drcontext, bb, instrlist_first(bb),
+                             (void *)at_switch, false/*!fp*/, 0);
+    } else if (pc == resume_pc && switched) {
+        dr_insert_clean_call(drcontext, bb, instrlist_first(bb),
+                             (void *)at_resume, false/*!fp*/, 0);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    if (!switched)
+        dr_fprintf(STDERR, "appdll_switch was never reached\n");
+    if (appdll_bbs_after > 0) {
+        dr_fprintf(STDERR, "%u appdll blocks were built after going native\n",
+                   appdll_bbs_after);
+    }
+    if (exe_bbs_after == 0)
+        dr_fprintf(STDERR, "no executable blocks were built after the switch\n");
+    if (!resumed)
+        dr_fprintf(STDERR, "exe_resume was never reached\n");
+    else if (appdll_bbs_resumed == 0)
+        dr_fprintf(STDERR, "no appdll blocks were built after moving it back\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t client_id)
+{
+    module_data_t *exe = dr_get_main_module();
+    ASSERT(exe != NULL);
+    exe_start = exe->start;
+    exe_end = exe->end;
+    dr_free_module_data(exe);
+    dr_register_module_load_event(event_module_load);
+    dr_register_bb_event(event_bb);
+    dr_register_exit_event(event_exit);
+}
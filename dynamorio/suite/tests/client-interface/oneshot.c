@@ -0,0 +1,76 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* App for client.oneshot: runs many distinct blocks, through indirect calls
+ * and a switch, often enough that each is also copied into traces, so that
+ * each one-shot call has far more chances to fire than it is allowed.
+ */
+
+#include "tools.h"
+
+#define ITERS 1000
+
+static int NOINLINE
+add(int i)
+{
+    return i + 7;
+}
+
+static int NOINLINE
+halve(int i)
+{
+    return i / 2;
+}
+
+static int NOINLINE
+negate(int i)
+{
+    return -i;
+}
+
+static int (*ops[])(int) = { add, halve, negate };
+
+int
+main(int argc, char **argv)
+{
+    int i, sum = 0;
+    for (i = 0; i < ITERS; i++) {
+        switch (i % 4) {
+        case 0: sum += (*ops[i % 3])(i); break;
+        case 1: sum ^= i; break;
+        case 2: sum -= (*ops[(i + 1) % 3])(sum & 0xff); break;
+        default: sum += i % 5; break;
+        }
+    }
+    print("sum is %d\n", sum);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_insert_oneshot_call(): every block in the app executable gets a
+ * one-shot call, and each must fire at most once per copy of the block no
+ * matter how often the block runs.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+
+static app_pc exe_start, exe_end;
+static int num_inserted;
+static int num_fired;
+static int num_fired_fp;
+
+static void
+at_first_exec(void *user_data)
+{
+    ASSERT(dr_get_current_drcontext() != NULL);
+    if (user_data == (void *)&num_fired_fp)
+        dr_atomic_add32_return_sum(&num_fired_fp, 1);
+    dr_atomic_add32_return_sum(&num_fired, 1);
+}
+
+static dr_emit_flags_t
+event_bb(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+         bool translating)
+{
+    bool save_fp;
+    if ((app_pc)tag < exe_start || (app_pc)tag >= exe_end)
+        return DR_EMIT_DEFAULT;
+    /* exercise both kinds of clean call, deterministically per tag */
+    save_fp = (((ptr_uint_t)tag & 0x4) != 0);
+    ASSERT(dr_insert_oneshot_call(drcontext, bb, instrlist_first(bb),
+                                  (void *)at_first_exec, save_fp,
+                                  save_fp ? (void *)&num_fired_fp : NULL));
+    if (!translating)
+        dr_atomic_add32_return_sum(&num_inserted, 1);
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    ASSERT(num_fired > 0);
+    ASSERT(num_fired <= num_inserted);
+    ASSERT(num_fired_fp <= num_fired);
+    dr_fprintf(STDERR, "oneshot test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    module_data_t *exe = dr_get_main_module();
+    ASSERT(exe != NULL);
+    exe_start = exe->start;
+    exe_end = exe->end;
+    dr_free_module_data(exe);
+    dr_register_bb_event(event_bb);
+    dr_register_exit_event(event_exit);
+}
@@ -0,0 +1,83 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_get_perfctr_values().  With the "on" client option DR is run
+ * with -perfctr: the counters that the machine supports must have seen the
+ * app's loop in the code cache.  Without it no counters may be returned.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+#include <string.h>
+
+static bool perfctr_on;
+
+static void
+thread_exit_event(void *drcontext)
+{
+    dr_perfctr_values_t values;
+    bool res;
+    values.size = sizeof(values);
+    res = dr_get_perfctr_values(drcontext, &values);
+    if (!perfctr_on) {
+        ASSERT_MSG(!res, "counters without -perfctr");
+        return;
+    }
+    /* the kernel or a VM may not give us any counters */
+    if (!res)
+        return;
+    ASSERT_MSG(values.available != 0, "no available counters");
+    if (TEST(1 << DR_PERFCTR_INSTRUCTIONS, values.available)) {
+        ASSERT_MSG(values.in_cache[DR_PERFCTR_INSTRUCTIONS] > 0 &&
+                   values.in_dr[DR_PERFCTR_INSTRUCTIONS] > 0,
+                   "instructions not counted");
+    }
+    if (TEST(1 << DR_PERFCTR_TASK_CLOCK, values.available)) {
+        ASSERT_MSG(values.in_cache[DR_PERFCTR_TASK_CLOCK] > 0 &&
+                   values.in_dr[DR_PERFCTR_TASK_CLOCK] > 0,
+                   "task clock not counted");
+    }
+}
+
+static void
+exit_event(void)
+{
+    dr_fprintf(STDERR, "perfctr test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    perfctr_on = (strcmp(dr_get_options(id), "on") == 0);
+    dr_register_thread_exit_event(thread_exit_event);
+    dr_register_exit_event(exit_event);
+}
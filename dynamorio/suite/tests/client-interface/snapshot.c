@@ -0,0 +1,91 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* App for client.snapshot: has the client take a snapshot while other
+ * threads run, and checks that it is never told about the snapshot process.
+ */
+
+#include "tools.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+
+#define NOP asm("nop")
+#define NUM_THREADS 4
+
+static volatile int started;
+static volatile int done;
+
+static void
+handle_sigchld(int sig)
+{
+    print("unexpected SIGCHLD\n");
+}
+
+static void *
+thread_func(void *arg)
+{
+    __sync_fetch_and_add(&started, 1);
+    while (!done)
+        ; /* stay in the code cache */
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t thread[NUM_THREADS];
+    struct timespec sleeptime;
+    int i;
+    signal(SIGCHLD, handle_sigchld);
+    for (i = 0; i < NUM_THREADS; i++) {
+        if (pthread_create(&thread[i], NULL, thread_func, NULL) != 0) {
+            print("cannot create thread\n");
+            return 1;
+        }
+    }
+    while (started < NUM_THREADS)
+        sched_yield();
+    /* the client takes a snapshot here */
+    NOP; NOP; NOP; NOP; NOP; NOP; NOP; NOP; NOP;
+    done = 1;
+    for (i = 0; i < NUM_THREADS; i++)
+        pthread_join(thread[i], NULL);
+    /* give any (unexpected) SIGCHLD time to arrive */
+    sleeptime.tv_sec = 0;
+    sleeptime.tv_nsec = 50000000; /* 50ms */
+    nanosleep(&sleeptime, NULL);
+    print("app done\n");
+    return 0;
+}
@@ -0,0 +1,121 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Takes a snapshot when the app reaches its marker and then immediately
+ * modifies the data the snapshot is dumping, checking that the snapshot
+ * sees the data as it was at the time of the call.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+#include <string.h>
+
+#define TABLE_ENTRIES 1000
+
+static int *table;
+
+static int
+table_sum(int *entries)
+{
+    int i, sum = 0;
+    for (i = 0; i < TABLE_ENTRIES; i++)
+        sum += entries[i];
+    return sum;
+}
+
+static void
+dump_snapshot(void *drcontext, void *arg)
+{
+    /* runs in the snapshot process, where DR's heap is usable */
+    int *buf = dr_global_alloc(TABLE_ENTRIES * sizeof(int));
+    ASSERT(arg == (void *)table);
+    memcpy(buf, table, TABLE_ENTRIES * sizeof(int));
+    dr_fprintf(STDERR, "snapshot: sum %d\n", table_sum(buf));
+    dr_global_free(buf, TABLE_ENTRIES * sizeof(int));
+}
+
+static void
+at_marker(void)
+{
+    process_id_t pid;
+    bool completed;
+    int i;
+    pid = dr_create_snapshot(dump_snapshot, table);
+    if (pid == (process_id_t) INVALID_PROCESS_ID) {
+        dr_fprintf(STDERR, "failed to create snapshot\n");
+        return;
+    }
+    /* keep mutating while the snapshot dumps */
+    for (i = 0; i < TABLE_ENTRIES; i++)
+        table[i] = 0;
+    if (!dr_snapshot_wait(pid, true/*block*/, &completed) || !completed)
+        dr_fprintf(STDERR, "snapshot failed\n");
+    dr_fprintf(STDERR, "live: sum %d\n", table_sum(table));
+}
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    instr_t *instr, *first_nop = NULL;
+    int num_nops = 0;
+    for (instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr)) {
+        if (instr_get_opcode(instr) == OP_nop) {
+            if (num_nops++ == 0)
+                first_nop = instr;
+            if (num_nops == 9) {
+                dr_insert_clean_call(drcontext, bb, first_nop, at_marker, false, 0);
+                break;
+            }
+        } else
+            num_nops = 0;
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+exit_event(void)
+{
+    dr_global_free(table, TABLE_ENTRIES * sizeof(int));
+    dr_fprintf(STDERR, "snapshot test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    int i;
+    table = dr_global_alloc(TABLE_ENTRIES * sizeof(int));
+    for (i = 0; i < TABLE_ENTRIES; i++)
+        table[i] = i;
+    dr_register_bb_event(bb_event);
+    dr_register_exit_event(exit_event);
+}
@@ -0,0 +1,105 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* App for client.synchall: runs a sweep of thread counts, parking a mix of
+ * threads spinning in the code cache and threads blocked in system calls
+ * while the client synchronizes with all of them.  Pass a maximum thread
+ * count (and the client's "timing" option) to use it as a benchmark of
+ * synch_with_all_threads latency versus thread count.
+ */
+
+#include "tools.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define NOP asm("nop")
+#define DEFAULT_MAX_THREADS 64
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int started;
+static volatile int done;
+
+static void *
+thread_func(void *arg)
+{
+    int id = (int)(ptr_int_t) arg;
+    struct timespec sleeptime;
+    sleeptime.tv_sec = 0;
+    sleeptime.tv_nsec = 1000000; /* 1ms */
+    pthread_mutex_lock(&lock);
+    started++;
+    pthread_mutex_unlock(&lock);
+    while (!done) {
+        /* most threads wait in a system call; the rest stay in the cache */
+        if (id % 4 != 0)
+            nanosleep(&sleeptime, NULL);
+    }
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t *thread;
+    int max_threads = DEFAULT_MAX_THREADS;
+    int num, i;
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    thread = (pthread_t *) malloc(max_threads * sizeof(*thread));
+    for (num = 1; num <= max_threads; num *= 4) {
+        started = 0;
+        done = 0;
+        for (i = 0; i < num; i++) {
+            if (pthread_create(&thread[i], NULL, thread_func, (void *)(ptr_int_t) i)
+                != 0) {
+                print("cannot create thread\n");
+                exit(1);
+            }
+        }
+        while (started < num)
+            sched_yield();
+        /* the client synchronizes with all threads here */
+        NOP; NOP; NOP; NOP; NOP; NOP; NOP; NOP; NOP;
+        done = 1;
+        for (i = 0; i < num; i++) {
+            if (pthread_join(thread[i], NULL) != 0) {
+                print("thread join failed\n");
+                exit(1);
+            }
+        }
+    }
+    free(thread);
+    print("all threads done\n");
+    return 0;
+}
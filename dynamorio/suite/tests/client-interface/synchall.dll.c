@@ -0,0 +1,119 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Suspends and resumes all other threads several times each time the app
+ * reaches its marker, checking that every live app thread was suspended.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+
+#define NUM_ROUNDS 10
+
+static void *count_lock;
+static uint num_live_threads;
+
+static void
+at_marker(void)
+{
+    void **drcontexts;
+    uint num_suspended, num_unsuspended, expect, i;
+    dr_mutex_lock(count_lock);
+    expect = num_live_threads - 1;
+    dr_mutex_unlock(count_lock);
+    for (i = 0; i < NUM_ROUNDS; i++) {
+        if (!dr_suspend_all_other_threads(&drcontexts, &num_suspended,
+                                          &num_unsuspended)) {
+            dr_fprintf(STDERR, "failed to suspend all threads\n");
+            return;
+        }
+        if (num_suspended != expect || num_unsuspended != 0) {
+            dr_fprintf(STDERR, "suspended %d and not %d of %d threads\n",
+                       num_suspended, num_unsuspended, expect);
+        }
+        if (!dr_resume_all_other_threads(drcontexts, num_suspended))
+            dr_fprintf(STDERR, "failed to resume all threads\n");
+    }
+    dr_fprintf(STDERR, "synched with %d threads\n", expect);
+}
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    instr_t *instr, *first_nop = NULL;
+    int num_nops = 0;
+    for (instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr)) {
+        if (instr_get_opcode(instr) == OP_nop) {
+            if (num_nops++ == 0)
+                first_nop = instr;
+            if (num_nops == 9) {
+                dr_insert_clean_call(drcontext, bb, first_nop, at_marker, false, 0);
+                break;
+            }
+        } else
+            num_nops = 0;
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+thread_init_event(void *drcontext)
+{
+    dr_mutex_lock(count_lock);
+    num_live_threads++;
+    dr_mutex_unlock(count_lock);
+}
+
+static void
+thread_exit_event(void *drcontext)
+{
+    dr_mutex_lock(count_lock);
+    num_live_threads--;
+    dr_mutex_unlock(count_lock);
+}
+
+static void
+exit_event(void)
+{
+    dr_mutex_destroy(count_lock);
+    dr_fprintf(STDERR, "synchall test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    count_lock = dr_mutex_create();
+    dr_register_bb_event(bb_event);
+    dr_register_thread_init_event(thread_init_event);
+    dr_register_thread_exit_event(thread_exit_event);
+    dr_register_exit_event(exit_event);
+}
@@ -0,0 +1,154 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_register_trace_region(): registers a region for each loop in the
+ * executable found from a backward conditional branch, and checks that
+ * traces get built at the region heads and that the end-trace event is
+ * not consulted for region traces.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+
+#define MAX_TAGS 256
+#define LOOP_SIZE_LIMIT 512
+
+static app_pc exe_start, exe_end;
+static void *mutex; /* protects everything below */
+static void *tags[MAX_TAGS];
+static uint num_tags;
+static app_pc heads[MAX_TAGS];
+static uint num_heads;
+static int num_region_traces;
+
+static bool
+is_region_head(app_pc tag)
+{
+    uint i;
+    for (i = 0; i < num_heads; i++) {
+        if (heads[i] == tag)
+            return true;
+    }
+    return false;
+}
+
+static dr_emit_flags_t
+event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating)
+{
+    instr_t *last = instrlist_last(bb);
+    void *region[MAX_TAGS];
+    app_pc head, end;
+    uint i, num = 0;
+    if (for_trace || translating || (app_pc)tag < exe_start || (app_pc)tag >= exe_end)
+        return DR_EMIT_DEFAULT;
+    dr_mutex_lock(mutex);
+    if (num_tags < MAX_TAGS)
+        tags[num_tags++] = tag;
+    if (!instr_is_cbr(last) || instr_get_branch_target_pc(last) > (app_pc)tag) {
+        dr_mutex_unlock(mutex);
+        return DR_EMIT_DEFAULT;
+    }
+    head = instr_get_branch_target_pc(last);
+    end = instr_get_app_pc(last) + instr_length(drcontext, last);
+    if (end - head > LOOP_SIZE_LIMIT) {
+        dr_mutex_unlock(mutex);
+        return DR_EMIT_DEFAULT;
+    }
+    for (i = 0; i < num_tags; i++) {
+        if ((app_pc)tags[i] >= head && (app_pc)tags[i] < end)
+            region[num++] = tags[i];
+    }
+    dr_mutex_unlock(mutex);
+    /* registering takes DR locks that rank below client mutexes */
+    if (!dr_register_trace_region(drcontext, head, region, num, 0))
+        dr_fprintf(STDERR, "failed to register region at "PFX"\n", head);
+    /* a repeated registration replaces the first */
+    if (!dr_register_trace_region(drcontext, head, region, num, num + 1))
+        dr_fprintf(STDERR, "failed to re-register region at "PFX"\n", head);
+    ASSERT(!dr_register_trace_region(drcontext, head, region, 0, 0));
+    dr_mutex_lock(mutex);
+    if (!is_region_head(head) && num_heads < MAX_TAGS)
+        heads[num_heads++] = head;
+    dr_mutex_unlock(mutex);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_trace(void *drcontext, void *tag, instrlist_t *trace, bool translating)
+{
+    dr_mutex_lock(mutex);
+    if (!translating && is_region_head(tag))
+        num_region_traces++;
+    dr_mutex_unlock(mutex);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_custom_trace_action_t
+event_end_trace(void *drcontext, void *trace_tag, void *next_tag)
+{
+    bool head;
+    dr_mutex_lock(mutex);
+    head = is_region_head(trace_tag);
+    dr_mutex_unlock(mutex);
+    /* regions take precedence over this event */
+    ASSERT(!head);
+    return CUSTOM_TRACE_DR_DECIDES;
+}
+
+static void
+event_exit(void)
+{
+    uint i;
+    ASSERT(num_heads > 0);
+    ASSERT(num_region_traces > 0);
+    for (i = 0; i < num_heads; i++)
+        ASSERT(dr_unregister_trace_region(heads[i]));
+    ASSERT(!dr_unregister_trace_region(heads[0]));
+    dr_mutex_destroy(mutex);
+    dr_fprintf(STDERR, "trace_region test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    module_data_t *exe = dr_get_main_module();
+    ASSERT(exe != NULL);
+    exe_start = exe->start;
+    exe_end = exe->end;
+    dr_free_module_data(exe);
+    mutex = dr_mutex_create();
+    dr_register_exit_event(event_exit);
+    dr_register_bb_event(event_basic_block);
+    dr_register_trace_event(event_trace);
+    dr_register_end_trace_event(event_end_trace);
+}
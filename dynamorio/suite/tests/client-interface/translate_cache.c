@@ -0,0 +1,92 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* App for client.translate_cache: repeatedly faults in the same block so that
+ * DR has to translate the same fragment over and over.
+ */
+
+#include "tools.h"
+#include <signal.h>
+#include <ucontext.h>
+#include <setjmp.h>
+
+#define NUM_FAULTS 200
+
+static SIGJMP_BUF mark;
+static volatile int *volatile bad_ptr;
+static unsigned char *fault_pc;
+static int num_faults;
+static int num_mismatches;
+
+static int
+fault_func(int x)
+{
+    /* the load from bad_ptr faults */
+    return x + *bad_ptr;
+}
+
+static void
+signal_handler(int sig, siginfo_t *siginfo, ucontext_t *ucxt)
+{
+    if (sig == SIGSEGV) {
+        struct sigcontext *sc = (struct sigcontext *) &(ucxt->uc_mcontext);
+        unsigned char *pc = (unsigned char *) sc->SC_XIP;
+        if (fault_pc == NULL)
+            fault_pc = pc;
+        else if (pc != fault_pc)
+            num_mismatches++;
+        num_faults++;
+        SIGLONGJMP(mark, 1);
+    }
+    exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, sum = 0;
+    intercept_signal(SIGSEGV, (handler_3_t) signal_handler, false);
+    for (i = 0; i < NUM_FAULTS; i++) {
+        if (SIGSETJMP(mark) == 0)
+            sum += fault_func(i);
+    }
+    if (num_faults == NUM_FAULTS && num_mismatches == 0 &&
+        fault_pc >= (unsigned char *) fault_func &&
+        fault_pc < (unsigned char *) fault_func + 64)
+        print("all faults translated to the same pc\n");
+    else {
+        print("faults: %d, mismatched pcs: %d, pc "PFX" vs fault_func "PFX"\n",
+              num_faults, num_mismatches, fault_pc, fault_func);
+    }
+    return sum;
+}
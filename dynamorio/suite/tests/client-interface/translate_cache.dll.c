@@ -0,0 +1,94 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Instruments every app instruction with meta code so that faults need real
+ * state translation, and counts how often DR re-creates blocks for
+ * translation.  With the "cached" client option the test checks that the
+ * recreate cache spares us re-decoding and re-instrumenting the faulting
+ * block on every fault.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+#include <string.h>
+
+static bool expect_cached;
+static uint num_restores;
+static uint num_translating;
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    instr_t *instr;
+    if (translating)
+        num_translating++;
+    for (instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr)) {
+        if (!instr_ok_to_mangle(instr))
+            continue;
+        /* clobber xax in between a spill and restore */
+        dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+        instrlist_meta_preinsert(bb, instr, INSTR_CREATE_mov_imm
+                                 (drcontext, opnd_create_reg(DR_REG_XAX),
+                                  OPND_CREATE_INTPTR(0)));
+        dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static bool
+restore_state_event(void *drcontext, bool restore_memory, dr_restore_state_info_t *info)
+{
+    ASSERT_MSG(info->fragment_info.app_code_consistent, "app code should be unchanged");
+    num_restores++;
+    return true;
+}
+
+static void
+exit_event(void)
+{
+    ASSERT_MSG(num_restores > 0, "no translations");
+    if (expect_cached) {
+        ASSERT_MSG(num_translating < num_restores / 2,
+              "recreate cache should avoid re-instrumenting");
+    }
+    dr_fprintf(STDERR, "translate_cache test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    expect_cached = (strcmp(dr_get_options(id), "cached") == 0);
+    dr_register_bb_event(bb_event);
+    dr_register_restore_state_ex_event(restore_state_event);
+    dr_register_exit_event(exit_event);
+}
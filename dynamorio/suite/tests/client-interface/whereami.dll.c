@@ -0,0 +1,83 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_where_am_i() from an itimer callback: samples in the code cache
+ * must come with a fragment tag, and a CPU-bound app must be caught in its
+ * own fragments.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+#include <sys/time.h>
+
+static app_pc exe_start, exe_end;
+/* only written by the app's single thread */
+static int num_samples;
+static int num_exe_samples;
+
+static void
+event_timer(void *drcontext, dr_mcontext_t *mcontext)
+{
+    void *tag;
+    dr_where_am_i_t where = dr_where_am_i(drcontext, mcontext->pc, &tag);
+    num_samples++;
+    if (where == DR_WHERE_FCACHE) {
+        app_pc pc;
+        ASSERT(tag != NULL);
+        pc = dr_fragment_app_pc(tag);
+        if (pc >= exe_start && pc < exe_end)
+            num_exe_samples++;
+    } else
+        ASSERT(tag == NULL);
+    ASSERT(where >= DR_WHERE_APP && where <= DR_WHERE_UNKNOWN);
+}
+
+static void
+event_exit(void)
+{
+    ASSERT(num_samples > 0);
+    ASSERT(num_exe_samples > 0);
+    dr_fprintf(STDERR, "whereami test done\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    module_data_t *exe = dr_get_main_module();
+    ASSERT(exe != NULL);
+    exe_start = exe->start;
+    exe_end = exe->end;
+    dr_free_module_data(exe);
+    if (!dr_set_itimer(ITIMER_PROF, 5, event_timer))
+        dr_fprintf(STDERR, "unable to set timer callback\n");
+    dr_register_exit_event(event_exit);
+}
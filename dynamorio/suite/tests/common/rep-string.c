@@ -0,0 +1,116 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Exercises single-instruction string loops ("rep movs" and "rep stos")
+ * in both directions, for string loop instrumentation such as the memtrace
+ * sample's range and expansion modes.
+ */
+
+#include "tools.h"
+#ifdef WINDOWS
+# include <intrin.h>
+#endif
+
+#define BUF_SIZE 4096
+#define ITERS 8
+
+static char src[BUF_SIZE];
+static char dst[BUF_SIZE];
+static int ints[BUF_SIZE / sizeof(int)];
+
+static void NOINLINE
+copy_bytes(char *to, const char *from, size_t count)
+{
+#ifdef WINDOWS
+    __movsb((unsigned char *)to, (const unsigned char *)from, count);
+#else
+    __asm__ __volatile__("rep movsb"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+#endif
+}
+
+static void NOINLINE
+copy_bytes_backward(char *to, const char *from, size_t count)
+{
+#ifdef WINDOWS
+    /* no intrinsic sets DF: copy forward instead */
+    __movsb((unsigned char *)to, (const unsigned char *)from, count);
+#else
+    /* point at the last element and run with DF set */
+    to += count - 1;
+    from += count - 1;
+    __asm__ __volatile__("std\n\t"
+                         "rep movsb\n\t"
+                         "cld"
+                         : "+D" (to), "+S" (from), "+c" (count) : : "memory");
+#endif
+}
+
+static void NOINLINE
+fill_ints(int *to, int val, size_t count)
+{
+#ifdef WINDOWS
+    __stosd((unsigned long *)to, (unsigned long)val, count);
+#else
+    __asm__ __volatile__("rep stosl"
+                         : "+D" (to), "+c" (count) : "a" (val) : "memory");
+#endif
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, j;
+    int mismatches = 0;
+
+    for (i = 0; i < BUF_SIZE; i++)
+        src[i] = (char) i;
+    for (i = 0; i < ITERS; i++) {
+        copy_bytes(dst, src, BUF_SIZE);
+        copy_bytes_backward(dst, src, BUF_SIZE);
+        fill_ints(ints, i, BUF_SIZE / sizeof(int));
+        /* an empty loop still executes the instruction */
+        copy_bytes(dst, src, 0);
+    }
+    for (j = 0; j < BUF_SIZE; j++) {
+        if (dst[j] != src[j])
+            mismatches++;
+    }
+    for (j = 0; j < BUF_SIZE / sizeof(int); j++) {
+        if (ints[j] != ITERS - 1)
+            mismatches++;
+    }
+    print("copied %d bytes with %d mismatches\n",
+          ITERS * BUF_SIZE * 3, mismatches);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Keeps calling into a library whose code is all reached in the first round,
+ * then calls a library function for the first time.  Used by
+ * tool.bbcov.native_after, which checks that the library went native during
+ * the first phase and so the late function was never instrumented.
+ */
+
+#include "tools.h"
+
+#include <time.h>
+
+extern int
+saturate_hot(int x);
+
+extern int
+saturate_late(int x);
+
+int
+main(void)
+{
+    clock_t start = clock();
+    int i, sum;
+    bool ok = true;
+    /* half a second is many times the quiet interval the test uses */
+    do {
+        sum = 0;
+        for (i = 0; i < 1000; i++)
+            sum += saturate_hot(i);
+        if (sum != 4500)
+            ok = false;
+    } while (clock() - start < CLOCKS_PER_SEC / 2);
+    print("hot phase %s\n", ok ? "done" : "failed");
+    print("late: %d\n", saturate_late(7));
+    return 0;
+}
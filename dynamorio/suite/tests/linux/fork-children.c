@@ -0,0 +1,96 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Forks two children that each run code the parent never does, one after
+ * the other so that the output is deterministic.  Used by
+ * tool.bbcov.shared_map to check that the coverage of forked children ends
+ * up in the parent's map.
+ */
+
+#include "tools.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int
+sum_squares(int n)
+{
+    int i, sum = 0;
+    for (i = 0; i < n; i++)
+        sum += i * i;
+    return sum;
+}
+
+static int
+count_vowels(const char *s)
+{
+    int vowels = 0;
+    for (; *s != '\0'; s++) {
+        if (strchr("aeiou", *s) != NULL)
+            vowels++;
+    }
+    return vowels;
+}
+
+static void
+run_child(int which)
+{
+    int status;
+    pid_t child = fork();
+    if (child < 0) {
+        print("fork failed\n");
+        exit(1);
+    } else if (child == 0) {
+        if (which == 1)
+            print("first child: %d\n", sum_squares(100));
+        else
+            print("second child: %d\n", count_vowels("coverage of forked children"));
+        exit(0);
+    }
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+        print("child %d failed\n", which);
+}
+
+int
+main(int argc, char **argv)
+{
+    print("parent forking\n");
+    run_child(1);
+    run_child(2);
+    print("parent done\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+/* **********************************************************
+ * Copyright (c) 2013 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Spends its CPU time two calls below main, in code built with frame
+ * pointers.  Used by tool.drprof, which checks that the samples are
+ * attributed to the whole main;profile_outer;profile_inner stack.
+ */
+
+#include "tools.h"
+
+#include <time.h>
+
+static NOINLINE uint
+profile_inner(uint seed)
+{
+    uint i, x = seed;
+    for (i = 0; i < 100000; i++)
+        x = x * 1103515245 + 12345;
+    return x;
+}
+
+static NOINLINE uint
+profile_outer(void)
+{
+    clock_t start = clock();
+    uint x = 1, rounds = 0;
+    /* a fifth of a second of CPU time is many samples at drprof's default rate */
+    while (clock() - start < CLOCKS_PER_SEC / 5 || rounds < 10) {
+        x = profile_inner(x);
+        rounds++;
+    }
+    return x;
+}
+
+int
+main(int argc, char **argv)
+{
+    uint x = profile_outer();
+    /* keep the result live */
+    print("profiled%s\n", x == 0 ? " to zero" : "");
+    return 0;
+}
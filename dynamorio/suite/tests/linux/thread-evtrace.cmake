@@ -0,0 +1,86 @@
+# **********************************************************
+# Copyright (c) 2013 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+# 
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+# 
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Check script for linux.thread-evtrace, included by runcheck.cmake: parses
+# the Chrome trace written under tmpdir and checks that it is a complete
+# event array from one process whose two threads each recorded bb building.
+
+file(GLOB_RECURSE traces "${tmpdir}/evtrace.*.json")
+list(LENGTH traces num_traces)
+if (NOT num_traces EQUAL 1)
+  message(FATAL_ERROR "expected one event trace under ${tmpdir}, found ${num_traces}")
+endif ()
+
+file(READ "${traces}" contents)
+if (NOT "${contents}" MATCHES "^\\[\n.*\n\\]\n$")
+  message(FATAL_ERROR "${traces} is not a complete JSON array")
+endif ()
+
+# one event per line, each but the last followed by a comma; strip the
+# array brackets first as they would confuse list splitting
+string(REGEX REPLACE "^\\[\n(.*)\n\\]\n$" "\\1" events "${contents}")
+string(REPLACE ",\n" ";" lines "${events}")
+set(pids "")
+set(tids "")
+set(bb_tids "")
+set(num_events 0)
+foreach (line ${lines})
+  if (NOT "${line}" MATCHES
+      "^{\"name\":\"([a-z0-9_]+)\",(\"cat\":\"dr\",)?\"ph\":\"([BEi])\",.*\"ts\":[0-9]+(\\.[0-9]+)?,\"pid\":([0-9]+),\"tid\":([0-9]+)(,.*)?}$")
+    message(FATAL_ERROR "malformed event in ${traces}: ${line}")
+  endif ()
+  set(name "${CMAKE_MATCH_1}")
+  set(phase "${CMAKE_MATCH_3}")
+  list(APPEND pids "${CMAKE_MATCH_5}")
+  list(APPEND tids "${CMAKE_MATCH_6}")
+  if ("${name}" STREQUAL "bb_building" AND "${phase}" STREQUAL "B")
+    list(APPEND bb_tids "${CMAKE_MATCH_6}")
+  endif ()
+  math(EXPR num_events "${num_events} + 1")
+endforeach ()
+
+if (num_events EQUAL 0)
+  message(FATAL_ERROR "no events in ${traces}")
+endif ()
+list(REMOVE_DUPLICATES pids)
+list(LENGTH pids num_pids)
+if (NOT num_pids EQUAL 1)
+  message(FATAL_ERROR "expected events from one process, found ${num_pids}")
+endif ()
+list(REMOVE_DUPLICATES tids)
+list(LENGTH tids num_tids)
+if (NOT num_tids EQUAL 2)
+  message(FATAL_ERROR "expected events from 2 threads, found ${num_tids}")
+endif ()
+list(REMOVE_DUPLICATES bb_tids)
+list(LENGTH bb_tids num_bb_tids)
+if (NOT num_bb_tids EQUAL 2)
+  message(FATAL_ERROR "expected bb building in 2 threads, found ${num_bb_tids}")
+endif ()